@@ -1,12 +1,19 @@
 #!/bin/sh
 
-DRIVE=$1
+# Usage: Copy-TXT-Image-to-SD.sh <drive>[,<drive>...] <build>
+# Several drives, separated by commas, are written at the same time
+
+DRIVES=`echo $1 | tr ',' ' '`
 BUILD=$2
+BMAPFLASH=../u-boot/bin/bmapflash
+
+for DRIVE in $DRIVES
+do
 
 # Check SD size
 
 DRIVEBYTES=`blockdev --getsize64 $DRIVE`
-echo "Size of drive is $DRIVEBYTES bytes"
+echo "Size of drive $DRIVE is $DRIVEBYTES bytes"
 case $DRIVEBYTES in
   7742685184) echo "Disk size OK" ;;
 
@@ -19,6 +26,8 @@ umount ${DRIVE}1
 umount ${DRIVE}2
 umount ${DRIVE}3
 
+done
+
 # Check image file
 
 IMAGEFILE=../ft-TXT_Build_$BUILD.img
@@ -31,11 +40,16 @@ then
   echo "Image file $IMAGEFILE does not exist! => exit" ; exit 2
 fi
 
-# Clear first MByte of disk
-
-dd if=/dev/zero of=$DRIVE bs=1024 count=1024
-
-# Write image
-
-sudo dd if=$IMAGEFILE of=$DRIVE
+# Write image: with its bmap, only the blocks in use, checking each by
+# reading it back
 
+if [ -f "$IMAGEFILE.bmap" ] && [ -x "$BMAPFLASH" ]
+then
+  sudo $BMAPFLASH $IMAGEFILE.bmap $IMAGEFILE $DRIVES || exit 3
+else
+  for DRIVE in $DRIVES
+  do
+    sudo dd if=$IMAGEFILE of=$DRIVE bs=1M || exit 3
+  done
+fi
+sync
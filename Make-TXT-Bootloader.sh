@@ -33,6 +33,12 @@ make u-boot
 mkdir bin
 cp board-support/u-boot-2013.10-ti2013.12.01/MLO ./bin
 cp board-support/u-boot-2013.10-ti2013.12.01/u-boot.img ./bin
+cp board-support/u-boot-2013.10-ti2013.12.01/tools/mksdimage ./bin
+cp board-support/u-boot-2013.10-ti2013.12.01/tools/bmp_logo ./bin
+cp board-support/u-boot-2013.10-ti2013.12.01/tools/bmapflash ./bin
+cp board-support/u-boot-2013.10-ti2013.12.01/tools/mkdelta ./bin
+cp board-support/u-boot-2013.10-ti2013.12.01/tools/delta/applydelta ./bin
+cp board-support/u-boot-2013.10-ti2013.12.01/tools/miniroot/miniroot ./bin
 
 cp board-support/u-boot-2013.10-ti2013.12.01/tools/env/fw_printenv $WRKDIR/board/FT/TXT/rootfs/sbin/
 
@@ -1,102 +1,41 @@
 #!/bin/bash
-if [[ $(id -u) -ne 0 ]] ; then echo "Please run as root" ; exit 1 ; fi
 #---
 BUILD=`cat board/FT/TXT/BUILD`
 IMAGEFILE=../ft-TXT_Build_$BUILD.img
-ROOTFSMNT=/tmp/XXXRootFs
+ROOTFSIMG=/tmp/XXXRootFs.ext3
+LOGOIMG=/tmp/XXXBootLogo.rle
+MKSDIMAGE=../u-boot/bin/mksdimage
 
 echo "Image: $IMAGEFILE"
 
-#-- build imagefile
 rm $IMAGEFILE*
-sync
-dd if=/dev/zero ibs=1M count=100  > $IMAGEFILE
-dd if=/dev/zero ibs=1M count=255 | tr "\000" "\377" >> $IMAGEFILE
-sync
-#-- create partitions
-fdisk $IMAGEFILE << EOF
-o
-n
-p
 
-
-+130M
-n
-p
-
-
-
-t
-1
-c
-a
-1
-p
-w
-EOF
-echo "============="
-sync
-sync
-#-- map partitions
-DRIVE1=/dev/mapper/`kpartx -s -l $IMAGEFILE | head -n +1| awk '{print $1}'`
-DRIVE2=/dev/mapper/`kpartx -s -l $IMAGEFILE | tail -n +2 | head -n +1| awk '{print $1}'`
-sleep 1
-echo ">>>>>>>>>>>>>>>>>>"
-echo $DRIVE1
-echo $DRIVE2
-echo ">>>>>>>>>>>>>>>>>>"
-kpartx -asv $IMAGEFILE
-#-- mount partitions
-umount /tmp/boot 2>/dev/null
-umount /tmp/rootfs 2>/dev/null
-
-rm -rf /tmp/boot  
-rm -rf /tmp/rootfs
-
-mkdir /tmp/boot  
-mkdir /tmp/rootfs
-
-dd if=/dev/zero of=${DRIVE1} bs=1M count=1
-mkfs.vfat -F 32 -n "BOOT" ${DRIVE1}
-mount ${DRIVE1} /tmp/boot
-
-du -h ${DRIVE1}
-
-cp ../buildroot/output/images/am335x-kno_txt.dtb /tmp/boot
-cp ../buildroot/output/images/uImage /tmp/boot
-cp ../buildroot/output/images/rootfs.ubi /tmp/boot
-cp ./board/FT/TXT/rootfs/etc/ft-logo.bmp /tmp/boot/bootlogo.bmp
-cp ../u-boot/bin/MLO /tmp/boot
-cp ../u-boot/bin/u-boot.img /tmp/boot
-
-ls -alh /tmp/boot
-
-dd if=/dev/zero of=${DRIVE2} bs=1M count=1
-mkfs.ext3 -L "ROOTF" ${DRIVE2}
-mount ${DRIVE2} /tmp/rootfs
-
-du -h ${DRIVE2}
-
-umount ${ROOTFSMNT} 2>/dev/null
-rm -rf ${ROOTFSMNT}
-mkdir -p ${ROOTFSMNT}
-echo "Mount ====>> " ${ROOTFSMNT}
-mount -o loop ../buildroot/output/images/rootfs.ext2 ${ROOTFSMNT}
-
-WRKDIR=`pwd`
-cd  ${ROOTFSMNT}
-tar cf - . | (cd /tmp/rootfs && tar xBf -)
-
-cd ${WRKDIR}
-umount ${ROOTFSMNT}
-
-sync
-sync
-umount ${DRIVE1}
-umount ${DRIVE2}
-                                                        
-#-- unmap partitions
-kpartx -d -s -v $IMAGEFILE
+#-- ROOTF partition: the buildroot ext3 image, shrunk to the 224M that
+#-- are left of the 355M image after the 130M BOOT partition
+cp --sparse=always ../buildroot/output/images/rootfs.ext2 ${ROOTFSIMG}
+e2fsck -fp ${ROOTFSIMG}
+resize2fs ${ROOTFSIMG} 224M || exit 1
+tune2fs -L "ROOTF" ${ROOTFSIMG}
+
+#-- boot logo in the panel's RGB565, run length encoded, so that U-Boot
+#-- shows it without converting the BMP
+../u-boot/bin/bmp_logo --gen-rle ./board/FT/TXT/rootfs/etc/ft-logo.bmp \
+	> ${LOGOIMG} || exit 1
+
+#-- build imagefile: MBR, FAT32 BOOT partition with MLO first, and the
+#-- ROOTF partition; only the blocks listed in the bmap need writing
+${MKSDIMAGE} -b 130M -s 355M -n BOOT -r ${ROOTFSIMG} -m $IMAGEFILE.bmap \
+	$IMAGEFILE \
+	../u-boot/bin/MLO \
+	../u-boot/bin/u-boot.img \
+	../buildroot/output/images/am335x-kno_txt.dtb \
+	../buildroot/output/images/uImage \
+	../buildroot/output/images/rootfs.ubi \
+	bootlogo.bmp=./board/FT/TXT/rootfs/etc/ft-logo.bmp \
+	bootlogo.rle=${LOGOIMG} || exit 1
+rm ${ROOTFSIMG} ${LOGOIMG}
+
+ls -lsh $IMAGEFILE
 #-- packen des Imagefiles
 rm $IMAGEFILE.zip 2>/dev/null
-zip -j $IMAGEFILE.zip $IMAGEFILE
+zip -j $IMAGEFILE.zip $IMAGEFILE $IMAGEFILE.bmap
@@ -1,5 +1,10 @@
 #!/bin/bash
 
+# Usage: Make-TXT-UpdateScripts.sh [<rootfs.tar.gz of the installed firmware>]
+# With the rootfs tarball of an earlier build, update-delta.sh is made as
+# well. It only carries what changed since that build and only updates a TXT
+# that runs exactly that firmware.
+
 set -e
 set -x
 
@@ -14,6 +19,12 @@ BUILDROOT="$(dirname "$SCRIPTDIR")/buildroot"
 # Update output
 UPDATE="$(dirname "$SCRIPTDIR")/update"
 
+# Host and target update tools, see Make-TXT-Bootloader.sh
+UBOOTBIN="$(dirname "$SCRIPTDIR")/u-boot/bin"
+
+# rootfs of the firmware a delta update is made for
+OLDROOTFS="$1"
+
 ##### CREATE UPDATE #####
 
 # Create updatescript
@@ -24,8 +35,55 @@ echo "PAYLOADTOOLSBEG:" >> "$UPDATE/update.sh"
 gzip -c "$UPDATE/ShowProgressOld" | base64 >> "$UPDATE/update.sh"
 echo "PAYLOADTOOLSEND:" >> "$UPDATE/update.sh"
 
+echo "" >> "$UPDATE/update.sh"
+echo "PAYLOADMINIROOTBEG:" >> "$UPDATE/update.sh"
+gzip -c "$UBOOTBIN/miniroot" | base64 >> "$UPDATE/update.sh"
+echo "PAYLOADMINIROOTEND:" >> "$UPDATE/update.sh"
+
 echo "" >> "$UPDATE/update.sh"
 echo "PAYLOADTAR:" >> "$UPDATE/update.sh"
 cat "$BUILDROOT/output/images/rootfs.tar.gz" >> "$UPDATE/update.sh"
 
 chmod u+x "$UPDATE/update.sh"
+
+# Create update-step-1.sh, which also builds its RAM system with miniroot
+
+cat "$SCRIPTDIR/update-step-1.sh" > "$UPDATE/update-step-1.sh"
+
+echo "" >> "$UPDATE/update-step-1.sh"
+echo "PAYLOADMINIROOTBEG:" >> "$UPDATE/update-step-1.sh"
+gzip -c "$UBOOTBIN/miniroot" | base64 >> "$UPDATE/update-step-1.sh"
+echo "PAYLOADMINIROOTEND:" >> "$UPDATE/update-step-1.sh"
+
+chmod u+x "$UPDATE/update-step-1.sh"
+
+##### CREATE DELTA UPDATE #####
+
+if [ -n "$OLDROOTFS" ]
+then
+  # The boot images and FwUpdTxt are deleted on the TXT once flashed, so
+  # they are sent whole whenever they changed
+  gzip -dc "$OLDROOTFS" > "$UPDATE/rootfs-old.tar"
+  gzip -dc "$BUILDROOT/output/images/rootfs.tar.gz" > "$UPDATE/rootfs-new.tar"
+  "$UBOOTBIN/mkdelta" -x lib/boot -x sbin/FwUpdTxt "$UPDATE/rootfs-old.tar" "$UPDATE/rootfs-new.tar" | xz -9 > "$UPDATE/rootfs.delta.xz"
+  rm "$UPDATE/rootfs-old.tar" "$UPDATE/rootfs-new.tar"
+
+  cat "$SCRIPTDIR/update-delta-in.sh" > "$UPDATE/update-delta.sh"
+
+  echo "" >> "$UPDATE/update-delta.sh"
+  echo "PAYLOADTOOLSBEG:" >> "$UPDATE/update-delta.sh"
+  gzip -c "$UPDATE/ShowProgressOld" | base64 >> "$UPDATE/update-delta.sh"
+  echo "PAYLOADTOOLSEND:" >> "$UPDATE/update-delta.sh"
+
+  echo "" >> "$UPDATE/update-delta.sh"
+  echo "PAYLOADAPPLYBEG:" >> "$UPDATE/update-delta.sh"
+  gzip -c "$UBOOTBIN/applydelta" | base64 >> "$UPDATE/update-delta.sh"
+  echo "PAYLOADAPPLYEND:" >> "$UPDATE/update-delta.sh"
+
+  echo "" >> "$UPDATE/update-delta.sh"
+  echo "PAYLOADDELTA:" >> "$UPDATE/update-delta.sh"
+  cat "$UPDATE/rootfs.delta.xz" >> "$UPDATE/update-delta.sh"
+  rm "$UPDATE/rootfs.delta.xz"
+
+  chmod u+x "$UPDATE/update-delta.sh"
+fi
@@ -1,6 +1,8 @@
 #!/bin/bash
 
 # Sign an update script
+# Usage: Sign-TXT-UpdateScripts.sh [update-delta]
+# Without an argument update.sh is signed
 
 set -e
 set +x
@@ -21,7 +23,7 @@ SCRIPTDIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 
 # Update script
 UPDATEDIR="$(dirname "$SCRIPTDIR")/update"
-UPDATEBASE="$UPDATEDIR/update"
+UPDATEBASE="$UPDATEDIR/${1:-update}"
 UPDATE="$UPDATEBASE.sh"
 
 # Signature history folder
@@ -43,7 +45,7 @@ SIGCOUNT=$(( SIGCOUNTPRE +1 ))
 SIGNATURDIR=$SIGNATUREROOTDIR/$CARDSERIAL/$SIGCOUNT
 mkdir -p $SIGNATURDIR
 cp $UPDATE $SIGNATURDIR/
-SIGNATURBASE=$SIGNATURDIR/update
+SIGNATURBASE=$SIGNATURDIR/$(basename $UPDATEBASE)
 
 ##### hash file #####
 
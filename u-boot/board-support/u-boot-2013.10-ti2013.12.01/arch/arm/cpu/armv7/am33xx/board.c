@@ -227,6 +227,31 @@ void s_init(void)
 }
 #endif
 
+#if defined(CONFIG_AM33XX) && !defined(CONFIG_SYS_L2CACHE_OFF)
+/* Cortex-A8 auxiliary control register: L2 cache enable */
+#define ACTLR_L2EN			(1 << 1)
+
+/*
+ * The Cortex-A8 L2 is switched on through ACTLR.L2EN, which comes up set
+ * but is not guaranteed to be by the time the ROM hands over. GP devices
+ * still run in secure mode here, so the register can be written
+ * directly. The L2 is an inner cache that set/way maintenance already
+ * covers, so the default (empty) outer disable is kept for the OS.
+ */
+void v7_outer_cache_enable(void)
+{
+	u32 actlr;
+
+	if (get_device_type() != GP_DEVICE)
+		return;
+
+	asm volatile("mrc p15, 0, %0, c1, c0, 1" : "=r" (actlr));
+	if (!(actlr & ACTLR_L2EN))
+		asm volatile("mcr p15, 0, %0, c1, c0, 1"
+			     : : "r" (actlr | ACTLR_L2EN));
+}
+#endif
+
 #ifndef CONFIG_SYS_DCACHE_OFF
 void enable_caches(void)
 {
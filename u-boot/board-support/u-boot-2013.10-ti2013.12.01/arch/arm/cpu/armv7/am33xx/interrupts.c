@@ -0,0 +1,111 @@
+/*
+ * interrupts.c
+ *
+ * AM33xx interrupt controller (INTC) support, for CONFIG_USE_IRQ
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <asm/io.h>
+#include <asm/arch/clock.h>
+#include <asm/arch/hardware.h>
+#include <asm/arch/sys_proto.h>
+#include <asm/proc-armv/ptrace.h>
+#include <linux/compiler.h>
+
+#define INTC_NR_IRQS		128
+
+#define INTC_SYSCONFIG		0x10
+#define INTC_SYSSTATUS		0x14
+#define INTC_SIR_IRQ		0x40
+#define INTC_CONTROL		0x48
+#define INTC_MIR_CLEAR(n)	(0x88 + (n) * 0x20)
+#define INTC_MIR_SET(n)		(0x8c + (n) * 0x20)
+#define INTC_ILR(m)		(0x100 + (m) * 4)
+
+#define INTC_SYSCONFIG_SOFTRESET	BIT(1)
+#define INTC_SYSSTATUS_RESETDONE	BIT(0)
+#define INTC_SIR_IRQ_ACTIVE_MASK	0x7f
+#define INTC_CONTROL_NEWIRQAGR		BIT(0)
+
+struct irq_action {
+	interrupt_handler_t *handler;
+	void *arg;
+};
+
+static struct irq_action irq_handlers[INTC_NR_IRQS];
+static struct pt_regs *irq_regs;
+
+int arch_interrupt_init(void)
+{
+	void __iomem *intc = (void __iomem *)INTC_BASE;
+	int i;
+
+	writel(INTC_SYSCONFIG_SOFTRESET, intc + INTC_SYSCONFIG);
+	if (!wait_on_value(INTC_SYSSTATUS_RESETDONE,
+			   INTC_SYSSTATUS_RESETDONE, intc + INTC_SYSSTATUS,
+			   LDELAY))
+		return -1;
+
+	/* Everything masked, all at the highest priority, routed to IRQ */
+	for (i = 0; i < INTC_NR_IRQS / 32; i++)
+		writel(0xffffffff, intc + INTC_MIR_SET(i));
+	for (i = 0; i < INTC_NR_IRQS; i++)
+		writel(0, intc + INTC_ILR(i));
+
+	return 0;
+}
+
+void irq_install_handler(int irq, interrupt_handler_t *handler, void *arg)
+{
+	void __iomem *intc = (void __iomem *)INTC_BASE;
+
+	if (irq < 0 || irq >= INTC_NR_IRQS)
+		return;
+
+	irq_handlers[irq].handler = handler;
+	irq_handlers[irq].arg = arg;
+	writel(BIT(irq % 32), intc + INTC_MIR_CLEAR(irq / 32));
+}
+
+void irq_free_handler(int irq)
+{
+	void __iomem *intc = (void __iomem *)INTC_BASE;
+
+	if (irq < 0 || irq >= INTC_NR_IRQS)
+		return;
+
+	writel(BIT(irq % 32), intc + INTC_MIR_SET(irq / 32));
+	irq_handlers[irq].handler = NULL;
+	irq_handlers[irq].arg = NULL;
+}
+
+struct pt_regs * notrace get_irq_regs(void)
+{
+	return irq_regs;
+}
+
+/*
+ * This must not be instrumented: it can interrupt the tracer itself
+ * (see CONFIG_TRACE_SAMPLE).
+ */
+void notrace do_irq(struct pt_regs *pt_regs)
+{
+	void __iomem *intc = (void __iomem *)INTC_BASE;
+	struct irq_action *action;
+	int irq;
+
+	irq = readl(intc + INTC_SIR_IRQ) & INTC_SIR_IRQ_ACTIVE_MASK;
+	action = &irq_handlers[irq];
+
+	irq_regs = pt_regs;
+	if (action->handler)
+		action->handler(action->arg);
+	else
+		writel(BIT(irq % 32), intc + INTC_MIR_SET(irq / 32));
+	irq_regs = NULL;
+
+	/* Let the INTC raise the next interrupt */
+	writel(INTC_CONTROL_NEWIRQAGR, intc + INTC_CONTROL);
+}
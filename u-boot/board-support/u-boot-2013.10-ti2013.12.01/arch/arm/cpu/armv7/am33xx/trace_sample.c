@@ -0,0 +1,85 @@
+/*
+ * trace_sample.c
+ *
+ * PC sampling profiler for the tracer, driven by DMTIMER3
+ *
+ * DMTIMER2 is the U-Boot timebase, so the profiling timer is DMTIMER3,
+ * clocked from the 24 MHz master oscillator. Each overflow interrupt
+ * records the interrupted PC with trace_add_sample().
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <trace.h>
+#include <asm/io.h>
+#include <asm/arch/clock.h>
+#include <asm/arch/cpu.h>
+#include <asm/arch/hardware.h>
+#include <asm/arch/sys_proto.h>
+#include <asm/proc-armv/ptrace.h>
+#include <linux/compiler.h>
+
+#define SAMPLE_TIMER_IRQ	69	/* TINT3 */
+#define SAMPLE_TIMER_CLOCK	V_OSCK
+
+/* DMTIMER interrupt bits (IRQSTATUS, IRQENABLE_SET/CLR) */
+#define DMTIMER_IRQ_OVF		BIT(1)
+
+#define MODULE_CLKCTRL_MODULEMODE_EN	0x2
+#define MODULE_CLKCTRL_IDLEST_MASK	(3 << 16)
+#define CLK_SEL_M_OSC			0x1
+
+static struct gptimer *const sample_timer =
+		(struct gptimer *)DM_TIMER3_BASE;
+
+static void notrace sample_timer_isr(void *arg)
+{
+	struct pt_regs *regs = get_irq_regs();
+
+	/* tistat is IRQSTATUS on this timer: write 1 to clear */
+	writel(DMTIMER_IRQ_OVF, &sample_timer->tistat);
+
+	/* The IRQ entry code saves the return address, which is pc + 4 */
+	trace_add_sample((void *)(regs->ARM_pc - 4));
+}
+
+int trace_sample_start(unsigned int hz)
+{
+	struct cm_perpll *const cmper = (struct cm_perpll *)CM_PER;
+	struct cm_dpll *const cmdpll = (struct cm_dpll *)CM_DPLL;
+
+	if (!hz || hz > SAMPLE_TIMER_CLOCK)
+		return -1;
+
+	writel(CLK_SEL_M_OSC, &cmdpll->clktimer3clk);
+	writel(MODULE_CLKCTRL_MODULEMODE_EN, &cmper->timer3clkctrl);
+	if (!wait_on_value(MODULE_CLKCTRL_IDLEST_MASK, 0,
+			   &cmper->timer3clkctrl, LDELAY)) {
+		puts("trace: sample timer does not come up\n");
+		return -1;
+	}
+
+	/* Count up from the reload value, one overflow per sample */
+	writel(0, &sample_timer->tclr);
+	writel(-(SAMPLE_TIMER_CLOCK / hz), &sample_timer->tldr);
+	writel(-(SAMPLE_TIMER_CLOCK / hz), &sample_timer->tcrr);
+	writel(DMTIMER_IRQ_OVF, &sample_timer->tistat);
+	/* tisr is IRQENABLE_SET on this timer */
+	writel(DMTIMER_IRQ_OVF, &sample_timer->tisr);
+
+	irq_install_handler(SAMPLE_TIMER_IRQ, sample_timer_isr, NULL);
+	writel(TCLR_AR | TCLR_ST, &sample_timer->tclr);
+	printf("trace: sampling PC at %u Hz\n", hz);
+
+	return 0;
+}
+
+void trace_sample_stop(void)
+{
+	writel(0, &sample_timer->tclr);
+	/* tcicr is IRQENABLE_CLR on this timer */
+	writel(DMTIMER_IRQ_OVF, &sample_timer->tcicr);
+	writel(DMTIMER_IRQ_OVF, &sample_timer->tistat);
+	irq_free_handler(SAMPLE_TIMER_IRQ);
+}
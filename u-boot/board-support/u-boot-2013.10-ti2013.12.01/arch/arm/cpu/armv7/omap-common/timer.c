@@ -17,6 +17,7 @@
  */
 
 #include <common.h>
+#include <div64.h>
 #include <asm/io.h>
 #include <asm/arch/cpu.h>
 #include <asm/arch/clock.h>
@@ -89,6 +90,29 @@ ulong get_timer_masked(void)
 	return gd->arch.tbl;
 }
 
+#ifdef CONFIG_BOOTSTAGE
+/*
+ * timer_init() never reloads the counter, so it keeps running from SPL
+ * into U-Boot. Reading it directly gives both stages one time base for
+ * their bootstage records.
+ */
+ulong timer_get_boot_us(void)
+{
+	return lldiv((u64)readl(&timer_base->tcrr) * 1000, TIMER_CLOCK / 1000);
+}
+#endif
+
+#ifdef CONFIG_TRACE
+/*
+ * Timestamps for the tracer, so this must not be instrumented itself.
+ * TIMER_CLOCK is a whole number of MHz, so a 32-bit divide will do.
+ */
+ulong notrace timer_get_us(void)
+{
+	return readl(&timer_base->tcrr) / (TIMER_CLOCK / 1000000);
+}
+#endif
+
 /*
  * This function is derived from PowerPC code (read timebase as long long).
  * On ARM it just returns the timer value.
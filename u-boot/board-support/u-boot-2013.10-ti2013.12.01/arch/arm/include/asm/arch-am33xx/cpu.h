@@ -191,7 +191,8 @@ struct cm_perpll {
 struct cm_dpll {
 	unsigned int resv1[2];
 	unsigned int clktimer2clk;	/* offset 0x08 */
-	unsigned int resv2[10];
+	unsigned int clktimer3clk;	/* offset 0x0C */
+	unsigned int resv2[9];
 	unsigned int clklcdcpixelclk;	/* offset 0x34 */
 };
 #else
@@ -20,6 +20,9 @@
 #define GPIO0_BASE			0x48032000
 #define GPIO2_BASE			0x481AC000
 
+/* Interrupt controller */
+#define INTC_BASE			0x48200000
+
 /* Watchdog Timer */
 #define WDT_BASE			0x44E35000
 
@@ -61,6 +64,11 @@
 #define USB0_OTG_BASE			0x47401000
 #define USB1_OTG_BASE			0x47401800
 
+/* USB subsystem CPPI 4.1 DMA */
+#define USB_CPPI41_DMA_BASE		0x47402000
+#define USB_CPPI41_SCHED_BASE		0x47403000
+#define USB_CPPI41_QMGR_BASE		0x47404000
+
 /* LCD Controller */
 #define LCD_CNTL_BASE			0x4830E000
 
@@ -45,6 +45,10 @@ u32 wait_on_value(u32, u32, void *, u32);
 void enable_norboot_pin_mux(void);
 #endif
 void am33xx_spl_board_init(void);
+#ifdef CONFIG_USE_IRQ
+struct pt_regs;
+struct pt_regs *get_irq_regs(void);
+#endif
 int am335x_get_efuse_mpu_max_freq(struct ctrl_dev *cdev);
 int am335x_get_tps65910_mpu_vdd(int sil_rev, int frequency);
 #endif
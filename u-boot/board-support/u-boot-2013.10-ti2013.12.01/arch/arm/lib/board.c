@@ -37,6 +37,7 @@
 #include <fdtdec.h>
 #include <post.h>
 #include <logbuff.h>
+#include <trace.h>
 #include <asm/sections.h>
 
 #ifdef CONFIG_BITBANGMII
@@ -368,6 +369,13 @@ void board_init_f(ulong bootflag)
 #endif /* CONFIG_FB_ADDR */
 #endif /* CONFIG_LCD */
 
+#ifdef CONFIG_TRACE
+	addr -= CONFIG_TRACE_BUFFER_SIZE;
+	gd->trace_buff = map_sysmem(addr, CONFIG_TRACE_BUFFER_SIZE);
+	debug("Reserving %dk for trace data at: %08lx\n",
+	      CONFIG_TRACE_BUFFER_SIZE >> 10, addr);
+#endif
+
 	/*
 	 * reserve memory for U-Boot code, data & bss
 	 * round down to next 4 kB limit
@@ -518,6 +526,9 @@ void board_init_r(gd_t *id, ulong dest_addr)
 
 	gd->flags |= GD_FLG_RELOC;	/* tell others: relocation done */
 	bootstage_mark_name(BOOTSTAGE_ID_START_UBOOT_R, "board_init_r");
+#ifdef CONFIG_TRACE
+	trace_init(gd->trace_buff, CONFIG_TRACE_BUFFER_SIZE);
+#endif
 
 	monitor_flash_len = _end_ofs;
 
@@ -551,6 +562,16 @@ void board_init_r(gd_t *id, ulong dest_addr)
 	/* The Malloc area is immediately below the monitor copy in DRAM */
 	malloc_start = dest_addr - TOTAL_MALLOC_LEN;
 	mem_malloc_init (malloc_start, TOTAL_MALLOC_LEN);
+#if defined(CONFIG_OF_CONTROL) && defined(CONFIG_FDT_INDEX)
+	fdt_index_enable(gd->fdt_blob);
+#endif
+
+#ifdef CONFIG_BOOTSTAGE_STASH
+	/* Pick up the SPL records; their names must outlive the stash */
+	if (!bootstage_unstash((void *)CONFIG_BOOTSTAGE_STASH,
+			       CONFIG_BOOTSTAGE_STASH_SIZE))
+		bootstage_relocate();
+#endif
 
 #ifdef CONFIG_ARCH_EARLY_INIT_R
 	arch_early_init_r();
@@ -19,6 +19,7 @@
 #include <asm/byteorder.h>
 #include <libfdt.h>
 #include <fdt_support.h>
+#include <trace.h>
 #include <asm/bootm.h>
 #include <linux/compiler.h>
 
@@ -80,6 +81,11 @@ static void announce_and_cleanup(int fake)
 
 #ifdef CONFIG_USB_DEVICE
 	udc_disconnect();
+#endif
+#ifdef CONFIG_TRACE
+	/* Leave the trace where the OS can find it, see fdt_fixup_trace() */
+	if (!fake)
+		trace_handoff();
 #endif
 	cleanup_before_linux();
 }
@@ -11,6 +11,10 @@
 #include <config.h>
 #include <spl.h>
 #include <image.h>
+#include <malloc.h>
+#include <spl_cache.h>
+#include <asm/armv7.h>
+#include <asm/system.h>
 #include <linux/compiler.h>
 
 /* Pointer to as well as the global data structure for SPL */
@@ -57,3 +61,85 @@ void __noreturn jump_to_image_linux(void *arg)
 	image_entry(0, machid, arg);
 }
 #endif
+
+#ifdef CONFIG_SPL_CACHE_SUPPORT
+static void spl_disable_dcache_mmu(void)
+{
+	set_cr(get_cr() & ~(CR_C | CR_M));
+	CP15ISB;
+}
+
+static void spl_disable_icache_bp(void)
+{
+	set_cr(get_cr() & ~(CR_I | CR_Z));
+	CP15ISB;
+}
+
+static void spl_inval_tlb(void)
+{
+	/* Invalidate entire unified TLB */
+	asm volatile ("mcr p15, 0, %0, c8, c7, 0" : : "r" (0));
+	CP15DSB;
+	CP15ISB;
+}
+
+static const struct spl_cache_ops spl_cache_ops = {
+	.flush_dcache	= flush_dcache_all,
+	.disable_dcache	= spl_disable_dcache_mmu,
+	.inval_dcache	= invalidate_dcache_all,
+	.disable_icache	= spl_disable_icache_bp,
+	.inval_icache	= invalidate_icache_all,
+	.inval_tlb	= spl_inval_tlb,
+};
+
+/*
+ * Map all of DDR write-back cacheable and everything else (SRAM, which
+ * holds our stack and code, and the peripherals) strongly ordered, then
+ * switch on the MMU, both L1 caches, the L2 and branch prediction. This
+ * needs the SPL malloc pool for the 16KiB page table.
+ */
+void spl_enable_caches(void)
+{
+	struct spl_mmu_region ddr = {
+		.start	= CONFIG_SYS_SDRAM_BASE,
+		.size	= CONFIG_SPL_CACHE_DDR_SIZE,
+		.option	= DCACHE_WRITEBACK,
+	};
+	u32 *table;
+
+	table = memalign(SPL_MMU_TABLE_ALIGN, SPL_MMU_TABLE_SIZE);
+	if (!table) {
+		debug("SPL: no memory for page table, caches stay off\n");
+		return;
+	}
+	if (spl_mmu_build_table(table, DCACHE_OFF, &ddr, 1) < 0) {
+		debug("SPL: bad DDR region, caches stay off\n");
+		free(table);
+		return;
+	}
+	gd->arch.tlb_addr = (ulong)table;
+	gd->arch.tlb_size = SPL_MMU_TABLE_SIZE;
+
+	/* L2 on, stale lines and TLB entries from the ROM gone */
+	v7_outer_cache_enable();
+	invalidate_dcache_all();
+	spl_inval_tlb();
+
+	asm volatile("mcr p15, 0, %0, c2, c0, 0"
+		     : : "r" (gd->arch.tlb_addr) : "memory");
+	/* All domains are managers, access permissions are not checked */
+	asm volatile("mcr p15, 0, %0, c3, c0, 0" : : "r" (~0));
+
+	invalidate_icache_all();
+	set_cr(get_cr() | CR_M | CR_C | CR_I | CR_Z);
+	CP15ISB;
+}
+
+void spl_disable_caches(void)
+{
+	if (!(get_cr() & CR_M))
+		return;
+
+	spl_cache_teardown(&spl_cache_ops);
+}
+#endif
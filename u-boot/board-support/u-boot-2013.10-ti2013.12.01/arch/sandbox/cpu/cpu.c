@@ -49,3 +49,7 @@ phys_addr_t map_to_sysmem(void *ptr)
 void flush_dcache_range(unsigned long start, unsigned long stop)
 {
 }
+
+void invalidate_dcache_range(unsigned long start, unsigned long stop)
+{
+}
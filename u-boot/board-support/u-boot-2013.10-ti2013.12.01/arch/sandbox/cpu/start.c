@@ -95,6 +95,13 @@ static int sb_cmdline_cb_fdt(struct sandbox_state *state, const char *arg)
 }
 SB_CMDLINE_OPT_SHORT(fdt, 'd', 1, "Specify U-Boot's control FDT");
 
+static int sb_cmdline_cb_tap(struct sandbox_state *state, const char *arg)
+{
+	state->tap_name = arg;
+	return 0;
+}
+SB_CMDLINE_OPT_SHORT(tap, 't', 1, "Use a host TAP interface for Ethernet");
+
 int main(int argc, char *argv[])
 {
 	struct sandbox_state *state;
@@ -0,0 +1,55 @@
+/*
+ * Sandbox model of a CPPI 4.1 DMA engine and queue manager
+ *
+ * The CPPI 4.1 driver reaches its registers through the accessors below,
+ * which keep the queues in the linking RAM the driver hands over, as the
+ * hardware does. The back-channel functions stand in for the USB side of
+ * the DMA and are for test code only.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __ASM_SANDBOX_CPPI41_H
+#define __ASM_SANDBOX_CPPI41_H
+
+u32 sandbox_cppi41_readl(const void *addr);
+void sandbox_cppi41_writel(u32 val, void *addr);
+
+/**
+ * Reset the model and return its register blocks
+ *
+ * @param ctrl		Returns the DMA controller registers
+ * @param sched		Returns the DMA scheduler registers
+ * @param qmgr		Returns the queue manager registers
+ */
+void sandbox_cppi41_reset(void **ctrl, void **sched, void **qmgr);
+
+/**
+ * Let a TX channel move its next descriptor out to the endpoint
+ *
+ * @param chan		DMA channel
+ * @param buf		Receives the data sent
+ * @param size		Size of buf
+ * @return number of bytes sent, or -1 if nothing was queued
+ */
+int sandbox_cppi41_tx(int chan, void *buf, int size);
+
+/**
+ * Deliver data from the endpoint into the next free descriptor of an RX
+ * channel, completing that descriptor
+ *
+ * @param chan		DMA channel
+ * @param data		Data received
+ * @param len		Length of data
+ * @return number of bytes stored, or -1 if the channel has no free
+ *	descriptor
+ */
+int sandbox_cppi41_rx(int chan, const void *data, int len);
+
+/**
+ * Return the number of bad accesses the model has seen: descriptors
+ * outside the region, pushed twice, or a teardown without a descriptor.
+ */
+int sandbox_cppi41_errors(void);
+
+#endif
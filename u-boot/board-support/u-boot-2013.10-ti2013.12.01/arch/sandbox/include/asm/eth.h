@@ -0,0 +1,36 @@
+/*
+ * Sandbox Ethernet driver
+ *
+ * Unless a TAP interface is given with --tap, test code plays the rest of
+ * the network: the hook sees every frame sent and replies are queued with
+ * sandbox_eth_inject() for the next receive poll. These functions are for
+ * test code only.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __ASM_SANDBOX_ETH_H
+#define __ASM_SANDBOX_ETH_H
+
+typedef void sandbox_eth_tx_hook(const uchar *frame, int len);
+
+/**
+ * Set the function which is given each frame sent
+ *
+ * @param hook		Function to call, or NULL to drop frames
+ */
+void sandbox_eth_set_tx_hook(sandbox_eth_tx_hook *hook);
+
+/**
+ * Queue a frame to be received. This may be called from the hook.
+ *
+ * @param frame		Ethernet frame
+ * @param len		Length of the frame
+ * @return 0 if queued, -1 if the queue is full or the frame too long
+ */
+int sandbox_eth_inject(const void *frame, int len);
+
+/* Drop every frame still queued */
+void sandbox_eth_flush(void);
+
+#endif
@@ -21,6 +21,7 @@ struct sandbox_state {
 	const char *fdt_fname;		/* Filename of FDT binary */
 	enum exit_type_id exit_type;	/* How we exited U-Boot */
 	const char *parse_err;		/* Error to report from parsing */
+	const char *tap_name;		/* Host TAP interface for Ethernet */
 	int argc;			/* Program arguments */
 	char **argv;
 };
@@ -20,6 +20,7 @@
 #endif
 #include <environment.h>
 #include <fdtdec.h>
+#include <libfdt.h>
 #if defined(CONFIG_CMD_IDE)
 #include <ide.h>
 #endif
@@ -263,6 +264,15 @@ static int initr_malloc(void)
 	return 0;
 }
 
+#if defined(CONFIG_OF_CONTROL) && defined(CONFIG_FDT_INDEX)
+static int initr_of_index(void)
+{
+	/* Lookups still work without the index, just more slowly */
+	fdt_index_enable(gd->fdt_blob);
+	return 0;
+}
+#endif
+
 __weak int power_init_board(void)
 {
 	return 0;
@@ -760,6 +770,9 @@ init_fnc_t init_sequence_r[] = {
 #endif
 	initr_barrier,
 	initr_malloc,
+#if defined(CONFIG_OF_CONTROL) && defined(CONFIG_FDT_INDEX)
+	initr_of_index,
+#endif
 	bootstage_relocate,
 #ifdef CONFIG_ARCH_EARLY_INIT_R
 	arch_early_init_r,
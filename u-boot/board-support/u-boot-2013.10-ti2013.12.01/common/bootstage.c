@@ -195,7 +195,7 @@ static int h_compare_record(const void *r1, const void *r2)
 	return rec1->time_us > rec2->time_us ? 1 : -1;
 }
 
-#ifdef CONFIG_OF_LIBFDT
+#if defined(CONFIG_OF_LIBFDT) && !defined(CONFIG_SPL_BUILD)
 /**
  * Add all bootstage timings to a device tree.
  *
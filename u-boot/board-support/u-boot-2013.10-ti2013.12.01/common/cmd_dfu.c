@@ -53,6 +53,9 @@ static int do_dfu(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 			goto exit;
 
 		usb_gadget_handle_interrupts();
+
+		/* write what came in while the host is busy sending more */
+		dfu_flush_poll();
 	}
 exit:
 	g_dnl_unregister();
@@ -35,7 +35,11 @@ U_BOOT_CMD(
 	"      the load stops on end of file.\n"
 	"      If either 'pos' or 'bytes' are not aligned to\n"
 	"      ARCH_DMA_MINALIGN then a misaligned buffer warning will\n"
-	"      be printed and performance will suffer for the load."
+	"      be printed and performance will suffer for the load.\n"
+	"fatload.image <interface> [<dev[:part]>]  <addr> <filename>\n"
+	"    - Of a FIT with external data, load just the FIT structure and\n"
+	"      the images of its default configuration; load other files\n"
+	"      whole."
 );
 
 static int do_fat_ls(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
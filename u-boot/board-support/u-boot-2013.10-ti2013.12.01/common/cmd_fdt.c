@@ -43,6 +43,12 @@ void set_working_fdt_addr(void *addr)
 	void *buf;
 
 	buf = map_sysmem((ulong)addr, 0);
+#ifdef CONFIG_FDT_INDEX
+	/* The same address may hold a new tree, loaded without libfdt */
+	if (working_fdt != buf)
+		fdt_index_disable(working_fdt);
+	fdt_index_enable(buf);
+#endif
 	working_fdt = buf;
 	setenv_addr("fdtaddr", addr);
 }
@@ -83,6 +89,12 @@ static int do_fdt(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	if (argc < 2)
 		return CMD_RET_USAGE;
 
+#ifdef CONFIG_FDT_INDEX
+	/* A tree may have been loaded over the working one since */
+	if (working_fdt)
+		fdt_index_enable(working_fdt);
+#endif
+
 	/*
 	 * Set the address of the fdt
 	 */
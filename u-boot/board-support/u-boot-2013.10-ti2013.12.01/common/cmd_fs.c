@@ -34,7 +34,11 @@ U_BOOT_CMD(
 	"      'bytes' gives the size to load in bytes.\n"
 	"      If 'bytes' is 0 or omitted, the file is read until the end.\n"
 	"      'pos' gives the file byte position to start reading from.\n"
-	"      If 'pos' is 0 or omitted, the file is read from the start."
+	"      If 'pos' is 0 or omitted, the file is read from the start.\n"
+	"load.image <interface> [<dev[:part]> [<addr> [<filename>]]]\n"
+	"    - Of a FIT with external data, load just the FIT structure and\n"
+	"      the images of its default configuration; load other files\n"
+	"      whole."
 );
 
 int do_ls_wrapper(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
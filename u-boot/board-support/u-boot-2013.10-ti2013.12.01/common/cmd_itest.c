@@ -63,7 +63,10 @@ static long evalexp(char *s, int w)
 		l = simple_strtoul(s, NULL, 16);
 	}
 
-	return (l & ((1 << (w * 8)) - 1));
+	/* 1 << 32 is undefined, a long needs no mask */
+	if (w < sizeof(long))
+		l &= (1UL << (w * 8)) - 1;
+	return l;
 }
 
 static char * evalstr(char *s)
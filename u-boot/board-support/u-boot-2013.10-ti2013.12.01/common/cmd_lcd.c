@@ -19,6 +19,8 @@
  */
 
 #include <watchdog.h> 
+#include <rle_logo.h>
+#include <asm/unaligned.h>
 #include <asm/arch-am33xx/hardware_am33xx.h>        // def's for PRCM Register
 #include <asm/arch-am33xx/cpu_am335x.h>             // def's for PLL Register
 
@@ -378,6 +380,108 @@ static int lcd_display_bitmap_txt(ulong bmp_image, int x, int y)
 	return 0;
 }
 
+/* Where a run length encoded logo is decoded from */
+struct rle_logo_txt {
+	const uchar *p, *end;
+	u32 run;		/* pixels left in the current run */
+	int repeat;		/* the run repeats pixel */
+	ushort pixel;
+	int error;		/* ran past the end, the rest is FTBLUE */
+};
+
+static ushort rle_next_pixel_txt(struct rle_logo_txt *rle)
+{
+	if (!rle->run) {
+		if (rle->p >= rle->end)
+			goto truncated;
+		rle->repeat = *rle->p & RLE_LOGO_REPEAT;
+		rle->run = (*rle->p++ & RLE_LOGO_COUNT) + 1;
+		if (rle->repeat) {
+			if (rle->end - rle->p < 2)
+				goto truncated;
+			rle->pixel = get_unaligned_le16(rle->p);
+			rle->p += 2;
+		}
+	}
+	if (!rle->repeat) {
+		if (rle->end - rle->p < 2)
+			goto truncated;
+		rle->pixel = get_unaligned_le16(rle->p);
+		rle->p += 2;
+	}
+	rle->run--;
+	return rle->pixel;
+
+truncated:
+	rle->error = 1;
+	rle->run = 0;
+	return FTBLUE;
+}
+
+/*
+ * Show a logo from "bmp_logo --gen-rle", centered on FTBLUE. Unlike a BMP it
+ * needs no conversion: the pixels are decoded straight into the LIDD data
+ * register, in one pass over the panel and without a frame buffer.
+ */
+static int lcd_display_rle_txt(ulong addr)
+{
+	const struct rle_logo_header *hdr = (void *)addr;
+	struct rle_logo_txt rle = { 0 };
+	unsigned short volatile *pLcdCmd;
+	unsigned short volatile *pLcdData;
+	u32 width, height, x, y, col, row;
+
+	width = get_unaligned_le16(&hdr->width);
+	height = get_unaligned_le16(&hdr->height);
+	if (width > panel_info.vl_col || height > panel_info.vl_row) {
+		printf("Error: %u x %u logo is larger than the panel\n",
+		       width, height);
+		return 1;
+	}
+	x = (panel_info.vl_col - width) / 2;
+	y = (panel_info.vl_row - height) / 2;
+
+	rle.p = (const uchar *)(hdr + 1);
+	rle.end = rle.p + get_unaligned_le32(&hdr->data_size);
+
+	SetWindowSize(0, 0, panel_info.vl_col - 1, panel_info.vl_row - 1);
+
+	pLcdCmd = (unsigned short *)  &psLcdReg->lidd_cs0_addr;
+	pLcdData = (unsigned short *) &psLcdReg->lidd_cs0_data;
+
+	*pLcdCmd = 0x002C;                          // Memory Write, Neustart Adress Zeiger
+
+	for (row = 0; row < panel_info.vl_row; row++) {
+		WATCHDOG_RESET();
+
+		if (row < y || row >= y + height) {
+			for (col = 0; col < panel_info.vl_col; col++)
+				*pLcdData = FTBLUE;
+			continue;
+		}
+		for (col = 0; col < x; col++)
+			*pLcdData = FTBLUE;
+		for (col = 0; col < width; col++)
+			*pLcdData = rle_next_pixel_txt(&rle);
+		for (col = x + width; col < panel_info.vl_col; col++)
+			*pLcdData = FTBLUE;
+	}
+
+	if (rle.error) {
+		printf("Error: RLE logo at %lx is truncated\n", addr);
+		return 1;
+	}
+	return 0;
+}
+
+static int lcd_display_logo_txt(ulong addr)
+{
+	if (!memcmp((void *)addr, RLE_LOGO_MAGIC, RLE_LOGO_MAGIC_LEN))
+		return lcd_display_rle_txt(addr);
+
+	return lcd_display_bitmap_txt(addr, 0, 0);
+}
+
 enum lcd_cmd {
 	LCD_GREEN,
 	LCD_RED,
@@ -402,7 +506,7 @@ static int do_lcd(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 		case 'r': sub_cmd = LCD_RED; SetWindowRGB( 0, 0, 240, 320, 0xF800); break;
 		case 'b': sub_cmd = LCD_BLUE; SetWindowRGB( 0, 0, 240, 320, 0x001F); break;
 		case 'f': sub_cmd = LCD_BLUE; SetWindowRGB( 0, 0, 240, 320, FTBLUE); break;
-		case 'l': sub_cmd = LCD_BMP; lcd_display_bitmap_txt(0x80200000, 0, 0); break;
+		case 'l': sub_cmd = LCD_BMP; lcd_display_logo_txt(0x80200000); break;
 		default:  goto show_usage;
 	}
 	printf("LCD Command called\n");
@@ -412,5 +516,5 @@ static int do_lcd(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 U_BOOT_CMD(lcd, 3, 0, do_lcd,
 	"lcd green|red|blue",
 	"<green|red|blue|ftblue|logo\n"
-	"   logo: BMP at 0x80200000\n"
+	"   logo: BMP or RLE logo (bmp_logo --gen-rle) at 0x80200000\n"
 	"    - fill lcd with color or show BMP");
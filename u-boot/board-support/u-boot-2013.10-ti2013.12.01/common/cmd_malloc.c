@@ -0,0 +1,58 @@
+/*
+ * malloc arena and object pool statistics
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <malloc.h>
+#include <malloc_pool.h>
+
+static int do_malloc_info(cmd_tbl_t *cmdtp, int flag, int argc,
+			  char * const argv[])
+{
+	struct mallinfo info = mallinfo();
+
+	printf("arena            = %08lx - %08lx (%lu KiB)\n",
+	       mem_malloc_start, mem_malloc_end,
+	       (mem_malloc_end - mem_malloc_start) >> 10);
+	printf("brk              = %08lx\n", mem_malloc_brk);
+	malloc_stats();
+	printf("free bytes       = %10u\n", (unsigned int)info.fordblks);
+	printf("free chunks      = %10u\n", (unsigned int)info.ordblks);
+	printf("top chunk bytes  = %10u\n", (unsigned int)info.keepcost);
+	puts("\n");
+	malloc_pool_stats();
+
+	return 0;
+}
+
+static cmd_tbl_t cmd_malloc_sub[] = {
+	U_BOOT_CMD_MKENT(info, 1, 1, do_malloc_info, "", ""),
+};
+
+static int do_malloc(cmd_tbl_t *cmdtp, int flag, int argc,
+		     char * const argv[])
+{
+	cmd_tbl_t *c;
+
+	if (argc < 2)
+		return CMD_RET_USAGE;
+
+	/* Strip off leading 'malloc' command argument */
+	argc--;
+	argv++;
+
+	c = find_cmd_tbl(argv[0], cmd_malloc_sub, ARRAY_SIZE(cmd_malloc_sub));
+
+	if (c)
+		return c->cmd(cmdtp, flag, argc, argv);
+	else
+		return CMD_RET_USAGE;
+}
+
+U_BOOT_CMD(malloc, 2, 1, do_malloc,
+	"malloc arena statistics",
+	"info - print malloc arena and object pool usage"
+);
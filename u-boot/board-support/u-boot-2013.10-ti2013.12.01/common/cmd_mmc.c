@@ -7,6 +7,8 @@
 
 #include <common.h>
 #include <command.h>
+#include <errno.h>
+#include <image.h>
 #include <mmc.h>
 
 static int curr_device = -1;
@@ -74,6 +76,7 @@ U_BOOT_CMD(
 enum mmc_state {
 	MMC_INVALID,
 	MMC_READ,
+	MMC_READ_IMAGE,
 	MMC_WRITE,
 	MMC_ERASE,
 };
@@ -161,6 +164,102 @@ static int boot_part_access(struct mmc *mmc, u8 ack, u8 part_num, u8 access)
 }
 #endif
 
+/* Write back what was read, for code that is run from there */
+static void mmc_flush_read(void *buf, ulong len)
+{
+	ulong start = (ulong)buf & ~(ARCH_DMA_MINALIGN - 1);
+
+	flush_cache(start, ALIGN((ulong)buf + len, ARCH_DMA_MINALIGN) - start);
+}
+
+#ifdef CONFIG_FIT
+struct mmc_image {
+	struct mmc *mmc;
+	u32 blk;		/* where the image starts */
+	u32 cnt;		/* how many blocks it may take */
+};
+
+/* Read any byte range of an image, through a bounce buffer at the ends */
+static int mmc_image_read(void *priv, ulong pos, ulong size, void *buf)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(u8, tmp, MMC_MAX_BLOCK_LEN);
+	struct mmc_image *img = priv;
+	ulong bl_len = img->mmc->read_bl_len;
+	u32 blk = img->blk + pos / bl_len;
+	ulong skip = pos % bl_len;
+	void *start = buf;
+	ulong len = size;
+	ulong n;
+
+	if (pos + size > (ulong)img->cnt * bl_len)
+		return -EFBIG;
+
+	while (size) {
+		if (skip || size < bl_len) {
+			if (img->mmc->block_dev.block_read(curr_device, blk, 1,
+							   tmp) != 1)
+				return -EIO;
+			n = min(size, bl_len - skip);
+			memcpy(buf, tmp + skip, n);
+			skip = 0;
+			blk++;
+		} else {
+			n = size / bl_len;
+			if (img->mmc->block_dev.block_read(curr_device, blk, n,
+							   buf) != n)
+				return -EIO;
+			blk += n;
+			n *= bl_len;
+		}
+		buf += n;
+		size -= n;
+	}
+	mmc_flush_read(start, len);
+
+	return 0;
+}
+#endif
+
+/*
+ * Read no more blocks than the image at blk occupies, if its header is one
+ * genimg_get_image_size() knows; otherwise read all *cnt blocks. On return
+ * *cnt is the number of blocks that should have been read. For a FIT with
+ * external data, the images of its default configuration are read too.
+ */
+static u32 mmc_read_image(struct mmc *mmc, u32 blk, u32 *cnt, void *addr)
+{
+	u32 max_cnt = *cnt;
+	ulong size;
+	u32 n;
+
+	if (!*cnt || mmc->block_dev.block_read(curr_device, blk, 1, addr) != 1)
+		return 0;
+
+	size = genimg_get_image_size(addr);
+	if (size) {
+		if (size > (ulong)*cnt * mmc->read_bl_len) {
+			printf("Image of 0x%lx bytes exceeds the limit\n", size);
+			return 0;
+		}
+		*cnt = DIV_ROUND_UP(size, mmc->read_bl_len);
+	}
+
+	n = mmc->block_dev.block_read(curr_device, blk, *cnt, addr);
+	mmc_flush_read(addr, n * mmc->read_bl_len);
+#ifdef CONFIG_FIT
+	if (n == *cnt && size && genimg_get_format(addr) == IMAGE_FORMAT_FIT) {
+		struct mmc_image img = { mmc, blk, max_cnt };
+
+		if (fit_load_external(addr, NULL, mmc_image_read, &img))
+			return 0;
+	}
+#endif
+	if (n == *cnt)
+		setenv_hex("filesize", size ? size : n * mmc->read_bl_len);
+
+	return n;
+}
+
 static int do_mmcops(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 {
 	enum mmc_state state;
@@ -343,6 +442,8 @@ static int do_mmcops(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	state = MMC_INVALID;
 	if (argc == 5 && strcmp(argv[1], "read") == 0)
 		state = MMC_READ;
+	else if (argc == 5 && strcmp(argv[1], "read.image") == 0)
+		state = MMC_READ_IMAGE;
 	else if (argc == 5 && strcmp(argv[1], "write") == 0)
 		state = MMC_WRITE;
 	else if (argc == 4 && strcmp(argv[1], "erase") == 0)
@@ -386,6 +487,9 @@ static int do_mmcops(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 			/* flush cache after read */
 			flush_cache((ulong)addr, cnt * 512); /* FIXME */
 			break;
+		case MMC_READ_IMAGE:
+			n = mmc_read_image(mmc, blk, &cnt, addr);
+			break;
 		case MMC_WRITE:
 			n = mmc->block_dev.block_write(curr_device, blk,
 						      cnt, addr);
@@ -409,6 +513,10 @@ U_BOOT_CMD(
 	mmc, 6, 1, do_mmcops,
 	"MMC sub system",
 	"read addr blk# cnt\n"
+	"mmc read.image addr blk# cnt - read at most cnt blocks, only as\n"
+	"    many as a uImage/FIT/FDT/BMP header says; sets 'filesize'.\n"
+	"    For a FIT with external data, read just the FIT structure\n"
+	"    and the images of its default configuration\n"
 	"mmc write addr blk# cnt\n"
 	"mmc erase blk# cnt\n"
 	"mmc rescan\n"
@@ -25,6 +25,7 @@
 #include <watchdog.h>
 #include <malloc.h>
 #include <asm/byteorder.h>
+#include <asm/errno.h>
 #include <jffs2/jffs2.h>
 #include <nand.h>
 
@@ -437,6 +438,116 @@ static int raw_access(nand_info_t *nand, ulong addr, loff_t off, ulong count,
 	return ret;
 }
 
+static int page_is_erased(const u_char *buf, size_t len)
+{
+	const u32 *p = (const u32 *)buf;
+
+	for (; len >= sizeof(*p); len -= sizeof(*p))
+		if (*p++ != 0xffffffff)
+			return 0;
+
+	return 1;
+}
+
+#ifdef CONFIG_FIT
+struct nand_image {
+	nand_info_t *nand;
+	loff_t off;		/* where the image starts */
+	loff_t maxsize;		/* how far it may go, bad blocks included */
+};
+
+/* Read part of an image written from img->off by nand_write_skip_bad() */
+static int nand_image_read(void *priv, ulong pos, ulong size, void *buf)
+{
+	struct nand_image *img = priv;
+	nand_info_t *nand = img->nand;
+	loff_t off = img->off;
+	loff_t end = img->off + img->maxsize;
+	size_t len = size;
+	ulong left;
+
+	/* Find the good eraseblock holding pos */
+	for (;;) {
+		if (off >= end)
+			return -EFBIG;
+		left = nand->erasesize - (off & (nand->erasesize - 1));
+		if (!nand_block_isbad(nand, off)) {
+			if (pos < left)
+				break;
+			pos -= left;
+		}
+		off += left;
+	}
+	off += pos;
+
+	return nand_read_skip_bad(nand, off, &len, NULL, end - off, buf);
+}
+#endif
+
+/*
+ * Read no more of an image than it occupies: as much as its header says for
+ * the formats genimg_get_image_size() knows, else up to the first erased
+ * page. On entry *length is the most to read, on return what was read.
+ * For a FIT with external data, only the FIT structure and the images of
+ * its default configuration are read, and *length is the size of the FIT
+ * structure.
+ */
+static int nand_read_image(nand_info_t *nand, loff_t off, size_t *length,
+			   loff_t maxsize, u_char *buf)
+{
+	size_t done, chunk, actual, page, size;
+	loff_t pos;
+	int ret;
+
+	chunk = min(*length, (size_t)nand->writesize);
+	ret = nand_read_skip_bad(nand, off, &chunk, NULL, maxsize, buf);
+	if (ret)
+		return ret;
+
+	size = genimg_get_image_size(buf);
+	if (size) {
+		if (size > *length) {
+			printf("Image of 0x%zx bytes exceeds the limit\n",
+			       size);
+			return -EFBIG;
+		}
+		*length = size;
+		ret = nand_read_skip_bad(nand, off, length, NULL, maxsize,
+					 buf);
+#ifdef CONFIG_FIT
+		if (!ret && genimg_get_format(buf) == IMAGE_FORMAT_FIT) {
+			struct nand_image img = { nand, off, maxsize };
+
+			ret = fit_load_external(buf, NULL, nand_image_read,
+						&img);
+		}
+#endif
+		return ret;
+	}
+
+	/* Unknown format: one eraseblock at a time, up to an empty page */
+	for (done = 0, pos = off; done < *length; done += chunk) {
+		chunk = nand->erasesize - (pos & (nand->erasesize - 1));
+		chunk = min(chunk, *length - done);
+		ret = nand_read_skip_bad(nand, pos, &chunk, &actual,
+					 maxsize - (pos - off), buf + done);
+		if (ret)
+			return ret;
+
+		for (page = 0; page < chunk; page += nand->writesize) {
+			if (page_is_erased(buf + done + page,
+					   min(chunk - page,
+					       (size_t)nand->writesize))) {
+				*length = done + page;
+				return 0;
+			}
+		}
+		pos += actual;
+	}
+
+	return 0;
+}
+
 /* Adjust a chip/partition size down for bad blocks so we don't
  * read/write past the end of a chip/partition by accident.
  */
@@ -715,6 +826,15 @@ static int do_nand(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 						maxsize, (u_char *)addr,
 						WITH_YAFFS_OOB);
 #endif
+		} else if (!strcmp(s, ".image")) {
+			if (!read) {
+				printf("Unknown nand command suffix '%s'.\n", s);
+				return 1;
+			}
+			ret = nand_read_image(nand, off, &rwsize, maxsize,
+					      (u_char *)addr);
+			if (!ret)
+				setenv_hex("filesize", rwsize);
 		} else if (!strcmp(s, ".oob")) {
 			/* out-of-band data */
 			mtd_oob_ops_t ops = {
@@ -848,6 +968,11 @@ static char nand_help_text[] =
 	"nand write - addr off|partition size\n"
 	"    read/write 'size' bytes starting at offset 'off'\n"
 	"    to/from memory address 'addr', skipping bad blocks.\n"
+	"nand read.image - addr off|partition [size]\n"
+	"    read an image only as far as its uImage/FIT/FDT/BMP header\n"
+	"    says, else up to the first erased page; sets 'filesize'.\n"
+	"    For a FIT with external data, read just the FIT structure\n"
+	"    and the images of its default configuration\n"
 	"nand read.raw - addr off|partition [count]\n"
 	"nand write.raw - addr off|partition [count]\n"
 	"    Use read.raw/write.raw to avoid ECC and access the flash as-is.\n"
@@ -77,12 +77,46 @@ static int create_call_list(int argc, char * const argv[])
 	return 0;
 }
 
+static int set_filter(int argc, char * const argv[])
+{
+	enum trace_filter_type type;
+	ulong start, size;
+
+	if (argc == 3 && !strcmp(argv[2], "clear")) {
+		trace_clear_filters();
+		return 0;
+	}
+	if (argc < 5)
+		return -1;
+	if (!strcmp(argv[2], "include"))
+		type = TRACE_FILTER_INCLUDE;
+	else if (!strcmp(argv[2], "exclude"))
+		type = TRACE_FILTER_EXCLUDE;
+	else
+		return -1;
+	start = simple_strtoul(argv[3], NULL, 16);
+	size = simple_strtoul(argv[4], NULL, 16);
+	if (trace_add_filter(type, start, size)) {
+		puts("Too many trace filters\n");
+		return 1;
+	}
+
+	return 0;
+}
+
 int do_trace(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 {
 	const char *cmd = argc < 2 ? NULL : argv[1];
+	int ret;
 
 	if (!cmd)
 		return cmd_usage(cmdtp);
+	if (!strcmp(cmd, "filter")) {
+		ret = set_filter(argc, argv);
+		if (ret < 0)
+			return CMD_RET_USAGE;
+		return ret;
+	}
 	switch (*cmd) {
 	case 'p':
 		trace_set_enabled(0);
@@ -109,12 +143,16 @@ int do_trace(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 }
 
 U_BOOT_CMD(
-	trace,	4,	1,	do_trace,
+	trace,	5,	1,	do_trace,
 	"trace utility commands",
 	"stats                        - display tracing statistics\n"
 	"trace pause                        - pause tracing\n"
 	"trace resume                       - resume tracing\n"
 	"trace funclist [<addr> <size>]     - dump function list into buffer\n"
 	"trace calls  [<addr> <size>]       "
-		"- dump function call trace into buffer"
+		"- dump function call trace into buffer\n"
+	"trace filter include|exclude <addr> <size>\n"
+	"                                   - only/never record calls to\n"
+	"                                     functions in System.map range\n"
+	"trace filter clear                 - remove all filters"
 );
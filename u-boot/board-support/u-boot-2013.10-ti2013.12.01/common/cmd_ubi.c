@@ -21,6 +21,7 @@
 #include <linux/mtd/partitions.h>
 #include <ubi_uboot.h>
 #include <asm/errno.h>
+#include <image.h>
 #include <jffs2/load_kernel.h>
 
 #undef ubi_msg
@@ -332,13 +333,13 @@ int ubi_volume_write(char *volume, void *buf, size_t size)
 	return ubi_volume_begin_write(volume, buf, size, size);
 }
 
-int ubi_volume_read(char *volume, char *buf, size_t size)
+static int ubi_volume_read_at(char *volume, char *buf, loff_t offp,
+			      size_t size)
 {
 	int err, lnum, off, len, tbuf_size;
 	void *tbuf;
 	unsigned long long tmp;
 	struct ubi_volume *vol;
-	loff_t offp = 0;
 
 	vol = ubi_find_volume(volume);
 	if (vol == NULL)
@@ -357,7 +358,7 @@ int ubi_volume_read(char *volume, char *buf, size_t size)
 
 	if (size == 0) {
 		printf("No size specified -> Using max size (%lld)\n", vol->used_bytes);
-		size = vol->used_bytes;
+		size = vol->used_bytes - offp;
 	}
 
 	if (vol->corrupted)
@@ -407,6 +408,76 @@ int ubi_volume_read(char *volume, char *buf, size_t size)
 	return err;
 }
 
+int ubi_volume_read(char *volume, char *buf, size_t size)
+{
+	return ubi_volume_read_at(volume, buf, 0, size);
+}
+
+#ifdef CONFIG_FIT
+/* Read any byte range of the volume holding a FIT */
+static int ubi_image_read(void *priv, ulong pos, ulong size, void *buf)
+{
+	struct ubi_volume *vol = priv;
+
+	if (!size)
+		return 0;
+	if (pos + size < pos || pos + size > vol->used_bytes)
+		return -EFBIG;
+
+	return ubi_volume_read_at(vol->name, buf, pos, size) ? -EIO : 0;
+}
+#endif
+
+/*
+ * Read no more of a volume than its contents: as much as the header of an
+ * image genimg_get_image_size() knows says, else up to the first logical
+ * eraseblock that was never written. For a FIT with external data, the
+ * images of its default configuration are read too, and *size is the size
+ * of the FIT structure.
+ */
+static int ubi_volume_read_image(char *volume, char *buf, size_t *size)
+{
+	struct ubi_volume *vol;
+	size_t len;
+	int lnum, err;
+
+	vol = ubi_find_volume(volume);
+	if (vol == NULL)
+		return ENODEV;
+
+	err = ubi_volume_read(volume, buf, ubi->min_io_size);
+	if (err)
+		return err;
+
+	len = genimg_get_image_size(buf);
+	if (len > vol->used_bytes) {
+		printf("Image of 0x%zx bytes exceeds the volume\n", len);
+		return EFBIG;
+	}
+	if (len) {
+		err = ubi_volume_read(volume, buf, len);
+#ifdef CONFIG_FIT
+		if (!err && genimg_get_format(buf) == IMAGE_FORMAT_FIT &&
+		    fit_load_external(buf, NULL, ubi_image_read, vol))
+			err = EIO;
+#endif
+		*size = len;
+		return err;
+	}
+
+	for (lnum = 0; lnum < vol->reserved_pebs; lnum++)
+		if (vol->eba_tbl[lnum] == UBI_LEB_UNMAPPED)
+			break;
+	len = min((unsigned long long)lnum * vol->usable_leb_size,
+		  vol->used_bytes);
+
+	*size = len;
+	if (!len)
+		return 0;
+
+	return ubi_volume_read(volume, buf, len);
+}
+
 static int ubi_dev_scan(struct mtd_info *info, char *ubidev,
 		const char *vid_header_offset)
 {
@@ -628,6 +699,24 @@ static int do_ubi(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 		return ret;
 	}
 
+	if (strncmp(argv[1], "read", 4) == 0 && strchr(argv[1], '.')) {
+		size_t len;
+		int ret;
+
+		if (strcmp(strchr(argv[1], '.'), ".image") || argc != 4)
+			return CMD_RET_USAGE;
+
+		addr = simple_strtoul(argv[2], NULL, 16);
+		ret = ubi_volume_read_image(argv[3], (char *)addr, &len);
+		if (!ret) {
+			printf("%zu bytes read from volume %s\n", len,
+			       argv[3]);
+			setenv_hex("filesize", len);
+		}
+
+		return ret;
+	}
+
 	if (strncmp(argv[1], "read", 4) == 0) {
 		size = 0;
 
@@ -671,6 +760,9 @@ U_BOOT_CMD(
 		" - Write part of a volume from address\n"
 	"ubi read[vol] address volume [size]"
 		" - Read volume to address with size\n"
+	"ubi read[vol].image address volume"
+		" - Read only the image a volume holds,\n"
+		"    with the external data of a FIT's default configuration\n"
 	"ubi remove[vol] volume"
 		" - Remove volume\n"
 	"[Legends]\n"
@@ -616,6 +616,34 @@ static int do_usb(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 			return 1;
 		}
 	}
+	if (strcmp(argv[1], "bench") == 0) {
+		unsigned long addr, blk, cnt, n, bytes, start, ms;
+
+		if (usb_stor_curr_dev < 0) {
+			printf("no current device selected\n");
+			return 1;
+		}
+		if (argc != 5)
+			return CMD_RET_USAGE;
+		addr = simple_strtoul(argv[2], NULL, 16);
+		blk  = simple_strtoul(argv[3], NULL, 16);
+		cnt  = simple_strtoul(argv[4], NULL, 16);
+		stor_dev = usb_stor_get_dev(usb_stor_curr_dev);
+		start = get_timer(0);
+		n = stor_dev->block_read(usb_stor_curr_dev, blk, cnt,
+					 (ulong *)addr);
+		ms = get_timer(start);
+		if (n != cnt) {
+			printf("%ld blocks read: ERROR\n", n);
+			return 1;
+		}
+		bytes = n * stor_dev->blksz;
+		printf("%lu bytes read in %lu ms", bytes, ms);
+		if (ms)
+			printf(" (%lu KiB/s)", bytes / 1024 * 1000 / ms);
+		printf("\n");
+		return 0;
+	}
 	if (strncmp(argv[1], "dev", 3) == 0) {
 		if (argc == 3) {
 			int dev = (int)simple_strtoul(argv[2], NULL, 10);
@@ -665,7 +693,9 @@ U_BOOT_CMD(
 	"usb read addr blk# cnt - read `cnt' blocks starting at block `blk#'\n"
 	"    to memory address `addr'\n"
 	"usb write addr blk# cnt - write `cnt' blocks starting at block `blk#'\n"
-	"    from memory address `addr'"
+	"    from memory address `addr'\n"
+	"usb bench addr blk# cnt - time reading `cnt' blocks starting at\n"
+	"    block `blk#' to memory address `addr'"
 #endif /* CONFIG_USB_STORAGE */
 );
 
@@ -61,6 +61,7 @@ int do_usb_mass_storage(cmd_tbl_t *cmdtp, int flag,
 			goto exit;
 	}
 exit:
+	fsg_cleanup();
 	g_dnl_unregister();
 	return 0;
 
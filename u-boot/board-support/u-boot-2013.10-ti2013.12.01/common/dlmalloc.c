@@ -930,7 +930,13 @@ struct mallinfo mALLINFo();
 #endif	/* 0 */			/* Moved to malloc.h */
 
 #include <malloc.h>
-#ifdef DEBUG
+
+/* Arena statistics are also wanted by the malloc command */
+#if defined(DEBUG) || defined(CONFIG_CMD_MALLOC)
+#define MALLOC_STATS
+#endif
+
+#ifdef MALLOC_STATS
 #if __STD_C
 static void malloc_update_mallinfo (void);
 void malloc_stats (void);
@@ -938,7 +944,7 @@ void malloc_stats (void);
 static void malloc_update_mallinfo ();
 void malloc_stats();
 #endif
-#endif	/* DEBUG */
+#endif	/* MALLOC_STATS */
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -1619,9 +1625,9 @@ static struct mallinfo current_mallinfo = {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 
 /* Tracking mmaps */
 
-#ifdef DEBUG
+#ifdef MALLOC_STATS
 static unsigned int n_mmaps = 0;
-#endif	/* DEBUG */
+#endif	/* MALLOC_STATS */
 static unsigned long mmapped_mem = 0;
 #if HAVE_MMAP
 static unsigned int max_n_mmaps = 0;
@@ -3096,7 +3102,7 @@ size_t malloc_usable_size(mem) Void_t* mem;
 
 /* Utility to update current_mallinfo for malloc_stats and mallinfo() */
 
-#ifdef DEBUG
+#ifdef MALLOC_STATS
 static void malloc_update_mallinfo()
 {
   int i;
@@ -3134,7 +3140,7 @@ static void malloc_update_mallinfo()
   current_mallinfo.keepcost = chunksize(top);
 
 }
-#endif	/* DEBUG */
+#endif	/* MALLOC_STATS */
 
 
 
@@ -3153,7 +3159,7 @@ static void malloc_update_mallinfo()
 
 */
 
-#ifdef DEBUG
+#ifdef MALLOC_STATS
 void malloc_stats()
 {
   malloc_update_mallinfo();
@@ -3168,19 +3174,19 @@ void malloc_stats()
 	  (unsigned int)max_n_mmaps);
 #endif
 }
-#endif	/* DEBUG */
+#endif	/* MALLOC_STATS */
 
 /*
   mallinfo returns a copy of updated current mallinfo.
 */
 
-#ifdef DEBUG
+#ifdef MALLOC_STATS
 struct mallinfo mALLINFo()
 {
   malloc_update_mallinfo();
   return current_mallinfo;
 }
-#endif	/* DEBUG */
+#endif	/* MALLOC_STATS */
 
 
 
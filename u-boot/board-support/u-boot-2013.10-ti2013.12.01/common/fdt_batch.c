@@ -0,0 +1,697 @@
+/*
+ * Batched device tree fixups
+ *
+ * Each fdt_setprop() or fdt_add_subnode() on a packed blob splices the
+ * structure block, moving everything behind the insertion point. bootm
+ * applies a dozen or more such fixups, each of them moving most of the
+ * blob. A batch records the fixups by node path instead and applies
+ * them in one go: the edits are sorted by offset and the blob is
+ * rewritten in place in a single pass, so every byte moves at most once
+ * however many fixups there are.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <fdt_support.h>
+
+struct fdt_batch_prop {
+	struct fdt_batch_prop *next;
+	int len;
+	char *val;			/* points behind name */
+	char name[];
+};
+
+struct fdt_batch_node {
+	struct fdt_batch_node *next;	/* next sibling */
+	struct fdt_batch_node *children;
+	struct fdt_batch_prop *props;
+	char name[];
+};
+
+struct fdt_batch_rsv {
+	struct fdt_batch_rsv *next;
+	u64 addr;
+	u64 size;
+	int del;			/* delete the entry for addr */
+};
+
+struct fdt_batch {
+	void *fdt;
+	struct fdt_batch_node *root;
+	struct fdt_batch_rsv *rsv;
+};
+
+/* A single splice of the blob, offsets are before the batch is applied */
+struct fdt_edit {
+	int offset;
+	int oldlen;			/* bytes removed at offset */
+	int newlen;			/* bytes inserted in their place */
+	int kind;			/* tie-break at the same offset */
+	int seq;
+	int data;			/* offset of new bytes in payload */
+};
+
+enum {
+	EDIT_ADD_PROP,			/* inserts come before replacements */
+	EDIT_ADD_NODE,			/* and nodes after properties */
+	EDIT_REPLACE,
+};
+
+struct fdt_batch_plan {
+	const void *fdt;
+	struct fdt_edit *edit;
+	int count;
+	int max;
+	char *payload;
+	int payload_len;
+	int payload_size;
+	char *strings;			/* property names new to the blob */
+	int strings_len;
+	int strings_size;
+};
+
+static struct fdt_batch *active_batch;
+
+static struct fdt_batch_node *batch_new_node(const char *name, int len)
+{
+	struct fdt_batch_node *node;
+
+	node = calloc(1, sizeof(*node) + len + 1);
+	if (node)
+		memcpy(node->name, name, len);
+
+	return node;
+}
+
+static void batch_free_node(struct fdt_batch_node *node)
+{
+	struct fdt_batch_node *child, *next_child;
+	struct fdt_batch_prop *prop, *next_prop;
+
+	for (child = node->children; child; child = next_child) {
+		next_child = child->next;
+		batch_free_node(child);
+	}
+	for (prop = node->props; prop; prop = next_prop) {
+		next_prop = prop->next;
+		free(prop);
+	}
+	free(node);
+}
+
+struct fdt_batch *fdt_batch_begin(void *fdt)
+{
+	struct fdt_batch *batch;
+
+	if (active_batch || fdt_check_header(fdt))
+		return NULL;
+
+	batch = calloc(1, sizeof(*batch));
+	if (!batch)
+		return NULL;
+	batch->root = batch_new_node("", 0);
+	if (!batch->root) {
+		free(batch);
+		return NULL;
+	}
+	batch->fdt = fdt;
+	active_batch = batch;
+
+	return batch;
+}
+
+struct fdt_batch *fdt_batch_get(const void *fdt)
+{
+	if (active_batch && active_batch->fdt == fdt)
+		return active_batch;
+
+	return NULL;
+}
+
+static void batch_free(struct fdt_batch *batch)
+{
+	struct fdt_batch_rsv *rsv, *next;
+
+	for (rsv = batch->rsv; rsv; rsv = next) {
+		next = rsv->next;
+		free(rsv);
+	}
+	batch_free_node(batch->root);
+	if (active_batch == batch)
+		active_batch = NULL;
+	free(batch);
+}
+
+/*
+ * Look up the batch node for a path, optionally creating it and its
+ * parents. Paths of nodes already in the blob are first turned into the
+ * full path, so that aliases and names without unit address end up at
+ * the same batch node.
+ */
+static struct fdt_batch_node *batch_find_node(struct fdt_batch *batch,
+					      const char *path, int create,
+					      int *errp)
+{
+	struct fdt_batch_node *node, *child, **link;
+	char buf[256];
+	const char *p, *q;
+	int offset, err;
+
+	offset = fdt_path_offset(batch->fdt, path);
+	if (offset >= 0) {
+		err = fdt_get_path(batch->fdt, offset, buf, sizeof(buf));
+		if (err) {
+			*errp = err;
+			return NULL;
+		}
+		path = buf;
+	} else if (*path != '/') {
+		*errp = -FDT_ERR_BADPATH;
+		return NULL;
+	}
+
+	node = batch->root;
+	for (p = path; *p; p = q) {
+		while (*p == '/')
+			p++;
+		if (!*p)
+			break;
+		q = strchr(p, '/');
+		if (!q)
+			q = p + strlen(p);
+
+		for (link = &node->children; *link; link = &(*link)->next) {
+			child = *link;
+			if (strlen(child->name) == q - p &&
+			    !memcmp(child->name, p, q - p))
+				break;
+		}
+		if (!*link) {
+			if (!create) {
+				*errp = -FDT_ERR_NOTFOUND;
+				return NULL;
+			}
+			*link = batch_new_node(p, q - p);
+			if (!*link) {
+				*errp = -FDT_ERR_NOSPACE;
+				return NULL;
+			}
+		}
+		node = *link;
+	}
+
+	return node;
+}
+
+int fdt_batch_add_node(struct fdt_batch *batch, const char *path)
+{
+	int err = 0;
+
+	batch_find_node(batch, path, 1, &err);
+
+	return err;
+}
+
+int fdt_batch_has_node(struct fdt_batch *batch, const char *path)
+{
+	int err;
+
+	if (fdt_path_offset(batch->fdt, path) >= 0)
+		return 1;
+
+	return batch_find_node(batch, path, 0, &err) != NULL;
+}
+
+int fdt_batch_setprop(struct fdt_batch *batch, const char *path,
+		      const char *name, const void *val, int len)
+{
+	struct fdt_batch_node *node;
+	struct fdt_batch_prop *prop, **link;
+	int namelen = strlen(name) + 1;
+	int err = 0;
+
+	node = batch_find_node(batch, path, 1, &err);
+	if (!node)
+		return err;
+
+	prop = malloc(sizeof(*prop) + namelen + len);
+	if (!prop)
+		return -FDT_ERR_NOSPACE;
+	memcpy(prop->name, name, namelen);
+	prop->val = prop->name + namelen;
+	memcpy(prop->val, val, len);
+	prop->len = len;
+	prop->next = NULL;
+
+	/* A later value for the same property replaces the earlier one */
+	for (link = &node->props; *link; link = &(*link)->next) {
+		if (!strcmp((*link)->name, name)) {
+			prop->next = (*link)->next;
+			free(*link);
+			break;
+		}
+	}
+	*link = prop;
+
+	return 0;
+}
+
+static int batch_queue_rsv(struct fdt_batch *batch, u64 addr, u64 size,
+			   int del)
+{
+	struct fdt_batch_rsv *rsv, **link;
+
+	for (link = &batch->rsv; *link; ) {
+		rsv = *link;
+		if (del && !rsv->del && rsv->addr == addr) {
+			*link = rsv->next;
+			free(rsv);
+			/* Deleting an entry we added cancels it out */
+			return 0;
+		}
+		link = &rsv->next;
+	}
+
+	rsv = malloc(sizeof(*rsv));
+	if (!rsv)
+		return -FDT_ERR_NOSPACE;
+	rsv->addr = addr;
+	rsv->size = size;
+	rsv->del = del;
+	rsv->next = NULL;
+	*link = rsv;
+
+	return 0;
+}
+
+int fdt_batch_add_mem_rsv(struct fdt_batch *batch, u64 addr, u64 size)
+{
+	return batch_queue_rsv(batch, addr, size, 0);
+}
+
+int fdt_batch_del_mem_rsv(struct fdt_batch *batch, u64 addr)
+{
+	return batch_queue_rsv(batch, addr, 0, 1);
+}
+
+static int plan_grow(char **buf, int *size, int need)
+{
+	char *p;
+	int new_size;
+
+	if (need <= *size)
+		return 0;
+	new_size = max(need, max(*size * 2, 256));
+	p = realloc(*buf, new_size);
+	if (!p)
+		return -FDT_ERR_NOSPACE;
+	*buf = p;
+	*size = new_size;
+
+	return 0;
+}
+
+static int plan_put(struct fdt_batch_plan *plan, const void *data, int len)
+{
+	int padded = ALIGN(len, FDT_TAGSIZE);
+	int err;
+
+	err = plan_grow(&plan->payload, &plan->payload_size,
+			plan->payload_len + padded);
+	if (err)
+		return err;
+	memcpy(plan->payload + plan->payload_len, data, len);
+	memset(plan->payload + plan->payload_len + len, '\0', padded - len);
+	plan->payload_len += padded;
+
+	return 0;
+}
+
+static int plan_put_cell(struct fdt_batch_plan *plan, u32 val)
+{
+	fdt32_t cell = cpu_to_fdt32(val);
+
+	return plan_put(plan, &cell, sizeof(cell));
+}
+
+static int plan_edit(struct fdt_batch_plan *plan, int offset, int oldlen,
+		     int data, int kind)
+{
+	struct fdt_edit *edit;
+
+	if (plan->count == plan->max) {
+		edit = realloc(plan->edit, (plan->max + 16) * sizeof(*edit));
+		if (!edit)
+			return -FDT_ERR_NOSPACE;
+		plan->edit = edit;
+		plan->max += 16;
+	}
+	edit = &plan->edit[plan->count];
+	edit->offset = offset;
+	edit->oldlen = oldlen;
+	edit->data = data;
+	edit->newlen = plan->payload_len - data;
+	edit->kind = kind;
+	edit->seq = plan->count++;
+
+	return 0;
+}
+
+/* Find or add a property name, returning its offset in the strings block */
+static int plan_string(struct fdt_batch_plan *plan, const char *name)
+{
+	const char *strtab = (const char *)plan->fdt +
+			     fdt_off_dt_strings(plan->fdt);
+	int tabsize = fdt_size_dt_strings(plan->fdt);
+	int len = strlen(name) + 1;
+	int i, err;
+
+	for (i = 0; i <= tabsize - len; i++)
+		if (!memcmp(strtab + i, name, len))
+			return i;
+	for (i = 0; i <= plan->strings_len - len; i++)
+		if (!memcmp(plan->strings + i, name, len))
+			return tabsize + i;
+
+	err = plan_grow(&plan->strings, &plan->strings_size,
+			plan->strings_len + len);
+	if (err)
+		return err;
+	memcpy(plan->strings + plan->strings_len, name, len);
+	plan->strings_len += len;
+
+	return tabsize + plan->strings_len - len;
+}
+
+static int plan_put_prop(struct fdt_batch_plan *plan,
+			 struct fdt_batch_prop *prop, int nameoff)
+{
+	int err;
+
+	err = plan_put_cell(plan, FDT_PROP);
+	if (!err)
+		err = plan_put_cell(plan, prop->len);
+	if (!err)
+		err = plan_put_cell(plan, nameoff);
+	if (!err)
+		err = plan_put(plan, prop->val, prop->len);
+
+	return err;
+}
+
+/* Write a node that is not in the blob yet, with all its children */
+static int plan_put_node(struct fdt_batch_plan *plan,
+			 struct fdt_batch_node *node)
+{
+	struct fdt_batch_node *child;
+	struct fdt_batch_prop *prop;
+	int nameoff, err;
+
+	err = plan_put_cell(plan, FDT_BEGIN_NODE);
+	if (!err)
+		err = plan_put(plan, node->name, strlen(node->name) + 1);
+	for (prop = node->props; prop && !err; prop = prop->next) {
+		nameoff = plan_string(plan, prop->name);
+		if (nameoff < 0)
+			return nameoff;
+		err = plan_put_prop(plan, prop, nameoff);
+	}
+	for (child = node->children; child && !err; child = child->next)
+		err = plan_put_node(plan, child);
+	if (!err)
+		err = plan_put_cell(plan, FDT_END_NODE);
+
+	return err;
+}
+
+/* Work out the edits for a node which exists in the blob at @offset */
+static int plan_node(struct fdt_batch_plan *plan, struct fdt_batch_node *node,
+		     int offset)
+{
+	const void *fdt = plan->fdt;
+	const struct fdt_property *old;
+	struct fdt_batch_node *child;
+	struct fdt_batch_prop *prop;
+	int struct_off = fdt_off_dt_struct(fdt);
+	int props_off, end_off, next, oldlen, nameoff, data, sub, err;
+	uint32_t tag;
+
+	/* Properties start behind the node name and end at the first child */
+	tag = fdt_next_tag(fdt, offset, &props_off);
+	if (tag != FDT_BEGIN_NODE)
+		return -FDT_ERR_BADSTRUCTURE;
+	next = props_off;
+	do {
+		end_off = next;
+		tag = fdt_next_tag(fdt, end_off, &next);
+	} while (tag == FDT_PROP || tag == FDT_NOP);
+
+	for (prop = node->props; prop; prop = prop->next) {
+		old = fdt_get_property(fdt, offset, prop->name, &oldlen);
+		if (!old && oldlen != -FDT_ERR_NOTFOUND)
+			return oldlen;
+		nameoff = old ? fdt32_to_cpu(old->nameoff) :
+			  plan_string(plan, prop->name);
+		if (nameoff < 0)
+			return nameoff;
+
+		data = plan->payload_len;
+		err = plan_put_prop(plan, prop, nameoff);
+		if (!err && old)
+			err = plan_edit(plan, (const char *)old - (const char *)fdt,
+					sizeof(*old) + ALIGN(oldlen, FDT_TAGSIZE),
+					data, EDIT_REPLACE);
+		else if (!err)
+			err = plan_edit(plan, struct_off + props_off, 0, data,
+					EDIT_ADD_PROP);
+		if (err)
+			return err;
+	}
+
+	for (child = node->children; child; child = child->next) {
+		sub = fdt_subnode_offset(fdt, offset, child->name);
+		if (sub >= 0) {
+			err = plan_node(plan, child, sub);
+		} else if (sub == -FDT_ERR_NOTFOUND) {
+			data = plan->payload_len;
+			err = plan_put_node(plan, child);
+			if (!err)
+				err = plan_edit(plan, struct_off + end_off, 0,
+						data, EDIT_ADD_NODE);
+		} else {
+			err = sub;
+		}
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static int plan_rsv(struct fdt_batch_plan *plan, struct fdt_batch_rsv *list)
+{
+	const void *fdt = plan->fdt;
+	struct fdt_batch_rsv *rsv;
+	uint64_t addr, size;
+	int rsv_off = fdt_off_mem_rsvmap(fdt);
+	int total = fdt_num_mem_rsv(fdt);
+	int i, data, err = 0;
+
+	for (rsv = list; rsv; rsv = rsv->next) {
+		if (!rsv->del)
+			continue;
+		/* Delete the first matching entry, as fdt_del_mem_rsv() would */
+		for (i = 0; i < total; i++) {
+			if (fdt_get_mem_rsv(fdt, i, &addr, &size) == 0 &&
+			    addr == rsv->addr) {
+				err = plan_edit(plan, rsv_off + i * 16, 16,
+						plan->payload_len, EDIT_REPLACE);
+				break;
+			}
+		}
+		if (err)
+			return err;
+	}
+
+	data = plan->payload_len;
+	for (rsv = list; rsv && !err; rsv = rsv->next) {
+		if (!rsv->del) {
+			fdt64_t entry[2];
+
+			entry[0] = cpu_to_fdt64(rsv->addr);
+			entry[1] = cpu_to_fdt64(rsv->size);
+			err = plan_put(plan, entry, sizeof(entry));
+		}
+	}
+	if (!err && plan->payload_len != data)
+		err = plan_edit(plan, rsv_off + total * 16, 0, data,
+				EDIT_ADD_PROP);
+
+	return err;
+}
+
+static void plan_free(struct fdt_batch_plan *plan)
+{
+	free(plan->edit);
+	free(plan->payload);
+	free(plan->strings);
+}
+
+static int edit_before(const struct fdt_edit *a, const struct fdt_edit *b)
+{
+	if (a->offset != b->offset)
+		return a->offset < b->offset;
+	if (a->kind != b->kind)
+		return a->kind < b->kind;
+
+	return a->seq < b->seq;
+}
+
+/*
+ * Turn the batch into a sorted list of edits. Returns the number of bytes
+ * the blob will use once the edits are applied, or -ve FDT error.
+ */
+static int plan_build(struct fdt_batch *batch, struct fdt_batch_plan *plan)
+{
+	void *fdt = batch->fdt;
+	int used, data, i, j, err;
+
+	memset(plan, '\0', sizeof(*plan));
+	plan->fdt = fdt;
+
+	/*
+	 * Blocks must be in the usual order, with the strings last. Like
+	 * the libfdt read-write functions, convert the blob if not.
+	 */
+	if (fdt_version(fdt) < 17 ||
+	    fdt_off_mem_rsvmap(fdt) > fdt_off_dt_struct(fdt) ||
+	    fdt_off_dt_struct(fdt) + fdt_size_dt_struct(fdt) >
+	    fdt_off_dt_strings(fdt)) {
+		err = fdt_open_into(fdt, fdt, fdt_totalsize(fdt));
+		if (err)
+			return err;
+	}
+	used = fdt_off_dt_strings(fdt) + fdt_size_dt_strings(fdt);
+
+	err = plan_rsv(plan, batch->rsv);
+	if (!err)
+		err = plan_node(plan, batch->root, 0);
+	if (!err && plan->strings_len) {
+		data = plan->payload_len;
+		err = plan_put(plan, plan->strings, plan->strings_len);
+		/* plan_put() pads, but strings must not be */
+		plan->payload_len = data + plan->strings_len;
+		if (!err)
+			err = plan_edit(plan, used, 0, data, EDIT_ADD_PROP);
+	}
+	if (err)
+		return err;
+
+	/* There are few edits, so a simple insertion sort does */
+	for (i = 1; i < plan->count; i++) {
+		struct fdt_edit edit = plan->edit[i];
+
+		for (j = i; j > 0 && edit_before(&edit, &plan->edit[j - 1]);
+		     j--)
+			plan->edit[j] = plan->edit[j - 1];
+		plan->edit[j] = edit;
+	}
+
+	for (i = 0; i < plan->count; i++) {
+		if (i && plan->edit[i - 1].offset + plan->edit[i - 1].oldlen >
+		    plan->edit[i].offset)
+			return -FDT_ERR_INTERNAL;
+		used += plan->edit[i].newlen - plan->edit[i].oldlen;
+	}
+
+	return used;
+}
+
+int fdt_batch_size(struct fdt_batch *batch)
+{
+	struct fdt_batch_plan plan;
+	int used;
+
+	used = plan_build(batch, &plan);
+	plan_free(&plan);
+
+	return used;
+}
+
+/*
+ * Apply the edits in place. The gaps between edits move by the sum of the
+ * size changes in front of them. Gaps moving down are moved first, front
+ * to back, then gaps moving up, back to front. Neither can overwrite a gap
+ * which has not moved yet, since the final positions keep their order.
+ */
+static void plan_apply(struct fdt_batch_plan *plan, void *fdt, int end)
+{
+	char *base = fdt;
+	struct fdt_edit *edit;
+	int i, shift, start, len, rsv_delta = 0, struct_delta = 0;
+	int strings_delta = 0;
+
+	for (i = 0, shift = 0; i < plan->count; i++) {
+		edit = &plan->edit[i];
+		shift += edit->newlen - edit->oldlen;
+		start = edit->offset + edit->oldlen;
+		len = (i + 1 < plan->count ? edit[1].offset : end) - start;
+		if (shift < 0 && len)
+			memmove(base + start + shift, base + start, len);
+	}
+	for (i = plan->count - 1; i >= 0; i--) {
+		edit = &plan->edit[i];
+		start = edit->offset + edit->oldlen;
+		len = (i + 1 < plan->count ? edit[1].offset : end) - start;
+		if (shift > 0 && len)
+			memmove(base + start + shift, base + start, len);
+		shift -= edit->newlen - edit->oldlen;
+	}
+
+	for (i = 0, shift = 0; i < plan->count; i++) {
+		edit = &plan->edit[i];
+		memcpy(base + edit->offset + shift, plan->payload + edit->data,
+		       edit->newlen);
+		shift += edit->newlen - edit->oldlen;
+
+		if (edit->offset < fdt_off_dt_struct(fdt))
+			rsv_delta += edit->newlen - edit->oldlen;
+		else if (edit->offset < fdt_off_dt_strings(fdt))
+			struct_delta += edit->newlen - edit->oldlen;
+		else
+			strings_delta += edit->newlen - edit->oldlen;
+	}
+
+	fdt_set_off_dt_struct(fdt, fdt_off_dt_struct(fdt) + rsv_delta);
+	fdt_set_size_dt_struct(fdt, fdt_size_dt_struct(fdt) + struct_delta);
+	fdt_set_off_dt_strings(fdt, fdt_off_dt_strings(fdt) + rsv_delta +
+			       struct_delta);
+	fdt_set_size_dt_strings(fdt, fdt_size_dt_strings(fdt) + strings_delta);
+}
+
+int fdt_batch_commit(struct fdt_batch *batch)
+{
+	struct fdt_batch_plan plan;
+	void *fdt = batch->fdt;
+	int used, end;
+
+	used = plan_build(batch, &plan);
+	end = fdt_off_dt_strings(fdt) + fdt_size_dt_strings(fdt);
+	if (used >= 0 && used > fdt_totalsize(fdt))
+		used = -FDT_ERR_NOSPACE;
+	if (used >= 0) {
+		debug("fdt batch: %d edits, %d -> %d bytes\n", plan.count,
+		      end, used);
+		plan_apply(&plan, fdt, end);
+#ifdef CONFIG_FDT_INDEX
+		fdt_index_invalidate(fdt);
+#endif
+	}
+
+	plan_free(&plan);
+	batch_free(batch);
+
+	return used < 0 ? used : 0;
+}
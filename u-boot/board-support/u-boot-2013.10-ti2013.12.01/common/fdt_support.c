@@ -64,6 +64,7 @@ u32 fdt_getprop_u32_default(const void *fdt, const char *path,
 int fdt_find_and_setprop(void *fdt, const char *node, const char *prop,
 			 const void *val, int len, int create)
 {
+	struct fdt_batch *batch = fdt_batch_get(fdt);
 	int nodeoff = fdt_path_offset(fdt, node);
 
 	if (nodeoff < 0)
@@ -72,9 +73,123 @@ int fdt_find_and_setprop(void *fdt, const char *node, const char *prop,
 	if ((!create) && (fdt_get_property(fdt, nodeoff, prop, NULL) == NULL))
 		return 0; /* create flag not set; so exit quietly */
 
+	if (batch)
+		return fdt_batch_setprop(batch, node, prop, val, len);
+
 	return fdt_setprop(fdt, nodeoff, prop, val, len);
 }
 
+/* Find the node at @path, adding any missing nodes along the way */
+static int fdt_find_or_add_path(void *fdt, const char *path)
+{
+	const char *p, *q;
+	int offset = 0, sub;
+
+	if (*path != '/')
+		return fdt_path_offset(fdt, path);
+
+	for (p = path; *p; p = q) {
+		while (*p == '/')
+			p++;
+		if (!*p)
+			break;
+		q = strchr(p, '/');
+		if (!q)
+			q = p + strlen(p);
+
+		sub = fdt_subnode_offset_namelen(fdt, offset, p, q - p);
+		if (sub == -FDT_ERR_NOTFOUND)
+			sub = fdt_add_subnode_namelen(fdt, offset, p, q - p);
+		if (sub < 0)
+			return sub;
+		offset = sub;
+	}
+
+	return offset;
+}
+
+/**
+ * fdt_fixup_setprop: set a property, creating the node if needed
+ *
+ * @fdt: ptr to device tree
+ * @path: path of node
+ * @prop: property name
+ * @val: ptr to new value
+ * @len: length of new property value
+ *
+ * If a fixup batch is open on @fdt the change is queued, otherwise it is
+ * made straight away.
+ */
+int fdt_fixup_setprop(void *fdt, const char *path, const char *prop,
+		      const void *val, int len)
+{
+	struct fdt_batch *batch = fdt_batch_get(fdt);
+	int nodeoff;
+
+	if (batch)
+		return fdt_batch_setprop(batch, path, prop, val, len);
+
+	nodeoff = fdt_find_or_add_path(fdt, path);
+	if (nodeoff < 0)
+		return nodeoff;
+
+	return fdt_setprop(fdt, nodeoff, prop, val, len);
+}
+
+int fdt_fixup_add_node(void *fdt, const char *path)
+{
+	struct fdt_batch *batch = fdt_batch_get(fdt);
+	int nodeoff;
+
+	if (batch)
+		return fdt_batch_add_node(batch, path);
+
+	nodeoff = fdt_find_or_add_path(fdt, path);
+
+	return nodeoff < 0 ? nodeoff : 0;
+}
+
+/* Check whether a node exists, or will once the open batch is applied */
+int fdt_fixup_node_exists(void *fdt, const char *path)
+{
+	struct fdt_batch *batch = fdt_batch_get(fdt);
+
+	if (batch)
+		return fdt_batch_has_node(batch, path);
+
+	return fdt_path_offset(fdt, path) >= 0;
+}
+
+int fdt_fixup_add_mem_rsv(void *fdt, u64 addr, u64 size)
+{
+	struct fdt_batch *batch = fdt_batch_get(fdt);
+
+	if (batch)
+		return fdt_batch_add_mem_rsv(batch, addr, size);
+
+	return fdt_add_mem_rsv(fdt, addr, size);
+}
+
+/* Delete the first memory reservation starting at @addr, if any */
+int fdt_fixup_del_mem_rsv(void *fdt, u64 addr)
+{
+	struct fdt_batch *batch = fdt_batch_get(fdt);
+	uint64_t rsv_addr, rsv_size;
+	int i, total;
+
+	if (batch)
+		return fdt_batch_del_mem_rsv(batch, addr);
+
+	total = fdt_num_mem_rsv(fdt);
+	for (i = 0; i < total; i++) {
+		if (fdt_get_mem_rsv(fdt, i, &rsv_addr, &rsv_size) == 0 &&
+		    rsv_addr == addr)
+			return fdt_del_mem_rsv(fdt, i);
+	}
+
+	return 0;
+}
+
 #ifdef CONFIG_OF_STDOUT_VIA_ALIAS
 
 #ifdef CONFIG_CONS_INDEX
@@ -91,7 +206,7 @@ static void fdt_fill_multisername(char *sername, size_t maxlen)
 }
 #endif
 
-static int fdt_fixup_stdout(void *fdt, int chosenoff)
+static int fdt_fixup_stdout(void *fdt)
 {
 	int err = 0;
 #ifdef CONFIG_CONS_INDEX
@@ -112,7 +227,7 @@ static int fdt_fixup_stdout(void *fdt, int chosenoff)
 			err = -FDT_ERR_NOSPACE;
 			if (p) {
 				memcpy(p, path, len);
-				err = fdt_setprop(fdt, chosenoff,
+				err = fdt_fixup_setprop(fdt, "/chosen",
 					"linux,stdout-path", p, len);
 				free(p);
 			}
@@ -132,39 +247,28 @@ static int fdt_fixup_stdout(void *fdt, int chosenoff)
 int fdt_initrd(void *fdt, ulong initrd_start, ulong initrd_end, int force)
 {
 	int   nodeoffset;
-	int   err, j, total;
+	int   err;
 	fdt32_t  tmp;
 	const char *path;
-	uint64_t addr, size;
 
 	/* Find the "chosen" node.  */
 	nodeoffset = fdt_path_offset (fdt, "/chosen");
 
-	/* If there is no "chosen" node in the blob return */
-	if (nodeoffset < 0) {
-		printf("fdt_initrd: %s\n", fdt_strerror(nodeoffset));
-		return nodeoffset;
+	/* If there is no "chosen" node in the blob (or batch) return */
+	if (!fdt_fixup_node_exists(fdt, "/chosen")) {
+		printf("fdt_initrd: %s\n", fdt_strerror(-FDT_ERR_NOTFOUND));
+		return -FDT_ERR_NOTFOUND;
 	}
 
 	/* just return if initrd_start/end aren't valid */
 	if ((initrd_start == 0) || (initrd_end == 0))
 		return 0;
 
-	total = fdt_num_mem_rsv(fdt);
-
-	/*
-	 * Look for an existing entry and update it.  If we don't find
-	 * the entry, we will j be the next available slot.
-	 */
-	for (j = 0; j < total; j++) {
-		err = fdt_get_mem_rsv(fdt, j, &addr, &size);
-		if (addr == initrd_start) {
-			fdt_del_mem_rsv(fdt, j);
-			break;
-		}
-	}
+	/* Replace any existing entry for the initrd */
+	fdt_fixup_del_mem_rsv(fdt, initrd_start);
 
-	err = fdt_add_mem_rsv(fdt, initrd_start, initrd_end - initrd_start);
+	err = fdt_fixup_add_mem_rsv(fdt, initrd_start,
+				    initrd_end - initrd_start);
 	if (err < 0) {
 		printf("fdt_initrd: %s\n", fdt_strerror(err));
 		return err;
@@ -173,7 +277,7 @@ int fdt_initrd(void *fdt, ulong initrd_start, ulong initrd_end, int force)
 	path = fdt_getprop(fdt, nodeoffset, "linux,initrd-start", NULL);
 	if ((path == NULL) || force) {
 		tmp = cpu_to_fdt32(initrd_start);
-		err = fdt_setprop(fdt, nodeoffset,
+		err = fdt_fixup_setprop(fdt, "/chosen",
 			"linux,initrd-start", &tmp, sizeof(tmp));
 		if (err < 0) {
 			printf("WARNING: "
@@ -182,7 +286,7 @@ int fdt_initrd(void *fdt, ulong initrd_start, ulong initrd_end, int force)
 			return err;
 		}
 		tmp = cpu_to_fdt32(initrd_end);
-		err = fdt_setprop(fdt, nodeoffset,
+		err = fdt_fixup_setprop(fdt, "/chosen",
 			"linux,initrd-end", &tmp, sizeof(tmp));
 		if (err < 0) {
 			printf("WARNING: could not set linux,initrd-end %s.\n",
@@ -214,18 +318,17 @@ int fdt_chosen(void *fdt, int force)
 	nodeoffset = fdt_path_offset (fdt, "/chosen");
 
 	/*
-	 * If there is no "chosen" node in the blob, create it.
+	 * If there is no "chosen" node in the blob, create it. With a
+	 * fixup batch open it only exists once the batch is applied.
 	 */
 	if (nodeoffset < 0) {
-		/*
-		 * Create a new node "/chosen" (offset 0 is root level)
-		 */
-		nodeoffset = fdt_add_subnode(fdt, 0, "chosen");
-		if (nodeoffset < 0) {
+		err = fdt_fixup_add_node(fdt, "/chosen");
+		if (err < 0) {
 			printf("WARNING: could not create /chosen %s.\n",
-				fdt_strerror(nodeoffset));
-			return nodeoffset;
+				fdt_strerror(err));
+			return err;
 		}
+		nodeoffset = fdt_path_offset(fdt, "/chosen");
 	}
 
 	/*
@@ -237,7 +340,7 @@ int fdt_chosen(void *fdt, int force)
 	if (str != NULL) {
 		path = fdt_getprop(fdt, nodeoffset, "bootargs", NULL);
 		if ((path == NULL) || force) {
-			err = fdt_setprop(fdt, nodeoffset,
+			err = fdt_fixup_setprop(fdt, "/chosen",
 				"bootargs", str, strlen(str)+1);
 			if (err < 0)
 				printf("WARNING: could not set bootargs %s.\n",
@@ -248,13 +351,13 @@ int fdt_chosen(void *fdt, int force)
 #ifdef CONFIG_OF_STDOUT_VIA_ALIAS
 	path = fdt_getprop(fdt, nodeoffset, "linux,stdout-path", NULL);
 	if ((path == NULL) || force)
-		err = fdt_fixup_stdout(fdt, nodeoffset);
+		err = fdt_fixup_stdout(fdt);
 #endif
 
 #ifdef OF_STDOUT_PATH
 	path = fdt_getprop(fdt, nodeoffset, "linux,stdout-path", NULL);
 	if ((path == NULL) || force) {
-		err = fdt_setprop(fdt, nodeoffset,
+		err = fdt_fixup_setprop(fdt, "/chosen",
 			"linux,stdout-path", OF_STDOUT_PATH, strlen(OF_STDOUT_PATH)+1);
 		if (err < 0)
 			printf("WARNING: could not set linux,stdout-path %s.\n",
@@ -378,7 +481,7 @@ static void write_cell(u8 *addr, u64 val, int size)
 #endif
 int fdt_fixup_memory_banks(void *blob, u64 start[], u64 size[], int banks)
 {
-	int err, nodeoffset;
+	int err;
 	int addr_cell_len, size_cell_len, len;
 	u8 tmp[MEMORY_BANKS_MAX * 16]; /* Up to 64-bit address + 64-bit size */
 	int bank;
@@ -397,15 +500,7 @@ int fdt_fixup_memory_banks(void *blob, u64 start[], u64 size[], int banks)
 	}
 
 	/* update, or add and update /memory node */
-	nodeoffset = fdt_path_offset(blob, "/memory");
-	if (nodeoffset < 0) {
-		nodeoffset = fdt_add_subnode(blob, 0, "memory");
-		if (nodeoffset < 0)
-			printf("WARNING: could not create /memory: %s.\n",
-					fdt_strerror(nodeoffset));
-		return nodeoffset;
-	}
-	err = fdt_setprop(blob, nodeoffset, "device_type", "memory",
+	err = fdt_fixup_setprop(blob, "/memory", "device_type", "memory",
 			sizeof("memory"));
 	if (err < 0) {
 		printf("WARNING: could not set %s %s.\n", "device_type",
@@ -424,7 +519,7 @@ int fdt_fixup_memory_banks(void *blob, u64 start[], u64 size[], int banks)
 		len += size_cell_len;
 	}
 
-	err = fdt_setprop(blob, nodeoffset, "reg", tmp, len);
+	err = fdt_fixup_setprop(blob, "/memory", "reg", tmp, len);
 	if (err < 0) {
 		printf("WARNING: could not set %s %s.\n",
 				"reg", fdt_strerror(err));
@@ -488,21 +583,26 @@ void fdt_fixup_ethernet(void *fdt)
 /* Resize the fdt to its actual size + a bit of padding */
 int fdt_resize(void *blob)
 {
-	int i;
-	uint64_t addr, size;
-	int total, ret;
+	struct fdt_batch *batch;
+	int ret, used;
 	uint actualsize;
 
 	if (!blob)
 		return 0;
 
-	total = fdt_num_mem_rsv(blob);
-	for (i = 0; i < total; i++) {
-		fdt_get_mem_rsv(blob, i, &addr, &size);
-		if (addr == (uintptr_t)blob) {
-			fdt_del_mem_rsv(blob, i);
-			break;
-		}
+	fdt_fixup_del_mem_rsv(blob, (uintptr_t)blob);
+
+	/*
+	 * With a batch open, size the blob for the fixups still pending,
+	 * but never below what it currently uses.
+	 */
+	used = fdt_off_dt_strings(blob) + fdt_size_dt_strings(blob);
+	batch = fdt_batch_get(blob);
+	if (batch) {
+		ret = fdt_batch_size(batch);
+		if (ret < 0)
+			return ret;
+		used = max(used, ret);
 	}
 
 	/*
@@ -511,8 +611,7 @@ int fdt_resize(void *blob)
 	 * for the fdt itself and 4 for a possible initrd
 	 * ((initrd-start + initrd-end) * 2 (name & value))
 	 */
-	actualsize = fdt_off_dt_strings(blob) +
-		fdt_size_dt_strings(blob) + 5 * sizeof(struct fdt_reserve_entry);
+	actualsize = used + 5 * sizeof(struct fdt_reserve_entry);
 
 	/* Make it so the fdt ends on a page boundary */
 	actualsize = ALIGN(actualsize + ((uintptr_t)blob & 0xfff), 0x1000);
@@ -522,7 +621,7 @@ int fdt_resize(void *blob)
 	fdt_set_totalsize(blob, actualsize);
 
 	/* Add the new reservation */
-	ret = fdt_add_mem_rsv(blob, (uintptr_t)blob, actualsize);
+	ret = fdt_fixup_add_mem_rsv(blob, (uintptr_t)blob, actualsize);
 	if (ret < 0)
 		return ret;
 
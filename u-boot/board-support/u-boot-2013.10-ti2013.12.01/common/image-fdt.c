@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <image.h>
 #include <libfdt.h>
+#include <trace.h>
 #include <asm/io.h>
 
 #ifndef CONFIG_SYS_FDT_PAD
@@ -89,6 +90,25 @@ void boot_fdt_add_mem_rsv_regions(struct lmb *lmb, void *fdt_blob)
 	}
 }
 
+/*
+ * Check whether the blob can stay where it was loaded: it must be below
+ * @max_addr (the limit a relocated copy would have to respect) and the
+ * padding behind it must not be in use. If so, reserve it there.
+ */
+static int boot_fdt_fits_in_place(struct lmb *lmb, void *fdt_blob,
+				  ulong of_len, ulong max_addr)
+{
+	ulong start = map_to_sysmem(fdt_blob);
+
+	if (start & 7)
+		return 0;
+	if (start < getenv_bootm_low() || start + of_len < start ||
+	    start + of_len > max_addr)
+		return 0;
+
+	return lmb_alloc_addr(lmb, start, of_len) == start;
+}
+
 /**
  * boot_relocate_fdt - relocate flat device tree
  * @lmb: pointer to lmb handle, will be used for memory mgmt
@@ -96,9 +116,10 @@ void boot_fdt_add_mem_rsv_regions(struct lmb *lmb, void *fdt_blob)
  * @of_size: pointer to a ulong variable, will hold fdt length
  *
  * boot_relocate_fdt() allocates a region of memory within the bootmap and
- * relocates the of_flat_tree into that region, even if the fdt is already in
- * the bootmap.  It also expands the size of the fdt by CONFIG_SYS_FDT_PAD
- * bytes.
+ * relocates the of_flat_tree into that region. If the fdt is already in
+ * the bootmap (below fdt_high, if set) and the space after it is free, it
+ * is used in place instead of being copied. It also expands the size of
+ * the fdt by CONFIG_SYS_FDT_PAD bytes.
  *
  * of_flat_tree and of_size are set to final (after relocation) values
  *
@@ -112,6 +133,7 @@ int boot_relocate_fdt(struct lmb *lmb, char **of_flat_tree, ulong *of_size)
 	void	*of_start = NULL;
 	char	*fdt_high;
 	ulong	of_len = 0;
+	ulong	max_addr;
 	int	err;
 	int	disable_relocation = 0;
 
@@ -139,22 +161,39 @@ int boot_relocate_fdt(struct lmb *lmb, char **of_flat_tree, ulong *of_size)
 			lmb_reserve(lmb, (ulong)of_start, of_len);
 			disable_relocation = 1;
 		} else if (desired_addr) {
-			of_start =
-			    (void *)(ulong) lmb_alloc_base(lmb, of_len, 0x1000,
-							   (ulong)desired_addr);
+			max_addr = (ulong)desired_addr;
+			if (boot_fdt_fits_in_place(lmb, fdt_blob, of_len,
+						   max_addr)) {
+				of_start = fdt_blob;
+				disable_relocation = 1;
+			} else {
+				of_start = (void *)(ulong)
+					lmb_alloc_base(lmb, of_len, 0x1000,
+						       max_addr);
+			}
 			if (of_start == NULL) {
 				puts("Failed using fdt_high value for Device Tree");
 				goto error;
 			}
 		} else {
-			of_start =
-			    (void *)(ulong) lmb_alloc(lmb, of_len, 0x1000);
+			if (boot_fdt_fits_in_place(lmb, fdt_blob, of_len,
+						   ~0UL)) {
+				of_start = fdt_blob;
+				disable_relocation = 1;
+			} else {
+				of_start = (void *)(ulong)
+					lmb_alloc(lmb, of_len, 0x1000);
+			}
 		}
 	} else {
-		of_start =
-		    (void *)(ulong) lmb_alloc_base(lmb, of_len, 0x1000,
-						   getenv_bootm_mapsize()
-						   + getenv_bootm_low());
+		max_addr = getenv_bootm_mapsize() + getenv_bootm_low();
+		if (boot_fdt_fits_in_place(lmb, fdt_blob, of_len, max_addr)) {
+			of_start = fdt_blob;
+			disable_relocation = 1;
+		} else {
+			of_start = (void *)(ulong)
+				lmb_alloc_base(lmb, of_len, 0x1000, max_addr);
+		}
 	}
 
 	if (of_start == NULL) {
@@ -233,6 +272,7 @@ int boot_get_fdt(int flag, int argc, char * const argv[], uint8_t arch,
 	int		fdt_noffset;
 #endif
 	const char *select = NULL;
+	int		in_image = 0;
 
 	*of_flat_tree = NULL;
 	*of_size = 0;
@@ -346,6 +386,8 @@ int boot_get_fdt(int flag, int argc, char * const argv[], uint8_t arch,
 #if defined(CONFIG_FIT)
 			/* check FDT blob vs FIT blob */
 			if (fit_check_format(buf)) {
+				const void *data;
+				size_t size;
 				ulong load, len;
 
 				fdt_noffset = fit_image_load(images,
@@ -360,6 +402,13 @@ int boot_get_fdt(int flag, int argc, char * const argv[], uint8_t arch,
 				images->fit_uname_fdt = fit_uname_fdt;
 				images->fit_noffset_fdt = fdt_noffset;
 				fdt_addr = load;
+
+				/* Not copied out: the rest of the FIT follows */
+				if (fdt_noffset >= 0 &&
+				    !fit_image_get_data(buf, fdt_noffset, &data,
+							&size) &&
+				    map_to_sysmem((void *)data) == load)
+					in_image = 1;
 				break;
 			} else
 #endif
@@ -406,6 +455,7 @@ int boot_get_fdt(int flag, int argc, char * const argv[], uint8_t arch,
 				fdt_error("fdt size != image size");
 				goto error;
 			}
+			in_image = 1;
 		} else {
 			debug("## No Flattened Device Tree\n");
 			return 0;
@@ -420,6 +470,18 @@ int boot_get_fdt(int flag, int argc, char * const argv[], uint8_t arch,
 	debug("   of_flat_tree at 0x%08lx size 0x%08lx\n",
 	      (ulong)*of_flat_tree, *of_size);
 
+	/*
+	 * A blob inside a FIT or multi-file image is followed by the rest
+	 * of that image. Reserve the padding space behind it so that
+	 * boot_relocate_fdt() copies the blob instead of growing it there.
+	 */
+#ifdef CONFIG_LMB
+	if (in_image)
+		lmb_reserve(&images->lmb,
+			    map_to_sysmem(fdt_blob) + *of_size,
+			    CONFIG_SYS_FDT_PAD);
+#endif
+
 	return 0;
 
 error:
@@ -455,17 +517,35 @@ int image_setup_libfdt(bootm_headers_t *images, void *blob,
 {
 	ulong *initrd_start = &images->initrd_start;
 	ulong *initrd_end = &images->initrd_end;
+	struct fdt_batch *batch;
 	int ret;
 
+	/*
+	 * Queue the fixups and apply them in one pass at the end. If no
+	 * batch can be opened they are simply applied one by one.
+	 */
+	batch = fdt_batch_begin(blob);
 	if (fdt_chosen(blob, 1) < 0) {
 		puts("ERROR: /chosen node create failed");
 		puts(" - must RESET the board to recover.\n");
-		return -1;
+		ret = -1;
+		goto err;
 	}
 	arch_fixup_memory_node(blob);
-	if (IMAAGE_OF_BOARD_SETUP)
+	if (IMAAGE_OF_BOARD_SETUP) {
+		/* Board code works on the blob directly, so flush first */
+		if (batch) {
+			ret = fdt_batch_commit(batch);
+			if (ret < 0)
+				return ret;
+			batch = fdt_batch_begin(blob);
+		}
 		ft_board_setup(blob, gd->bd);
+	}
 	fdt_fixup_ethernet(blob);
+#ifdef CONFIG_TRACE
+	fdt_fixup_trace(blob);
+#endif
 
 	/* Delete the old LMB reservation */
 	lmb_free(lmb, (phys_addr_t)(u32)(uintptr_t)blob,
@@ -473,7 +553,7 @@ int image_setup_libfdt(bootm_headers_t *images, void *blob,
 
 	ret = fdt_resize(blob);
 	if (ret < 0)
-		return ret;
+		goto err;
 	of_size = ret;
 
 	if (*initrd_start && *initrd_end) {
@@ -484,8 +564,21 @@ int image_setup_libfdt(bootm_headers_t *images, void *blob,
 	lmb_reserve(lmb, (ulong)blob, of_size);
 
 	fdt_initrd(blob, *initrd_start, *initrd_end, 1);
+	if (batch) {
+		ret = fdt_batch_commit(batch);
+		if (ret < 0) {
+			printf("ERROR: device tree fixups failed: %s\n",
+			       fdt_strerror(ret));
+			return ret;
+		}
+	}
 	if (!ft_verify_fdt(blob))
 		return -1;
 
 	return 0;
+
+err:
+	if (batch)
+		fdt_batch_commit(batch);
+	return ret;
 }
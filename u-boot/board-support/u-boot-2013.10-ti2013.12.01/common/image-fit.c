@@ -714,7 +714,8 @@ int fit_image_get_entry(const void *fit, int noffset, ulong *entry)
  *
  * fit_image_get_data() finds data property in a given component image node.
  * If the property is found its data start address and size are returned to
- * the caller.
+ * the caller. For an image with external data, the address is worked out
+ * from the data-offset and data-size properties instead.
  *
  * returns:
  *     0, on success
@@ -723,8 +724,24 @@ int fit_image_get_entry(const void *fit, int noffset, ulong *entry)
 int fit_image_get_data(const void *fit, int noffset,
 		const void **data, size_t *size)
 {
+	int offset;
 	int len;
 
+	if (!fit_image_get_data_offset(fit, noffset, &offset)) {
+		if (fit_image_get_data_size(fit, noffset, &len)) {
+			*data = NULL;
+			*size = 0;
+			return -1;
+		}
+		/*
+		 * The offset is signed: fit_load_external() may have put
+		 * the data below the FIT
+		 */
+		*data = (const char *)fit + fit_get_data_base(fit) + offset;
+		*size = len;
+		return 0;
+	}
+
 	*data = fdt_getprop(fit, noffset, FIT_DATA_PROP, &len);
 	if (*data == NULL) {
 		fit_get_debug(fit, noffset, FIT_DATA_PROP, len);
@@ -736,6 +753,72 @@ int fit_image_get_data(const void *fit, int noffset,
 	return 0;
 }
 
+/**
+ * fit_image_get_data_offset - get data-offset property of an image node
+ * @fit: pointer to the FIT format image header
+ * @noffset: component image node offset
+ * @offset: pointer to int, will hold the offset of the data from
+ *	fit_get_data_base()
+ *
+ * returns:
+ *     0, on success
+ *     -1, if the image has no external data
+ */
+int fit_image_get_data_offset(const void *fit, int noffset, int *offset)
+{
+	const fdt32_t *val;
+
+	val = fdt_getprop(fit, noffset, FIT_DATA_OFFSET_PROP, NULL);
+	if (!val)
+		return -1;
+
+	*offset = fdt32_to_cpu(*val);
+	return 0;
+}
+
+/**
+ * fit_image_get_data_size - get data-size property of an image node
+ * @fit: pointer to the FIT format image header
+ * @noffset: component image node offset
+ * @size: pointer to int, will hold the size of the external data
+ *
+ * returns:
+ *     0, on success
+ *     -1, on failure
+ */
+int fit_image_get_data_size(const void *fit, int noffset, int *size)
+{
+	const fdt32_t *val;
+	int len;
+
+	val = fdt_getprop(fit, noffset, FIT_DATA_SIZE_PROP, &len);
+	if (val == NULL) {
+		fit_get_debug(fit, noffset, FIT_DATA_SIZE_PROP, len);
+		return -1;
+	}
+
+	*size = fdt32_to_cpu(*val);
+	return 0;
+}
+
+int fit_has_external(const void *fit)
+{
+	int images_noffset, noffset, offset;
+
+	images_noffset = fdt_path_offset(fit, FIT_IMAGES_PATH);
+	if (images_noffset < 0)
+		return 0;
+
+	for (noffset = fdt_first_subnode(fit, images_noffset);
+	     noffset >= 0;
+	     noffset = fdt_next_subnode(fit, noffset)) {
+		if (!fit_image_get_data_offset(fit, noffset, &offset))
+			return 1;
+	}
+
+	return 0;
+}
+
 /**
  * fit_image_hash_get_algo - get hash algorithm name
  * @fit: pointer to the FIT format image header
@@ -1646,7 +1729,8 @@ int fit_image_load(bootm_headers_t *images, const char *prop_name, ulong addr,
 		       prop_name, data, load);
 
 		dst = map_sysmem(load, len);
-		memmove(dst, buf, len);
+		if (dst != buf)
+			memmove(dst, buf, len);
 		data = load;
 	}
 	bootstage_mark(bootstage_id + BOOTSTAGE_SUB_LOAD);
@@ -1660,3 +1744,88 @@ int fit_image_load(bootm_headers_t *images, const char *prop_name, ulong addr,
 
 	return noffset;
 }
+
+#ifndef USE_HOSTCC
+/* Room left for U-Boot's stack, which grows down from gd->start_addr_sp */
+#define FIT_STACK_RESERVE	(1 << 20)
+
+int fit_load_external(void *fit, const char *conf_uname, fit_read_fn read,
+		      void *priv)
+{
+	static const char * const props[] = {
+		FIT_KERNEL_PROP, FIT_FDT_PROP, FIT_RAMDISK_PROP
+	};
+	ulong base, fit_start, fit_end, dst, load, low, limit;
+	int cfg_noffset, noffset;
+	int offset, size;
+	int i, ret;
+
+	if (!fit_has_external(fit))
+		return 0;
+
+	cfg_noffset = fit_conf_get_node(fit, conf_uname);
+	if (cfg_noffset < 0) {
+		puts("Could not find configuration node\n");
+		return -ENOENT;
+	}
+
+	base = fit_get_data_base(fit);
+	fit_start = map_to_sysmem(fit);
+	fit_end = fit_start + fit_get_size(fit);
+
+	/*
+	 * Nothing is verified before the data has been read, so where it
+	 * goes must not depend on trusting the FIT: keep it in the RAM
+	 * bootm may use and below U-Boot and its stack.
+	 */
+	low = getenv_bootm_low();
+	limit = gd->start_addr_sp - FIT_STACK_RESERVE;
+
+	for (i = 0; i < ARRAY_SIZE(props); i++) {
+		noffset = fit_conf_get_prop_node(fit, cfg_noffset, props[i]);
+		if (noffset < 0 ||
+		    fit_image_get_data_offset(fit, noffset, &offset))
+			continue;
+		if (fit_image_get_data_size(fit, noffset, &size) || size < 0) {
+			printf("Bad %s data size\n", props[i]);
+			return -EINVAL;
+		}
+		if (offset < 0 || base + offset < base ||
+		    fit_start + base + offset < fit_start) {
+			printf("Bad %s data offset\n", props[i]);
+			return -EINVAL;
+		}
+
+		/* Straight to where it will be used, if it is used as is */
+		dst = fit_start + base + offset;
+		if (fit_image_check_comp(fit, noffset, IH_COMP_NONE) &&
+		    !fit_image_get_load(fit, noffset, &load)) {
+			if (load < fit_end && load + size > fit_start) {
+				printf("Error: %s would overwrite the FIT\n",
+				       props[i]);
+				return -EXDEV;
+			}
+			dst = load;
+		}
+		if (dst < low || dst > limit || size > limit - dst) {
+			printf("Error: %s at 0x%08lx is outside usable RAM\n",
+			       props[i], dst);
+			return -EXDEV;
+		}
+
+		printf("   Reading %s (%d bytes) to 0x%08lx\n", props[i], size,
+		       dst);
+		ret = read(priv, base + offset, size, map_sysmem(dst, size));
+		if (ret) {
+			printf("Error reading %s data\n", props[i]);
+			return ret;
+		}
+
+		offset = dst - fit_start - base;
+		fdt_setprop_inplace_u32(fit, noffset, FIT_DATA_OFFSET_PROP,
+					offset);
+	}
+
+	return 0;
+}
+#endif /* !USE_HOSTCC */
@@ -227,7 +227,9 @@ int fit_image_verify_required_sigs(const void *fit, int image_noffset,
 int fit_config_check_sig(const void *fit, int noffset, int required_keynode,
 			 char **err_msgp)
 {
-	char * const exc_prop[] = {"data"};
+	/* External data is checked by hash, wherever it has been put */
+	char * const exc_prop[] = {FIT_DATA_PROP, FIT_DATA_OFFSET_PROP,
+				   FIT_DATA_SIZE_PROP};
 	const char *prop, *end, *name;
 	struct image_sign_info info;
 	const uint32_t *strings;
@@ -37,6 +37,8 @@
 #include <sha1.h>
 #include <asm/errno.h>
 #include <asm/io.h>
+#include <asm/unaligned.h>
+#include <rle_logo.h>
 
 #ifdef CONFIG_CMD_BDI
 extern int do_bdinfo(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
@@ -666,6 +668,41 @@ int genimg_get_format(const void *img_addr)
 	return format;
 }
 
+/**
+ * genimg_get_image_size - get the size of the image starting at an address
+ * @img_addr: image start address
+ *
+ * genimg_get_image_size() looks at the header of a legacy image, a FIT or
+ * FDT blob, a BMP file or an RLE logo and returns the size the header
+ * declares, so that a loader only needs to read that much. Only the first
+ * 64 bytes of the image have to be present.
+ *
+ * returns:
+ *     image size in bytes, or 0 if the format is not recognized
+ */
+ulong genimg_get_image_size(const void *img_addr)
+{
+	const image_header_t *hdr = img_addr;
+	const uchar *bmp = img_addr;
+	const struct rle_logo_header *logo = img_addr;
+
+	if (image_check_magic(hdr) && image_check_hcrc(hdr))
+		return image_get_image_size(hdr);
+#if defined(CONFIG_FIT) || defined(CONFIG_OF_LIBFDT)
+	if (fdt_check_header(img_addr) == 0)
+		return fdt_totalsize(img_addr);
+#endif
+	/* struct bmp_header: file_size, reserved and data_offset follow "BM" */
+	if (bmp[0] == 'B' && bmp[1] == 'M' &&
+	    get_unaligned_le32(bmp + 6) == 0 &&
+	    get_unaligned_le32(bmp + 10) < get_unaligned_le32(bmp + 2))
+		return get_unaligned_le32(bmp + 2);
+	if (!memcmp(logo->magic, RLE_LOGO_MAGIC, RLE_LOGO_MAGIC_LEN))
+		return sizeof(*logo) + get_unaligned_le32(&logo->data_size);
+
+	return 0;
+}
+
 /**
  * genimg_get_image - get image from special storage (if necessary)
  * @img_addr: image start address
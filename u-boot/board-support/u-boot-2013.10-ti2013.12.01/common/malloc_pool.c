@@ -0,0 +1,151 @@
+/*
+ * Fixed-size object pools on top of malloc()
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <malloc_pool.h>
+
+/* Aim for chunks of about this size, but never fewer than 8 objects */
+#define MALLOC_POOL_CHUNK_SIZE	4096
+#define MALLOC_POOL_MIN_OBJS	8
+
+struct malloc_pool_chunk {
+	struct malloc_pool_chunk *next;
+	/* objects follow, suitably aligned */
+};
+
+#define MALLOC_POOL_CHUNK_HDR	ALIGN(sizeof(struct malloc_pool_chunk), \
+				      sizeof(void *))
+
+static struct malloc_pool *pool_list;
+
+struct malloc_pool *malloc_pool_create(const char *name, unsigned int size)
+{
+	struct malloc_pool *pool;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pool->name = name;
+	/* Each free object holds the free-list link */
+	if (size < sizeof(void *))
+		size = sizeof(void *);
+	pool->obj_size = ALIGN(size, sizeof(void *));
+	pool->per_chunk = (MALLOC_POOL_CHUNK_SIZE - MALLOC_POOL_CHUNK_HDR) /
+			  pool->obj_size;
+	if (pool->per_chunk < MALLOC_POOL_MIN_OBJS)
+		pool->per_chunk = MALLOC_POOL_MIN_OBJS;
+
+	pool->next = pool_list;
+	pool_list = pool;
+
+	return pool;
+}
+
+static int malloc_pool_grow(struct malloc_pool *pool)
+{
+	struct malloc_pool_chunk *chunk;
+	char *obj;
+	int i;
+
+	chunk = malloc(MALLOC_POOL_CHUNK_HDR +
+		       pool->per_chunk * pool->obj_size);
+	if (!chunk)
+		return -1;
+
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+	pool->num_chunks++;
+
+	/* Thread the new objects onto the free list, lowest address first */
+	obj = (char *)chunk + MALLOC_POOL_CHUNK_HDR +
+	      (pool->per_chunk - 1) * pool->obj_size;
+	for (i = 0; i < pool->per_chunk; i++, obj -= pool->obj_size) {
+		*(void **)obj = pool->free_list;
+		pool->free_list = obj;
+	}
+
+	return 0;
+}
+
+void *malloc_pool_alloc(struct malloc_pool *pool)
+{
+	void *obj;
+
+	if (!pool->free_list && malloc_pool_grow(pool))
+		return NULL;
+
+	obj = pool->free_list;
+	pool->free_list = *(void **)obj;
+
+	pool->allocs++;
+	if (++pool->in_use > pool->peak)
+		pool->peak = pool->in_use;
+
+	return obj;
+}
+
+void malloc_pool_free(struct malloc_pool *pool, void *ptr)
+{
+	if (!ptr)
+		return;
+
+	*(void **)ptr = pool->free_list;
+	pool->free_list = ptr;
+	pool->in_use--;
+}
+
+void malloc_pool_reset(struct malloc_pool *pool)
+{
+	struct malloc_pool_chunk *chunk, *next;
+
+	for (chunk = pool->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	pool->chunks = NULL;
+	pool->num_chunks = 0;
+	pool->free_list = NULL;
+	pool->in_use = 0;
+}
+
+void malloc_pool_destroy(struct malloc_pool *pool)
+{
+	struct malloc_pool **pp;
+
+	if (!pool)
+		return;
+
+	malloc_pool_reset(pool);
+	for (pp = &pool_list; *pp; pp = &(*pp)->next) {
+		if (*pp == pool) {
+			*pp = pool->next;
+			break;
+		}
+	}
+	free(pool);
+}
+
+void malloc_pool_stats(void)
+{
+	struct malloc_pool *pool;
+
+	if (!pool_list) {
+		puts("No object pools\n");
+		return;
+	}
+
+	printf("%-20s %6s %8s %8s %8s %6s %9s\n", "pool", "size", "allocs",
+	       "in use", "peak", "chunks", "bytes");
+	for (pool = pool_list; pool; pool = pool->next) {
+		printf("%-20s %6u %8lu %8lu %8lu %6u %9lu\n", pool->name,
+		       pool->obj_size, pool->allocs, pool->in_use, pool->peak,
+		       pool->num_chunks, (ulong)pool->num_chunks *
+		       (MALLOC_POOL_CHUNK_HDR +
+			pool->per_chunk * pool->obj_size));
+	}
+}
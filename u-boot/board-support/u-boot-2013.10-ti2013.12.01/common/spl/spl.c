@@ -15,6 +15,8 @@
 #include <i2c.h>
 #include <image.h>
 #include <malloc.h>
+#include <net.h>
+#include <spl_cache.h>
 #include <linux/compiler.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -150,9 +152,20 @@ void board_init_r(gd_t *dummy1, ulong dummy2)
 #ifdef CONFIG_SPL_BOARD_INIT
 	spl_board_init();
 #endif
+	bootstage_mark_name(BOOTSTAGE_ID_START_SPL, "spl");
+
+#ifdef CONFIG_SPL_CACHE_SUPPORT
+	spl_enable_caches();
+#endif
+
+#ifdef CONFIG_SPL_NET_LEASE_ADDR
+	/* Only a lease from this boot may reach U-Boot proper */
+	((struct net_lease *)CONFIG_SPL_NET_LEASE_ADDR)->magic = 0;
+#endif
 
 	boot_device = spl_boot_device();
 	debug("boot device - %d\n", boot_device);
+	bootstage_mark_name(BOOTSTAGE_ID_SPL_LOAD_START, "spl_load_image");
 	switch (boot_device) {
 #ifdef CONFIG_SPL_RAM_DEVICE
 	case BOOT_DEVICE_RAM:
@@ -214,6 +227,17 @@ void board_init_r(gd_t *dummy1, ulong dummy2)
 		debug("SPL: Un-supported Boot Device\n");
 		hang();
 	}
+	bootstage_mark_name(BOOTSTAGE_ID_SPL_LOAD_DONE, dcache_status() ?
+			    "spl_load_done (cached)" : "spl_load_done");
+
+#ifdef CONFIG_SPL_CACHE_SUPPORT
+	/* Everything we loaded must be in DDR before the caches go away */
+	spl_disable_caches();
+#endif
+#ifdef CONFIG_BOOTSTAGE_STASH
+	bootstage_stash((void *)CONFIG_BOOTSTAGE_STASH,
+			CONFIG_BOOTSTAGE_STASH_SIZE);
+#endif
 
 	switch (spl_image.os) {
 	case IH_OS_U_BOOT:
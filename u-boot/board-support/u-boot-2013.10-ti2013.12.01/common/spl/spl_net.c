@@ -33,5 +33,8 @@ void spl_net_load_image(const char *device)
 		printf("Problem booting with BOOTP\n");
 		hang();
 	}
+#ifdef CONFIG_SPL_NET_LEASE_ADDR
+	net_save_lease();
+#endif
 	spl_parse_image_header((struct image_header *)load_addr);
 }
@@ -131,7 +131,10 @@ struct us_data {
 	trans_cmnd	transport;		/* transport routine */
 };
 
-#ifdef CONFIG_USB_EHCI
+#if defined(CONFIG_USB_MAX_XFER_BLK)
+/* The board knows what its host controller can move in one transfer */
+#define USB_MAX_XFER_BLK	CONFIG_USB_MAX_XFER_BLK
+#elif defined(CONFIG_USB_EHCI)
 /*
  * The U-Boot EHCI driver can handle any transfer length as long as there is
  * enough free heap space left, but the SCSI READ(10) and WRITE(10) commands are
@@ -144,6 +147,18 @@ struct us_data {
 
 static struct us_data usb_stor[USB_MAX_STOR_DEV];
 
+/*
+ * What we learned about each LUN while scanning, so that a block transfer
+ * does not have to look the device up again or fall back to the smallest
+ * transfer size every controller can handle.
+ */
+struct usb_stor_lun {
+	struct us_data *ss;		/* transport of the LUN */
+	unsigned short max_xfer_blk;	/* blocks per READ(10)/WRITE(10) */
+};
+
+static struct usb_stor_lun usb_lun[USB_MAX_STOR_DEV];
+
 
 #define USB_STOR_TRANSPORT_GOOD	   0
 #define USB_STOR_TRANSPORT_FAILED -1
@@ -232,6 +247,7 @@ int usb_stor_scan(int mode)
 		usb_dev_desc[i].block_read = usb_stor_read;
 		usb_dev_desc[i].block_write = usb_stor_write;
 	}
+	memset(usb_lun, '\0', sizeof(usb_lun));
 
 	usb_max_devs = 0;
 	for (i = 0; i < USB_MAX_DEVICE; i++) {
@@ -979,6 +995,39 @@ static int usb_read_capacity(ccb *srb, struct us_data *ss)
 	return -1;
 }
 
+/*
+ * Ask the LUN for the largest transfer it accepts, from its Block Limits VPD
+ * page. Returns the limit in blocks, or 0 if the device sets none or does not
+ * have the page.
+ */
+static unsigned long usb_max_transfer(ccb *srb, struct us_data *ss)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, vpd, 64);
+	unsigned char *pdata = srb->pdata;
+	unsigned long max = 0;
+
+	memset(vpd, 0, 64);
+	memset(&srb->cmd[0], 0, 12);
+	srb->cmd[0] = SCSI_INQUIRY;
+	srb->cmd[1] = (srb->lun << 5) | 1;	/* EVPD */
+	srb->cmd[2] = 0xb0;			/* Block Limits */
+	srb->cmd[4] = 64;
+	srb->datalen = 64;
+	srb->cmdlen = 12;
+	srb->pdata = vpd;
+	if (ss->transport(srb, ss) == USB_STOR_TRANSPORT_GOOD) {
+		if (vpd[1] == 0xb0 && vpd[3] >= 0x0c)
+			max = (vpd[8] << 24) | (vpd[9] << 16) |
+			      (vpd[10] << 8) | vpd[11];
+	} else {
+		usb_request_sense(srb, ss);
+	}
+	srb->pdata = pdata;
+	debug("Block Limits: max transfer %lu blocks\n", max);
+
+	return max;
+}
+
 static int usb_read_10(ccb *srb, struct us_data *ss, unsigned long start,
 		       unsigned short blocks)
 {
@@ -1042,10 +1091,9 @@ unsigned long usb_stor_read(int device, lbaint_t blknr,
 {
 	lbaint_t start, blks;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
-	struct usb_device *dev;
+	unsigned short smallblks, max_blks;
 	struct us_data *ss;
-	int retry, i;
+	int retry;
 	ccb *srb = &usb_ccb;
 
 	if (blkcnt == 0)
@@ -1054,15 +1102,10 @@ unsigned long usb_stor_read(int device, lbaint_t blknr,
 	device &= 0xff;
 	/* Setup  device */
 	debug("\nusb_read: dev %d \n", device);
-	dev = NULL;
-	for (i = 0; i < USB_MAX_DEVICE; i++) {
-		dev = usb_get_dev_index(i);
-		if (dev == NULL)
-			return 0;
-		if (dev->devnum == usb_dev_desc[device].target)
-			break;
-	}
-	ss = (struct us_data *)dev->privptr;
+	if (device >= USB_MAX_STOR_DEV || !usb_lun[device].ss)
+		return 0;
+	ss = usb_lun[device].ss;
+	max_blks = usb_lun[device].max_xfer_blk;
 
 	usb_disable_asynch(1); /* asynch transfer not allowed */
 	srb->lun = usb_dev_desc[device].lun;
@@ -1077,12 +1120,12 @@ unsigned long usb_stor_read(int device, lbaint_t blknr,
 		/* XXX need some comment here */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (blks > USB_MAX_XFER_BLK)
-			smallblks = USB_MAX_XFER_BLK;
+		if (blks > max_blks)
+			smallblks = max_blks;
 		else
 			smallblks = (unsigned short) blks;
 retry_it:
-		if (smallblks == USB_MAX_XFER_BLK)
+		if (smallblks == max_blks)
 			usb_show_progress();
 		srb->datalen = usb_dev_desc[device].blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1094,6 +1137,8 @@ retry_it:
 			blkcnt -= blks;
 			break;
 		}
+		/* The device is up, so the next command can follow at once */
+		ss->flags |= USB_READY;
 		start += smallblks;
 		blks -= smallblks;
 		buf_addr += srb->datalen;
@@ -1105,7 +1150,7 @@ retry_it:
 	      start, smallblks, buf_addr);
 
 	usb_disable_asynch(0); /* asynch transfer allowed */
-	if (blkcnt >= USB_MAX_XFER_BLK)
+	if (blkcnt >= max_blks)
 		debug("\n");
 	return blkcnt;
 }
@@ -1115,10 +1160,9 @@ unsigned long usb_stor_write(int device, lbaint_t blknr,
 {
 	lbaint_t start, blks;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
-	struct usb_device *dev;
+	unsigned short smallblks, max_blks;
 	struct us_data *ss;
-	int retry, i;
+	int retry;
 	ccb *srb = &usb_ccb;
 
 	if (blkcnt == 0)
@@ -1127,15 +1171,10 @@ unsigned long usb_stor_write(int device, lbaint_t blknr,
 	device &= 0xff;
 	/* Setup  device */
 	debug("\nusb_write: dev %d \n", device);
-	dev = NULL;
-	for (i = 0; i < USB_MAX_DEVICE; i++) {
-		dev = usb_get_dev_index(i);
-		if (dev == NULL)
-			return 0;
-		if (dev->devnum == usb_dev_desc[device].target)
-			break;
-	}
-	ss = (struct us_data *)dev->privptr;
+	if (device >= USB_MAX_STOR_DEV || !usb_lun[device].ss)
+		return 0;
+	ss = usb_lun[device].ss;
+	max_blks = usb_lun[device].max_xfer_blk;
 
 	usb_disable_asynch(1); /* asynch transfer not allowed */
 
@@ -1153,12 +1192,12 @@ unsigned long usb_stor_write(int device, lbaint_t blknr,
 		 */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (blks > USB_MAX_XFER_BLK)
-			smallblks = USB_MAX_XFER_BLK;
+		if (blks > max_blks)
+			smallblks = max_blks;
 		else
 			smallblks = (unsigned short) blks;
 retry_it:
-		if (smallblks == USB_MAX_XFER_BLK)
+		if (smallblks == max_blks)
 			usb_show_progress();
 		srb->datalen = usb_dev_desc[device].blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1170,6 +1209,8 @@ retry_it:
 			blkcnt -= blks;
 			break;
 		}
+		/* The device is up, so the next command can follow at once */
+		ss->flags |= USB_READY;
 		start += smallblks;
 		blks -= smallblks;
 		buf_addr += srb->datalen;
@@ -1180,7 +1221,7 @@ retry_it:
 	      start, smallblks, buf_addr);
 
 	usb_disable_asynch(0); /* asynch transfer allowed */
-	if (blkcnt >= USB_MAX_XFER_BLK)
+	if (blkcnt >= max_blks)
 		debug("\n");
 	return blkcnt;
 
@@ -1335,9 +1376,14 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 	unsigned char perq, modi;
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned long, cap, 2);
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, usb_stor_buf, 36);
-	unsigned long *capacity, *blksz;
+	unsigned long *capacity, *blksz, max;
+	struct usb_stor_lun *lun;
 	ccb *pccb = &usb_ccb;
 
+	lun = &usb_lun[dev_desc - usb_dev_desc];
+	lun->ss = ss;
+	lun->max_xfer_blk = USB_MAX_XFER_BLK;
+
 	pccb->pdata = usb_stor_buf;
 
 	dev_desc->target = dev->devnum;
@@ -1388,6 +1434,15 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 		cap[0] = 2880;
 		cap[1] = 0x200;
 	}
+	/*
+	 * Only devices claiming SPC-3 or later are asked for their limits, as
+	 * older bridges are known to choke on VPD requests.
+	 */
+	if ((usb_stor_buf[2] & 7) >= 5) {
+		max = usb_max_transfer(pccb, ss);
+		if (max && max < lun->max_xfer_blk)
+			lun->max_xfer_blk = max;
+	}
 	ss->flags &= ~USB_READY;
 	debug("Read Capacity returns: 0x%lx, 0x%lx\n", cap[0], cap[1]);
 #if 0
@@ -287,7 +287,27 @@ BCURDIR = $(subst $(SRCTREE)/,,$(CURDIR:$(obj)%=%))
 ifeq ($(findstring examples/,$(BCURDIR)),)
 ifeq ($(CONFIG_SPL_BUILD),)
 ifdef FTRACE
-CFLAGS += -finstrument-functions -DFTRACE
+ifeq ($(FTRACE),sample)
+# PC sampling only, no instrumentation
+CFLAGS += -DFTRACE_SAMPLE
+else
+# FTRACE_DIRS limits instrumentation to some directories, e.g. "drivers/mtd"
+ifeq ($(FTRACE_DIRS),)
+FTRACE_THIS_DIR := y
+else
+FTRACE_THIS_DIR := $(filter $(addsuffix %,$(FTRACE_DIRS)),$(BCURDIR))
+endif
+ifneq ($(FTRACE_THIS_DIR),)
+CFLAGS += -finstrument-functions
+ifdef FTRACE_EXCLUDE_FUNCS
+CFLAGS += -finstrument-functions-exclude-function-list=$(FTRACE_EXCLUDE_FUNCS)
+endif
+ifdef FTRACE_EXCLUDE_FILES
+CFLAGS += -finstrument-functions-exclude-file-list=$(FTRACE_EXCLUDE_FILES)
+endif
+endif
+CFLAGS += -DFTRACE
+endif
 endif
 endif
 endif
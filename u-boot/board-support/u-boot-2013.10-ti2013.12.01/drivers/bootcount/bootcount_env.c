@@ -0,0 +1,31 @@
+/*
+ * Boot counter kept in the environment
+ *
+ * The count is only kept while "upgrade_available" is set, i.e. while a
+ * newly installed system boots on trial. The environment is then written
+ * once per boot, and not at all once the new system has confirmed that
+ * it came up by clearing "upgrade_available". Unlike a counter in RAM or
+ * RTC scratch registers, it also survives the power being cut.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <environment.h>
+
+void bootcount_store(ulong a)
+{
+	if (!getenv_ulong("upgrade_available", 10, 0))
+		return;
+
+	setenv_ulong("bootcount", a);
+	saveenv();
+}
+
+ulong bootcount_load(void)
+{
+	if (!getenv_ulong("upgrade_available", 10, 0))
+		return 0;
+
+	return getenv_ulong("bootcount", 10, 0);
+}
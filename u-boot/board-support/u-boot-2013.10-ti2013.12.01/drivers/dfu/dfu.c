@@ -93,32 +93,140 @@ unsigned char *dfu_get_buf(void)
 	return dfu_buf;
 }
 
-static int dfu_write_buffer_drain(struct dfu_entity *dfu)
+/*
+ * Writes are pipelined: the data buffer is split in CONFIG_SYS_DFU_NUM_BUFS
+ * parts and while one is being filled from USB the others wait for, or are
+ * being written to, the medium. The writing is done a slice at a time from
+ * dfu_flush_poll() so that the USB side keeps being serviced.
+ */
+struct dfu_pending {
+	u8 *start;
+	long len;
+	long done;
+	u64 offset;
+};
+
+static struct dfu_pending dfu_pending[CONFIG_SYS_DFU_NUM_BUFS];
+static int dfu_pending_head, dfu_pending_count;
+static struct dfu_entity *dfu_writer;
+static unsigned long dfu_part_size;
+static int dfu_write_err;
+
+/* Fill the part that comes after the ones waiting to be written */
+static void dfu_next_fill(struct dfu_entity *dfu)
+{
+	int part = (dfu_pending_head + dfu_pending_count) %
+			CONFIG_SYS_DFU_NUM_BUFS;
+
+	dfu->i_buf_start = dfu_buf + part * dfu_part_size;
+	dfu->i_buf_end = dfu->i_buf_start + dfu_part_size;
+	dfu->i_buf = dfu->i_buf_start;
+}
+
+static void dfu_queue(struct dfu_entity *dfu, u8 *start, long len)
+{
+	struct dfu_pending *p;
+
+	p = &dfu_pending[(dfu_pending_head + dfu_pending_count) %
+			 CONFIG_SYS_DFU_NUM_BUFS];
+	p->start = start;
+	p->len = len;
+	p->done = 0;
+	p->offset = dfu->offset;
+	dfu_pending_count++;
+
+	/* update CRC32 */
+	dfu->crc = crc32(dfu->crc, start, len);
+
+	/* the next data goes after this */
+	dfu->offset += len;
+}
+
+/* Write one slice of the oldest pending buffer */
+static int dfu_flush_step(struct dfu_entity *dfu)
 {
+	struct dfu_pending *p = &dfu_pending[dfu_pending_head];
 	long w_size;
 	int ret;
 
+	w_size = min(p->len - p->done, (long)CONFIG_SYS_DFU_WRITE_SLICE);
+	ret = dfu->write_medium(dfu, p->offset + p->done, p->start + p->done,
+				&w_size);
+	if (ret) {
+		debug("%s: Write error!\n", __func__);
+		dfu_write_err = ret;
+		/* give the buffer up, the transfer has failed anyway */
+		w_size = p->len - p->done;
+	}
+
+	p->done += w_size;
+	if (p->done >= p->len) {
+		dfu_pending_head = (dfu_pending_head + 1) %
+				CONFIG_SYS_DFU_NUM_BUFS;
+		dfu_pending_count--;
+		puts("#");
+	}
+
+	return ret;
+}
+
+static int dfu_flush_all(struct dfu_entity *dfu)
+{
+	while (dfu_pending_count)
+		dfu_flush_step(dfu);
+
+	return dfu_write_err;
+}
+
+int dfu_flush_poll(void)
+{
+	struct dfu_entity *dfu = dfu_writer;
+	int ret;
+
+	if (!dfu)
+		return 0;
+
+	if (dfu_pending_count) {
+		ret = dfu_flush_step(dfu);
+		return ret ? ret : 1;
+	}
+
+	/* Nothing to write: get the medium ready for what has come in */
+	if (dfu->prepare_medium && dfu->i_buf > dfu->i_buf_start) {
+		ret = dfu->prepare_medium(dfu, dfu->offset,
+					  dfu->i_buf - dfu->i_buf_start);
+		if (ret < 0)
+			dfu_write_err = ret;
+		return ret;
+	}
+
+	return 0;
+}
+
+static int dfu_write_buffer_drain(struct dfu_entity *dfu)
+{
+	long w_size;
+
 	/* flush size? */
 	w_size = dfu->i_buf - dfu->i_buf_start;
 	if (w_size == 0)
 		return 0;
 
-	/* update CRC32 */
-	dfu->crc = crc32(dfu->crc, dfu->i_buf_start, w_size);
-
-	ret = dfu->write_medium(dfu, dfu->offset, dfu->i_buf_start, &w_size);
-	if (ret)
-		debug("%s: Write error!\n", __func__);
+	dfu_queue(dfu, dfu->i_buf_start, w_size);
 
-	/* point back */
-	dfu->i_buf = dfu->i_buf_start;
+	/* all parts in use, so wait for the oldest one */
+	while (dfu_pending_count == CONFIG_SYS_DFU_NUM_BUFS)
+		dfu_flush_step(dfu);
 
-	/* update offset */
-	dfu->offset += w_size;
+	dfu_next_fill(dfu);
 
-	puts("#");
+	return dfu_write_err;
+}
 
-	return ret;
+/* thor receives straight into the data buffer */
+static bool dfu_in_buf(void *buf)
+{
+	return (u8 *)buf >= dfu_buf && (u8 *)buf < dfu_buf + dfu_buf_size;
 }
 
 int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
@@ -135,12 +243,19 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		dfu->crc = 0;
 		dfu->offset = 0;
 		dfu->bad_skip = 0;
+		dfu->erased = 0;
+		dfu->erase_skip = 0;
 		dfu->i_blk_seq_num = 0;
-		dfu->i_buf_start = dfu_get_buf();
-		if (dfu->i_buf_start == NULL)
+		if (dfu_get_buf() == NULL)
 			return -ENOMEM;
-		dfu->i_buf_end = dfu_get_buf() + dfu_buf_size;
-		dfu->i_buf = dfu->i_buf_start;
+
+		dfu_part_size = dfu_buf_size / CONFIG_SYS_DFU_NUM_BUFS;
+		dfu_part_size &= ~(CONFIG_SYS_CACHELINE_SIZE - 1);
+		dfu_pending_head = 0;
+		dfu_pending_count = 0;
+		dfu_write_err = 0;
+		dfu_writer = dfu;
+		dfu_next_fill(dfu);
 
 		dfu->inited = 1;
 	}
@@ -167,6 +282,22 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 	/* handle rollover */
 	dfu->i_blk_seq_num = (dfu->i_blk_seq_num + 1) & 0xffff;
 
+	/* a background write failed */
+	ret = dfu_write_err;
+
+	if (size && dfu_in_buf(buf)) {
+		/* write it where it is, after everything before it */
+		dfu_write_buffer_drain(dfu);
+		dfu_flush_all(dfu);
+		dfu_queue(dfu, buf, size);
+		tret = dfu_flush_all(dfu);
+		if (ret == 0)
+			ret = tret;
+		dfu_next_fill(dfu);
+
+		return ret;
+	}
+
 	/* flush buffer if overflow */
 	if ((dfu->i_buf + size) > dfu->i_buf_end) {
 		tret = dfu_write_buffer_drain(dfu);
@@ -193,9 +324,16 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 
 	/* end? */
 	if (size == 0) {
+		tret = dfu_flush_all(dfu);
+		if (ret == 0)
+			ret = tret;
+
 		/* Now try and flush to the medium if needed. */
-		if (dfu->flush_medium)
-			ret = dfu->flush_medium(dfu);
+		if (dfu->flush_medium) {
+			tret = dfu->flush_medium(dfu);
+			if (ret == 0)
+				ret = tret;
+		}
 		printf("\nDFU complete CRC32: 0x%08x\n", dfu->crc);
 
 		/* clear everything */
@@ -206,6 +344,7 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		dfu->i_buf_start = dfu_buf;
 		dfu->i_buf_end = dfu_buf;
 		dfu->i_buf = dfu->i_buf_start;
+		dfu_writer = NULL;
 
 		dfu->inited = 0;
 
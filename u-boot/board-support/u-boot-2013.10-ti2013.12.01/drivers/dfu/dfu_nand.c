@@ -19,6 +19,44 @@
 #include <jffs2/load_kernel.h>
 #include <nand.h>
 
+/*
+ * Erase the good blocks of the area until the first end bytes of data
+ * have somewhere to go, at most max_blocks of them (0 for no limit).
+ * Blocks are only erased once data is on its way to them and bad blocks
+ * are skipped the same way nand_write_skip_bad() skips them.
+ */
+static int nand_erase_ahead(struct dfu_entity *dfu, nand_info_t *nand,
+			    u64 end, int max_blocks)
+{
+	loff_t block, lim;
+	int n = 0;
+	int ret;
+
+	lim = dfu->data.nand.start + dfu->data.nand.size;
+	while (dfu->erased < end && (!max_blocks || n < max_blocks)) {
+		block = dfu->data.nand.start + dfu->erased + dfu->erase_skip;
+		if (block >= lim) {
+			printf("%s: no room left at %llx\n", __func__, block);
+			return -ENOSPC;
+		}
+
+		if (nand_block_isbad(nand, block)) {
+			dfu->erase_skip += nand->erasesize;
+			continue;
+		}
+
+		ret = nand_erase(nand, block, nand->erasesize);
+		if (ret) {
+			printf("%s: erase failed at %llx\n", __func__, block);
+			return ret;
+		}
+		dfu->erased += nand->erasesize;
+		n++;
+	}
+
+	return n;
+}
+
 static int nand_block_op(enum dfu_op op, struct dfu_entity *dfu,
 			u64 offset, void *buf, long *len)
 {
@@ -50,17 +88,9 @@ static int nand_block_op(enum dfu_op op, struct dfu_entity *dfu,
 		ret = nand_read_skip_bad(nand, start, &count, &actual,
 				lim, buf);
 	} else {
-		nand_erase_options_t opts;
-
-		memset(&opts, 0, sizeof(opts));
-		opts.offset = start;
-		opts.length = count;
-		opts.spread = 1;
-		opts.quiet = 1;
-		opts.lim = lim;
-		/* first erase */
-		ret = nand_erase_opts(nand, &opts);
-		if (ret)
+		/* first erase, unless that was done ahead */
+		ret = nand_erase_ahead(dfu, nand, offset + count, 0);
+		if (ret < 0)
 			return ret;
 		/* then write */
 		ret = nand_write_skip_bad(nand, start, &count, &actual,
@@ -131,6 +161,19 @@ static int dfu_read_medium_nand(struct dfu_entity *dfu, u64 offset, void *buf,
 	return ret;
 }
 
+static int dfu_prepare_medium_nand(struct dfu_entity *dfu, u64 offset,
+		long len)
+{
+	if (nand_curr_device < 0 ||
+	    nand_curr_device >= CONFIG_SYS_MAX_NAND_DEVICE ||
+	    !nand_info[nand_curr_device].name)
+		return -ENODEV;
+
+	/* One block at a time, so that USB is serviced in between */
+	return nand_erase_ahead(dfu, &nand_info[nand_curr_device],
+				offset + len, 1);
+}
+
 static int dfu_flush_medium_nand(struct dfu_entity *dfu)
 {
 	int ret = 0;
@@ -149,12 +192,14 @@ static int dfu_flush_medium_nand(struct dfu_entity *dfu)
 
 		nand = &nand_info[nand_curr_device];
 
+		/* everything up to here was erased ahead of the data */
 		memset(&opts, 0, sizeof(opts));
-		opts.offset = dfu->data.nand.start + dfu->offset +
-				dfu->bad_skip;
+		opts.offset = dfu->data.nand.start + dfu->erased +
+				dfu->erase_skip;
 		opts.length = dfu->data.nand.start +
 				dfu->data.nand.size - opts.offset;
-		ret = nand_erase_opts(nand, &opts);
+		if (opts.offset < dfu->data.nand.start + dfu->data.nand.size)
+			ret = nand_erase_opts(nand, &opts);
 		if (ret != 0)
 			printf("Failure erase: %d\n", ret);
 	}
@@ -210,6 +255,7 @@ int dfu_fill_entity_nand(struct dfu_entity *dfu, char *s)
 	dfu->read_medium = dfu_read_medium_nand;
 	dfu->write_medium = dfu_write_medium_nand;
 	dfu->flush_medium = dfu_flush_medium_nand;
+	dfu->prepare_medium = dfu_prepare_medium_nand;
 
 	/* initial state */
 	dfu->inited = 0;
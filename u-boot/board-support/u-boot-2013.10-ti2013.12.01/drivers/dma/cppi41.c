@@ -0,0 +1,300 @@
+/*
+ * TI CPPI 4.1 DMA engine and queue manager
+ *
+ * Only what the AM335x USB subsystem needs: one descriptor region with
+ * the linking RAM in DDR, host packet descriptors with a single buffer
+ * and a fixed queue for every channel.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <cppi41.h>
+#include <errno.h>
+#include <malloc.h>
+#include <asm/io.h>
+
+#ifdef CONFIG_SANDBOX_CPPI41
+#include <asm/cppi41.h>
+
+#define cppi_readl(addr)	sandbox_cppi41_readl(addr)
+#define cppi_writel(val, addr)	sandbox_cppi41_writel(val, addr)
+#else
+#define cppi_readl(addr)	readl(addr)
+#define cppi_writel(val, addr)	writel(val, addr)
+#endif
+
+/* Size hint pushed along with each descriptor */
+#define DESC_SIZE_HINT		((CPPI41_DESC_SIZE - 24) / 4)
+
+static void desc_flush(struct cppi41_desc *desc)
+{
+	unsigned long start = (unsigned long)desc;
+
+	flush_dcache_range(start, start + CPPI41_DESC_SIZE);
+}
+
+static void desc_invalidate(struct cppi41_desc *desc)
+{
+	unsigned long start = (unsigned long)desc;
+
+	invalidate_dcache_range(start, start + CPPI41_DESC_SIZE);
+}
+
+static void queue_push(struct cppi41 *cppi, int q, struct cppi41_desc *desc)
+{
+	u32 addr = map_to_sysmem(desc);
+
+	desc_flush(desc);
+	cppi_writel(addr | DESC_SIZE_HINT, cppi->qmgr + CPPI41_QMGR_QUEUE_D(q));
+}
+
+static struct cppi41_desc *queue_pop(struct cppi41 *cppi, int q)
+{
+	struct cppi41_desc *desc;
+	u32 addr;
+
+	addr = cppi_readl(cppi->qmgr + CPPI41_QMGR_QUEUE_D(q));
+	addr &= ~CPPI41_QUEUE_DESC_MASK;
+	if (!addr)
+		return NULL;
+
+	desc = map_sysmem(addr, CPPI41_DESC_SIZE);
+	desc_invalidate(desc);
+
+	return desc;
+}
+
+static void chan_enable(struct cppi41_chan *chan)
+{
+	struct cppi41 *cppi = chan->cppi;
+	u32 fdq = chan->submit_q | chan->submit_q << 16;
+
+	if (chan->is_tx) {
+		cppi_writel(CPPI41_GCR_CHAN_ENABLE,
+			    cppi->ctrl + CPPI41_DMA_TXGCR(chan->num));
+	} else {
+		/* Every buffer of a packet comes from the channel's free queue */
+		cppi_writel(fdq, cppi->ctrl + CPPI41_DMA_RXHPCRA(chan->num));
+		cppi_writel(fdq, cppi->ctrl + CPPI41_DMA_RXHPCRB(chan->num));
+		cppi_writel(CPPI41_GCR_CHAN_ENABLE | CPPI41_GCR_STARV_RETRY |
+			    CPPI41_GCR_DESC_TYPE_HOST | chan->complete_q,
+			    cppi->ctrl + CPPI41_DMA_RXGCR(chan->num));
+	}
+	chan->enabled = 1;
+}
+
+static void chan_init(struct cppi41 *cppi, struct cppi41_chan *chan, int num,
+		      int is_tx, struct cppi41_desc *desc)
+{
+	chan->cppi = cppi;
+	chan->num = num;
+	chan->is_tx = is_tx;
+	chan->desc = desc;
+	if (is_tx) {
+		chan->submit_q = CPPI41_TX_SUBMIT_Q(num);
+		chan->complete_q = CPPI41_TX_COMPLETE_Q(num);
+	} else {
+		chan->submit_q = CPPI41_RX_SUBMIT_Q(num);
+		chan->complete_q = CPPI41_RX_COMPLETE_Q(num);
+	}
+	chan_enable(chan);
+}
+
+struct cppi41 *cppi41_init(void *ctrl, void *sched, void *qmgr)
+{
+	struct cppi41 *cppi;
+	unsigned long start;
+	u32 val;
+	int i;
+
+	cppi = calloc(1, sizeof(*cppi));
+	if (!cppi)
+		return NULL;
+	cppi->ctrl = ctrl;
+	cppi->sched = sched;
+	cppi->qmgr = qmgr;
+
+	cppi->descs = memalign(CPPI41_DESC_SIZE,
+			       CPPI41_NUM_DESCS * CPPI41_DESC_SIZE);
+	cppi->linkram = memalign(ARCH_DMA_MINALIGN,
+				 CPPI41_NUM_DESCS * sizeof(u32));
+	if (!cppi->descs || !cppi->linkram) {
+		free(cppi->descs);
+		free(cppi->linkram);
+		free(cppi);
+		return NULL;
+	}
+
+	/* Nothing dirty may be left in the cache over memory the DMA owns */
+	memset(cppi->descs, '\0', CPPI41_NUM_DESCS * CPPI41_DESC_SIZE);
+	start = (unsigned long)cppi->descs;
+	flush_dcache_range(start, start + CPPI41_NUM_DESCS * CPPI41_DESC_SIZE);
+	start = (unsigned long)cppi->linkram;
+	flush_dcache_range(start, start + CPPI41_NUM_DESCS * sizeof(u32));
+
+	cppi_writel(map_to_sysmem(cppi->linkram),
+		    qmgr + CPPI41_QMGR_LRAM0_BASE);
+	cppi_writel(CPPI41_NUM_DESCS, qmgr + CPPI41_QMGR_LRAM_SIZE);
+	cppi_writel(0, qmgr + CPPI41_QMGR_LRAM1_BASE);
+
+	cppi_writel(map_to_sysmem(cppi->descs), qmgr + CPPI41_QMGR_MEMBASE(0));
+	val = (CPPI41_DESC_SHIFT - 5) << CPPI41_QMGR_MEMCTRL_DESC_SHIFT;
+	val |= CPPI41_NUM_DESCS_SHIFT - 5;
+	cppi_writel(val, qmgr + CPPI41_QMGR_MEMCTRL(0));
+
+	/* Descriptor 0 is for teardown, then one per channel */
+	cppi->td = &cppi->descs[0];
+	cppi_writel(CPPI41_TD_FREE_Q, ctrl + CPPI41_DMA_TDFDQ);
+	for (i = 0; i < CPPI41_NUM_CHANS; i++) {
+		chan_init(cppi, &cppi->tx[i], i, 1, &cppi->descs[1 + i]);
+		chan_init(cppi, &cppi->rx[i], i, 0,
+			  &cppi->descs[1 + CPPI41_NUM_CHANS + i]);
+	}
+
+	/* Give every channel a TX and an RX slot, in channel order */
+	cppi_writel(0, sched + CPPI41_SCHED_CTRL);
+	for (i = 0; i < CPPI41_NUM_CHANS; i += 2) {
+		val = i;
+		val |= (i | CPPI41_SCHED_WORD_IS_RX) << 8;
+		val |= (i + 1) << 16;
+		val |= ((i + 1) | CPPI41_SCHED_WORD_IS_RX) << 24;
+		cppi_writel(val, sched + CPPI41_SCHED_WORD(i / 2));
+	}
+	cppi_writel(CPPI41_SCHED_CTRL_ENABLE | (CPPI41_NUM_CHANS * 2 - 1),
+		    sched + CPPI41_SCHED_CTRL);
+
+	return cppi;
+}
+
+void cppi41_exit(struct cppi41 *cppi)
+{
+	int i;
+
+	cppi_writel(0, cppi->sched + CPPI41_SCHED_CTRL);
+	for (i = 0; i < CPPI41_NUM_CHANS; i++) {
+		cppi_writel(0, cppi->ctrl + CPPI41_DMA_TXGCR(i));
+		cppi_writel(0, cppi->ctrl + CPPI41_DMA_RXGCR(i));
+	}
+	free(cppi->descs);
+	free(cppi->linkram);
+	free(cppi);
+}
+
+struct cppi41_chan *cppi41_chan_get(struct cppi41 *cppi, int num, int is_tx)
+{
+	if (num < 0 || num >= CPPI41_NUM_CHANS)
+		return NULL;
+
+	return is_tx ? &cppi->tx[num] : &cppi->rx[num];
+}
+
+int cppi41_chan_submit(struct cppi41_chan *chan, u32 addr, u32 len)
+{
+	struct cppi41_desc *desc = chan->desc;
+
+	if (chan->busy || chan->tearing)
+		return -EBUSY;
+	if (!len || len > CPPI41_MAX_LEN)
+		return -EINVAL;
+	if (!chan->enabled)
+		chan_enable(chan);
+
+	memset(desc, '\0', sizeof(*desc));
+	desc->pd0 = CPPI41_DESC_TYPE_HOST << CPPI41_DESC_TYPE_SHIFT;
+	if (chan->is_tx)
+		desc->pd0 |= len;
+	desc->pd2 = CPPI41_DESC_PKT_TYPE_USB | chan->complete_q;
+	desc->pd3 = len;
+	desc->pd4 = addr;
+	desc->pd6 = len;
+	desc->pd7 = addr;
+
+	chan->busy = 1;
+	queue_push(chan->cppi, chan->submit_q, desc);
+
+	return 0;
+}
+
+int cppi41_chan_poll(struct cppi41_chan *chan, u32 *actual)
+{
+	struct cppi41_desc *desc;
+
+	if (!chan->busy || chan->tearing)
+		return 0;
+
+	desc = queue_pop(chan->cppi, chan->complete_q);
+	if (!desc)
+		return 0;
+	chan->busy = 0;
+	if (desc != chan->desc) {
+		debug("cppi41: chan %d got foreign descriptor %p\n", chan->num,
+		      desc);
+		return -EIO;
+	}
+	*actual = desc->pd0 & CPPI41_DESC_LEN_MASK;
+
+	return 1;
+}
+
+/* Take the channel's descriptor back from wherever it is */
+static void chan_reclaim(struct cppi41_chan *chan)
+{
+	struct cppi41 *cppi = chan->cppi;
+
+	if (queue_pop(cppi, chan->complete_q) == chan->desc)
+		chan->busy = 0;
+	/* An RX descriptor not taken yet still sits on the free queue */
+	else if (!chan->is_tx && queue_pop(cppi, chan->submit_q) == chan->desc)
+		chan->busy = 0;
+}
+
+int cppi41_chan_abort(struct cppi41_chan *chan)
+{
+	struct cppi41 *cppi = chan->cppi;
+	struct cppi41_desc *td;
+	void *gcr;
+	u32 want;
+
+	if (!chan->tearing) {
+		if (!chan->busy)
+			return 0;
+		/* Nothing to tear down if the transfer is over or not begun */
+		chan_reclaim(chan);
+		if (!chan->busy)
+			return 0;
+		if (cppi->td_owner)
+			return -EAGAIN;
+
+		cppi->td_owner = chan;
+		chan->tearing = 1;
+		chan->td_seen = 0;
+		memset(cppi->td, '\0', sizeof(*cppi->td));
+		queue_push(cppi, CPPI41_TD_FREE_Q, cppi->td);
+		gcr = cppi->ctrl + (chan->is_tx ? CPPI41_DMA_TXGCR(chan->num) :
+				    CPPI41_DMA_RXGCR(chan->num));
+		cppi_writel(cppi_readl(gcr) | CPPI41_GCR_TEARDOWN, gcr);
+	}
+
+	if (!chan->td_seen) {
+		td = queue_pop(cppi, CPPI41_TD_COMPLETE_Q);
+		want = chan->num | (chan->is_tx ? 0 : CPPI41_TD_IS_RX);
+		if (td == cppi->td &&
+		    (td->pd0 & (CPPI41_TD_IS_RX | CPPI41_TD_CHAN_MASK)) == want)
+			chan->td_seen = 1;
+		else if (td)
+			debug("cppi41: chan %d unexpected teardown %p\n",
+			      chan->num, td);
+	}
+	if (chan->busy)
+		chan_reclaim(chan);
+	if (!chan->td_seen || chan->busy)
+		return -EAGAIN;
+
+	/* The hardware disables the channel once torn down */
+	chan->tearing = 0;
+	chan->enabled = 0;
+	cppi->td_owner = NULL;
+
+	return 0;
+}
@@ -0,0 +1,280 @@
+/*
+ * Sandbox model of a CPPI 4.1 DMA engine and queue manager
+ *
+ * Queues are linked lists threaded through the linking RAM, one entry
+ * per descriptor of the single descriptor region, as in the hardware.
+ * Every push is checked against the region the driver set up. The USB
+ * side of the DMA is driven from test code: sandbox_cppi41_tx() lets a
+ * TX channel send its next descriptor and sandbox_cppi41_rx() delivers
+ * a packet into the next free descriptor of an RX channel.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <cppi41.h>
+#include <asm/cppi41.h>
+#include <asm/io.h>
+
+#define CTRL_SIZE	0x1000
+#define SCHED_SIZE	0x1000
+#define QMGR_SIZE	0x3000
+
+/* Most descriptors the model can track */
+#define MAX_DESCS	1024
+#define LINK_END	0xffff
+
+struct queue {
+	int head;
+	int tail;
+	int count;
+};
+
+static u32 ctrl_regs[CTRL_SIZE / 4];
+static u32 sched_regs[SCHED_SIZE / 4];
+static u32 qmgr_regs[QMGR_SIZE / 4];
+static struct queue queues[CPPI41_NUM_QUEUES];
+static u8 queued[MAX_DESCS];
+static u8 size_hint[MAX_DESCS];
+static int errors;
+
+static int in_block(const void *addr, u32 *regs, int size, unsigned *off)
+{
+	const u8 *p = addr, *base = (const u8 *)regs;
+
+	if (p < base || p >= base + size)
+		return 0;
+	*off = p - base;
+
+	return 1;
+}
+
+static u32 region_base(void)
+{
+	return qmgr_regs[CPPI41_QMGR_MEMBASE(0) / 4];
+}
+
+static u32 region_desc_size(void)
+{
+	u32 memctrl = qmgr_regs[CPPI41_QMGR_MEMCTRL(0) / 4];
+
+	return 1 << (((memctrl >> CPPI41_QMGR_MEMCTRL_DESC_SHIFT) & 0xf) + 5);
+}
+
+static u32 region_count(void)
+{
+	return 1 << ((qmgr_regs[CPPI41_QMGR_MEMCTRL(0) / 4] & 0xf) + 5);
+}
+
+static u32 *linkram(void)
+{
+	return map_sysmem(qmgr_regs[CPPI41_QMGR_LRAM0_BASE / 4],
+			  qmgr_regs[CPPI41_QMGR_LRAM_SIZE / 4] * sizeof(u32));
+}
+
+static int desc_index(u32 addr)
+{
+	u32 offset = addr - region_base();
+	u32 count = region_count();
+
+	if (addr < region_base() || offset % region_desc_size())
+		return -1;
+	if (offset / region_desc_size() >= count || count > MAX_DESCS ||
+	    count > qmgr_regs[CPPI41_QMGR_LRAM_SIZE / 4])
+		return -1;
+
+	return offset / region_desc_size();
+}
+
+static struct cppi41_desc *desc_ptr(u32 addr)
+{
+	return map_sysmem(addr & ~CPPI41_QUEUE_DESC_MASK, region_desc_size());
+}
+
+static void queue_push(int q, u32 val)
+{
+	struct queue *queue = &queues[q];
+	int idx = desc_index(val & ~CPPI41_QUEUE_DESC_MASK);
+	u32 *link = linkram();
+
+	if (q >= CPPI41_NUM_QUEUES || idx < 0 || queued[idx]) {
+		errors++;
+		return;
+	}
+
+	link[idx] = LINK_END;
+	if (queue->count)
+		link[queue->tail] = idx;
+	else
+		queue->head = idx;
+	queue->tail = idx;
+	queue->count++;
+	queued[idx] = 1;
+	size_hint[idx] = val & CPPI41_QUEUE_DESC_MASK;
+}
+
+static u32 queue_pop(int q)
+{
+	struct queue *queue = &queues[q];
+	int idx;
+
+	if (q >= CPPI41_NUM_QUEUES || !queue->count)
+		return 0;
+
+	idx = queue->head;
+	queue->head = linkram()[idx];
+	queue->count--;
+	queued[idx] = 0;
+
+	return (region_base() + idx * region_desc_size()) | size_hint[idx];
+}
+
+/* Hand the teardown descriptor back, returning queued TX work first */
+static void teardown(int chan, int is_tx)
+{
+	struct cppi41_desc *desc;
+	u32 td, addr;
+
+	td = queue_pop(ctrl_regs[CPPI41_DMA_TDFDQ / 4]);
+	if (!td) {
+		errors++;
+		return;
+	}
+
+	while (is_tx && (addr = queue_pop(CPPI41_TX_SUBMIT_Q(chan)))) {
+		desc = desc_ptr(addr);
+		queue_push(desc->pd2 & CPPI41_DESC_RETQ_MASK, addr);
+	}
+
+	desc = desc_ptr(td);
+	desc->pd0 = CPPI41_DESC_TYPE_TEARDOWN << CPPI41_DESC_TYPE_SHIFT;
+	desc->pd0 |= (is_tx ? 0 : CPPI41_TD_IS_RX) | chan;
+	queue_push(CPPI41_TD_COMPLETE_Q, td);
+}
+
+static void ctrl_write(unsigned off, u32 val)
+{
+	int chan = (off - CPPI41_DMA_TXGCR(0)) / 0x20;
+	int reg = (off - CPPI41_DMA_TXGCR(0)) % 0x20;
+
+	if (off >= CPPI41_DMA_TXGCR(0) && chan < CPPI41_NUM_CHANS &&
+	    (reg == 0 || reg == 8) && (val & CPPI41_GCR_TEARDOWN)) {
+		teardown(chan, reg == 0);
+		val &= ~(CPPI41_GCR_CHAN_ENABLE | CPPI41_GCR_TEARDOWN);
+	}
+	ctrl_regs[off / 4] = val;
+}
+
+u32 sandbox_cppi41_readl(const void *addr)
+{
+	unsigned off;
+
+	if (in_block(addr, ctrl_regs, CTRL_SIZE, &off))
+		return ctrl_regs[off / 4];
+	if (in_block(addr, sched_regs, SCHED_SIZE, &off))
+		return sched_regs[off / 4];
+	if (!in_block(addr, qmgr_regs, QMGR_SIZE, &off)) {
+		errors++;
+		return 0;
+	}
+
+	if (off >= CPPI41_QMGR_QUEUE_A(0) &&
+	    off < CPPI41_QMGR_QUEUE_A(CPPI41_NUM_QUEUES)) {
+		switch (off & 0xf) {
+		case 0x0:
+			return queues[(off - CPPI41_QMGR_QUEUE_A(0)) / 0x10].count;
+		case 0xc:
+			return queue_pop((off - CPPI41_QMGR_QUEUE_A(0)) / 0x10);
+		}
+	}
+
+	return qmgr_regs[off / 4];
+}
+
+void sandbox_cppi41_writel(u32 val, void *addr)
+{
+	unsigned off;
+
+	if (in_block(addr, ctrl_regs, CTRL_SIZE, &off)) {
+		ctrl_write(off, val);
+	} else if (in_block(addr, sched_regs, SCHED_SIZE, &off)) {
+		sched_regs[off / 4] = val;
+	} else if (in_block(addr, qmgr_regs, QMGR_SIZE, &off)) {
+		if (off >= CPPI41_QMGR_QUEUE_D(0) &&
+		    off < CPPI41_QMGR_QUEUE_A(CPPI41_NUM_QUEUES) &&
+		    (off & 0xf) == 0xc)
+			queue_push((off - CPPI41_QMGR_QUEUE_A(0)) / 0x10, val);
+		else
+			qmgr_regs[off / 4] = val;
+	} else {
+		errors++;
+	}
+}
+
+void sandbox_cppi41_reset(void **ctrl, void **sched, void **qmgr)
+{
+	memset(ctrl_regs, '\0', sizeof(ctrl_regs));
+	memset(sched_regs, '\0', sizeof(sched_regs));
+	memset(qmgr_regs, '\0', sizeof(qmgr_regs));
+	memset(queues, '\0', sizeof(queues));
+	memset(queued, '\0', sizeof(queued));
+	errors = 0;
+
+	*ctrl = ctrl_regs;
+	*sched = sched_regs;
+	*qmgr = qmgr_regs;
+}
+
+static int dma_running(void)
+{
+	return sched_regs[CPPI41_SCHED_CTRL / 4] & CPPI41_SCHED_CTRL_ENABLE;
+}
+
+int sandbox_cppi41_tx(int chan, void *buf, int size)
+{
+	struct cppi41_desc *desc;
+	u32 addr, len;
+
+	if (!dma_running() || !(ctrl_regs[CPPI41_DMA_TXGCR(chan) / 4] &
+				CPPI41_GCR_CHAN_ENABLE))
+		return -1;
+	addr = queue_pop(CPPI41_TX_SUBMIT_Q(chan));
+	if (!addr)
+		return -1;
+
+	desc = desc_ptr(addr);
+	len = min((int)(desc->pd0 & CPPI41_DESC_LEN_MASK), size);
+	memcpy(buf, map_sysmem(desc->pd4, len), len);
+	queue_push(desc->pd2 & CPPI41_DESC_RETQ_MASK, addr);
+
+	return len;
+}
+
+int sandbox_cppi41_rx(int chan, const void *data, int len)
+{
+	struct cppi41_desc *desc;
+	u32 gcr = ctrl_regs[CPPI41_DMA_RXGCR(chan) / 4];
+	u32 fdq = ctrl_regs[CPPI41_DMA_RXHPCRA(chan) / 4] & 0x3fff;
+	u32 addr;
+
+	if (!dma_running() || !(gcr & CPPI41_GCR_CHAN_ENABLE))
+		return -1;
+	addr = queue_pop(fdq);
+	if (!addr)
+		return -1;
+
+	desc = desc_ptr(addr);
+	len = min(len, (int)desc->pd6);
+	memcpy(map_sysmem(desc->pd7, len), data, len);
+	desc->pd0 = (desc->pd0 & ~CPPI41_DESC_LEN_MASK) | len;
+	desc->pd3 = len;
+	desc->pd4 = desc->pd7;
+	queue_push(gcr & CPPI41_GCR_QUEUE_MASK, addr);
+
+	return len;
+}
+
+int sandbox_cppi41_errors(void)
+{
+	return errors;
+}
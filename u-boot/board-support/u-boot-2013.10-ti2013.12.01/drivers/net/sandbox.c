@@ -0,0 +1,127 @@
+/*
+ * Sandbox Ethernet driver
+ *
+ * With --tap frames go through a TAP interface on the host, so U-Boot can
+ * reach servers running there. Otherwise frames sent go to a hook set by
+ * test code, which queues whatever the network should answer.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <net.h>
+#include <netdev.h>
+#include <os.h>
+#include <asm/eth.h>
+#include <asm/state.h>
+
+#define RX_QUEUE_LEN	128
+
+struct rx_frame {
+	int len;
+	uchar data[PKTSIZE_ALIGN];
+};
+
+static struct rx_frame rx_queue[RX_QUEUE_LEN];
+static int rx_head;
+static int rx_count;
+static sandbox_eth_tx_hook *tx_hook;
+static int tap_fd = -1;
+
+void sandbox_eth_set_tx_hook(sandbox_eth_tx_hook *hook)
+{
+	tx_hook = hook;
+}
+
+int sandbox_eth_inject(const void *frame, int len)
+{
+	struct rx_frame *rx;
+
+	if (rx_count == RX_QUEUE_LEN || len > PKTSIZE_ALIGN)
+		return -1;
+
+	rx = &rx_queue[(rx_head + rx_count) % RX_QUEUE_LEN];
+	memcpy(rx->data, frame, len);
+	rx->len = len;
+	rx_count++;
+
+	return 0;
+}
+
+void sandbox_eth_flush(void)
+{
+	rx_count = 0;
+}
+
+static int sb_eth_init(struct eth_device *dev, bd_t *bis)
+{
+	struct sandbox_state *state = state_get_current();
+
+	if (state->tap_name && tap_fd < 0) {
+		tap_fd = os_tap_open(state->tap_name);
+		if (tap_fd < 0) {
+			printf("%s: cannot open TAP interface '%s'\n",
+			       dev->name, state->tap_name);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int sb_eth_send(struct eth_device *dev, void *packet, int length)
+{
+	if (tap_fd >= 0)
+		return os_write(tap_fd, packet, length) == length ? 0 : -1;
+
+	if (tx_hook)
+		tx_hook(packet, length);
+
+	return 0;
+}
+
+static int sb_eth_recv(struct eth_device *dev)
+{
+	struct rx_frame *rx;
+	int len;
+
+	if (tap_fd >= 0) {
+		len = os_read_no_block(tap_fd, NetRxPackets[0], PKTSIZE_ALIGN);
+		if (len > 0)
+			NetReceive(NetRxPackets[0], len);
+		return 0;
+	}
+
+	/* Frames the handlers queue in reply wait for the next poll */
+	for (len = rx_count; len > 0 && rx_count; len--) {
+		rx = &rx_queue[rx_head];
+		memcpy(NetRxPackets[0], rx->data, rx->len);
+		rx_head = (rx_head + 1) % RX_QUEUE_LEN;
+		rx_count--;
+		NetReceive(NetRxPackets[0], rx->len);
+	}
+
+	return 0;
+}
+
+static void sb_eth_halt(struct eth_device *dev)
+{
+}
+
+int sandbox_eth_initialize(bd_t *bis)
+{
+	struct eth_device *dev;
+
+	dev = calloc(1, sizeof(*dev));
+	if (!dev)
+		return -1;
+
+	strcpy(dev->name, "sb_eth");
+	dev->init = sb_eth_init;
+	dev->send = sb_eth_send;
+	dev->recv = sb_eth_recv;
+	dev->halt = sb_eth_halt;
+
+	return eth_register(dev);
+}
@@ -28,9 +28,6 @@ extern struct platform_data brd;
 #define spin_lock(x)
 #define spin_unlock(x)
 
-
-unsigned packet_received, packet_sent;
-
 #define GFP_ATOMIC ((gfp_t) 0)
 #define GFP_KERNEL ((gfp_t) 0)
 
@@ -83,6 +80,7 @@ static const char shortname[] = "ether";
 static const char driver_desc[] = DRIVER_DESC;
 
 #define RX_EXTRA	20		/* guard against rx overflows */
+#define RX_QLEN_MAX	16		/* OUT requests kept queued */
 
 #ifndef	CONFIG_USB_ETH_RNDIS
 #define rndis_uninit(x)		do {} while (0)
@@ -110,7 +108,22 @@ struct eth_dev {
 	const struct usb_endpoint_descriptor
 				*in, *out, *status;
 
-	struct usb_request	*tx_req, *rx_req;
+	/*
+	 * Frames sent while an IN transfer is in flight gather in the other
+	 * buffer, as many as RNDIS lets one transfer carry, and go when it
+	 * completes. OUT requests complete in the order they are queued.
+	 */
+	struct usb_request	*tx_req;
+	u8			*tx_buf[2];
+	int			tx_size;
+	int			tx_fill;	/* buffer gathering frames */
+	int			tx_len;
+	int			tx_pkts;
+	struct usb_request	*rx_reqs[RX_QLEN_MAX];
+	unsigned		rx_qlen;
+	unsigned		rx_head;	/* oldest queued request */
+	u32			rx_ready;	/* completed, by index */
+	int			rx_size;
 
 	struct eth_device	*net;
 	struct net_device_stats	stats;
@@ -935,6 +948,7 @@ config_buf(struct usb_gadget *g, u8 *buf, u8 type, unsigned index, int is_otg)
 
 static void eth_start(struct eth_dev *dev, gfp_t gfp_flags);
 static int alloc_requests(struct eth_dev *dev, unsigned n, gfp_t gfp_flags);
+static void free_requests(struct eth_dev *dev);
 
 static int
 set_ether_config(struct eth_dev *dev, gfp_t gfp_flags)
@@ -1028,20 +1042,11 @@ static void eth_reset_config(struct eth_dev *dev)
 	 * pending i/o.  then free the requests.
 	 */
 
-	if (dev->in) {
+	if (dev->in)
 		usb_ep_disable(dev->in_ep);
-		if (dev->tx_req) {
-			usb_ep_free_request(dev->in_ep, dev->tx_req);
-			dev->tx_req = NULL;
-		}
-	}
-	if (dev->out) {
+	if (dev->out)
 		usb_ep_disable(dev->out_ep);
-		if (dev->rx_req) {
-			usb_ep_free_request(dev->out_ep, dev->rx_req);
-			dev->rx_req = NULL;
-		}
-	}
+	free_requests(dev);
 	if (dev->status)
 		usb_ep_disable(dev->status_ep);
 
@@ -1515,12 +1520,12 @@ done_set_intf:
 /*-------------------------------------------------------------------------*/
 
 static void rx_complete(struct usb_ep *ep, struct usb_request *req);
+static void tx_complete(struct usb_ep *ep, struct usb_request *req);
 
 static int rx_submit(struct eth_dev *dev, struct usb_request *req,
 				gfp_t gfp_flags)
 {
 	int			retval = -ENOMEM;
-	size_t			size;
 
 	/*
 	 * Padding up to RX_EXTRA handles minor disagreements with host.
@@ -1539,20 +1544,7 @@ static int rx_submit(struct eth_dev *dev, struct usb_request *req,
 	if (!req)
 		return -EINVAL;
 
-	size = (ETHER_HDR_SIZE + dev->mtu + RX_EXTRA);
-	size += dev->out_ep->maxpacket - 1;
-	if (rndis_active(dev))
-		size += sizeof(struct rndis_packet_msg_type);
-	size -= size % dev->out_ep->maxpacket;
-
-	/*
-	 * Some platforms perform better when IP packets are aligned,
-	 * but on at least one, checksumming fails otherwise.  Note:
-	 * RNDIS headers involve variable numbers of LE32 values.
-	 */
-
-	req->buf = (u8 *) NetRxPackets[0];
-	req->length = size;
+	req->length = dev->rx_size;
 	req->complete = rx_complete;
 
 	retval = usb_ep_queue(dev->out_ep, req, gfp_flags);
@@ -1566,29 +1558,12 @@ static int rx_submit(struct eth_dev *dev, struct usb_request *req,
 static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct eth_dev	*dev = ep->driver_data;
+	unsigned	i;
 
 	debug("%s: status %d\n", __func__, req->status);
 	switch (req->status) {
-	/* normal completion */
+	/* normal completion, frames are checked as they are taken */
 	case 0:
-		if (rndis_active(dev)) {
-			/* we know MaxPacketsPerTransfer == 1 here */
-			int length = rndis_rm_hdr(req->buf, req->actual);
-			if (length < 0)
-				goto length_err;
-			req->length -= length;
-			req->actual -= length;
-		}
-		if (req->actual < ETH_HLEN || ETH_FRAME_LEN < req->actual) {
-length_err:
-			dev->stats.rx_errors++;
-			dev->stats.rx_length_errors++;
-			debug("rx length %d\n", req->length);
-			break;
-		}
-
-		dev->stats.rx_packets++;
-		dev->stats.rx_bytes += req->length;
 		break;
 
 	/* software-driven interface shutdown */
@@ -1596,7 +1571,7 @@ length_err:
 	case -ESHUTDOWN:		/* disconnect etc */
 	/* for hardware automagic (such as pxa) */
 	case -ECONNABORTED:		/* endpoint reset */
-		break;
+		return;
 
 	/* data overrun */
 	case -EOVERFLOW:
@@ -1607,31 +1582,199 @@ length_err:
 		break;
 	}
 
-	packet_received = 1;
+	for (i = 0; i < dev->rx_qlen; i++) {
+		if (dev->rx_reqs[i] == req)
+			dev->rx_ready |= 1 << i;
+	}
 }
 
-static int alloc_requests(struct eth_dev *dev, unsigned n, gfp_t gfp_flags)
+/*
+ * Hand the frames of a completed OUT transfer to the network stack. They
+ * are passed in place; only a frame the host did not align is copied.
+ */
+static void rx_deliver(struct eth_dev *dev, struct usb_request *req)
 {
+	u8		*data = req->buf;
+	int		length = req->actual;
+	int		offset = 0;
 
-	dev->tx_req = usb_ep_alloc_request(dev->in_ep, 0);
+	do {
+		if (rndis_active(dev)) {
+			length = rndis_rx_pkt(req->buf, req->actual, &offset,
+					      &data);
+			if (!length)
+				break;
+		}
+		/* also catches rndis_rx_pkt() errors */
+		if (length < ETH_HLEN || ETH_FRAME_LEN < length) {
+			dev->stats.rx_errors++;
+			dev->stats.rx_length_errors++;
+			debug("rx length %d\n", length);
+			break;
+		}
 
-	if (!dev->tx_req)
-		goto fail1;
+		dev->stats.rx_packets++;
+		dev->stats.rx_bytes += length;
 
-	dev->rx_req = usb_ep_alloc_request(dev->out_ep, 0);
+		if ((ulong)data & 3) {
+			memcpy(NetRxPackets[0], data, length);
+			data = NetRxPackets[0];
+		}
+		NetReceive(data, length);
+	} while (rndis_active(dev));
+}
+
+static int alloc_requests(struct eth_dev *dev, unsigned n, gfp_t gfp_flags)
+{
+	struct usb_request	*req;
+	int			i;
+
+	if (rndis_active(dev)) {
+		dev->tx_size = RNDIS_MAX_PKTS * RNDIS_PKT_SPACE(dev->mtu);
+		dev->rx_size = RNDIS_MAX_TRANSFER(dev->mtu);
+	} else {
+		dev->tx_size = ETHER_HDR_SIZE + dev->mtu;
+		dev->rx_size = ETHER_HDR_SIZE + dev->mtu;
+	}
+	/* one more byte in case a zero length packet must be avoided */
+	dev->tx_size = ALIGN(dev->tx_size + 1, CONFIG_SYS_CACHELINE_SIZE);
+	dev->rx_size += RX_EXTRA + dev->out_ep->maxpacket - 1;
+	dev->rx_size -= dev->rx_size % dev->out_ep->maxpacket;
 
-	if (!dev->rx_req)
-		goto fail2;
+	dev->tx_req = usb_ep_alloc_request(dev->in_ep, 0);
+	if (!dev->tx_req)
+		goto fail;
+	for (i = 0; i < 2; i++) {
+		dev->tx_buf[i] = memalign(CONFIG_SYS_CACHELINE_SIZE,
+					  dev->tx_size);
+		if (!dev->tx_buf[i])
+			goto fail;
+	}
+	dev->tx_fill = 0;
+	dev->tx_len = 0;
+	dev->tx_pkts = 0;
+	dev->tx_qlen = 0;
+
+	dev->rx_qlen = min(n, (unsigned)RX_QLEN_MAX);
+	for (i = 0; i < dev->rx_qlen; i++) {
+		req = usb_ep_alloc_request(dev->out_ep, 0);
+		if (!req)
+			goto fail;
+		dev->rx_reqs[i] = req;
+		req->buf = memalign(CONFIG_SYS_CACHELINE_SIZE, dev->rx_size);
+		if (!req->buf)
+			goto fail;
+	}
+	dev->rx_head = 0;
+	dev->rx_ready = 0;
 
 	return 0;
 
-fail2:
-	usb_ep_free_request(dev->in_ep, dev->tx_req);
-fail1:
+fail:
+	free_requests(dev);
 	error("can't alloc requests");
 	return -1;
 }
 
+static void free_requests(struct eth_dev *dev)
+{
+	int			i;
+
+	for (i = 0; i < dev->rx_qlen; i++) {
+		if (!dev->rx_reqs[i])
+			continue;
+		free(dev->rx_reqs[i]->buf);
+		usb_ep_free_request(dev->out_ep, dev->rx_reqs[i]);
+		dev->rx_reqs[i] = NULL;
+	}
+	dev->rx_qlen = 0;
+	dev->rx_ready = 0;
+
+	for (i = 0; i < 2; i++) {
+		free(dev->tx_buf[i]);
+		dev->tx_buf[i] = NULL;
+	}
+	if (dev->tx_req) {
+		usb_ep_free_request(dev->in_ep, dev->tx_req);
+		dev->tx_req = NULL;
+	}
+	dev->tx_len = 0;
+	dev->tx_qlen = 0;
+}
+
+/* Send the frames gathered so far, unless an IN transfer is in flight */
+static void tx_kick(struct eth_dev *dev)
+{
+	struct usb_request	*req = dev->tx_req;
+	int			length = dev->tx_len;
+
+	if (!req || dev->tx_qlen || !length)
+		return;
+
+	req->buf = dev->tx_buf[dev->tx_fill];
+	req->context = NULL;
+	req->complete = tx_complete;
+
+	/*
+	 * use zlp framing on tx for strict CDC-Ether conformance,
+	 * though any robust network rx path ignores extra padding.
+	 * and some hardware doesn't like to write zlps.
+	 */
+	req->zero = 1;
+	if (!dev->zlp && (length % dev->in_ep->maxpacket) == 0)
+		length++;
+	req->length = length;
+
+	dev->tx_fill ^= 1;
+	dev->tx_len = 0;
+	dev->tx_pkts = 0;
+	dev->tx_qlen = 1;
+
+	if (usb_ep_queue(dev->in_ep, req, GFP_ATOMIC)) {
+		debug("%s: tx queue failed\n", __func__);
+		dev->stats.tx_dropped++;
+		dev->tx_qlen = 0;
+	}
+}
+
+/*
+ * Add a frame to the buffer being gathered. Returns -ENOSPC if it has to
+ * wait for the transfer in flight, or another error if it can never go.
+ */
+static int tx_gather(struct eth_dev *dev, void *packet, int length)
+{
+	u8			*buf = dev->tx_buf[dev->tx_fill];
+	int			max, len;
+
+	if (!rndis_active(dev)) {
+		if (dev->tx_len)
+			return -ENOSPC;
+		if (length >= dev->tx_size)
+			return -EMSGSIZE;
+		memcpy(buf, packet, length);
+		dev->tx_len = length;
+		return 0;
+	}
+
+	if (dev->tx_pkts == RNDIS_MAX_PKTS)
+		return -ENOSPC;
+
+	/* stay within what the host takes, but always allow one frame */
+	max = dev->tx_size - 1;
+	if (rndis_get_max_transfer(dev->rndis_config) < max)
+		max = rndis_get_max_transfer(dev->rndis_config) - 1;
+	if (max < RNDIS_PKT_SPACE(dev->mtu))
+		max = RNDIS_PKT_SPACE(dev->mtu);
+
+	len = rndis_tx_pkt(buf, dev->tx_len, max, packet, length);
+	if (len < 0)
+		return dev->tx_len ? -ENOSPC : -EMSGSIZE;
+	dev->tx_len = len;
+	dev->tx_pkts++;
+
+	return 0;
+}
+
 static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct eth_dev	*dev = ep->driver_data;
@@ -1650,7 +1793,8 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 	}
 	dev->stats.tx_packets++;
 
-	packet_sent = 1;
+	dev->tx_qlen = 0;
+	tx_kick(dev);
 }
 
 static inline int eth_is_promisc(struct eth_dev *dev)
@@ -1792,15 +1936,7 @@ static void eth_unbind(struct usb_gadget *gadget)
 		dev->stat_req = NULL;
 	}
 
-	if (dev->tx_req) {
-		usb_ep_free_request(dev->in_ep, dev->tx_req);
-		dev->tx_req = NULL;
-	}
-
-	if (dev->rx_req) {
-		usb_ep_free_request(dev->out_ep, dev->rx_req);
-		dev->rx_req = NULL;
-	}
+	free_requests(dev);
 
 /*	unregister_netdev (dev->net);*/
 /*	free_netdev(dev->net);*/
@@ -2336,6 +2472,7 @@ static int usb_eth_init(struct eth_device *netdev, bd_t *bd)
 	struct usb_gadget *gadget;
 	unsigned long ts;
 	unsigned long timeout = USB_CONNECT_TIMEOUT;
+	int i;
 
 	if (!netdev) {
 		error("received NULL ptr");
@@ -2372,9 +2509,6 @@ static int usb_eth_init(struct eth_device *netdev, bd_t *bd)
 
 	dev->network_started = 0;
 
-	packet_received = 0;
-	packet_sent = 0;
-
 	gadget = dev->gadget;
 	usb_gadget_connect(gadget);
 
@@ -2391,8 +2525,10 @@ static int usb_eth_init(struct eth_device *netdev, bd_t *bd)
 		usb_gadget_handle_interrupts();
 	}
 
-	packet_received = 0;
-	rx_submit(dev, dev->rx_req, 0);
+	dev->rx_head = 0;
+	dev->rx_ready = 0;
+	for (i = 0; i < dev->rx_qlen; i++)
+		rx_submit(dev, dev->rx_reqs[i], 0);
 	return 0;
 fail:
 	return -1;
@@ -2400,88 +2536,46 @@ fail:
 
 static int usb_eth_send(struct eth_device *netdev, void *packet, int length)
 {
-	int			retval;
-	void			*rndis_pkt = NULL;
 	struct eth_dev		*dev = &l_ethdev;
-	struct usb_request	*req = dev->tx_req;
 	unsigned long ts;
 	unsigned long timeout = USB_CONNECT_TIMEOUT;
+	int			retval;
 
 	debug("%s:...\n", __func__);
 
-	/* new buffer is needed to include RNDIS header */
-	if (rndis_active(dev)) {
-		rndis_pkt = malloc(length +
-					sizeof(struct rndis_packet_msg_type));
-		if (!rndis_pkt) {
-			error("No memory to alloc RNDIS packet");
-			goto drop;
-		}
-		rndis_add_hdr(rndis_pkt, length);
-		memcpy(rndis_pkt + sizeof(struct rndis_packet_msg_type),
-				packet, length);
-		packet = rndis_pkt;
-		length += sizeof(struct rndis_packet_msg_type);
-	}
-	req->buf = packet;
-	req->context = NULL;
-	req->complete = tx_complete;
-
-	/*
-	 * use zlp framing on tx for strict CDC-Ether conformance,
-	 * though any robust network rx path ignores extra padding.
-	 * and some hardware doesn't like to write zlps.
-	 */
-	req->zero = 1;
-	if (!dev->zlp && (length % dev->in_ep->maxpacket) == 0)
-		length++;
-
-	req->length = length;
-#if 0
-	/* throttle highspeed IRQ rate back slightly */
-	if (gadget_is_dualspeed(dev->gadget))
-		req->no_interrupt = (dev->gadget->speed == USB_SPEED_HIGH)
-			? ((dev->tx_qlen % qmult) != 0) : 0;
-#endif
-	dev->tx_qlen = 1;
 	ts = get_timer(0);
-	packet_sent = 0;
-
-	retval = usb_ep_queue(dev->in_ep, req, GFP_ATOMIC);
-
-	if (!retval)
-		debug("%s: packet queued\n", __func__);
-	while (!packet_sent) {
+	while ((retval = tx_gather(dev, packet, length)) == -ENOSPC) {
 		if (get_timer(ts) > timeout) {
 			printf("timeout sending packets to usb ethernet\n");
 			return -1;
 		}
 		usb_gadget_handle_interrupts();
 	}
-	if (rndis_pkt)
-		free(rndis_pkt);
+	if (retval) {
+		dev->stats.tx_dropped++;
+		return retval;
+	}
+
+	tx_kick(dev);
 
 	return 0;
-drop:
-	dev->stats.tx_dropped++;
-	return -ENOMEM;
 }
 
 static int usb_eth_recv(struct eth_device *netdev)
 {
 	struct eth_dev *dev = &l_ethdev;
+	struct usb_request *req;
 
 	usb_gadget_handle_interrupts();
 
-	if (packet_received) {
-		debug("%s: packet received\n", __func__);
-		if (dev->rx_req) {
-			NetReceive(NetRxPackets[0], dev->rx_req->length);
-			packet_received = 0;
+	while (dev->rx_qlen && (dev->rx_ready & (1 << dev->rx_head))) {
+		req = dev->rx_reqs[dev->rx_head];
+		if (!req->status)
+			rx_deliver(dev, req);
 
-			rx_submit(dev, dev->rx_req, 0);
-		} else
-			error("dev->rx_req invalid");
+		dev->rx_ready &= ~(1 << dev->rx_head);
+		dev->rx_head = (dev->rx_head + 1) % dev->rx_qlen;
+		rx_submit(dev, req, 0);
 	}
 	return 0;
 }
@@ -2489,6 +2583,7 @@ static int usb_eth_recv(struct eth_device *netdev)
 void usb_eth_halt(struct eth_device *netdev)
 {
 	struct eth_dev *dev = &l_ethdev;
+	unsigned long ts;
 
 	if (!netdev) {
 		error("received NULL ptr");
@@ -2499,6 +2594,12 @@ void usb_eth_halt(struct eth_device *netdev)
 	if (!dev->gadget)
 		return;
 
+	/* Let frames still gathered or in flight reach the host */
+	ts = get_timer(0);
+	while (dev->network_started && (dev->tx_qlen || dev->tx_len) &&
+	       get_timer(ts) < USB_CONNECT_TIMEOUT)
+		usb_gadget_handle_interrupts();
+
 	/*
 	 * Some USB controllers may need additional deinitialization here
 	 * before dropping pull-up (also due to hardware issues).
@@ -133,9 +133,16 @@ static struct usb_gadget_strings *dfu_strings[] = {
 static void dnload_request_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct f_dfu *f_dfu = req->context;
+	int ret;
 
-	dfu_write(dfu_get_entity(f_dfu->altsetting), req->buf,
-		  req->length, f_dfu->blk_seq_num);
+	ret = dfu_write(dfu_get_entity(f_dfu->altsetting), req->buf,
+			req->length, f_dfu->blk_seq_num);
+	if (ret) {
+		/* reported to the host on its next DFU_GETSTATUS */
+		f_dfu->dfu_status = DFU_STATUS_errWRITE;
+		f_dfu->dfu_state = DFU_STATE_dfuERROR;
+		return;
+	}
 
 	if (req->length == 0)
 		puts("DOWNLOAD ... OK\nCtrl+C to exit ...\n");
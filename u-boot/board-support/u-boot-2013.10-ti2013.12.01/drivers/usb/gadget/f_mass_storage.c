@@ -316,6 +316,13 @@ struct fsg_common {
 	struct fsg_buffhd	*next_buffhd_to_drain;
 	struct fsg_buffhd	buffhds[FSG_NUM_BUFFERS];
 
+	/* Medium cache, see fsg_medium_read() */
+	u8			*cache_buf;
+	u32			cache_lba;
+	u32			cache_count;
+	int			cache_dirty;
+	u32			read_next_lba;
+
 	int			cmnd_size;
 	u8			cmnd[MAX_COMMAND_SIZE];
 
@@ -659,6 +666,136 @@ static void busy_indicator(void)
 		state = 0;
 }
 
+/*-------------------------------------------------------------------------*/
+
+/*
+ * The medium is reached through one cache buffer. Sequential reads are
+ * served from a single large read-ahead and writes to consecutive
+ * sectors are gathered into one multi-block write, as SD cards and eMMC
+ * are far faster with a few large requests than with many small ones.
+ * Gathered writes go to the medium once the buffer is full, before
+ * anything that needs them there, and whenever the host goes quiet.
+ */
+#define FSG_CACHE_SECTORS	(FSG_CACHE_SIZE / SECTOR_SIZE)
+
+static int fsg_cache_flush(struct fsg_common *common)
+{
+	int rc;
+
+	if (!common->cache_dirty)
+		return 0;
+
+	common->cache_dirty = 0;
+	rc = ums_info->write_sector(&(ums_info->ums_dev), common->cache_lba,
+				    common->cache_count, common->cache_buf);
+	if (rc) {
+		common->cache_count = 0;
+		return -EIO;
+	}
+
+	/* What was written stays valid for reading */
+	return 0;
+}
+
+static int fsg_cache_holds(struct fsg_common *common, u32 lba, u32 count)
+{
+	return lba >= common->cache_lba &&
+	       lba + count <= common->cache_lba + common->cache_count;
+}
+
+static int fsg_cache_overlaps(struct fsg_common *common, u32 lba, u32 count)
+{
+	return lba < common->cache_lba + common->cache_count &&
+	       lba + count > common->cache_lba;
+}
+
+static int fsg_medium_read(struct fsg_common *common, u32 lba, u32 count,
+			   void *buf)
+{
+	struct fsg_lun	*curlun = &common->luns[common->lun];
+	int		sequential = lba == common->read_next_lba;
+	u32		ahead;
+	int		rc;
+
+	common->read_next_lba = lba + count;
+
+	if (fsg_cache_holds(common, lba, count))
+		goto hit;
+
+	/* Partly cached: make the medium current and read from there */
+	if (fsg_cache_overlaps(common, lba, count)) {
+		rc = fsg_cache_flush(common);
+		if (rc)
+			return rc;
+	}
+
+	if (!sequential || count >= FSG_CACHE_SECTORS || common->cache_dirty) {
+		rc = ums_info->read_sector(&(ums_info->ums_dev), lba, count,
+					   buf);
+		return rc ? -EIO : 0;
+	}
+
+	/* The host is reading sequentially: read ahead in one go */
+	ahead = min((u32)FSG_CACHE_SECTORS, (u32)curlun->num_sectors - lba);
+	common->cache_count = 0;
+	rc = ums_info->read_sector(&(ums_info->ums_dev), lba, ahead,
+				   common->cache_buf);
+	if (rc)
+		return -EIO;
+	common->cache_lba = lba;
+	common->cache_count = ahead;
+
+hit:
+	memcpy(buf, common->cache_buf +
+	       (lba - common->cache_lba) * SECTOR_SIZE, count * SECTOR_SIZE);
+	return 0;
+}
+
+static int fsg_medium_write(struct fsg_common *common, u32 lba, u32 count,
+			    const void *buf)
+{
+	int rc;
+
+	if (common->cache_dirty) {
+		/* Rewriting gathered sectors, or carrying straight on */
+		if (fsg_cache_holds(common, lba, count) ||
+		    (lba == common->cache_lba + common->cache_count &&
+		     common->cache_count + count <= FSG_CACHE_SECTORS)) {
+			memcpy(common->cache_buf +
+			       (lba - common->cache_lba) * SECTOR_SIZE, buf,
+			       count * SECTOR_SIZE);
+			common->cache_count = max(common->cache_count,
+						  lba + count -
+						  common->cache_lba);
+			goto out;
+		}
+
+		rc = fsg_cache_flush(common);
+		if (rc)
+			return rc;
+	}
+
+	/* Anything cached for reading is of no more use */
+	common->cache_count = 0;
+
+	if (count >= FSG_CACHE_SECTORS) {
+		rc = ums_info->write_sector(&(ums_info->ums_dev), lba, count,
+					    buf);
+		return rc ? -EIO : 0;
+	}
+
+	memcpy(common->cache_buf, buf, count * SECTOR_SIZE);
+	common->cache_lba = lba;
+	common->cache_count = count;
+	common->cache_dirty = 1;
+
+out:
+	if (common->cache_count == FSG_CACHE_SECTORS)
+		return fsg_cache_flush(common);
+
+	return 0;
+}
+
 static int sleep_thread(struct fsg_common *common)
 {
 	int	rc = 0;
@@ -673,6 +810,11 @@ static int sleep_thread(struct fsg_common *common)
 			busy_indicator();
 			i = 0;
 			k++;
+
+			/* The host has gone quiet, so write what we hold */
+			if (fsg_cache_flush(common))
+				common->luns[common->lun].unit_attention_data =
+					SS_WRITE_ERROR;
 		}
 
 		usb_gadget_handle_interrupts();
@@ -758,10 +900,9 @@ static int do_read(struct fsg_common *common)
 
 		/* Perform the read */
 		nread = 0;
-		rc = ums_info->read_sector(&(ums_info->ums_dev),
-					   file_offset / SECTOR_SIZE,
-					   amount / SECTOR_SIZE,
-					   (char __user *)bh->buf);
+		rc = fsg_medium_read(common, file_offset / SECTOR_SIZE,
+				     amount / SECTOR_SIZE,
+				     (char __user *)bh->buf);
 		if (rc)
 			return -EIO;
 		nread = amount;
@@ -931,10 +1072,9 @@ static int do_write(struct fsg_common *common)
 			amount = bh->outreq->actual;
 
 			/* Perform the write */
-			rc = ums_info->write_sector(&(ums_info->ums_dev),
-					       file_offset / SECTOR_SIZE,
-					       amount / SECTOR_SIZE,
-					       (char __user *)bh->buf);
+			rc = fsg_medium_write(common, file_offset / SECTOR_SIZE,
+					      amount / SECTOR_SIZE,
+					      (char __user *)bh->buf);
 			if (rc)
 				return -EIO;
 			nwritten = amount;
@@ -978,6 +1118,13 @@ static int do_write(struct fsg_common *common)
 			return rc;
 	}
 
+	/* FUA: the data has to be on the medium before we report back */
+	if (common->cmnd[0] != SC_WRITE_6 && (common->cmnd[1] & 0x08) &&
+	    fsg_cache_flush(common)) {
+		curlun->sense_data = SS_WRITE_ERROR;
+		curlun->info_valid = 1;
+	}
+
 	return -EIO;		/* No default reply */
 }
 
@@ -985,6 +1132,12 @@ static int do_write(struct fsg_common *common)
 
 static int do_synchronize_cache(struct fsg_common *common)
 {
+	struct fsg_lun	*curlun = &common->luns[common->lun];
+
+	/* We ignore the requested LBA and write out all the cache */
+	if (fsg_cache_flush(common))
+		curlun->sense_data = SS_WRITE_ERROR;
+
 	return 0;
 }
 
@@ -1026,6 +1179,10 @@ static int do_verify(struct fsg_common *common)
 	file_offset = ((loff_t) lba) << 9;
 
 	/* Write out all the dirty buffers before invalidating them */
+	if (fsg_cache_flush(common)) {
+		curlun->sense_data = SS_WRITE_ERROR;
+		return -EIO;
+	}
 
 	/* Just try to read the requested blocks */
 	while (amount_left > 0) {
@@ -1319,6 +1476,12 @@ static int do_start_stop(struct fsg_common *common)
 		return -EINVAL;
 	}
 
+	/* The host may be about to let go of the medium */
+	if (fsg_cache_flush(common)) {
+		curlun->sense_data = SS_WRITE_ERROR;
+		return -EIO;
+	}
+
 	return 0;
 }
 
@@ -2430,7 +2593,6 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 {
 	struct usb_gadget *gadget = cdev->gadget;
 	struct fsg_buffhd *bh;
-	struct fsg_lun *curlun;
 	int nluns, i, rc;
 
 	/* Find out how many LUNs there should be */
@@ -2467,13 +2629,7 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 		fsg_intf_desc.iInterface = rc;
 	}
 
-	/* Create the LUNs, open their backing files, and register the
-	 * LUN devices in sysfs. */
-	curlun = calloc(nluns, sizeof *curlun);
-	if (!curlun) {
-		rc = -ENOMEM;
-		goto error_release;
-	}
+	/* Open the LUNs, they live in common->luns[] */
 	common->nluns = nluns;
 
 	for (i = 0; i < nluns; i++) {
@@ -2496,7 +2652,8 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 buffhds_first_it:
 		bh->inreq_busy = 0;
 		bh->outreq_busy = 0;
-		bh->buf = kmalloc(FSG_BUFLEN, GFP_KERNEL);
+		/* Aligned, so the UDC can DMA straight into it */
+		bh->buf = memalign(ARCH_DMA_MINALIGN, FSG_BUFLEN);
 		if (unlikely(!bh->buf)) {
 			rc = -ENOMEM;
 			goto error_release;
@@ -2504,6 +2661,12 @@ buffhds_first_it:
 	} while (--i);
 	bh->next = common->buffhds;
 
+	common->cache_buf = memalign(ARCH_DMA_MINALIGN, FSG_CACHE_SIZE);
+	if (unlikely(!common->cache_buf)) {
+		rc = -ENOMEM;
+		goto error_release;
+	}
+
 	snprintf(common->inquiry_string, sizeof common->inquiry_string,
 		 "%-8s%-16s%04x",
 		 "Linux   ",
@@ -2551,17 +2714,19 @@ static void fsg_common_release(struct kref *ref)
 		wait_for_completion(&common->thread_notifier);
 	}
 
-	if (likely(common->luns)) {
+	{
 		struct fsg_lun *lun = common->luns;
 		unsigned i = common->nluns;
 
 		/* In error recovery common->nluns may be zero. */
 		for (; i; --i, ++lun)
 			fsg_lun_close(lun);
-
-		kfree(common->luns);
 	}
 
+	/* Gathered writes the host did not wait for */
+	if (common->cache_buf && fsg_cache_flush(common))
+		printf("%s: writing cached sectors failed\n", __func__);
+
 	{
 		struct fsg_buffhd *bh = common->buffhds;
 		unsigned i = FSG_NUM_BUFFERS;
@@ -2569,7 +2734,10 @@ static void fsg_common_release(struct kref *ref)
 			kfree(bh->buf);
 		} while (++bh, --i);
 	}
+	kfree(common->cache_buf);
 
+	if (the_fsg_common == common)
+		the_fsg_common = NULL;
 	if (common->free_storage_on_release)
 		kfree(common);
 }
@@ -2629,16 +2797,23 @@ usb_copy_descriptors(struct usb_descriptor_header **src)
 static void fsg_unbind(struct usb_configuration *c, struct usb_function *f)
 {
 	struct fsg_dev		*fsg = fsg_from_func(f);
+	struct fsg_common	*common = fsg->common;
 
 	DBG(fsg, "unbind\n");
-	if (fsg->common->fsg == fsg) {
-		fsg->common->new_fsg = NULL;
-		raise_exception(fsg->common, FSG_STATE_CONFIG_CHANGE);
+	if (common->fsg == fsg) {
+		common->new_fsg = NULL;
+		raise_exception(common, FSG_STATE_CONFIG_CHANGE);
 	}
 
 	free(fsg->function.descriptors);
 	free(fsg->function.hs_descriptors);
 	kfree(fsg);
+
+	/*
+	 * There is one fsg per fsg_common (see fsg_add()), so the buffers go
+	 * with it; otherwise every "ums" run would leak them.
+	 */
+	fsg_common_release(&common->ref);
 }
 
 static int fsg_bind(struct usb_configuration *c, struct usb_function *f)
@@ -2738,8 +2913,11 @@ static int fsg_bind_config(struct usb_composite_dev *cdev,
 int fsg_add(struct usb_configuration *c)
 {
 	struct fsg_common *fsg_common;
+	int rc;
 
 	fsg_common = fsg_common_init(NULL, c->cdev);
+	if (IS_ERR(fsg_common))
+		return PTR_ERR(fsg_common);
 
 	fsg_common->vendor_name = 0;
 	fsg_common->product_name = 0;
@@ -2750,7 +2928,11 @@ int fsg_add(struct usb_configuration *c)
 
 	the_fsg_common = fsg_common;
 
-	return fsg_bind_config(c->cdev, c, fsg_common);
+	rc = fsg_bind_config(c->cdev, c, fsg_common);
+	if (rc)
+		fsg_common_release(&fsg_common->ref);
+
+	return rc;
 }
 
 int fsg_init(struct ums_board_info *ums)
@@ -2759,3 +2941,10 @@ int fsg_init(struct ums_board_info *ums)
 
 	return 0;
 }
+
+void fsg_cleanup(void)
+{
+	/* Whatever the host wrote last must not be lost */
+	if (the_fsg_common && fsg_cache_flush(the_fsg_common))
+		error("UMS: writing the cache back failed");
+}
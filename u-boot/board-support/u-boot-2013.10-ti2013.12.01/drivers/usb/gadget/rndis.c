@@ -799,16 +799,18 @@ static int rndis_init_response(int configNr, rndis_init_msg_type *buf)
 	resp->MinorVersion = __constant_cpu_to_le32(RNDIS_MINOR_VERSION);
 	resp->DeviceFlags = __constant_cpu_to_le32(RNDIS_DF_CONNECTIONLESS);
 	resp->Medium = __constant_cpu_to_le32(RNDIS_MEDIUM_802_3);
-	resp->MaxPacketsPerTransfer = __constant_cpu_to_le32(1);
+	resp->MaxPacketsPerTransfer = __constant_cpu_to_le32(RNDIS_MAX_PKTS);
 	resp->MaxTransferSize = cpu_to_le32(
-		  rndis_per_dev_params[configNr].mtu
-		+ ETHER_HDR_SIZE
-		+ sizeof(struct rndis_packet_msg_type)
-		+ 22);
-	resp->PacketAlignmentFactor = __constant_cpu_to_le32(0);
+		RNDIS_MAX_TRANSFER(rndis_per_dev_params[configNr].mtu));
+	/* 2^2: frames start 4-aligned, so they can go to the stack in place */
+	resp->PacketAlignmentFactor = __constant_cpu_to_le32(2);
 	resp->AFListOffset = __constant_cpu_to_le32(0);
 	resp->AFListSize = __constant_cpu_to_le32(0);
 
+	/* what the host takes in one IN transfer */
+	rndis_per_dev_params[configNr].host_max_transfer =
+		get_unaligned_le32(&buf->MaxTransferSize);
+
 	if (rndis_per_dev_params[configNr].ack)
 		rndis_per_dev_params[configNr].ack(
 			rndis_per_dev_params[configNr].dev);
@@ -1197,16 +1199,38 @@ int rndis_set_param_medium(u8 configNr, u32 medium, u32 speed)
 	return 0;
 }
 
-void rndis_add_hdr(void *buf, int length)
+/*
+ * Append a frame to a transfer for the host, as a packet message padded
+ * to four bytes. @buf must be 4-aligned. Returns the new length of the
+ * transfer, or -ENOSPC if the frame does not fit within @max bytes.
+ */
+int rndis_tx_pkt(void *buf, int length, int max, const void *data, int len)
 {
 	struct rndis_packet_msg_type	*header;
+	int				msg_len;
 
-	header = buf;
+	msg_len = ALIGN(sizeof *header + len, 4);
+	if (length + msg_len > max)
+		return -ENOSPC;
+
+	header = buf + length;
 	memset(header, 0, sizeof *header);
 	header->MessageType = __constant_cpu_to_le32(REMOTE_NDIS_PACKET_MSG);
-	header->MessageLength = cpu_to_le32(length + sizeof *header);
+	header->MessageLength = cpu_to_le32(msg_len);
 	header->DataOffset = __constant_cpu_to_le32(36);
-	header->DataLength = cpu_to_le32(length);
+	header->DataLength = cpu_to_le32(len);
+	memcpy(header + 1, data, len);
+	memset((u8 *)(header + 1) + len, 0, msg_len - sizeof *header - len);
+
+	return length + msg_len;
+}
+
+u32 rndis_get_max_transfer(int configNr)
+{
+	if (configNr >= RNDIS_MAX_CONFIGS)
+		return 0;
+
+	return rndis_per_dev_params[configNr].host_max_transfer;
 }
 
 void rndis_free_response(int configNr, u8 *buf)
@@ -1265,33 +1289,45 @@ static rndis_resp_t *rndis_add_response(int configNr, u32 length)
 	return r;
 }
 
-int rndis_rm_hdr(void *buf, int length)
+/*
+ * Find the next frame in a transfer from the host, which may hold up to
+ * MaxPacketsPerTransfer packet messages. *@offset is where to look and is
+ * moved past the message; the frame is left in place at *@data.
+ * Returns the frame length, 0 when there are no more or a negative error.
+ */
+int rndis_rx_pkt(void *buf, int length, int *offset, u8 **data)
 {
 	/* tmp points to a struct rndis_packet_msg_type */
-	__le32		*tmp = buf;
-	int		offs, len;
+	__le32		*tmp = buf + *offset;
+	u32		type, msg_len, offs, len;
+
+	/* hosts may pad the transfer, e.g. to avoid a zero length packet */
+	if (*offset + sizeof(struct rndis_packet_msg_type) > length)
+		return 0;
 
 	/* MessageType, MessageLength */
-	if (__constant_cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
-			!= get_unaligned(tmp++))
+	type = get_unaligned_le32(tmp++);
+	if (!type)
+		return 0;
+	if (type != REMOTE_NDIS_PACKET_MSG)
 		return -EINVAL;
-	tmp++;
+	msg_len = get_unaligned_le32(tmp++);
+	if (msg_len < sizeof(struct rndis_packet_msg_type) ||
+	    msg_len > length - *offset)
+		return -EOVERFLOW;
 
 	/* DataOffset, DataLength */
 	offs = get_unaligned_le32(tmp++) + 8 /* offset of DataOffset */;
 	if (offs != sizeof(struct rndis_packet_msg_type))
 		debug("%s: unexpected DataOffset: %d\n", __func__, offs);
-	if (offs >= length)
-		return -EOVERFLOW;
-
 	len = get_unaligned_le32(tmp++);
-	if (len + sizeof(struct rndis_packet_msg_type) != length)
-		debug("%s: unexpected DataLength: %d, packet length=%d\n",
-				__func__, len, length);
+	if (!len || offs > msg_len || len > msg_len - offs)
+		return -EOVERFLOW;
 
-	memmove(buf, buf + offs, len);
+	*data = buf + *offset + offs;
+	*offset += msg_len;
 
-	return offs;
+	return len;
 }
 
 int rndis_init(void)
@@ -199,6 +199,23 @@ struct rndis_config_parameter {
 	__le32	ParameterValueLength;
 };
 
+/*
+ * Number of frames the host may pack into one OUT transfer, and we into
+ * one IN transfer as long as the host's MaxTransferSize allows
+ */
+#ifdef CONFIG_USB_ETH_RNDIS_MAX_PKTS
+#define RNDIS_MAX_PKTS		CONFIG_USB_ETH_RNDIS_MAX_PKTS
+#else
+#define RNDIS_MAX_PKTS		1
+#endif
+
+/* Room one frame of @mtu takes in a transfer, as messages are 4-aligned */
+#define RNDIS_PKT_SPACE(mtu) \
+	ALIGN(sizeof(struct rndis_packet_msg_type) + ETHER_HDR_SIZE + (mtu), 4)
+
+/* Longest OUT transfer we tell the host it may send */
+#define RNDIS_MAX_TRANSFER(mtu)	(RNDIS_MAX_PKTS * RNDIS_PKT_SPACE(mtu) + 22)
+
 /* implementation specific */
 enum rndis_state {
 	RNDIS_UNINITIALIZED,
@@ -227,6 +244,7 @@ typedef struct rndis_params {
 	struct eth_device	*dev;
 	struct net_device_stats *stats;
 	int			mtu;
+	u32			host_max_transfer;
 
 	u32			vendorID;
 	const char		*vendorDescr;
@@ -244,8 +262,9 @@ int  rndis_set_param_dev(u8 configNr, struct eth_device *dev, int mtu,
 int  rndis_set_param_vendor(u8 configNr, u32 vendorID,
 			    const char *vendorDescr);
 int  rndis_set_param_medium(u8 configNr, u32 medium, u32 speed);
-void rndis_add_hdr(void *bug, int length);
-int rndis_rm_hdr(void *bug, int length);
+int  rndis_rx_pkt(void *buf, int length, int *offset, u8 **data);
+int  rndis_tx_pkt(void *buf, int length, int max, const void *data, int len);
+u32  rndis_get_max_transfer(int configNr);
 u8   *rndis_get_next_response(int configNr, u32 *length);
 void rndis_free_response(int configNr, u8 *buf);
 
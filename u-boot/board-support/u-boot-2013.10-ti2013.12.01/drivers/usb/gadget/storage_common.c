@@ -312,10 +312,25 @@ static struct fsg_lun *fsg_lun_from_dev(struct device *dev)
 #define DELAYED_STATUS	(EP0_BUFSIZE + 999)	/* An impossibly large value */
 
 /* Number of buffers we will use.  2 is enough for double-buffering */
+#ifdef CONFIG_USB_GADGET_STORAGE_NUM_BUFFERS
+#define FSG_NUM_BUFFERS	CONFIG_USB_GADGET_STORAGE_NUM_BUFFERS
+#else
 #define FSG_NUM_BUFFERS	2
+#endif
 
 /* Default size of buffer length. */
+#ifdef CONFIG_USB_GADGET_STORAGE_BUFLEN
+#define FSG_BUFLEN	((u32)CONFIG_USB_GADGET_STORAGE_BUFLEN)
+#else
 #define FSG_BUFLEN	((u32)16384)
+#endif
+
+/* Size of the read-ahead / write gathering cache in front of the medium */
+#ifdef CONFIG_USB_GADGET_STORAGE_CACHE_SIZE
+#define FSG_CACHE_SIZE	((u32)CONFIG_USB_GADGET_STORAGE_CACHE_SIZE)
+#else
+#define FSG_CACHE_SIZE	((u32)(256 * 1024))
+#endif
 
 /* Maximal number of LUNs supported in mass storage function */
 #define FSG_MAX_LUNS	8
@@ -88,6 +88,18 @@ typedef unsigned long dmaaddr_t;
 
 #define msleep(a)	udelay(a * 1000)
 
+/*
+ * Buffers are used at their own address; the DMA glue does the cache
+ * maintenance itself when it programs a channel.
+ */
+#define DMA_TO_DEVICE		1
+#define DMA_FROM_DEVICE		2
+#define dma_map_single(dev, ptr, size, dir) \
+	((dma_addr_t)(unsigned long)(ptr))
+#define dma_unmap_single(dev, addr, size, dir) do {} while (0)
+#define dma_sync_single_for_device(dev, addr, size, dir) do {} while (0)
+#define dma_sync_single_for_cpu(dev, addr, size, dir) do {} while (0)
+
 /*
  * Map U-Boot config options to Linux ones
  */
@@ -0,0 +1,387 @@
+/*
+ * CPPI 4.1 DMA glue for the MUSB controllers of the AM335x USB subsystem
+ *
+ * Both ports share one CPPI 4.1 engine: endpoint n of port p uses DMA
+ * channel (n - 1) + 15 * p in each direction. A transfer longer than one
+ * packet runs in the wrapper's generic RNDIS mode, where one descriptor
+ * covers many packets and an RX descriptor also ends at a short packet;
+ * anything longer than the RNDIS size register allows is split up here,
+ * so the core sees one DMA completion per request or URB.
+ *
+ * U-Boot has no interrupts, so completions are picked up by polling
+ * from the DSPS interrupt handler, which the gadget and host loops call
+ * all the time anyway.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#define __UBOOT__
+#include <common.h>
+#include <cppi41.h>
+#include <malloc.h>
+#include <asm/arch/hardware.h>
+#include "linux-compat.h"
+
+#include "musb_core.h"
+
+/* Wrapper registers, relative to musb->ctrl_base */
+#define USB_CTRL_TX_MODE	0x70
+#define USB_CTRL_RX_MODE	0x74
+#define USB_GENRNDIS_EP(ep)	(0x80 + ((ep) - 1) * 4)
+#define USB_CTRL_AUTOREQ	0xd0
+#define USB_TDOWN		0xd8
+
+/* Two bits per endpoint in the mode and autoreq registers */
+#define EP_FIELD_SHIFT(ep)	(((ep) - 1) * 2)
+#define EP_FIELD_MASK(ep)	(3 << EP_FIELD_SHIFT(ep))
+#define EP_MODE_TRANSPARENT	0
+#define EP_MODE_GEN_RNDIS	3
+#define EP_AUTOREQ_NONE		0
+#define EP_AUTOREQ_ALL_NEOP	1
+
+/* Largest transfer the generic RNDIS size register can describe */
+#define RNDIS_MAX_LEN		0x10000
+
+#define CPPI41_PORT_CHANS	15
+#define CPPI41_ABORT_TRIES	1000
+
+struct cppi41_dma_controller;
+
+struct cppi41_dma_channel {
+	struct dma_channel channel;
+	struct cppi41_dma_controller *controller;
+	struct musb_hw_ep *hw_ep;
+	struct cppi41_chan *chan;
+	u8 is_tx;
+	u8 draining;		/* all data moved, waiting for the FIFO */
+	u16 packet_sz;
+	u32 buf;
+	u32 total;
+	u32 done;
+	u32 chunk;
+};
+
+struct cppi41_dma_controller {
+	struct dma_controller controller;
+	struct musb *musb;
+	struct cppi41_dma_channel tx[CPPI41_PORT_CHANS];
+	struct cppi41_dma_channel rx[CPPI41_PORT_CHANS];
+};
+
+/* The engine is shared by both ports */
+static struct cppi41 *cppi;
+static int cppi_users;
+
+static void update_ep_field(struct musb *musb, unsigned reg, u8 ep, u32 val)
+{
+	u32 old, new;
+
+	old = musb_readl(musb->ctrl_base, reg);
+	new = (old & ~EP_FIELD_MASK(ep)) | (val << EP_FIELD_SHIFT(ep));
+	if (new != old)
+		musb_writel(musb->ctrl_base, reg, new);
+}
+
+static int cppi41_start_chunk(struct cppi41_dma_channel *cc)
+{
+	struct musb *musb = cc->controller->musb;
+	u8 ep = cc->hw_ep->epnum;
+	u32 left = cc->total - cc->done;
+	u32 len = left;
+	u32 mode = EP_MODE_TRANSPARENT;
+	u32 autoreq = EP_AUTOREQ_NONE;
+	u16 csr;
+	int ret;
+
+	if (left > cc->packet_sz) {
+		len = min_t(u32, left, RNDIS_MAX_LEN);
+		if (!cc->is_tx)
+			len -= len % cc->packet_sz;
+		mode = EP_MODE_GEN_RNDIS;
+		autoreq = EP_AUTOREQ_ALL_NEOP;
+		musb_writel(musb->ctrl_base, USB_GENRNDIS_EP(ep), len);
+	}
+	cc->chunk = len;
+
+	if (cc->is_tx) {
+		update_ep_field(musb, USB_CTRL_TX_MODE, ep, mode);
+	} else {
+		update_ep_field(musb, USB_CTRL_RX_MODE, ep, mode);
+		if (is_host_active(musb))
+			update_ep_field(musb, USB_CTRL_AUTOREQ, ep, autoreq);
+	}
+
+	ret = cppi41_chan_submit(cc->chan, cc->buf + cc->done, len);
+
+	/* The core only sends the first IN token of a transfer */
+	if (!ret && !cc->is_tx && cc->done && is_host_active(musb)) {
+		musb_ep_select(musb->mregs, ep);
+		csr = musb_readw(cc->hw_ep->regs, MUSB_RXCSR);
+		musb_writew(cc->hw_ep->regs, MUSB_RXCSR, MUSB_RXCSR_H_WZC_BITS |
+			    csr | MUSB_RXCSR_H_REQPKT);
+	}
+
+	return ret;
+}
+
+static int cppi41_dma_start(struct dma_controller *c)
+{
+	return 0;
+}
+
+static int cppi41_dma_stop(struct dma_controller *c)
+{
+	return 0;
+}
+
+static struct dma_channel *cppi41_dma_channel_allocate(struct dma_controller *c,
+				struct musb_hw_ep *hw_ep, u8 is_tx)
+{
+	struct cppi41_dma_controller *controller = container_of(c,
+			struct cppi41_dma_controller, controller);
+	struct cppi41_dma_channel *cc;
+	u8 ep = hw_ep->epnum;
+
+	if (!ep || ep > CPPI41_PORT_CHANS)
+		return NULL;
+
+	cc = is_tx ? &controller->tx[ep - 1] : &controller->rx[ep - 1];
+	if (cc->channel.status != MUSB_DMA_STATUS_UNKNOWN)
+		return NULL;
+
+	cc->hw_ep = hw_ep;
+	cc->channel.status = MUSB_DMA_STATUS_FREE;
+	cc->channel.actual_len = 0;
+
+	return &cc->channel;
+}
+
+static void cppi41_dma_channel_release(struct dma_channel *channel)
+{
+	struct cppi41_dma_channel *cc = channel->private_data;
+
+	if (channel->status == MUSB_DMA_STATUS_BUSY)
+		channel->status = MUSB_DMA_STATUS_CORE_ABORT;
+	if (channel->status == MUSB_DMA_STATUS_CORE_ABORT)
+		cc->controller->controller.channel_abort(channel);
+	channel->status = MUSB_DMA_STATUS_UNKNOWN;
+	cc->hw_ep = NULL;
+}
+
+/*
+ * RX buffers are invalidated rather than flushed, so they must not share
+ * cache lines with anything else. They must also hold whole packets,
+ * since the DMA cannot stop in the middle of one.
+ */
+static int cppi41_dma_buf_ok(struct cppi41_dma_channel *cc, u16 maxpacket,
+			     unsigned long addr, u32 len)
+{
+	if (cc->is_tx)
+		return 1;
+
+	return !(addr & (ARCH_DMA_MINALIGN - 1)) &&
+		!(len & (ARCH_DMA_MINALIGN - 1)) && !(len % maxpacket);
+}
+
+static int cppi41_dma_is_compatible(struct dma_channel *channel,
+				    u16 maxpacket, void *buf, u32 length)
+{
+	return cppi41_dma_buf_ok(channel->private_data, maxpacket,
+				 (unsigned long)buf, length);
+}
+
+static int cppi41_dma_channel_program(struct dma_channel *channel,
+				      u16 packet_sz, u8 mode,
+				      dma_addr_t dma_addr, u32 len)
+{
+	struct cppi41_dma_channel *cc = channel->private_data;
+	unsigned long start = dma_addr;
+
+	if (!len || !cppi41_dma_buf_ok(cc, packet_sz, start, len))
+		return false;
+	/*
+	 * A TX ending in a zero length packet is left to PIO. For TX,
+	 * @mode is the gadget request's zero flag or the host URB's
+	 * URB_ZERO_PACKET.
+	 */
+	if (cc->is_tx && mode && !(len % packet_sz))
+		return false;
+
+	if (cc->is_tx)
+		flush_dcache_range(start & ~(ARCH_DMA_MINALIGN - 1),
+				   ALIGN(start + len, ARCH_DMA_MINALIGN));
+	else
+		invalidate_dcache_range(start, start + len);
+
+	cc->packet_sz = packet_sz;
+	cc->buf = dma_addr;
+	cc->total = len;
+	cc->done = 0;
+	cc->draining = 0;
+	channel->actual_len = 0;
+	channel->status = MUSB_DMA_STATUS_BUSY;
+
+	if (cppi41_start_chunk(cc)) {
+		channel->status = MUSB_DMA_STATUS_FREE;
+		return false;
+	}
+
+	return true;
+}
+
+static int cppi41_dma_channel_abort(struct dma_channel *channel)
+{
+	struct cppi41_dma_channel *cc = channel->private_data;
+	struct musb *musb = cc->controller->musb;
+	u8 ep = cc->hw_ep->epnum;
+	u32 tdbit = cc->is_tx ? 1 << (ep + 16) : 1 << ep;
+	int tries = CPPI41_ABORT_TRIES;
+	int ret;
+
+	if (channel->status != MUSB_DMA_STATUS_BUSY &&
+	    channel->status != MUSB_DMA_STATUS_CORE_ABORT)
+		return 0;
+
+	if (!cc->draining) {
+		do {
+			musb_writel(musb->ctrl_base, USB_TDOWN, tdbit);
+			ret = cppi41_chan_abort(cc->chan);
+			if (ret == -EAGAIN)
+				udelay(1);
+		} while (ret == -EAGAIN && --tries);
+		if (ret)
+			printf("musb: ep%d %s DMA teardown timed out\n", ep,
+			       cc->is_tx ? "tx" : "rx");
+	}
+
+	channel->actual_len = cc->done;
+	channel->status = MUSB_DMA_STATUS_FREE;
+
+	return 0;
+}
+
+static int cppi41_tx_fifo_empty(struct cppi41_dma_channel *cc)
+{
+	struct musb *musb = cc->controller->musb;
+	u16 csr;
+
+	musb_ep_select(musb->mregs, cc->hw_ep->epnum);
+	csr = musb_readw(cc->hw_ep->regs, MUSB_TXCSR);
+
+	return !(csr & (MUSB_TXCSR_TXPKTRDY | MUSB_TXCSR_FIFONOTEMPTY));
+}
+
+static void cppi41_dma_channel_poll(struct cppi41_dma_channel *cc)
+{
+	struct musb *musb = cc->controller->musb;
+	u32 actual = 0;
+	int ret;
+
+	if (!cc->draining) {
+		ret = cppi41_chan_poll(cc->chan, &actual);
+		if (!ret)
+			return;
+		cc->done += actual;
+
+		if (!cc->is_tx) {
+			unsigned long start = cc->buf + cc->done - actual;
+
+			invalidate_dcache_range(start,
+					ALIGN(start + actual, ARCH_DMA_MINALIGN));
+		}
+
+		/* Move on to the next chunk unless this one ended short */
+		if (ret > 0 && actual == cc->chunk && cc->done < cc->total &&
+		    !cppi41_start_chunk(cc))
+			return;
+		cc->draining = cc->is_tx;
+	}
+
+	/* The last packets may still be in the FIFO */
+	if (cc->draining && !cppi41_tx_fifo_empty(cc))
+		return;
+
+	cc->draining = 0;
+	cc->channel.actual_len = cc->done;
+	cc->channel.status = MUSB_DMA_STATUS_FREE;
+	musb_dma_completion(musb, cc->hw_ep->epnum, cc->is_tx);
+}
+
+void cppi41_dma_poll(struct dma_controller *c)
+{
+	struct cppi41_dma_controller *controller = container_of(c,
+			struct cppi41_dma_controller, controller);
+	int i;
+
+	for (i = 0; i < CPPI41_PORT_CHANS; i++) {
+		if (controller->tx[i].channel.status == MUSB_DMA_STATUS_BUSY)
+			cppi41_dma_channel_poll(&controller->tx[i]);
+		if (controller->rx[i].channel.status == MUSB_DMA_STATUS_BUSY)
+			cppi41_dma_channel_poll(&controller->rx[i]);
+	}
+}
+
+static void cppi41_dma_init_channel(struct cppi41_dma_controller *controller,
+				    struct cppi41_dma_channel *cc, int num,
+				    int is_tx)
+{
+	cc->controller = controller;
+	cc->chan = cppi41_chan_get(cppi, num, is_tx);
+	cc->is_tx = is_tx;
+	cc->channel.private_data = cc;
+	cc->channel.max_len = CPPI41_MAX_LEN;
+	cc->channel.status = MUSB_DMA_STATUS_UNKNOWN;
+}
+
+struct dma_controller *__init
+dma_controller_create(struct musb *musb, void __iomem *base)
+{
+	struct cppi41_dma_controller *controller;
+	int port = (unsigned long)musb->ctrl_base == USB1_OTG_BASE;
+	int i;
+
+	controller = calloc(1, sizeof(*controller));
+	if (!controller)
+		return NULL;
+
+	if (!cppi) {
+		cppi = cppi41_init((void *)USB_CPPI41_DMA_BASE,
+				   (void *)USB_CPPI41_SCHED_BASE,
+				   (void *)USB_CPPI41_QMGR_BASE);
+		if (!cppi) {
+			free(controller);
+			return NULL;
+		}
+	}
+	cppi_users++;
+
+	controller->musb = musb;
+	controller->controller.start = cppi41_dma_start;
+	controller->controller.stop = cppi41_dma_stop;
+	controller->controller.channel_alloc = cppi41_dma_channel_allocate;
+	controller->controller.channel_release = cppi41_dma_channel_release;
+	controller->controller.channel_program = cppi41_dma_channel_program;
+	controller->controller.channel_abort = cppi41_dma_channel_abort;
+	controller->controller.is_compatible = cppi41_dma_is_compatible;
+
+	for (i = 0; i < CPPI41_PORT_CHANS; i++) {
+		cppi41_dma_init_channel(controller, &controller->tx[i],
+					i + port * CPPI41_PORT_CHANS, 1);
+		cppi41_dma_init_channel(controller, &controller->rx[i],
+					i + port * CPPI41_PORT_CHANS, 0);
+	}
+
+	return &controller->controller;
+}
+
+void dma_controller_destroy(struct dma_controller *c)
+{
+	struct cppi41_dma_controller *controller = container_of(c,
+			struct cppi41_dma_controller, controller);
+
+	free(controller);
+	if (!--cppi_users) {
+		cppi41_exit(cppi);
+		cppi = NULL;
+	}
+}
@@ -68,7 +68,7 @@ struct musb_hw_ep;
 #define	is_dma_capable()	(0)
 #endif
 
-#ifdef CONFIG_USB_TI_CPPI_DMA
+#if defined(CONFIG_USB_TI_CPPI_DMA) || defined(CONFIG_USB_TI_CPPI41_DMA)
 #define	is_cppi_enabled()	1
 #else
 #define	is_cppi_enabled()	0
@@ -183,4 +183,9 @@ dma_controller_create(struct musb *, void __iomem *);
 
 extern void dma_controller_destroy(struct dma_controller *);
 
+#ifdef CONFIG_USB_TI_CPPI41_DMA
+/* U-Boot has no DMA interrupt, so the glue polls for completions */
+extern void cppi41_dma_poll(struct dma_controller *);
+#endif
+
 #endif	/* __MUSB_DMA_H__ */
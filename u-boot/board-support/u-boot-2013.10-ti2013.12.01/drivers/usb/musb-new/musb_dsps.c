@@ -317,6 +317,11 @@ static irqreturn_t dsps_interrupt(int irq, void *hci)
 
 	spin_lock_irqsave(&musb->lock, flags);
 
+#ifdef CONFIG_USB_TI_CPPI41_DMA
+	if (musb->dma_controller)
+		cppi41_dma_poll(musb->dma_controller);
+#endif
+
 	/* Get endpoint interrupts */
 	epintr = dsps_readl(reg_base, wrp->epintr_status);
 	musb->int_rx = (epintr & wrp->rxep_bitmap) >> wrp->rxep_shift;
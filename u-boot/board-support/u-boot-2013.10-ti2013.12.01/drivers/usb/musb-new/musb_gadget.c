@@ -436,7 +436,7 @@ static void txstate(struct musb *musb, struct musb_request *req)
 			}
 		}
 
-#elif defined(CONFIG_USB_TI_CPPI_DMA)
+#elif defined(CONFIG_USB_TI_CPPI_DMA) || defined(CONFIG_USB_TI_CPPI41_DMA)
 		/* program endpoint CSR first, then setup DMA */
 		csr &= ~(MUSB_TXCSR_P_UNDERRUN | MUSB_TXCSR_TXPKTRDY);
 		csr |= MUSB_TXCSR_DMAENAB | MUSB_TXCSR_DMAMODE |
@@ -457,10 +457,15 @@ static void txstate(struct musb *musb, struct musb_request *req)
 		/* "mode" is irrelevant here; handle terminating ZLPs like
 		 * PIO does, since the hardware RNDIS mode seems unreliable
 		 * except for the last-packet-is-already-short case.
+		 * CPPI 4.1 takes the zero flag to leave those to PIO.
 		 */
 		use_dma = use_dma && c->channel_program(
 				musb_ep->dma, musb_ep->packet_sz,
+#ifdef CONFIG_USB_TI_CPPI41_DMA
+				request->zero,
+#else
 				0,
+#endif
 				request->dma + request->actual,
 				request_size);
 		if (!use_dma) {
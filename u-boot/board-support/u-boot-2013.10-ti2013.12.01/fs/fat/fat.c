@@ -806,6 +806,27 @@ exit:
 __u8 do_fat_read_at_block[MAX_CLUSTSIZE]
 	__aligned(ARCH_DMA_MINALIGN);
 
+/*
+ * The FAT window buffer is kept between calls, so that loading a file
+ * does not cost a memalign()/free() pair in the malloc arena each time.
+ * It is only reallocated when a volume with larger sectors comes along.
+ */
+static __u8 *do_fat_read_at_fatbuf;
+static __u32 do_fat_read_at_fatbuf_size;
+
+static __u8 *get_fatbuf(fsdata *mydata)
+{
+	if (do_fat_read_at_fatbuf_size < FATBUFSIZE) {
+		free(do_fat_read_at_fatbuf);
+		do_fat_read_at_fatbuf = memalign(ARCH_DMA_MINALIGN,
+						 FATBUFSIZE);
+		do_fat_read_at_fatbuf_size = do_fat_read_at_fatbuf ?
+					     FATBUFSIZE : 0;
+	}
+
+	return do_fat_read_at_fatbuf;
+}
+
 long
 do_fat_read_at(const char *filename, unsigned long pos, void *buffer,
 	       unsigned long maxsize, int dols)
@@ -866,7 +887,7 @@ do_fat_read_at(const char *filename, unsigned long pos, void *buffer,
 	}
 
 	mydata->fatbufnum = -1;
-	mydata->fatbuf = memalign(ARCH_DMA_MINALIGN, FATBUFSIZE);
+	mydata->fatbuf = get_fatbuf(mydata);
 	if (mydata->fatbuf == NULL) {
 		debug("Error: allocating memory\n");
 		return -1;
@@ -1156,7 +1177,6 @@ rootdir_done:
 	debug("Size: %d, got: %ld\n", FAT2CPU32(dentptr->size), ret);
 
 exit:
-	free(mydata->fatbuf);
 	return ret;
 }
 
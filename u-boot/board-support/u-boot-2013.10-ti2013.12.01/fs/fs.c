@@ -21,6 +21,7 @@
 #include <fat.h>
 #include <fs.h>
 #include <sandboxfs.h>
+#include <asm/errno.h>
 #include <asm/io.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -59,6 +60,8 @@ static inline void fs_close_unsupported(void)
 
 struct fstype_info {
 	int fstype;
+	/* Whether probe() copes without a block device, as for "host" */
+	bool null_dev_desc_ok;
 	int (*probe)(block_dev_desc_t *fs_dev_desc,
 		     disk_partition_t *fs_partition);
 	int (*ls)(const char *dirname);
@@ -89,6 +92,7 @@ static struct fstype_info fstypes[] = {
 #ifdef CONFIG_SANDBOX
 	{
 		.fstype = FS_TYPE_SANDBOX,
+		.null_dev_desc_ok = true,
 		.probe = sandbox_fs_set_blk_dev,
 		.close = sandbox_fs_close,
 		.ls = sandbox_fs_ls,
@@ -150,6 +154,9 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 				fstype != info->fstype)
 			continue;
 
+		if (!fs_dev_desc && !info->null_dev_desc_ok)
+			continue;
+
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
 			return 0;
@@ -230,6 +237,61 @@ int fs_write(const char *filename, ulong addr, int offset, int len)
 	return ret;
 }
 
+struct fs_image {
+	const char *ifname;
+	const char *dev_part_str;
+	int fstype;
+	const char *filename;
+};
+
+#ifdef CONFIG_FIT
+static int fs_image_read(void *priv, ulong pos, ulong size, void *buf)
+{
+	struct fs_image *img = priv;
+
+	if (fs_set_blk_dev(img->ifname, img->dev_part_str, img->fstype))
+		return -ENODEV;
+	if (fs_read(img->filename, map_to_sysmem(buf), pos, size) != size)
+		return -EIO;
+
+	return 0;
+}
+#endif
+
+/*
+ * Read a FIT with external data as far as its structure, then the images
+ * of its default configuration; read anything else whole. Like fs_read()
+ * this is called with the device set, and returns the number of bytes read
+ * at addr, or -1 on error.
+ */
+static int fs_read_image(struct fs_image *img, ulong addr)
+{
+	int len;
+#ifdef CONFIG_FIT
+	void *buf;
+
+	len = fs_read(img->filename, addr, 0, sizeof(struct fdt_header));
+	if (len < 0)
+		return len;
+	buf = map_sysmem(addr, 0);
+	if (genimg_get_format(buf) == IMAGE_FORMAT_FIT)
+		len = fdt_totalsize(buf);
+	else
+		len = 0;
+
+	if (fs_set_blk_dev(img->ifname, img->dev_part_str, img->fstype))
+		return -1;
+	len = fs_read(img->filename, addr, 0, len);
+	if (len > 0 && fit_has_external(buf) &&
+	    fit_load_external(buf, NULL, fs_image_read, img))
+		return -1;
+#else
+	len = fs_read(img->filename, addr, 0, 0);
+#endif
+
+	return len;
+}
+
 int do_load(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[],
 		int fstype)
 {
@@ -240,11 +302,13 @@ int do_load(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[],
 	unsigned long pos;
 	int len_read;
 	unsigned long time;
+	const char *suffix;
 
 	if (argc < 2)
 		return CMD_RET_USAGE;
 	if (argc > 7)
 		return CMD_RET_USAGE;
+	suffix = strchr(argv[0], '.');
 
 	if (fs_set_blk_dev(argv[1], (argc >= 3) ? argv[2] : NULL, fstype))
 		return 1;
@@ -277,7 +341,15 @@ int do_load(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[],
 		pos = 0;
 
 	time = get_timer(0);
-	len_read = fs_read(filename, addr, pos, bytes);
+	if (suffix && !strcmp(suffix, ".image")) {
+		struct fs_image img = {
+			argv[1], argc >= 3 ? argv[2] : NULL, fstype, filename
+		};
+
+		len_read = fs_read_image(&img, addr);
+	} else {
+		len_read = fs_read(filename, addr, pos, bytes);
+	}
 	time = get_timer(time);
 	if (len_read <= 0)
 		return 1;
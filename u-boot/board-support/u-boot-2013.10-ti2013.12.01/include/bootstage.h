@@ -192,6 +192,9 @@ enum bootstage_id {
 
 	BOOTSTAGE_ID_ACCUM_LCD,
 
+	BOOTSTAGE_ID_SPL_LOAD_START,	/* SPL starts loading its payload */
+	BOOTSTAGE_ID_SPL_LOAD_DONE,	/* payload loaded, about to jump */
+
 	/* a few spare for the user, from here */
 	BOOTSTAGE_ID_USER,
 	BOOTSTAGE_ID_COUNT = BOOTSTAGE_ID_USER + CONFIG_BOOTSTAGE_USER_COUNT,
@@ -217,8 +220,8 @@ void show_boot_progress(int val);
 #define show_boot_progress(val) do {} while (0)
 #endif
 
-#if defined(CONFIG_BOOTSTAGE) && !defined(CONFIG_SPL_BUILD) && \
-	!defined(USE_HOSTCC)
+#if defined(CONFIG_BOOTSTAGE) && !defined(USE_HOSTCC) && \
+	(!defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_BOOTSTAGE))
 /* This is the full bootstage implementation */
 
 /**
@@ -61,6 +61,20 @@
 
 #define CONFIG_PREBOOT
 
+/*
+ * A/B slots: with "boot_slot" set to a or b, nandboot takes the kernel, DT
+ * and root filesystem from the UBI volumes kernel_<slot>, dtb_<slot> and
+ * rootfs_<slot> in NAND.rootfs (see flash_rootfs_ab). Without it, the
+ * single slot layout of flash_all is booted. A system installed into the
+ * other slot boots on trial with upgrade_available=1 until Linux confirms
+ * it; after "bootlimit" boots that did not, altbootcmd switches back. So
+ * that a failed trial counts without anyone cycling the power, a slot
+ * that cannot be loaded or booted resets the board (ab_failed) and its
+ * kernel reboots 5 s after a panic.
+ */
+#define CONFIG_BOOTCOUNT_LIMIT
+#define CONFIG_BOOTCOUNT_ENV
+
 /* Always 128 KiB env size */
 #define CONFIG_ENV_SIZE			(128 << 10)
 
@@ -225,7 +239,8 @@
 	        	"root=/dev/mmcblk0p2 rw rootwait quiet;" \
                 "bootm 0x80200000 - 0x80F00000\0" \
         "bootcmd=run sdboot\0" \
-        "preboot=ext4load mmc 0:2 0x80200000 /etc/ft-logo.bmp; lcd l\0"\
+        "preboot=fatload mmc 0:1 0x80200000 bootlogo.rle || " \
+		"ext4load mmc 0:2 0x80200000 /etc/ft-logo.bmp; lcd l\0"\
         "flash_erase=nand erase.chip\0" \
         "flash_rootfs=mtdparts default;"\
         	"nand erase.part NAND.rootfs; " \
@@ -260,7 +275,8 @@
 	"flash_bootlogo=mtdparts default; " \
 		"nand erase.part NAND.bootlogo; " \
 		"mw.b 0x80200000 0xff 0x40000; "\
-		"fatload mmc 0:1 0x80200000 bootlogo.bmp; "\
+		"fatload mmc 0:1 0x80200000 bootlogo.rle || " \
+			"fatload mmc 0:1 0x80200000 bootlogo.bmp; "\
 		"nand write 0x80200000 NAND.bootlogo 0x${filesize}\0" \
         "usbflash_rootfs=mtdparts default;usb start;"\
         	"nand erase.part NAND.rootfs; " \
@@ -295,7 +311,8 @@
 	"usbflash_bootlogo=mtdparts default;usb start; " \
 		"nand erase.part NAND.bootlogo; " \
 		"mw.b 0x80200000 0xff 0x40000; "\
-		"fatload usb 0:1 0x80200000 bootlogo.bmp; "\
+		"fatload usb 0:1 0x80200000 bootlogo.rle || " \
+			"fatload usb 0:1 0x80200000 bootlogo.bmp; "\
 		"nand write 0x80200000 NAND.bootlogo 0x${filesize}\0" \
 	"flash_all=run flash_erase; run flash_u-boot; run flash_spl; " \
 		"run flash_rootfs; run flash_dtb; run flash_uImage; " \
@@ -309,16 +326,82 @@
 		"setenv bootcmd run nandboot; " \
 		"setenv preboot run nandpreboot; " \
 		"saveenv\0" \
-	"nandpreboot=mtdparts default; nand read 0x80200000 NAND.bootlogo; lcd l\0" \
+	"nandpreboot=mtdparts default; nand read.image 0x80200000 NAND.bootlogo; lcd l\0" \
 	"nandboot=run reset_wl18xx; mtdparts default; " \
 		"mtdparts default; " \
-		"nand read 0x80200000 NAND.uImage; " \
-		"nand read 0x80F00000 NAND.dtb; " \
+		"if test -n \"${boot_slot}\"; then " \
+			"ubi part NAND.rootfs || run ab_failed; " \
+			"ubi read.image 0x80200000 kernel_${boot_slot} || " \
+				"run ab_failed; " \
+			"ubi read.image 0x80F00000 dtb_${boot_slot} || " \
+				"run ab_failed; " \
+			"setenv rootvol rootfs_${boot_slot}; " \
+			"setenv abargs panic=5; " \
+		"else " \
+			"nand read.image 0x80200000 NAND.uImage; " \
+			"nand read.image 0x80F00000 NAND.dtb; " \
+			"setenv rootvol rootfs; " \
+			"setenv abargs; " \
+		"fi; " \
                 "fdt addr 0x80F00000; " \
                 "run opp;" \
 		"setenv bootargs fbtft_device.name=txt_ili9341 fbtft_device.fps=10 console=ttyO0,115200 " \
-			"ubi.mtd=10 root=ubi0:rootfs rootfstype=ubifs rootwait quiet; " \
-		"bootm 0x80200000 - 0x80F00000\0"
+			"ubi.mtd=10 root=ubi0:${rootvol} rootfstype=ubifs rootwait quiet " \
+			"${abargs}; " \
+		"bootm 0x80200000 - 0x80F00000; " \
+		"run ab_failed\0" \
+	"ab_failed=if test x${upgrade_available} = x1; then " \
+			"echo Slot ${boot_slot} failed on trial, resetting; " \
+			"reset; " \
+		"fi\0" \
+	"bootlimit=3\0" \
+	"altbootcmd=if test x${boot_slot} = xa; then " \
+			"setenv boot_slot b; " \
+		"elif test x${boot_slot} = xb; then " \
+			"setenv boot_slot a; " \
+		"fi; " \
+		"setenv upgrade_available 0; setenv bootcount 0; saveenv; " \
+		"run bootcmd\0" \
+	"ab_rootfs_size=0x3000000\0" \
+	"ab_check_rootfs=if fatload mmc 0:1 0x80200000 rootfs.ubifs; then " \
+			"if itest 0x${filesize} -le ${ab_rootfs_size}; then " \
+				"true; " \
+			"else " \
+				"echo rootfs.ubifs is 0x${filesize} bytes, " \
+					"more than ab_rootfs_size ${ab_rootfs_size}; " \
+				"echo It does not fit an A/B slot, use flash_all; " \
+				"false; " \
+			"fi; " \
+		"else " \
+			"false; " \
+		"fi\0" \
+	"flash_rootfs_ab=run ab_check_rootfs && " \
+		"mtdparts default && " \
+		"nand erase.part NAND.rootfs && " \
+		"ubi part NAND.rootfs && " \
+		"ubi create kernel_a 0x500000 && ubi create kernel_b 0x500000 && " \
+		"ubi create dtb_a 0x40000 && ubi create dtb_b 0x40000 && " \
+		"ubi create rootfs_a ${ab_rootfs_size} && " \
+		"ubi create rootfs_b ${ab_rootfs_size} && " \
+		"ubi write 0x80200000 rootfs_a 0x${filesize} && " \
+		"ubi write 0x80200000 rootfs_b 0x${filesize} && " \
+		"fatload mmc 0:1 0x80200000 uImage && " \
+		"ubi write 0x80200000 kernel_a 0x${filesize} && " \
+		"ubi write 0x80200000 kernel_b 0x${filesize} && " \
+		"fatload mmc 0:1 0x80200000 am335x-kno_txt.dtb && " \
+		"ubi write 0x80200000 dtb_a 0x${filesize} && " \
+		"ubi write 0x80200000 dtb_b 0x${filesize} && " \
+		"setenv boot_slot a && " \
+		"setenv upgrade_available 0 && setenv bootcount 0\0" \
+	"flash_all_ab=if run ab_check_rootfs; then " \
+			"run flash_erase; run flash_u-boot; run flash_spl; " \
+			"if run flash_rootfs_ab; then " \
+				"run flash_bootlogo; " \
+				"setenv bootcmd run nandboot; " \
+				"setenv preboot run nandpreboot; " \
+				"saveenv; " \
+			"fi; " \
+		"fi\0"
 		
 #endif
 
@@ -352,8 +435,50 @@
 #define CONFIG_SYS_MEMTEST_END  (CONFIG_SYS_MEMTEST_START + 224 * 1024 *1024)
 #define CONFIG_SYS_MEMTEST_SCRATCH      (CONFIG_SYS_MEMTEST_END + 1024)    /* dummy address */
 
+/*
+ * Boot timing. SPL records how long it takes to load its payload and
+ * stashes the records just below its BSS, where U-Boot picks them up
+ * again; see "bootstage report".
+ */
+#define CONFIG_BOOTSTAGE
+#define CONFIG_CMD_BOOTSTAGE
+#define CONFIG_BOOTSTAGE_STASH		0x809ff000
+#define CONFIG_BOOTSTAGE_STASH_SIZE	0x1000
+
+/* malloc arena and UBI slab usage, see "malloc info" */
+#define CONFIG_CMD_MALLOC
+
+/* Hash lookups in the device tree fixed up by bootm */
+#define CONFIG_FDT_INDEX
+
+/*
+ * Profiling, see doc/README.trace: build with FTRACE=1 to trace every
+ * function call, or FTRACE=sample to only sample the PC. The trace is
+ * kept in a ring and handed on to Linux in a reserved memory region.
+ */
+#if defined(FTRACE) || defined(FTRACE_SAMPLE)
+#define CONFIG_TRACE
+#define CONFIG_CMD_TRACE
+#define CONFIG_TRACE_BUFFER_SIZE	(16 << 20)
+#define CONFIG_TRACE_RING
+#define CONFIG_TRACE_SAMPLE
+#define CONFIG_TRACE_SAMPLE_HZ		1000
+#define CONFIG_USE_IRQ
+#define CONFIG_STACKSIZE_IRQ		(4 << 10)
+#define CONFIG_STACKSIZE_FIQ		(4 << 10)
+#endif
+
 /* SPL */
 #ifndef CONFIG_NOR_BOOT
+#define CONFIG_SPL_BOOTSTAGE
+
+/*
+ * Run the SPL image load with MMU, L1/L2 caches and branch prediction
+ * on. All 256MiB of DDR are mapped cacheable; the page table comes from
+ * the SPL malloc pool.
+ */
+#define CONFIG_SPL_CACHE_SUPPORT
+#define CONFIG_SPL_CACHE_DDR_SIZE	(256 << 20)
 #define CONFIG_SPL_POWER_SUPPORT
 #define CONFIG_SPL_YMODEM_SUPPORT
 
@@ -367,6 +492,8 @@
 #define CONFIG_SPL_NET_SUPPORT
 #define CONFIG_SPL_ENV_SUPPORT
 #define CONFIG_SPL_NET_VCI_STRING	"AM335x U-Boot SPL"
+/* Hand the BOOTP lease on in SRAM, after the other scratch words */
+#define CONFIG_SPL_NET_LEASE_ADDR	(SRAM_SCRATCH_SPACE_ADDR + 0x100)
 
 /* SPI flash. */
 #define CONFIG_SPL_SPI_SUPPORT
@@ -475,7 +602,13 @@
 #define CONFIG_USB_MUSB_DSPS
 #define CONFIG_ARCH_MISC_INIT
 #define CONFIG_MUSB_GADGET
+#ifdef CONFIG_SPL_BUILD
 #define CONFIG_MUSB_PIO_ONLY
+#else
+/* Move bulk data with the USB subsystem's CPPI 4.1 DMA */
+#define CONFIG_TI_CPPI41
+#define CONFIG_USB_TI_CPPI41_DMA
+#endif
 #define CONFIG_MUSB_DISABLE_BULK_COMBINE_SPLIT
 #define CONFIG_USB_GADGET
 #define CONFIG_USBDOWNLOAD_GADGET
@@ -490,12 +623,36 @@
 #ifdef CONFIG_MUSB_HOST
 #define CONFIG_CMD_USB
 #define CONFIG_USB_STORAGE
+/* musb-new takes transfers of any length, so move 1MiB per command */
+#define CONFIG_USB_MAX_XFER_BLK	2048
 #endif
 
 #ifdef CONFIG_MUSB_GADGET
 #define CONFIG_USB_ETHER
 #define CONFIG_USB_ETH_RNDIS
+#define CONFIG_USB_ETH_RNDIS_MAX_PKTS	8
 #define CONFIG_USBNET_HOST_ADDR	"de:ad:be:af:00:00"
+/* USB flow control keeps RNDIS lossless, so TFTP can stream blocks */
+#define CONFIG_TFTP_WINDOWSIZE	16
+/* wget and its TCP client are for U-Boot proper only */
+#ifndef CONFIG_SPL_BUILD
+#define CONFIG_CMD_WGET
+#define CONFIG_WGET_CRC32
+#endif
+/* 16KiB NFSv3 reads, several at once; SPL has no room for defrag */
+#ifndef CONFIG_SPL_BUILD
+#define CONFIG_IP_DEFRAG
+#define CONFIG_NFS_READ_WINDOW	8
+#endif
+
+/* Expose the SD card to a host PC with "ums 0 0" */
+#ifndef CONFIG_SPL_BUILD
+#define CONFIG_USB_GADGET_MASS_STORAGE
+#define CONFIG_CMD_USB_MASS_STORAGE
+#define CONFIG_USB_GADGET_STORAGE_NUM_BUFFERS	4
+#define CONFIG_USB_GADGET_STORAGE_BUFLEN	(64 * 1024)
+#define CONFIG_USB_GADGET_STORAGE_CACHE_SIZE	(1024 * 1024)
+#endif
 
 /* USB TI's IDs */
 #define CONFIG_G_DNL_VENDOR_NUM 0x0403
@@ -25,6 +25,7 @@
 #define CONFIG_OF_CONTROL
 #define CONFIG_OF_HOSTFILE
 #define CONFIG_OF_LIBFDT
+#define CONFIG_FDT_INDEX
 #define CONFIG_LMB
 #define CONFIG_FIT
 #define CONFIG_FIT_SIGNATURE
@@ -37,6 +38,7 @@
 #define CONFIG_CMD_FAT
 #define CONFIG_CMD_EXT4
 #define CONFIG_CMD_EXT4_WRITE
+#define CONFIG_CMD_FS_GENERIC
 
 #define CONFIG_SYS_VSNPRINTF
 
@@ -44,6 +46,17 @@
 #define CONFIG_SANDBOX_GPIO
 #define CONFIG_SANDBOX_GPIO_COUNT	20
 
+#define CONFIG_TI_CPPI41
+#define CONFIG_SANDBOX_CPPI41
+
+#define CONFIG_DFU_FUNCTION
+#define CONFIG_DFU_RAM
+
+/* RNDIS message handling only, as there is no USB device controller */
+#define CONFIG_USB_ETH_RNDIS
+#define CONFIG_USB_ETH_RNDIS_MAX_PKTS	8
+#define CONFIG_SYS_CACHELINE_SIZE	64
+
 /*
  * Size of malloc() pool, although we don't actually use this yet.
  */
@@ -92,9 +105,13 @@
 /* include default commands */
 #include <config_cmd_default.h>
 
-/* We don't have networking support yet */
-#undef CONFIG_CMD_NET
-#undef CONFIG_CMD_NFS
+/* Networking through a host TAP interface or test code */
+#define CONFIG_SANDBOX_ETH
+#define CONFIG_ETHADDR		02:00:11:22:33:44
+#define CONFIG_CMD_WGET
+#define CONFIG_WGET_CRC32
+#define CONFIG_IP_DEFRAG
+#define CONFIG_SPL_NET_LEASE_ADDR	0x1000
 
 #define CONFIG_CMD_HASH
 #define CONFIG_HASH_VERIFY
@@ -102,6 +119,7 @@
 #define CONFIG_SHA256
 
 #define CONFIG_CMD_SANDBOX
+#define CONFIG_CMD_MALLOC
 
 #define CONFIG_BOOTARGS ""
 
@@ -0,0 +1,227 @@
+/*
+ * TI CPPI 4.1 DMA engine and queue manager
+ *
+ * This is the part of CPPI 4.1 found in the AM335x USB subsystem: a
+ * queue manager with one descriptor region and 30 TX plus 30 RX DMA
+ * channels, each channel feeding one MUSB endpoint FIFO. Transfers use
+ * host packet descriptors with a single buffer, and each channel has at
+ * most one descriptor in flight, which is how the MUSB glue drives it.
+ *
+ * Completions are found by polling the completion queues, so no
+ * interrupt support is needed.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __CPPI41_H
+#define __CPPI41_H
+
+#define CPPI41_NUM_CHANS	30
+
+/* Descriptors are one cache line each, so they can be flushed alone */
+#define CPPI41_DESC_SHIFT	6
+#define CPPI41_DESC_SIZE	(1 << CPPI41_DESC_SHIFT)
+#define CPPI41_NUM_DESCS_SHIFT	6
+#define CPPI41_NUM_DESCS	(1 << CPPI41_NUM_DESCS_SHIFT)
+
+/* Largest buffer one host packet descriptor can describe */
+#define CPPI41_MAX_LEN		((1 << 22) - 1)
+
+/* Queue manager registers */
+#define CPPI41_QMGR_LRAM0_BASE		0x80
+#define CPPI41_QMGR_LRAM_SIZE		0x84
+#define CPPI41_QMGR_LRAM1_BASE		0x88
+#define CPPI41_QMGR_MEMBASE(x)		(0x1000 + (x) * 0x10)
+#define CPPI41_QMGR_MEMCTRL(x)		(0x1004 + (x) * 0x10)
+#define CPPI41_QMGR_MEMCTRL_IDX_SHIFT	16
+#define CPPI41_QMGR_MEMCTRL_DESC_SHIFT	8
+#define CPPI41_QMGR_QUEUE_A(n)		(0x2000 + (n) * 0x10)
+#define CPPI41_QMGR_QUEUE_D(n)		(0x200c + (n) * 0x10)
+
+/* The low bits of a queue push/pop give the descriptor size hint */
+#define CPPI41_QUEUE_DESC_MASK		0x1f
+
+/* DMA controller registers */
+#define CPPI41_DMA_TDFDQ		0x04
+#define CPPI41_DMA_TXGCR(x)		(0x800 + (x) * 0x20)
+#define CPPI41_DMA_RXGCR(x)		(0x808 + (x) * 0x20)
+#define CPPI41_DMA_RXHPCRA(x)		(0x80c + (x) * 0x20)
+#define CPPI41_DMA_RXHPCRB(x)		(0x810 + (x) * 0x20)
+
+#define CPPI41_GCR_CHAN_ENABLE		(1 << 31)
+#define CPPI41_GCR_TEARDOWN		(1 << 30)
+#define CPPI41_GCR_STARV_RETRY		(1 << 24)
+#define CPPI41_GCR_DESC_TYPE_HOST	(1 << 14)
+#define CPPI41_GCR_QUEUE_MASK		0xfff
+
+/* DMA scheduler registers */
+#define CPPI41_SCHED_CTRL		0x00
+#define CPPI41_SCHED_CTRL_ENABLE	(1 << 31)
+#define CPPI41_SCHED_WORD(x)		(0x800 + (x) * 4)
+#define CPPI41_SCHED_WORD_IS_RX		(1 << 7)
+
+/* Host packet descriptor fields */
+#define CPPI41_DESC_TYPE_SHIFT		27
+#define CPPI41_DESC_TYPE_HOST		0x10
+#define CPPI41_DESC_TYPE_TEARDOWN	0x13
+#define CPPI41_DESC_TYPE_MASK		0x1f
+#define CPPI41_DESC_LEN_MASK		CPPI41_MAX_LEN
+#define CPPI41_DESC_PKT_TYPE_USB	(5 << 26)
+#define CPPI41_DESC_RETQ_MASK		0xfff
+
+/* Teardown descriptor, as returned by the DMA */
+#define CPPI41_TD_IS_RX			(1 << 16)
+#define CPPI41_TD_CHAN_MASK		0x1f
+
+/* Fixed queue assignment in the AM335x USB subsystem */
+#define CPPI41_TD_COMPLETE_Q		0
+#define CPPI41_TD_FREE_Q		31
+#define CPPI41_RX_SUBMIT_Q(ch)		(1 + (ch))
+#define CPPI41_TX_SUBMIT_Q(ch)		(32 + 2 * (ch))
+#define CPPI41_TX_COMPLETE_Q(ch)	((ch) < 15 ? 93 + (ch) : 125 + (ch) - 15)
+#define CPPI41_RX_COMPLETE_Q(ch)	((ch) < 15 ? 109 + (ch) : 141 + (ch) - 15)
+#define CPPI41_NUM_QUEUES		156
+
+/**
+ * struct cppi41_desc - Host packet descriptor
+ *
+ * @pd0:	Descriptor type and packet length
+ * @pd1:	Source and destination tags (unused)
+ * @pd2:	Packet type and return queue
+ * @pd3:	Length of the buffer
+ * @pd4:	Buffer pointer
+ * @pd5:	Next descriptor, always 0 here
+ * @pd6:	Original buffer length, which RX fills up to
+ * @pd7:	Original buffer pointer
+ */
+struct cppi41_desc {
+	u32 pd0;
+	u32 pd1;
+	u32 pd2;
+	u32 pd3;
+	u32 pd4;
+	u32 pd5;
+	u32 pd6;
+	u32 pd7;
+	u32 pad[(CPPI41_DESC_SIZE / 4) - 8];
+};
+
+struct cppi41;
+
+/**
+ * struct cppi41_chan - One direction of one DMA channel
+ *
+ * @cppi:	Controller this channel belongs to
+ * @num:	Channel number, 0 to CPPI41_NUM_CHANS - 1
+ * @is_tx:	1 for a TX (memory to FIFO) channel, 0 for RX
+ * @submit_q:	Queue descriptors are pushed to (free queue for RX)
+ * @complete_q:	Queue the DMA returns finished descriptors to
+ * @desc:	The channel's descriptor
+ * @busy:	1 while @desc belongs to the hardware
+ * @enabled:	0 after a teardown, until the next submit re-enables it
+ * @tearing:	1 while the channel is being torn down
+ * @td_seen:	The teardown descriptor has come back
+ */
+struct cppi41_chan {
+	struct cppi41 *cppi;
+	int num;
+	int is_tx;
+	int submit_q;
+	int complete_q;
+	struct cppi41_desc *desc;
+	int busy;
+	int enabled;
+	int tearing;
+	int td_seen;
+};
+
+/**
+ * struct cppi41 - A CPPI 4.1 DMA controller and its queue manager
+ *
+ * @ctrl:	DMA controller registers
+ * @sched:	DMA scheduler registers
+ * @qmgr:	Queue manager registers
+ * @descs:	Descriptor region, CPPI41_NUM_DESCS entries
+ * @linkram:	Linking RAM for the descriptor region
+ * @td:		Descriptor lent to the DMA for channel teardown
+ * @td_owner:	Channel being torn down, as there is only one @td
+ * @tx:		TX channels
+ * @rx:		RX channels
+ */
+struct cppi41 {
+	void *ctrl;
+	void *sched;
+	void *qmgr;
+	struct cppi41_desc *descs;
+	u32 *linkram;
+	struct cppi41_desc *td;
+	struct cppi41_chan *td_owner;
+	struct cppi41_chan tx[CPPI41_NUM_CHANS];
+	struct cppi41_chan rx[CPPI41_NUM_CHANS];
+};
+
+/**
+ * cppi41_init() - Set up the queue manager, scheduler and channels
+ *
+ * Allocates the descriptor region and its linking RAM, programs the
+ * queue manager with them, enables every channel with its fixed queues
+ * and starts the scheduler.
+ *
+ * @ctrl:	Base of the DMA controller registers
+ * @sched:	Base of the DMA scheduler registers
+ * @qmgr:	Base of the queue manager registers
+ * @return new controller, or NULL if out of memory
+ */
+struct cppi41 *cppi41_init(void *ctrl, void *sched, void *qmgr);
+
+/**
+ * cppi41_exit() - Stop the scheduler and free a controller
+ *
+ * All channels must be idle.
+ */
+void cppi41_exit(struct cppi41 *cppi);
+
+/**
+ * cppi41_chan_get() - Look up a channel
+ *
+ * @return channel, or NULL if @num is out of range
+ */
+struct cppi41_chan *cppi41_chan_get(struct cppi41 *cppi, int num, int is_tx);
+
+/**
+ * cppi41_chan_submit() - Start one transfer on a channel
+ *
+ * The caller looks after the cache for the buffer itself; the
+ * descriptor is flushed here.
+ *
+ * @chan:	Channel to use
+ * @addr:	Bus address of the buffer
+ * @len:	Bytes to send, or the room in the buffer for RX
+ * @return 0 if started, -EBUSY if a transfer is already in flight,
+ *	-EINVAL if @len is 0 or above CPPI41_MAX_LEN
+ */
+int cppi41_chan_submit(struct cppi41_chan *chan, u32 addr, u32 len);
+
+/**
+ * cppi41_chan_poll() - Check whether a transfer has finished
+ *
+ * @chan:	Channel to check
+ * @actual:	Returns the number of bytes moved when done
+ * @return 1 if the transfer finished, 0 if it is still running or none
+ *	was started, -EIO if the completion queue held something other
+ *	than this channel's descriptor (which is dropped)
+ */
+int cppi41_chan_poll(struct cppi41_chan *chan, u32 *actual);
+
+/**
+ * cppi41_chan_abort() - Tear a channel down
+ *
+ * This needs calling until it returns 0; in between, the caller has to
+ * ask the endpoint to give the channel up as well (the MUSB wrapper's
+ * teardown register does this).
+ *
+ * @return 0 once the channel is idle, -EAGAIN while teardown is running
+ */
+int cppi41_chan_abort(struct cppi41_chan *chan);
+
+#endif /* __CPPI41_H */
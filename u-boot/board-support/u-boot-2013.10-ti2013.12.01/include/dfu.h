@@ -77,6 +77,14 @@ static inline unsigned int get_mmc_blk_size(int dev)
 #ifndef CONFIG_SYS_DFU_MAX_FILE_SIZE
 #define CONFIG_SYS_DFU_MAX_FILE_SIZE CONFIG_SYS_DFU_DATA_BUF_SIZE
 #endif
+/* The data buffer is split in this many parts, written in turn */
+#ifndef CONFIG_SYS_DFU_NUM_BUFS
+#define CONFIG_SYS_DFU_NUM_BUFS		2
+#endif
+/* Most bytes written to the medium between two USB polls */
+#ifndef CONFIG_SYS_DFU_WRITE_SLICE
+#define CONFIG_SYS_DFU_WRITE_SLICE	(128 * 1024)
+#endif
 
 struct dfu_entity {
 	char			name[DFU_NAME_SIZE];
@@ -100,6 +108,13 @@ struct dfu_entity {
 
 	int (*flush_medium)(struct dfu_entity *dfu);
 
+	/*
+	 * Optional: get the medium ready for len bytes at offset, doing a
+	 * bounded amount of work. Returns > 0 if it did some work, 0 once
+	 * the medium is ready or -ve on error.
+	 */
+	int (*prepare_medium)(struct dfu_entity *dfu, u64 offset, long len);
+
 	struct list_head list;
 
 	/* on the fly state */
@@ -113,6 +128,8 @@ struct dfu_entity {
 	long b_left;
 
 	u32 bad_skip;	/* for nand use */
+	u64 erased;	/* for nand use: good bytes erased ahead */
+	u32 erase_skip;	/* for nand use: bad bytes skipped by erasing */
 
 	unsigned int inited:1;
 };
@@ -134,6 +151,18 @@ unsigned char *dfu_free_buf(void);
 
 int dfu_read(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
 int dfu_write(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
+
+/**
+ * Write part of the received data to the medium
+ *
+ * Full buffers are written in the background: call this whenever the
+ * USB side is idle. Each call does at most CONFIG_SYS_DFU_WRITE_SLICE
+ * bytes of writing, or one step of medium preparation.
+ *
+ * @return 1 if some work was done, 0 if there is nothing to do, or
+ *	-ve on error
+ */
+int dfu_flush_poll(void);
 /* Device specific */
 #ifdef CONFIG_DFU_MMC
 extern int dfu_fill_entity_mmc(struct dfu_entity *dfu, char *s);
@@ -43,6 +43,38 @@ int fdt_fixup_memory_banks(void *blob, u64 start[], u64 size[], int banks);
 void fdt_fixup_ethernet(void *fdt);
 int fdt_find_and_setprop(void *fdt, const char *node, const char *prop,
 			 const void *val, int len, int create);
+int fdt_fixup_setprop(void *fdt, const char *path, const char *prop,
+		      const void *val, int len);
+int fdt_fixup_add_node(void *fdt, const char *path);
+int fdt_fixup_node_exists(void *fdt, const char *path);
+int fdt_fixup_add_mem_rsv(void *fdt, u64 addr, u64 size);
+int fdt_fixup_del_mem_rsv(void *fdt, u64 addr);
+
+/*
+ * Batched fixups (common/fdt_batch.c)
+ *
+ * While a batch is open on a blob, the fdt_fixup_*() helpers above and
+ * the fixups built on them (fdt_chosen(), fdt_initrd(),
+ * fdt_fixup_memory_banks(), fdt_fixup_ethernet(), do_fixup_by_path(),
+ * fdt_resize(), ...) only record their changes. fdt_batch_commit()
+ * then applies all of them in a single pass over the blob. Changes made
+ * directly with libfdt in the meantime are kept, but do not see the
+ * queued ones. Only one batch can be open at a time.
+ */
+struct fdt_batch;
+
+struct fdt_batch *fdt_batch_begin(void *fdt);
+struct fdt_batch *fdt_batch_get(const void *fdt);
+int fdt_batch_add_node(struct fdt_batch *batch, const char *path);
+int fdt_batch_has_node(struct fdt_batch *batch, const char *path);
+int fdt_batch_setprop(struct fdt_batch *batch, const char *path,
+		      const char *name, const void *val, int len);
+int fdt_batch_add_mem_rsv(struct fdt_batch *batch, u64 addr, u64 size);
+int fdt_batch_del_mem_rsv(struct fdt_batch *batch, u64 addr);
+/* Bytes the blob will use once the batch is committed, or -ve error */
+int fdt_batch_size(struct fdt_batch *batch);
+/* Apply and close the batch; the blob must have room (see fdt_batch_size) */
+int fdt_batch_commit(struct fdt_batch *batch);
 void fdt_fixup_qe_firmware(void *fdt);
 
 #if defined(CONFIG_HAS_FSL_DR_USB) || defined(CONFIG_HAS_FSL_MPH_USB)
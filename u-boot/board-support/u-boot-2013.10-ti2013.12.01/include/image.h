@@ -403,6 +403,7 @@ enum fit_load_op {
 #define IMAGE_FORMAT_FIT	0x02	/* new, libfdt based format */
 
 int genimg_get_format(const void *img_addr);
+ulong genimg_get_image_size(const void *img_addr);
 int genimg_has_config(bootm_headers_t *images);
 ulong genimg_get_image(ulong img_addr);
 
@@ -675,6 +676,8 @@ int bootz_setup(ulong image, ulong *start, ulong *end);
 
 /* image node */
 #define FIT_DATA_PROP		"data"
+#define FIT_DATA_OFFSET_PROP	"data-offset"
+#define FIT_DATA_SIZE_PROP	"data-size"
 #define FIT_TIMESTAMP_PROP	"timestamp"
 #define FIT_DESC_PROP		"description"
 #define FIT_ARCH_PROP		"arch"
@@ -713,6 +716,20 @@ static inline ulong fit_get_size(const void *fit)
 	return fdt_totalsize(fit);
 }
 
+/**
+ * fit_get_data_base() - get the offset of external data in a FIT
+ *
+ * Images with a data-offset property have their data stored after the
+ * FIT structure rather than in it, data-offset bytes past this point.
+ *
+ * @fit:	FIT to check
+ * @return offset from the start of the FIT of external data offset 0
+ */
+static inline ulong fit_get_data_base(const void *fit)
+{
+	return (fdt_totalsize(fit) + 3) & ~3;
+}
+
 /**
  * fit_get_end - get FIT image end
  * @fit: pointer to the FIT format image header
@@ -751,6 +768,16 @@ int fit_image_get_load(const void *fit, int noffset, ulong *load);
 int fit_image_get_entry(const void *fit, int noffset, ulong *entry);
 int fit_image_get_data(const void *fit, int noffset,
 				const void **data, size_t *size);
+int fit_image_get_data_offset(const void *fit, int noffset, int *offset);
+int fit_image_get_data_size(const void *fit, int noffset, int *size);
+
+/**
+ * fit_has_external() - check whether any image in a FIT has external data
+ *
+ * @fit:	FIT to check
+ * @return 1 if an image has a data-offset property, else 0
+ */
+int fit_has_external(const void *fit);
 
 int fit_image_hash_get_algo(const void *fit, int noffset, char **algo);
 int fit_image_hash_get_value(const void *fit, int noffset, uint8_t **value,
@@ -811,6 +838,41 @@ void fit_conf_print(const void *fit, int noffset, const char *p);
 int fit_check_ramdisk(const void *fit, int os_noffset,
 		uint8_t arch, int verify);
 
+#ifndef USE_HOSTCC
+/**
+ * fit_read_fn - read part of a FIT from where it is stored
+ *
+ * @priv:	Private data of the caller of fit_load_external()
+ * @offset:	Offset from the start of the FIT
+ * @size:	Number of bytes to read
+ * @buf:	Place to put them
+ * @return 0 if ok, -ve on error
+ */
+typedef int (*fit_read_fn)(void *priv, ulong offset, ulong size, void *buf);
+
+/**
+ * fit_load_external() - read the external data a configuration uses
+ *
+ * Given a FIT of which only the structure has been read, this reads the
+ * kernel, FDT and ramdisk of one configuration. Those which are not
+ * compressed and have a load address are read straight to it, so bootm
+ * need not move them; the others go where they are in the FIT. Images
+ * which other configurations use are not read at all.
+ *
+ * The data-offset of each image read is changed to say where it went.
+ * Signatures do not cover data-offset and data-size, and hashes are
+ * still checked on the data wherever it is.
+ *
+ * @fit:	FIT structure, as far as fit_get_size()
+ * @conf_uname:	Configuration to read, or NULL for the default one
+ * @read:	Function to read from the FIT's storage
+ * @priv:	Passed to @read
+ * @return 0 if ok, or if the FIT has no external data, -ve on error
+ */
+int fit_load_external(void *fit, const char *conf_uname, fit_read_fn read,
+		      void *priv);
+#endif
+
 int calculate_hash(const void *data, int data_len, const char *algo,
 			uint8_t *value, int *value_len);
 
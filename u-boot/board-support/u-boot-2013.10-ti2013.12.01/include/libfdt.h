@@ -1575,4 +1575,41 @@ int fdt_find_regions(const void *fdt, char * const inc[], int inc_count,
 		     struct fdt_region region[], int max_regions,
 		     char *path, int path_len, int add_string_tab);
 
+/**
+ * fdt_index_enable() - build a lookup index for a device tree
+ *
+ * Once enabled, fdt_subnode_offset() (and so fdt_path_offset()),
+ * fdt_node_offset_by_compatible() and fdt_node_offset_by_phandle() use
+ * hash tables built from a single pass over the tree instead of
+ * scanning it. Results are the same as without the index.
+ *
+ * Any libfdt write to the tree invalidates the index, and lookups fall
+ * back to scanning. The index is rebuilt once a few lookups have been
+ * made without further writes. Callers which change the tree without
+ * using libfdt must call fdt_index_invalidate() themselves, or call
+ * fdt_index_enable() again: on an indexed tree it checks the index
+ * against a checksum of the tree and rebuilds it if they differ.
+ *
+ * @fdt:	Device tree to index
+ * @return 0 if ok, -FDT_ERR_NOSPACE if out of memory, other -ve FDT error
+ */
+int fdt_index_enable(const void *fdt);
+
+/**
+ * fdt_index_disable() - drop the lookup index for a device tree
+ *
+ * This must be called before the memory holding an indexed tree is
+ * freed or reused for something else.
+ *
+ * @fdt:	Device tree, which need not be valid any more
+ */
+void fdt_index_disable(const void *fdt);
+
+/**
+ * fdt_index_invalidate() - mark the lookup index stale after a change
+ *
+ * @fdt:	Device tree which has been modified
+ */
+void fdt_index_invalidate(const void *fdt);
+
 #endif /* _LIBFDT_H */
@@ -0,0 +1,81 @@
+/*
+ * Fixed-size object pools on top of malloc()
+ *
+ * Subsystems that churn through many small objects of one size (UBI
+ * eraseblock bookkeeping, scan results, ...) allocate them from a pool
+ * instead of going through dlmalloc for each one. A pool grabs objects
+ * from malloc() a chunk at a time, hands them out from a free list and
+ * gives all chunks back with a single malloc_pool_reset() once the
+ * objects are no longer needed, e.g. at the end of a scan or detach.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __MALLOC_POOL_H
+#define __MALLOC_POOL_H
+
+struct malloc_pool_chunk;
+
+struct malloc_pool {
+	const char *name;
+	unsigned int obj_size;		/* rounded up to pointer alignment */
+	unsigned int per_chunk;		/* objects carved from each chunk */
+	void *free_list;
+	struct malloc_pool_chunk *chunks;
+	struct malloc_pool *next;	/* list of all pools, for statistics */
+
+	/* Statistics */
+	unsigned long allocs;		/* successful malloc_pool_alloc() */
+	unsigned long in_use;		/* objects currently handed out */
+	unsigned long peak;		/* highest value of in_use */
+	unsigned int num_chunks;	/* chunks currently held */
+};
+
+/**
+ * malloc_pool_create() - Set up a pool of fixed-size objects
+ *
+ * @name:	Name shown in the statistics (not copied)
+ * @size:	Size of each object in bytes
+ * @return new pool, or NULL if out of memory
+ */
+struct malloc_pool *malloc_pool_create(const char *name, unsigned int size);
+
+/**
+ * malloc_pool_alloc() - Allocate one object from a pool
+ *
+ * The contents of the object are undefined.
+ *
+ * @pool:	Pool to allocate from
+ * @return pointer to the object, or NULL if out of memory
+ */
+void *malloc_pool_alloc(struct malloc_pool *pool);
+
+/**
+ * malloc_pool_free() - Return an object to its pool
+ *
+ * @pool:	Pool the object was allocated from
+ * @ptr:	Object to free, may be NULL
+ */
+void malloc_pool_free(struct malloc_pool *pool, void *ptr);
+
+/**
+ * malloc_pool_reset() - Free every object of a pool at once
+ *
+ * All chunks go back to malloc(), so any object still held by the
+ * caller becomes invalid. The pool itself stays usable.
+ *
+ * @pool:	Pool to reset
+ */
+void malloc_pool_reset(struct malloc_pool *pool);
+
+/**
+ * malloc_pool_destroy() - Reset a pool and free the pool itself
+ *
+ * @pool:	Pool to destroy, may be NULL
+ */
+void malloc_pool_destroy(struct malloc_pool *pool);
+
+/* Print per-pool statistics */
+void malloc_pool_stats(void);
+
+#endif /* __MALLOC_POOL_H */
@@ -244,6 +244,7 @@ struct vlan_ethernet_hdr {
 #define PROT_VLAN	0x8100		/* IEEE 802.1q protocol		*/
 
 #define IPPROTO_ICMP	 1	/* Internet Control Message Protocol	*/
+#define IPPROTO_TCP	 6	/* Transmission Control Protocol	*/
 #define IPPROTO_UDP	17	/* User Datagram Protocol		*/
 
 /*
@@ -383,6 +384,11 @@ struct icmp_hdr {
 #define PKTSIZE_ALIGN		1536
 /*#define PKTSIZE		608*/
 
+#if defined(CONFIG_IP_DEFRAG) && !defined(CONFIG_NET_MAXDEFRAG)
+/* Largest UDP payload we reassemble from IP fragments */
+#define CONFIG_NET_MAXDEFRAG	16384
+#endif
+
 /*
  * Maximum receive ring size; that is, the number of packets
  * we can buffer before overflow happens. Basically, this just
@@ -437,7 +443,7 @@ extern int		NetRestartWrap;		/* Tried all network devices */
 
 enum proto_t {
 	BOOTP, RARP, ARP, TFTPGET, DHCP, PING, DNS, NFS, CDP, NETCONS, SNTP,
-	TFTPSRV, TFTPPUT, LINKLOCAL
+	TFTPSRV, TFTPPUT, LINKLOCAL, WGET
 };
 
 /* from net/net.c */
@@ -545,6 +551,19 @@ static inline void NetSendPacket(uchar *pkt, int len)
 extern int NetSendUDPPacket(uchar *ether, IPaddr_t dest, int dport,
 			int sport, int payload_len);
 
+/*
+ * Transmit "NetTxPacket" as an IP packet of the given protocol, performing
+ * ARP request if needed (ether will be populated). The payload must already
+ * be in place after the Ethernet and IP headers.
+ *
+ * @param ether Raw packet buffer
+ * @param dest IP address to send the datagram to
+ * @param proto IP protocol number
+ * @param payload_len Length of data after the IP header
+ */
+int net_send_ip_packet(uchar *ether, IPaddr_t dest, int proto,
+		       int payload_len);
+
 /* Processes a received packet */
 extern void NetReceive(uchar *, int);
 
@@ -580,6 +599,27 @@ static inline void eth_set_last_protocol(int protocol)
  */
 void net_auto_load(void);
 
+/*
+ * A BOOTP/DHCP lease SPL leaves at CONFIG_SPL_NET_LEASE_ADDR. The first
+ * bootp or dhcp in U-Boot proper on the same interface takes it instead
+ * of asking the server again. Addresses are in network byte order.
+ */
+struct net_lease {
+	u32		magic;
+	uchar		ether[6];	/* interface the lease is for */
+	uchar		server_ether[6]; /* how to reach the server */
+	IPaddr_t	ip;
+	IPaddr_t	netmask;
+	IPaddr_t	gateway;
+	IPaddr_t	server;
+	IPaddr_t	dns;
+};
+
+#define NET_LEASE_MAGIC	0x4c534553	/* "LSES" */
+
+/* Leave the current lease for U-Boot proper */
+void net_save_lease(void);
+
 /*
  * The following functions are a bit ugly, but necessary to deal with
  * alignment restrictions on ARM.
@@ -170,6 +170,14 @@ int os_dirent_ls(const char *dirname, struct os_dirent_node **headp);
  */
 const char *os_dirent_get_typename(enum os_dirent_t type);
 
+/**
+ * Open a host TAP interface for Ethernet frames
+ *
+ * @param name		Name of the interface, which is created if needed
+ * @return file descriptor to read and write frames, or -1 on error
+ */
+int os_tap_open(const char *name);
+
 /**
  * Get the size of a file
  *
@@ -0,0 +1,36 @@
+/*
+ * Run length encoded RGB565 boot logo, written by "bmp_logo --gen-rle" and
+ * shown by "lcd logo"
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _RLE_LOGO_H
+#define _RLE_LOGO_H
+
+/*
+ * The header is followed by data_size bytes of pixels in the panel's
+ * RGB565, top row first and each row left to right, so that they can be
+ * written to the panel as they are decoded. Numbers are little endian.
+ *
+ * The pixels come in runs, which may cross rows. A run starts with a
+ * control byte c:
+ *
+ *	c & RLE_LOGO_REPEAT	one u16 pixel follows, which is repeated
+ *				(c & RLE_LOGO_COUNT) + 1 times
+ *	otherwise		c + 1 u16 pixels follow
+ */
+#define RLE_LOGO_MAGIC		"RLE5"
+#define RLE_LOGO_MAGIC_LEN	4
+#define RLE_LOGO_REPEAT		0x80
+#define RLE_LOGO_COUNT		0x7f
+#define RLE_LOGO_MAX_RUN	(RLE_LOGO_COUNT + 1)
+
+struct rle_logo_header {
+	char		magic[RLE_LOGO_MAGIC_LEN];
+	uint16_t	width;
+	uint16_t	height;
+	uint32_t	data_size;	/* bytes following the header */
+} __attribute__ ((packed));
+
+#endif /* _RLE_LOGO_H */
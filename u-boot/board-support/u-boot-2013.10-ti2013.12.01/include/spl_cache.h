@@ -0,0 +1,95 @@
+/*
+ * Minimal MMU and cache handling for SPL
+ *
+ * SPL normally runs its whole image load with the MMU and D-cache off.
+ * These helpers build a flat, identity-mapped section table in which
+ * only the regions the board asks for (normally DDR) are cacheable, and
+ * describe the order in which the caches have to be shut down again
+ * before control is passed to U-Boot or the kernel.
+ *
+ * The table builder and the teardown sequence are plain C so that they
+ * can be exercised on the host (see test/spl_cache.c).
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __SPL_CACHE_H
+#define __SPL_CACHE_H
+
+/* ARMv7 short-descriptor translation table: 4096 1MiB sections */
+#define SPL_MMU_SECTION_SHIFT	20
+#define SPL_MMU_SECTION_SIZE	(1 << SPL_MMU_SECTION_SHIFT)
+#define SPL_MMU_ENTRIES		4096
+#define SPL_MMU_TABLE_SIZE	(SPL_MMU_ENTRIES * sizeof(u32))
+#define SPL_MMU_TABLE_ALIGN	(16 << 10)
+
+/* Section AP[1:0] = 0b11, read/write at any privilege level */
+#define SPL_MMU_SECTION_AP_RW	(3 << 10)
+
+/**
+ * struct spl_mmu_region - A region with non-default section attributes
+ *
+ * @start:	Physical start address, rounded down to a section
+ * @size:	Size in bytes, rounded up to a whole number of sections
+ * @option:	Section descriptor type/cache bits (enum dcache_option on ARM)
+ */
+struct spl_mmu_region {
+	ulong start;
+	ulong size;
+	u32 option;
+};
+
+/**
+ * spl_mmu_build_table() - Fill in an identity-mapped section table
+ *
+ * Every section is first mapped with @default_option, then each region
+ * is overlaid in order, so a later region wins where two overlap.
+ *
+ * @table:		Table of SPL_MMU_ENTRIES words, SPL_MMU_TABLE_ALIGN
+ *			aligned when it is handed to the MMU
+ * @default_option:	Attributes for memory not covered by a region
+ * @region:		List of regions to map with their own attributes
+ * @count:		Number of entries in @region
+ * @return number of section entries written for @region, or -EINVAL
+ *	if a region runs past the end of the address space
+ */
+int spl_mmu_build_table(u32 *table, u32 default_option,
+			const struct spl_mmu_region *region, int count);
+
+/**
+ * struct spl_cache_ops - Primitives used to shut the caches down
+ *
+ * @flush_dcache:	Clean and invalidate all data/unified cache levels
+ * @disable_dcache:	Clear SCTLR.C and SCTLR.M
+ * @inval_dcache:	Invalidate all data/unified cache levels
+ * @disable_icache:	Clear SCTLR.I and SCTLR.Z
+ * @inval_icache:	Invalidate I-cache and branch predictor
+ * @inval_tlb:		Invalidate the unified TLB
+ */
+struct spl_cache_ops {
+	void (*flush_dcache)(void);
+	void (*disable_dcache)(void);
+	void (*inval_dcache)(void);
+	void (*disable_icache)(void);
+	void (*inval_icache)(void);
+	void (*inval_tlb)(void);
+};
+
+/**
+ * spl_cache_teardown() - Return to a caches-off, MMU-off state
+ *
+ * Dirty lines are written back before the D-cache and MMU are switched
+ * off, then anything speculatively fetched between the flush and the
+ * SCTLR write is dropped. Only after that are the I-cache, branch
+ * predictor and TLB reset, so the next stage starts from the state the
+ * ROM would have left it in.
+ *
+ * @ops:	Cache primitives for this CPU
+ */
+void spl_cache_teardown(const struct spl_cache_ops *ops);
+
+/* Implemented by the architecture, called from the SPL framework */
+void spl_enable_caches(void);
+void spl_disable_caches(void);
+
+#endif /* __SPL_CACHE_H */
@@ -29,6 +29,7 @@ enum {
 enum trace_chunk_type {
 	TRACE_CHUNK_FUNCS,
 	TRACE_CHUNK_CALLS,
+	TRACE_CHUNK_END,		/* No records, marks end of data */
 };
 
 /* A trace record for a function, as written to the profile output file */
@@ -65,6 +66,7 @@ enum ftrace_flags {
 	FUNCF_EXIT		= 0UL << 30,
 	FUNCF_ENTRY		= 1UL << 30,
 	FUNCF_TEXTBASE		= 2UL << 30,
+	FUNCF_SAMPLE		= 3UL << 30,	/* func is the sampled PC */
 
 	FUNCF_TIMESTAMP_MASK	= 0x3fffffff,
 };
@@ -89,6 +91,72 @@ int trace_list_calls(void *buff, int buff_size, unsigned int *needed);
  */
 void trace_set_enabled(int enabled);
 
+/* Function filters, see trace_add_filter() */
+enum trace_filter_type {
+	TRACE_FILTER_INCLUDE,
+	TRACE_FILTER_EXCLUDE,
+};
+
+/**
+ * Limit which instrumented functions produce call records
+ *
+ * If any include filter is set, only functions inside an include range
+ * are recorded. Functions inside an exclude range are never recorded.
+ * Call counts and depth are still tracked for every function.
+ *
+ * @param type		TRACE_FILTER_INCLUDE or TRACE_FILTER_EXCLUDE
+ * @param start		Start address as shown in System.map
+ * @param size		Size of range in bytes
+ * @return 0 if ok, -1 if there are too many filters
+ */
+int trace_add_filter(enum trace_filter_type type, ulong start, ulong size);
+
+/* Remove all function filters */
+void trace_clear_filters(void);
+
+/**
+ * Record a PC sample in the call trace
+ *
+ * This is called from the profiling timer interrupt. Samples which
+ * arrive while a function entry/exit is being recorded are dropped.
+ *
+ * @param pc		Interrupted program counter
+ */
+void trace_add_sample(void *pc);
+
+/**
+ * Export the trace and stop tracing before handing over to an OS
+ *
+ * The call list is written to the start of the trace buffer in the
+ * format used by 'trace calls' and terminated by a TRACE_CHUNK_END
+ * record, so that it can be read back from the OS (see
+ * fdt_fixup_trace()) and fed straight to proftool.
+ */
+void trace_handoff(void);
+
+/**
+ * Reserve the trace buffer in the device tree passed to the OS
+ *
+ * Adds a memory reservation and a /reserved-memory node for it.
+ *
+ * @param blob		Device tree to update
+ * @return 0 if ok (or tracing is not active), -ve FDT error code
+ */
+int fdt_fixup_trace(void *blob);
+
+#ifdef CONFIG_TRACE_SAMPLE
+/**
+ * Start the profiling timer, which calls trace_add_sample() periodically
+ *
+ * @param hz		Sample rate
+ * @return 0 if ok, -1 on error
+ */
+int trace_sample_start(unsigned int hz);
+
+/* Stop the profiling timer */
+void trace_sample_stop(void);
+#endif
+
 #ifdef CONFIG_TRACE_EARLY
 int trace_early_init(void);
 #else
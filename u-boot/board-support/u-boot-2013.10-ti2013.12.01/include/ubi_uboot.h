@@ -17,6 +17,7 @@
 #include <common.h>
 #include <compiler.h>
 #include <malloc.h>
+#include <malloc_pool.h>
 #include <div64.h>
 #include <linux/crc32.h>
 #include <linux/types.h>
@@ -127,11 +128,13 @@ typedef int	wait_queue_head_t;
 #define up_read(...)			do { } while (0)
 #define up_write(...)			do { } while (0)
 
-struct kmem_cache { int i; };
-#define kmem_cache_create(...)		1
-#define kmem_cache_alloc(obj, gfp)	malloc(sizeof(struct ubi_wl_entry))
-#define kmem_cache_free(obj, size)	free(size)
-#define kmem_cache_destroy(...)
+/* Slab caches are fixed-size object pools, see <malloc_pool.h> */
+#define kmem_cache			malloc_pool
+#define kmem_cache_create(name, size, align, flags, ctor) \
+	malloc_pool_create(name, size)
+#define kmem_cache_alloc(cache, gfp)	malloc_pool_alloc(cache)
+#define kmem_cache_free(cache, obj)	malloc_pool_free(cache, obj)
+#define kmem_cache_destroy(cache)	malloc_pool_destroy(cache)
 
 #define cond_resched()			do { } while (0)
 #define yield()				do { } while (0)
@@ -40,7 +40,7 @@ int fsg_main_thread(void *);
 #ifdef CONFIG_USB_GADGET_MASS_STORAGE
 int fsg_add(struct usb_configuration *c);
 #else
-int fsg_add(struct usb_configuration *c)
+static inline int fsg_add(struct usb_configuration *c)
 {
 	return 0;
 }
@@ -205,5 +205,29 @@ int fdt_move(const void *fdt, void *buf, int bufsize)
 		return -FDT_ERR_NOSPACE;
 
 	memmove(buf, fdt, fdt_totalsize(fdt));
+	_fdt_index_invalidate(buf);
 	return 0;
 }
+
+/* Without fdt_index.c every lookup scans the tree */
+int __attribute__((weak)) _fdt_index_subnode(const void *fdt,
+		int parentoffset, const char *name, int namelen)
+{
+	return FDT_INDEX_NONE;
+}
+
+int __attribute__((weak)) _fdt_index_compatible(const void *fdt,
+		int startoffset, const char *compatible)
+{
+	return FDT_INDEX_NONE;
+}
+
+int __attribute__((weak)) _fdt_index_phandle(const void *fdt,
+					     uint32_t phandle)
+{
+	return FDT_INDEX_NONE;
+}
+
+void __attribute__((weak)) _fdt_index_invalidate(const void *fdt)
+{
+}
@@ -0,0 +1,485 @@
+/*
+ * libfdt - Flat Device Tree manipulation
+ * Lookup index for node names, compatible strings and phandles
+ *
+ * SPDX-License-Identifier:	GPL-2.0+ BSD-2-Clause
+ */
+#include "libfdt_env.h"
+
+#ifndef USE_HOSTCC
+#include <fdt.h>
+#include <libfdt.h>
+#include <malloc.h>
+#else
+#include "fdt_host.h"
+#include <stdlib.h>
+#endif
+
+#include "libfdt_internal.h"
+
+/* Lookups made on a stale index, with no writes between, before a rebuild */
+#define FDT_INDEX_REBUILD	8
+#define FDT_INDEX_MAX_DEPTH	32
+
+/*
+ * Each node is entered under its full name and, if it has a unit
+ * address, under the name without it, matching _fdt_nodename_eq().
+ * The first node entered for a key wins, which is the one a scan finds.
+ */
+struct fdt_index_name {
+	const char *name;	/* Points into the tree, NULL if slot is free */
+	int len;
+	int parent;
+	int node;
+};
+
+/* Nodes with a compatible string are a sorted run in compat_nodes[] */
+struct fdt_index_compat {
+	const char *str;	/* Points into the tree, NULL if slot is free */
+	int first;
+	int count;
+};
+
+struct fdt_index_phandle {
+	uint32_t phandle;	/* 0 if slot is free */
+	int node;
+};
+
+struct fdt_index {
+	struct fdt_index *next;
+	const void *fdt;
+	int valid;
+	int stale;		/* Lookups since the index became invalid */
+
+	/* Header values when built, to catch changes made behind our back */
+	uint32_t off_dt_struct;
+	uint32_t size_dt_struct;
+	uint32_t size_dt_strings;
+	uint32_t sum;		/* Of both blocks, see fdt_index_enable() */
+
+	void *mem;		/* Single allocation holding the tables */
+	int num_nodes;
+	int *nodes;		/* Node offsets in tree order */
+	unsigned int name_mask;
+	struct fdt_index_name *names;
+	unsigned int compat_mask;
+	struct fdt_index_compat *compats;
+	int *compat_nodes;
+	unsigned int phandle_mask;
+	struct fdt_index_phandle *phandles;
+};
+
+/*
+ * libfdt is used before relocation, when BSS is not available, so keep
+ * this in the data section. Indexes are only created after relocation.
+ */
+#ifdef USE_HOSTCC
+static struct fdt_index *index_list;
+#else
+static struct fdt_index *index_list __attribute__((section(".data")));
+#endif
+
+static uint32_t index_hash(const char *str, int len, uint32_t seed)
+{
+	uint32_t hash = 2166136261U ^ seed;	/* FNV-1a */
+	int i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)str[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/* Return a power-of-two mask for a table at most half full */
+static unsigned int index_mask(int entries)
+{
+	unsigned int size = 8;
+
+	while (size < 2 * entries)
+		size <<= 1;
+
+	return size - 1;
+}
+
+static void index_add_name(struct fdt_index *idx, int parent,
+			   const char *name, int len, int node)
+{
+	struct fdt_index_name *slot;
+	unsigned int i;
+
+	for (i = index_hash(name, len, parent) & idx->name_mask;
+	     idx->names[i].name; i = (i + 1) & idx->name_mask) {
+		slot = &idx->names[i];
+		if (slot->parent == parent && slot->len == len &&
+		    !memcmp(slot->name, name, len))
+			return;
+	}
+	slot = &idx->names[i];
+	slot->name = name;
+	slot->len = len;
+	slot->parent = parent;
+	slot->node = node;
+}
+
+static struct fdt_index_compat *index_compat(struct fdt_index *idx,
+					     const char *str, int add)
+{
+	unsigned int i;
+
+	for (i = index_hash(str, strlen(str), 0) & idx->compat_mask;
+	     idx->compats[i].str; i = (i + 1) & idx->compat_mask) {
+		if (!strcmp(idx->compats[i].str, str))
+			return &idx->compats[i];
+	}
+	if (!add)
+		return NULL;
+	idx->compats[i].str = str;
+
+	return &idx->compats[i];
+}
+
+static struct fdt_index_phandle *index_phandle(struct fdt_index *idx,
+					       uint32_t phandle)
+{
+	unsigned int i;
+
+	for (i = (phandle * 2654435761U) & idx->phandle_mask;
+	     idx->phandles[i].phandle; i = (i + 1) & idx->phandle_mask) {
+		if (idx->phandles[i].phandle == phandle)
+			break;
+	}
+
+	return &idx->phandles[i];
+}
+
+/* Checksum the blocks that lookups read, for changes made without libfdt */
+static uint32_t index_sum(const void *fdt)
+{
+	uint32_t sum;
+
+	sum = index_hash((const char *)fdt + fdt_off_dt_struct(fdt),
+			 fdt_size_dt_struct(fdt), 0);
+
+	return index_hash((const char *)fdt + fdt_off_dt_strings(fdt),
+			  fdt_size_dt_strings(fdt), sum);
+}
+
+/* Count the terminated strings in a string list */
+static int index_count_strings(const char *list, int len)
+{
+	int count = 0;
+
+	while (len-- > 0)
+		if (*list++ == '\0')
+			count++;
+
+	return count;
+}
+
+static void index_free_tables(struct fdt_index *idx)
+{
+	free(idx->mem);
+	idx->mem = NULL;
+	idx->valid = 0;
+	idx->stale = 0;
+}
+
+static int index_build(struct fdt_index *idx)
+{
+	const void *fdt = idx->fdt;
+	int parents[FDT_INDEX_MAX_DEPTH];
+	struct fdt_index_compat *compat;
+	struct fdt_index_phandle *ph;
+	int num_nodes = 0, num_strings = 0, num_phandles = 0;
+	int offset, depth, len, i, n, first;
+	const char *name, *at, *prop, *end, *next;
+	uint32_t phandle;
+	char *mem;
+
+	index_free_tables(idx);
+	if (fdt_magic(fdt) != FDT_MAGIC)
+		return -FDT_ERR_BADMAGIC;
+	FDT_CHECK_HEADER(fdt);
+
+	/* First pass to size the tables */
+	for (offset = 0, depth = 0; offset >= 0 && depth >= 0;
+	     offset = fdt_next_node(fdt, offset, &depth)) {
+		if (depth >= FDT_INDEX_MAX_DEPTH)
+			return -FDT_ERR_BADSTRUCTURE;
+		num_nodes++;
+		prop = fdt_getprop(fdt, offset, "compatible", &len);
+		if (prop)
+			num_strings += index_count_strings(prop, len);
+		if (fdt_get_phandle(fdt, offset))
+			num_phandles++;
+	}
+	if (offset < 0)
+		return offset;
+
+	idx->name_mask = index_mask(2 * num_nodes);
+	idx->compat_mask = index_mask(num_strings);
+	idx->phandle_mask = index_mask(num_phandles);
+	mem = calloc(1, (idx->name_mask + 1) * sizeof(*idx->names) +
+		     (idx->compat_mask + 1) * sizeof(*idx->compats) +
+		     (idx->phandle_mask + 1) * sizeof(*idx->phandles) +
+		     (num_nodes + num_strings) * sizeof(int));
+	if (!mem)
+		return -FDT_ERR_NOSPACE;
+	idx->mem = mem;
+	idx->names = (struct fdt_index_name *)mem;
+	mem += (idx->name_mask + 1) * sizeof(*idx->names);
+	idx->compats = (struct fdt_index_compat *)mem;
+	mem += (idx->compat_mask + 1) * sizeof(*idx->compats);
+	idx->phandles = (struct fdt_index_phandle *)mem;
+	mem += (idx->phandle_mask + 1) * sizeof(*idx->phandles);
+	idx->nodes = (int *)mem;
+	idx->compat_nodes = idx->nodes + num_nodes;
+	idx->num_nodes = num_nodes;
+
+	/* Second pass fills in names and phandles, and counts compatibles */
+	for (offset = 0, depth = 0, n = 0; n < num_nodes;
+	     offset = fdt_next_node(fdt, offset, &depth), n++) {
+		idx->nodes[n] = offset;
+		parents[depth] = offset;
+		if (depth > 0) {
+			name = fdt_get_name(fdt, offset, &len);
+			index_add_name(idx, parents[depth - 1], name, len,
+				       offset);
+			at = memchr(name, '@', len);
+			if (at)
+				index_add_name(idx, parents[depth - 1], name,
+					       at - name, offset);
+		}
+		phandle = fdt_get_phandle(fdt, offset);
+		if (phandle) {
+			ph = index_phandle(idx, phandle);
+			if (!ph->phandle) {
+				ph->phandle = phandle;
+				ph->node = offset;
+			}
+		}
+		prop = fdt_getprop(fdt, offset, "compatible", &len);
+		for (end = prop ? prop + len : NULL;
+		     prop && (next = memchr(prop, '\0', end - prop));
+		     prop = next + 1)
+			index_compat(idx, prop, 1)->count++;
+	}
+
+	for (i = 0, first = 0; i <= idx->compat_mask; i++) {
+		compat = &idx->compats[i];
+		compat->first = first;
+		first += compat->count;
+		compat->count = 0;
+	}
+
+	/* Nodes are visited in order, so each run ends up sorted */
+	for (n = 0; n < num_nodes; n++) {
+		offset = idx->nodes[n];
+		prop = fdt_getprop(fdt, offset, "compatible", &len);
+		for (end = prop ? prop + len : NULL;
+		     prop && (next = memchr(prop, '\0', end - prop));
+		     prop = next + 1) {
+			compat = index_compat(idx, prop, 0);
+			idx->compat_nodes[compat->first + compat->count++] =
+				offset;
+		}
+	}
+
+	idx->off_dt_struct = fdt_off_dt_struct(fdt);
+	idx->size_dt_struct = fdt_size_dt_struct(fdt);
+	idx->size_dt_strings = fdt_size_dt_strings(fdt);
+	idx->sum = index_sum(fdt);
+	idx->valid = 1;
+
+	return 0;
+}
+
+static struct fdt_index *index_find(const void *fdt)
+{
+	struct fdt_index *idx;
+
+	for (idx = index_list; idx; idx = idx->next)
+		if (idx->fdt == fdt)
+			return idx;
+
+	return NULL;
+}
+
+static int index_same_header(struct fdt_index *idx)
+{
+	const void *fdt = idx->fdt;
+
+	return fdt_off_dt_struct(fdt) == idx->off_dt_struct &&
+		fdt_size_dt_struct(fdt) == idx->size_dt_struct &&
+		fdt_size_dt_strings(fdt) == idx->size_dt_strings;
+}
+
+/* Return a usable index for a tree, or NULL if the caller must scan */
+static struct fdt_index *index_get(const void *fdt)
+{
+	struct fdt_index *idx;
+
+	if (!index_list)
+		return NULL;
+	idx = index_find(fdt);
+	if (!idx)
+		return NULL;
+	if (idx->valid && !index_same_header(idx))
+		index_free_tables(idx);
+	if (!idx->valid) {
+		if (++idx->stale < FDT_INDEX_REBUILD)
+			return NULL;
+		if (index_build(idx))
+			return NULL;
+	}
+
+	return idx;
+}
+
+/* Check that an offset is the start of a node */
+static int index_is_node(struct fdt_index *idx, int offset)
+{
+	int lo = 0, hi = idx->num_nodes, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (idx->nodes[mid] == offset)
+			return 1;
+		if (idx->nodes[mid] < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return 0;
+}
+
+int _fdt_index_subnode(const void *fdt, int parentoffset,
+		       const char *name, int namelen)
+{
+	struct fdt_index *idx;
+	struct fdt_index_name *slot;
+	unsigned int i;
+
+	idx = index_get(fdt);
+	if (!idx || !index_is_node(idx, parentoffset))
+		return FDT_INDEX_NONE;
+
+	for (i = index_hash(name, namelen, parentoffset) & idx->name_mask;
+	     idx->names[i].name; i = (i + 1) & idx->name_mask) {
+		slot = &idx->names[i];
+		if (slot->parent == parentoffset && slot->len == namelen &&
+		    !memcmp(slot->name, name, namelen))
+			return slot->node;
+	}
+
+	return -FDT_ERR_NOTFOUND;
+}
+
+int _fdt_index_compatible(const void *fdt, int startoffset,
+			  const char *compatible)
+{
+	struct fdt_index *idx;
+	struct fdt_index_compat *compat;
+	int lo, hi, mid;
+
+	idx = index_get(fdt);
+	if (!idx || (startoffset >= 0 && !index_is_node(idx, startoffset)))
+		return FDT_INDEX_NONE;
+
+	compat = index_compat(idx, compatible, 0);
+	if (!compat)
+		return -FDT_ERR_NOTFOUND;
+
+	/* Find the first node after startoffset */
+	lo = compat->first;
+	hi = compat->first + compat->count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (idx->compat_nodes[mid] <= startoffset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == compat->first + compat->count)
+		return -FDT_ERR_NOTFOUND;
+
+	return idx->compat_nodes[lo];
+}
+
+int _fdt_index_phandle(const void *fdt, uint32_t phandle)
+{
+	struct fdt_index *idx;
+	struct fdt_index_phandle *ph;
+
+	idx = index_get(fdt);
+	if (!idx)
+		return FDT_INDEX_NONE;
+
+	ph = index_phandle(idx, phandle);
+	if (!ph->phandle)
+		return -FDT_ERR_NOTFOUND;
+
+	return ph->node;
+}
+
+void _fdt_index_invalidate(const void *fdt)
+{
+	struct fdt_index *idx;
+
+	if (!index_list)
+		return;
+	idx = index_find(fdt);
+	if (idx)
+		index_free_tables(idx);
+}
+
+int fdt_index_enable(const void *fdt)
+{
+	struct fdt_index *idx;
+	int err;
+
+	idx = index_find(fdt);
+	if (idx) {
+		if (idx->valid && index_same_header(idx) &&
+		    index_sum(fdt) == idx->sum)
+			return 0;
+		return index_build(idx);
+	}
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx)
+		return -FDT_ERR_NOSPACE;
+	idx->fdt = fdt;
+	err = index_build(idx);
+	if (err) {
+		free(idx);
+		return err;
+	}
+	idx->next = index_list;
+	index_list = idx;
+
+	return 0;
+}
+
+void fdt_index_disable(const void *fdt)
+{
+	struct fdt_index **pp, *idx;
+
+	for (pp = &index_list; *pp; pp = &(*pp)->next) {
+		idx = *pp;
+		if (idx->fdt == fdt) {
+			*pp = idx->next;
+			index_free_tables(idx);
+			free(idx);
+			return;
+		}
+	}
+}
+
+void fdt_index_invalidate(const void *fdt)
+{
+	_fdt_index_invalidate(fdt);
+}
@@ -91,10 +91,14 @@ static int _nextprop(const void *fdt, int offset)
 int fdt_subnode_offset_namelen(const void *fdt, int offset,
 			       const char *name, int namelen)
 {
-	int depth;
+	int depth, found;
 
 	FDT_CHECK_HEADER(fdt);
 
+	found = _fdt_index_subnode(fdt, offset, name, namelen);
+	if (found != FDT_INDEX_NONE)
+		return found;
+
 	for (depth = 0;
 	     (offset >= 0) && (depth >= 0);
 	     offset = fdt_next_node(fdt, offset, &depth))
@@ -458,6 +462,10 @@ int fdt_node_offset_by_phandle(const void *fdt, uint32_t phandle)
 
 	FDT_CHECK_HEADER(fdt);
 
+	offset = _fdt_index_phandle(fdt, phandle);
+	if (offset != FDT_INDEX_NONE)
+		return offset;
+
 	/* FIXME: The algorithm here is pretty horrible: we
 	 * potentially scan each property of a node in
 	 * fdt_get_phandle(), then if that didn't find what
@@ -513,6 +521,10 @@ int fdt_node_offset_by_compatible(const void *fdt, int startoffset,
 
 	FDT_CHECK_HEADER(fdt);
 
+	offset = _fdt_index_compatible(fdt, startoffset, compatible);
+	if (offset != FDT_INDEX_NONE)
+		return offset;
+
 	/* FIXME: The algorithm here is pretty horrible: we scan each
 	 * property of a node in fdt_node_check_compatible(), then if
 	 * that didn't find what we want, we scan over them again
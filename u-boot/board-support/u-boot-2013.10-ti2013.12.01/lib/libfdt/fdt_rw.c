@@ -63,6 +63,7 @@ static int _fdt_splice(void *fdt, void *splicepoint, int oldlen, int newlen)
 	if ((end - oldlen + newlen) > ((char *)fdt + fdt_totalsize(fdt)))
 		return -FDT_ERR_NOSPACE;
 	memmove(p + newlen, p + oldlen, end - p - oldlen);
+	_fdt_index_invalidate(fdt);
 	return 0;
 }
 
@@ -432,6 +433,7 @@ int fdt_open_into(const void *fdt, void *buf, int bufsize)
 	fdt_set_version(buf, 17);
 	fdt_set_last_comp_version(buf, 16);
 	fdt_set_boot_cpuid_phys(buf, fdt_boot_cpuid_phys(fdt));
+	_fdt_index_invalidate(buf);
 
 	return 0;
 }
@@ -446,6 +448,7 @@ int fdt_pack(void *fdt)
 		* sizeof(struct fdt_reserve_entry);
 	_fdt_packblocks(fdt, fdt, mem_rsv_size, fdt_size_dt_struct(fdt));
 	fdt_set_totalsize(fdt, _fdt_data_size(fdt));
+	_fdt_index_invalidate(fdt);
 
 	return 0;
 }
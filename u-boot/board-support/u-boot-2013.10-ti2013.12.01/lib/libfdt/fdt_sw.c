@@ -48,6 +48,7 @@ int fdt_create(void *buf, int bufsize)
 		return -FDT_ERR_NOSPACE;
 
 	memset(buf, 0, bufsize);
+	_fdt_index_invalidate(buf);
 
 	fdt_set_magic(fdt, FDT_SW_MAGIC);
 	fdt_set_version(fdt, FDT_LAST_SUPPORTED_VERSION);
@@ -47,4 +47,18 @@ static inline struct fdt_reserve_entry *_fdt_mem_rsv_w(void *fdt, int n)
 
 #define FDT_SW_MAGIC		(~FDT_MAGIC)
 
+/*
+ * Lookup index hooks, see fdt_index.c. FDT_INDEX_NONE means that no
+ * usable index exists and the caller should scan the tree itself. When
+ * the index is not built in, weak versions in fdt.c always return it.
+ */
+#define FDT_INDEX_NONE		(-(FDT_ERR_MAX + 1))
+
+int _fdt_index_subnode(const void *fdt, int parentoffset,
+		       const char *name, int namelen);
+int _fdt_index_compatible(const void *fdt, int startoffset,
+			  const char *compatible);
+int _fdt_index_phandle(const void *fdt, uint32_t phandle);
+void _fdt_index_invalidate(const void *fdt);
+
 #endif /* _LIBFDT_INTERNAL_H */
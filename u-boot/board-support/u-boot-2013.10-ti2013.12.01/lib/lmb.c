@@ -319,6 +319,32 @@ phys_addr_t __lmb_alloc_base(struct lmb *lmb, phys_size_t size, ulong align, phy
 	return 0;
 }
 
+/*
+ * Try to allocate a specific address range: it must lie within one memory
+ * region and must not overlap anything already reserved.
+ */
+phys_addr_t lmb_alloc_addr(struct lmb *lmb, phys_addr_t base, phys_size_t size)
+{
+	long i;
+
+	for (i = 0; i < lmb->memory.cnt; i++) {
+		phys_addr_t rgnbase = lmb->memory.region[i].base;
+		phys_size_t rgnsize = lmb->memory.region[i].size;
+
+		if (base >= rgnbase && base + size <= rgnbase + rgnsize)
+			break;
+	}
+	if (i == lmb->memory.cnt)
+		return 0;
+
+	if (lmb_overlaps_region(&lmb->reserved, base, size) >= 0)
+		return 0;
+	if (lmb_add_region(&lmb->reserved, base, size) < 0)
+		return 0;
+
+	return base;
+}
+
 int lmb_is_reserved(struct lmb *lmb, phys_addr_t addr)
 {
 	int i;
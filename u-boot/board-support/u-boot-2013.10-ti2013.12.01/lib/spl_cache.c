@@ -0,0 +1,53 @@
+/*
+ * Minimal MMU and cache handling for SPL
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <spl_cache.h>
+
+static u32 spl_mmu_section(ulong section, u32 option)
+{
+	return (section << SPL_MMU_SECTION_SHIFT) | SPL_MMU_SECTION_AP_RW |
+		option;
+}
+
+int spl_mmu_build_table(u32 *table, u32 default_option,
+			const struct spl_mmu_region *region, int count)
+{
+	ulong i, first, last;
+	int mapped = 0;
+
+	for (i = 0; i < SPL_MMU_ENTRIES; i++)
+		table[i] = spl_mmu_section(i, default_option);
+
+	for (; count > 0; count--, region++) {
+		if (!region->size)
+			continue;
+		first = region->start >> SPL_MMU_SECTION_SHIFT;
+		last = (region->start + region->size - 1) >>
+			SPL_MMU_SECTION_SHIFT;
+		/* Catch wrap-around of start + size on 32-bit hosts too */
+		if (last < first || last >= SPL_MMU_ENTRIES)
+			return -EINVAL;
+
+		for (i = first; i <= last; i++) {
+			table[i] = spl_mmu_section(i, region->option);
+			mapped++;
+		}
+	}
+
+	return mapped;
+}
+
+void spl_cache_teardown(const struct spl_cache_ops *ops)
+{
+	ops->flush_dcache();
+	ops->disable_dcache();
+	ops->inval_dcache();
+	ops->disable_icache();
+	ops->inval_icache();
+	ops->inval_tlb();
+}
@@ -5,6 +5,8 @@
  */
 
 #include <common.h>
+#include <libfdt.h>
+#include <fdt_support.h>
 #include <trace.h>
 #include <asm/io.h>
 #include <asm/sections.h>
@@ -14,6 +16,23 @@ DECLARE_GLOBAL_DATA_PTR;
 static char trace_enabled __attribute__((section(".data")));
 static char trace_inited __attribute__((section(".data")));
 
+/* Set while an entry/exit record is written, so samples keep out */
+static volatile char trace_busy __attribute__((section(".data")));
+
+#define TRACE_MAX_FILTERS	8
+
+/* A range of function sites, in the units used by func_ptr_to_num() */
+struct trace_filter {
+	enum trace_filter_type type;
+	uintptr_t start;
+	uintptr_t end;
+};
+
+static struct trace_filter trace_filters[TRACE_MAX_FILTERS]
+		__attribute__((section(".data")));
+static int trace_filter_count __attribute__((section(".data")));
+static int trace_include_count __attribute__((section(".data")));
+
 /* The header block at the start of the trace memory area */
 struct trace_hdr {
 	int func_count;		/* Total number of function call sites */
@@ -32,6 +51,10 @@ struct trace_hdr {
 	ulong ftrace_size;	/* Num. of ftrace records we have space for */
 	ulong ftrace_count;	/* Num. of ftrace records written */
 	ulong ftrace_too_deep_count;	/* Functions that were too deep */
+	ulong ftrace_filtered_count;	/* Functions that were filtered out */
+	ulong ring_pos;		/* Next record to overwrite (ring mode) */
+	ulong sample_count;	/* Num. of PC samples taken */
+	ulong sample_dropped_count;	/* Samples dropped as trace was busy */
 
 	int depth;
 	int depth_limit;
@@ -56,33 +79,84 @@ static inline uintptr_t __attribute__((no_instrument_function))
 	return offset / FUNC_SITE_SIZE;
 }
 
+/**
+ * Get the next ftrace record to write
+ *
+ * Once the buffer is full, records are dropped - or, with
+ * CONFIG_TRACE_RING, the oldest one is overwritten. Record 0 always
+ * holds the text base, so the ring wraps round to record 1.
+ *
+ * @return record to fill in, or NULL if it must be dropped
+ */
+static struct trace_call * __attribute__((no_instrument_function))
+		next_ftrace(void)
+{
+	struct trace_call *rec = NULL;
+
+	if (hdr->ftrace_count < hdr->ftrace_size) {
+		rec = &hdr->ftrace[hdr->ftrace_count];
+#ifdef CONFIG_TRACE_RING
+	} else if (hdr->ftrace_size > 1) {
+		rec = &hdr->ftrace[hdr->ring_pos];
+		if (++hdr->ring_pos == hdr->ftrace_size)
+			hdr->ring_pos = 1;
+#endif
+	}
+	hdr->ftrace_count++;
+
+	return rec;
+}
+
+/* Check whether calls to a function should be recorded */
+static int __attribute__((no_instrument_function)) filter_func(uintptr_t func)
+{
+	struct trace_filter *filt;
+	int included = !trace_include_count;
+	int i;
+
+	for (i = 0, filt = trace_filters; i < trace_filter_count; i++, filt++) {
+		if (func < filt->start || func >= filt->end)
+			continue;
+		if (filt->type == TRACE_FILTER_EXCLUDE)
+			return 0;
+		included = 1;
+	}
+
+	return included;
+}
+
 static void __attribute__((no_instrument_function)) add_ftrace(void *func_ptr,
 				void *caller, ulong flags)
 {
+	struct trace_call *rec;
+	uintptr_t func;
+
 	if (hdr->depth > hdr->depth_limit) {
 		hdr->ftrace_too_deep_count++;
 		return;
 	}
-	if (hdr->ftrace_count < hdr->ftrace_size) {
-		struct trace_call *rec = &hdr->ftrace[hdr->ftrace_count];
-
-		rec->func = func_ptr_to_num(func_ptr);
+	func = func_ptr_to_num(func_ptr);
+	if (trace_filter_count && !filter_func(func)) {
+		hdr->ftrace_filtered_count++;
+		return;
+	}
+	rec = next_ftrace();
+	if (rec) {
+		rec->func = func;
 		rec->caller = func_ptr_to_num(caller);
 		rec->flags = flags | (timer_get_us() & FUNCF_TIMESTAMP_MASK);
 	}
-	hdr->ftrace_count++;
 }
 
 static void __attribute__((no_instrument_function)) add_textbase(void)
 {
-	if (hdr->ftrace_count < hdr->ftrace_size) {
-		struct trace_call *rec = &hdr->ftrace[hdr->ftrace_count];
+	struct trace_call *rec = next_ftrace();
 
+	if (rec) {
 		rec->func = CONFIG_SYS_TEXT_BASE;
 		rec->caller = 0;
 		rec->flags = FUNCF_TEXTBASE;
 	}
-	hdr->ftrace_count++;
 }
 
 /**
@@ -100,6 +174,7 @@ void __attribute__((no_instrument_function)) __cyg_profile_func_enter(
 	if (trace_enabled) {
 		int func;
 
+		trace_busy = 1;
 		add_ftrace(func_ptr, caller, FUNCF_ENTRY);
 		func = func_ptr_to_num(func_ptr);
 		if (func < hdr->func_count) {
@@ -111,6 +186,7 @@ void __attribute__((no_instrument_function)) __cyg_profile_func_enter(
 		hdr->depth++;
 		if (hdr->depth > hdr->depth_limit)
 			hdr->max_depth = hdr->depth;
+		trace_busy = 0;
 	}
 }
 
@@ -126,9 +202,61 @@ void __attribute__((no_instrument_function)) __cyg_profile_func_exit(
 		void *func_ptr, void *caller)
 {
 	if (trace_enabled) {
+		trace_busy = 1;
 		add_ftrace(func_ptr, caller, FUNCF_EXIT);
 		hdr->depth--;
+		trace_busy = 0;
+	}
+}
+
+void __attribute__((no_instrument_function)) trace_add_sample(void *pc)
+{
+	struct trace_call *rec;
+
+	if (!trace_enabled)
+		return;
+	if (trace_busy) {
+		hdr->sample_dropped_count++;
+		return;
 	}
+	rec = next_ftrace();
+	if (rec) {
+		rec->func = func_ptr_to_num(pc);
+		rec->caller = 0;
+		rec->flags = FUNCF_SAMPLE |
+			(timer_get_us() & FUNCF_TIMESTAMP_MASK);
+	}
+	hdr->sample_count++;
+}
+
+int trace_add_filter(enum trace_filter_type type, ulong start, ulong size)
+{
+	struct trace_filter *filt;
+
+	if (trace_filter_count == TRACE_MAX_FILTERS)
+		return -1;
+
+	/* System.map addresses are relative to the link-time text base */
+#ifdef CONFIG_SANDBOX
+	start -= (uintptr_t)&_init;
+#else
+	start -= CONFIG_SYS_TEXT_BASE;
+#endif
+	filt = &trace_filters[trace_filter_count];
+	filt->type = type;
+	filt->start = start / FUNC_SITE_SIZE;
+	filt->end = (start + size + FUNC_SITE_SIZE - 1) / FUNC_SITE_SIZE;
+	if (type == TRACE_FILTER_INCLUDE)
+		trace_include_count++;
+	trace_filter_count++;
+
+	return 0;
+}
+
+void trace_clear_filters(void)
+{
+	trace_filter_count = 0;
+	trace_include_count = 0;
 }
 
 /**
@@ -187,6 +315,20 @@ int trace_list_functions(void *buff, int buff_size, unsigned int *needed)
 	return 0;
 }
 
+/* Find the n'th oldest record, allowing for the ring wrapping round */
+static ulong ftrace_index(ulong n)
+{
+	ulong index = n;
+
+	if (n && hdr->ftrace_count > hdr->ftrace_size) {
+		index = hdr->ring_pos + n - 1;
+		if (index >= hdr->ftrace_size)
+			index -= hdr->ftrace_size - 1;
+	}
+
+	return index;
+}
+
 int trace_list_calls(void *buff, int buff_size, unsigned *needed)
 {
 	struct trace_output_hdr *output_hdr = NULL;
@@ -201,13 +343,13 @@ int trace_list_calls(void *buff, int buff_size, unsigned *needed)
 		output_hdr = ptr;
 	ptr += sizeof(struct trace_output_hdr);
 
-	/* Add information about each call */
+	/* Add information about each call, oldest first */
 	count = hdr->ftrace_count;
 	if (count > hdr->ftrace_size)
 		count = hdr->ftrace_size;
 	for (rec = upto = 0; rec < count; rec++) {
 		if (ptr + sizeof(struct trace_call) < end) {
-			struct trace_call *call = &hdr->ftrace[rec];
+			struct trace_call *call = &hdr->ftrace[ftrace_index(rec)];
 			struct trace_call *out = ptr;
 
 			out->func = call->func * FUNC_SITE_SIZE;
@@ -236,7 +378,7 @@ void trace_print_stats(void)
 {
 	ulong count;
 
-#ifndef FTRACE
+#if !defined(FTRACE) && !defined(CONFIG_TRACE_SAMPLE)
 	puts("Warning: make U-Boot with FTRACE to enable function instrumenting.\n");
 	puts("You will likely get zeroed data here\n");
 #endif
@@ -254,16 +396,167 @@ void trace_print_stats(void)
 	print_grouped_ull(count, 10);
 	puts(" traced function calls");
 	if (hdr->ftrace_count > hdr->ftrace_size) {
+#ifdef CONFIG_TRACE_RING
+		printf(" (%lu oldest overwritten)",
+		       hdr->ftrace_count - hdr->ftrace_size);
+#else
 		printf(" (%lu dropped due to overflow)",
 		       hdr->ftrace_count - hdr->ftrace_size);
+#endif
 	}
 	puts("\n");
 	printf("%15d maximum observed call depth\n", hdr->max_depth);
 	printf("%15d call depth limit\n", hdr->depth_limit);
 	print_grouped_ull(hdr->ftrace_too_deep_count, 10);
 	puts(" calls not traced due to depth\n");
+	print_grouped_ull(hdr->ftrace_filtered_count, 10);
+	printf(" calls not traced due to %d filter(s)\n",
+	       trace_filter_count);
+	print_grouped_ull(hdr->sample_count, 10);
+	puts(" PC samples");
+	if (hdr->sample_dropped_count)
+		printf(" (%lu dropped while busy)", hdr->sample_dropped_count);
+	puts("\n");
+}
+
+/* Reverse the order of a run of records, in place */
+static void reverse_ftrace(struct trace_call *start, struct trace_call *end)
+{
+	struct trace_call tmp;
+
+	while (start < --end) {
+		tmp = *start;
+		*start++ = *end;
+		*end = tmp;
+	}
 }
 
+void trace_handoff(void)
+{
+	struct trace_output_hdr *out;
+	struct trace_hdr saved;
+	struct trace_call *ftrace;
+	unsigned int needed;
+	void *buff;
+	ulong size;
+
+	if (!trace_inited)
+		return;
+	trace_enabled = 0;
+#ifdef CONFIG_TRACE_SAMPLE
+	trace_sample_stop();
+#endif
+
+	/*
+	 * Put a wrapped ring back in time order, keeping record 0 in place,
+	 * so that the export below only ever copies records downwards.
+	 */
+	if (hdr->ftrace_count > hdr->ftrace_size && hdr->ring_pos > 1) {
+		ftrace = hdr->ftrace + 1;
+		reverse_ftrace(ftrace, hdr->ftrace + hdr->ring_pos);
+		reverse_ftrace(hdr->ftrace + hdr->ring_pos,
+			       hdr->ftrace + hdr->ftrace_size);
+		reverse_ftrace(ftrace, hdr->ftrace + hdr->ftrace_size);
+		hdr->ring_pos = 1;
+	}
+
+	/*
+	 * The output goes over the start of the buffer, header included, so
+	 * work from a copy of the header. Each record is read before it can
+	 * be overwritten, since the output record for each is placed below
+	 * it, where the header and call counts were.
+	 */
+	buff = hdr;
+	saved = *hdr;
+	hdr = &saved;
+	size = (char *)(hdr->ftrace + hdr->ftrace_size) - (char *)buff;
+	trace_inited = 0;
+	if (trace_list_calls(buff, size - sizeof(*out), &needed)) {
+		puts("trace: handoff truncated\n");
+		hdr = NULL;
+		return;
+	}
+	hdr = NULL;
+	out = buff + needed;
+	out->type = TRACE_CHUNK_END;
+	out->rec_count = 0;
+
+	printf("trace: %#x bytes of call data at %08lx for the OS\n",
+	       needed, (ulong)map_to_sysmem(buff));
+}
+
+#ifdef CONFIG_OF_LIBFDT
+int fdt_fixup_trace(void *blob)
+{
+	ulong start, size;
+	char path[60];
+	fdt32_t reg[4], cell;
+	int addr_cells, size_cells, len;
+	int err;
+	const fdt32_t *cells;
+
+	if (!trace_inited)
+		return 0;
+	start = map_to_sysmem(hdr);
+	size = (char *)(hdr->ftrace + hdr->ftrace_size) - (char *)hdr;
+
+	/* For kernels which do not know about /reserved-memory */
+	err = fdt_fixup_add_mem_rsv(blob, start, size);
+	if (err < 0)
+		goto err;
+
+	cells = fdt_getprop(blob, 0, "#address-cells", &len);
+	addr_cells = cells ? fdt32_to_cpu(*cells) : 1;
+	cells = fdt_getprop(blob, 0, "#size-cells", &len);
+	size_cells = cells ? fdt32_to_cpu(*cells) : 1;
+	if (addr_cells > 2 || size_cells > 2) {
+		err = -FDT_ERR_BADSTRUCTURE;
+		goto err;
+	}
+
+	if (!fdt_fixup_node_exists(blob, "/reserved-memory")) {
+		cell = cpu_to_fdt32(addr_cells);
+		err = fdt_fixup_setprop(blob, "/reserved-memory",
+					"#address-cells", &cell, sizeof(cell));
+		cell = cpu_to_fdt32(size_cells);
+		if (!err)
+			err = fdt_fixup_setprop(blob, "/reserved-memory",
+						"#size-cells", &cell,
+						sizeof(cell));
+		if (!err)
+			err = fdt_fixup_setprop(blob, "/reserved-memory",
+						"ranges", NULL, 0);
+		if (err)
+			goto err;
+	}
+
+	snprintf(path, sizeof(path), "/reserved-memory/u-boot-trace@%lx",
+		 start);
+	len = 0;
+	if (addr_cells == 2)
+		reg[len++] = 0;
+	reg[len++] = cpu_to_fdt32(start);
+	if (size_cells == 2)
+		reg[len++] = 0;
+	reg[len++] = cpu_to_fdt32(size);
+	err = fdt_fixup_setprop(blob, path, "reg", reg, len * sizeof(reg[0]));
+	if (!err)
+		err = fdt_fixup_setprop(blob, path, "compatible",
+					"u-boot,trace-buffer",
+					sizeof("u-boot,trace-buffer"));
+	if (!err)
+		err = fdt_fixup_setprop(blob, path, "no-map", NULL, 0);
+	if (err)
+		goto err;
+
+	return 0;
+err:
+	printf("trace: cannot reserve buffer in FDT: %s\n",
+	       fdt_strerror(err));
+	return err;
+}
+#endif
+
 void __attribute__((no_instrument_function)) trace_set_enabled(int enabled)
 {
 	trace_enabled = enabled != 0;
@@ -321,12 +614,16 @@ int __attribute__((no_instrument_function)) trace_init(void *buff,
 	/* Use any remaining space for the timed function trace */
 	hdr->ftrace = (struct trace_call *)(buff + needed);
 	hdr->ftrace_size = (buff_size - needed) / sizeof(*hdr->ftrace);
+	hdr->ring_pos = 1;
 	add_textbase();
 
 	puts("trace: enabled\n");
 	hdr->depth_limit = 15;
 	trace_enabled = 1;
 	trace_inited = 1;
+#ifdef CONFIG_TRACE_SAMPLE
+	trace_sample_start(CONFIG_TRACE_SAMPLE_HZ);
+#endif
 	return 0;
 }
 
@@ -356,6 +653,7 @@ int __attribute__((no_instrument_function)) trace_early_init(void)
 	/* Use any remaining space for the timed function trace */
 	hdr->ftrace = (struct trace_call *)((char *)hdr + needed);
 	hdr->ftrace_size = (buff_size - needed) / sizeof(*hdr->ftrace);
+	hdr->ring_pos = 1;
 	add_textbase();
 	hdr->depth_limit = 200;
 	printf("trace: early enable at %08x\n", CONFIG_TRACE_EARLY_ADDR);
@@ -37,6 +37,10 @@ int		NetArpWaitTry;
 static uchar   *NetArpTxPacket;	/* THE ARP transmit packet */
 static uchar	NetArpPacketBuf[PKTSIZE_ALIGN + PKTALIGN];
 
+/* The last destination resolved, and the MAC address packets to it use */
+static IPaddr_t	arp_cache_ip;
+static uchar	arp_cache_ether[6];
+
 void ArpInit(void)
 {
 	/* XXX problem with bss workaround */
@@ -48,6 +52,22 @@ void ArpInit(void)
 	NetArpTxPacket -= (ulong)NetArpTxPacket % PKTALIGN;
 }
 
+void arp_cache_set(IPaddr_t ip, const uchar *ether)
+{
+	arp_cache_ip = ether ? ip : 0;
+	if (ether)
+		memcpy(arp_cache_ether, ether, ARP_HLEN);
+}
+
+int arp_cache_get(IPaddr_t ip, uchar *ether)
+{
+	if (!ip || ip != arp_cache_ip)
+		return -1;
+	memcpy(ether, arp_cache_ether, ARP_HLEN);
+
+	return 0;
+}
+
 void arp_raw_request(IPaddr_t sourceIP, const uchar *targetEther,
 	IPaddr_t targetIP)
 {
@@ -211,6 +231,7 @@ void ArpReceive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 			if (NetArpWaitPacketMAC != NULL)
 				memcpy(NetArpWaitPacketMAC,
 				       &arp->ar_sha, ARP_HLEN);
+			arp_cache_set(NetArpWaitPacketIP, &arp->ar_sha);
 
 			net_get_arp_handler()((uchar *)arp, 0, reply_ip_addr,
 				0, len);
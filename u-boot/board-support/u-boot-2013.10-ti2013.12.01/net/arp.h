@@ -25,6 +25,13 @@ void ArpRequest(void);
 void arp_raw_request(IPaddr_t sourceIP, const uchar *targetEther,
 	IPaddr_t targetIP);
 void ArpTimeoutCheck(void);
+
+/*
+ * Remember the MAC address that reaches @ip, or forget it if @ether is
+ * NULL. A transfer that starts by looking @ip up needs no ARP request.
+ */
+void arp_cache_set(IPaddr_t ip, const uchar *ether);
+int arp_cache_get(IPaddr_t ip, uchar *ether);	/* 0 if known */
 void ArpReceive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len);
 
 #endif /* __ARP_H__ */
@@ -11,6 +11,8 @@
 #include <common.h>
 #include <command.h>
 #include <net.h>
+#include <asm/io.h>
+#include "arp.h"
 #include "bootp.h"
 #include "tftp.h"
 #include "nfs.h"
@@ -597,6 +599,58 @@ static int BootpExtended(u8 *e)
 }
 #endif
 
+#ifdef CONFIG_SPL_NET_LEASE_ADDR
+void net_save_lease(void)
+{
+	struct net_lease *lease;
+
+	lease = map_sysmem(CONFIG_SPL_NET_LEASE_ADDR, sizeof(*lease));
+	memset(lease, '\0', sizeof(*lease));
+	memcpy(lease->ether, NetOurEther, 6);
+	arp_cache_get(NetServerIP, lease->server_ether);
+	lease->ip = NetOurIP;
+	lease->netmask = NetOurSubnetMask;
+	lease->gateway = NetOurGatewayIP;
+	lease->server = NetServerIP;
+#if defined(CONFIG_CMD_DNS)
+	lease->dns = NetOurDNSIP;
+#endif
+	lease->magic = NET_LEASE_MAGIC;
+	unmap_sysmem(lease);
+}
+
+#ifndef CONFIG_SPL_BUILD
+/*
+ * Take the lease SPL got, once, if it is for this interface. The boot
+ * file name is left alone, as servers often give SPL a different one.
+ */
+static int bootp_take_lease(void)
+{
+	struct net_lease *lease;
+	int found;
+
+	lease = map_sysmem(CONFIG_SPL_NET_LEASE_ADDR, sizeof(*lease));
+	found = lease->magic == NET_LEASE_MAGIC &&
+		!memcmp(lease->ether, NetOurEther, 6);
+	if (found) {
+		NetOurIP = lease->ip;
+		NetOurSubnetMask = lease->netmask;
+		NetOurGatewayIP = lease->gateway;
+		NetServerIP = lease->server;
+#if defined(CONFIG_CMD_DNS)
+		NetOurDNSIP = lease->dns;
+#endif
+		if (memcmp(lease->server_ether, NetEtherNullAddr, 6))
+			arp_cache_set(lease->server, lease->server_ether);
+	}
+	lease->magic = 0;
+	unmap_sysmem(lease);
+
+	return found;
+}
+#endif
+#endif
+
 void
 BootpRequest(void)
 {
@@ -613,6 +667,18 @@ BootpRequest(void)
 	dhcp_state = INIT;
 #endif
 
+#if defined(CONFIG_SPL_NET_LEASE_ADDR) && !defined(CONFIG_SPL_BUILD)
+	if (BootpTry == 0 && bootp_take_lease()) {
+		printf("Using address %pI4 from SPL\n", &NetOurIP);
+#if defined(CONFIG_CMD_DHCP)
+		dhcp_state = BOUND;
+#endif
+		bootstage_mark_name(BOOTSTAGE_ID_BOOTP_STOP, "bootp_stop");
+		net_auto_load();
+		return;
+	}
+#endif
+
 #ifdef CONFIG_BOOTP_RANDOM_DELAY		/* Random BOOTP delay */
 	if (BootpTry == 0)
 		srand_mac();
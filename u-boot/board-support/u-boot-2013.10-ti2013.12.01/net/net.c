@@ -104,6 +104,10 @@
 #include "sntp.h"
 #endif
 #include "tftp.h"
+#if defined(CONFIG_CMD_WGET)
+#include "tcp.h"
+#include "wget.h"
+#endif
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -414,6 +418,11 @@ restart:
 			NfsStart();
 			break;
 #endif
+#if defined(CONFIG_CMD_WGET)
+		case WGET:
+			wget_start();
+			break;
+#endif
 #if defined(CONFIG_CMD_CDP)
 		case CDP:
 			CDPStart();
@@ -613,6 +622,9 @@ void NetStartAgain(void)
 
 	NetTryCount++;
 
+	/* the server may have moved, so look it up again */
+	arp_cache_set(0, NULL);
+
 	eth_halt();
 #if !defined(CONFIG_NET_DO_NOT_TRY_ANOTHER)
 	eth_try_another(!NetRestarted);
@@ -693,6 +705,33 @@ NetSetTimeout(ulong iv, thand_f *f)
 	}
 }
 
+/* Send what is in NetTxPacket, doing ARP first if the MAC is not known */
+static int net_send_arp(uchar *ether, IPaddr_t dest, int len)
+{
+	/* if MAC address was not discovered yet, do an ARP request */
+	if (memcmp(ether, NetEtherNullAddr, 6) == 0) {
+		debug_cond(DEBUG_DEV_PKT, "sending ARP for %pI4\n", &dest);
+
+		/* save the ip and eth addr for the packet to send after arp */
+		NetArpWaitPacketIP = dest;
+		NetArpWaitPacketMAC = ether;
+
+		/* size of the waiting packet */
+		NetArpWaitTxPacketSize = len;
+
+		/* and do the ARP request */
+		NetArpWaitTry = 1;
+		NetArpWaitTimerStart = get_timer(0);
+		ArpRequest();
+		return 1;	/* waiting */
+	} else {
+		debug_cond(DEBUG_DEV_PKT, "sending IP to %pI4/%pM\n",
+			&dest, ether);
+		NetSendPacket(NetTxPacket, len);
+		return 0;	/* transmitted */
+	}
+}
+
 int NetSendUDPPacket(uchar *ether, IPaddr_t dest, int dport, int sport,
 		int payload_len)
 {
@@ -720,28 +759,27 @@ int NetSendUDPPacket(uchar *ether, IPaddr_t dest, int dport, int sport,
 	net_set_udp_header(pkt, dest, dport, sport, payload_len);
 	pkt_hdr_size = eth_hdr_size + IP_UDP_HDR_SIZE;
 
-	/* if MAC address was not discovered yet, do an ARP request */
-	if (memcmp(ether, NetEtherNullAddr, 6) == 0) {
-		debug_cond(DEBUG_DEV_PKT, "sending ARP for %pI4\n", &dest);
+	return net_send_arp(ether, dest, pkt_hdr_size + payload_len);
+}
 
-		/* save the ip and eth addr for the packet to send after arp */
-		NetArpWaitPacketIP = dest;
-		NetArpWaitPacketMAC = ether;
+int net_send_ip_packet(uchar *ether, IPaddr_t dest, int proto,
+		       int payload_len)
+{
+	struct ip_udp_hdr *ip;
+	int eth_hdr_size;
 
-		/* size of the waiting packet */
-		NetArpWaitTxPacketSize = pkt_hdr_size + payload_len;
+	if (NetTxPacket == NULL)
+		return -1;
 
-		/* and do the ARP request */
-		NetArpWaitTry = 1;
-		NetArpWaitTimerStart = get_timer(0);
-		ArpRequest();
-		return 1;	/* waiting */
-	} else {
-		debug_cond(DEBUG_DEV_PKT, "sending UDP to %pI4/%pM\n",
-			&dest, ether);
-		NetSendPacket(NetTxPacket, pkt_hdr_size + payload_len);
-		return 0;	/* transmitted */
-	}
+	eth_hdr_size = NetSetEther(NetTxPacket, ether, PROT_IP);
+	ip = (struct ip_udp_hdr *)(NetTxPacket + eth_hdr_size);
+	net_set_ip_header((uchar *)ip, dest, NetOurIP);
+	ip->ip_len = htons(IP_HDR_SIZE + payload_len);
+	ip->ip_p = proto;
+	ip->ip_sum = ~NetCksum((uchar *)ip, IP_HDR_SIZE >> 1);
+
+	return net_send_arp(ether, dest,
+			    eth_hdr_size + IP_HDR_SIZE + payload_len);
 }
 
 #ifdef CONFIG_IP_DEFRAG
@@ -750,18 +788,16 @@ int NetSendUDPPacket(uchar *ether, IPaddr_t dest, int dport, int sport,
  * to the algorithm in RFC815. It returns NULL or the pointer to
  * a complete packet, in static storage
  */
-#ifndef CONFIG_NET_MAXDEFRAG
-#define CONFIG_NET_MAXDEFRAG 16384
-#endif
 /*
- * MAXDEFRAG, above, is chosen in the config file and  is real data
- * so we need to add the NFS overhead, which is more than TFTP.
+ * MAXDEFRAG, from net.h, is chosen in the config file and  is real data
+ * so we need to add the UDP and NFS overhead, which is more than TFTP.
  * To use sizeof in the internal unnamed structures, we need a real
  * instance (can't do "sizeof(struct rpc_t.u.reply))", unfortunately).
  * The compiler doesn't complain nor allocates the actual structure
  */
 static struct rpc_t rpc_specimen;
-#define IP_PKTSIZE (CONFIG_NET_MAXDEFRAG + sizeof(rpc_specimen.u.reply))
+#define IP_PKTSIZE (CONFIG_NET_MAXDEFRAG + IP_UDP_HDR_SIZE + \
+		    sizeof(rpc_specimen.u.reply))
 
 #define IP_MAXUDP (IP_PKTSIZE - IP_HDR_SIZE)
 
@@ -1131,6 +1167,11 @@ NetReceive(uchar *inpkt, int len)
 		if (ip->ip_p == IPPROTO_ICMP) {
 			receive_icmp(ip, len, src_ip, et);
 			return;
+#if defined(CONFIG_CMD_WGET)
+		} else if (ip->ip_p == IPPROTO_TCP) {
+			tcp_receive(ip, len);
+			return;
+#endif
 		} else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
 			return;
 		}
@@ -1234,6 +1275,9 @@ static int net_check_prereq(enum proto_t protocol)
 #endif
 #if defined(CONFIG_CMD_NFS)
 	case NFS:
+#endif
+#if defined(CONFIG_CMD_WGET)
+	case WGET:
 #endif
 	case TFTPGET:
 	case TFTPPUT:
@@ -26,28 +26,58 @@
 #include <command.h>
 #include <net.h>
 #include <malloc.h>
+#include <asm/io.h>
+#include "arp.h"
 #include "nfs.h"
 #include "bootp.h"
 
 #define HASHES_PER_LINE 65	/* Number of "loading" hashes per line	*/
+#define HASH_BYTES	(64 << 10)
 #define NFS_RETRY_COUNT 30
 #ifndef CONFIG_NFS_TIMEOUT
 # define NFS_TIMEOUT 2000UL
 #else
 # define NFS_TIMEOUT CONFIG_NFS_TIMEOUT
 #endif
+#define NFS_RTO_MIN	100UL	/* floor for the measured timeout, ms */
+#define NFS_READ_TICK	10UL	/* how often READs are checked, ms */
 
 #define NFS_RPC_ERR	1
 #define NFS_RPC_DROP	124
 
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
-static ulong nfs_timeout = NFS_TIMEOUT;
+static int nfs_version;		/* 3, or 2 if the server has no NFSv3 */
 
-static char dirfh[NFS_FHSIZE];	/* file handle of directory */
-static char filefh[NFS_FHSIZE]; /* file handle of kernel image */
+/*
+ * Retransmit timeout from the measured round trip time (RFC 6298), with
+ * the smoothed RTT scaled by 8 and its variation by 4
+ */
+static ulong nfs_rto;
+static long nfs_srtt;
+static long nfs_rttvar;
+static ulong nfs_sent;		/* when the last request went out */
+
+static uchar dirfh[NFS3_FHSIZE];	/* file handle of directory */
+static int dirfh_len;
+static uchar filefh[NFS3_FHSIZE];	/* file handle of kernel image */
+static int filefh_len;
+
+/* A READ in flight, matched to its reply by RPC id; 0 if the slot is free */
+struct nfs_read {
+	unsigned long id;
+	ulong offset;
+	unsigned len;
+	ulong sent;
+	int tries;		/* times sent again; no RTT sample once set */
+};
+
+static struct nfs_read nfs_reads[NFS_READ_WINDOW];
+static ulong nfs_next;		/* first offset not asked for yet */
+static ulong nfs_end;		/* file size once the server shows EOF */
+static unsigned nfs_read_size;
+static ulong nfs_received;	/* bytes stored, for the hashes */
+static ulong nfs_start_time;
 
 static enum net_loop_state nfs_download_state;
 static IPaddr_t NfsServerIP;
@@ -72,6 +102,7 @@ static char nfs_path_buff[2048];
 static inline int
 store_block(uchar *src, unsigned offset, unsigned len)
 {
+	void *ptr;
 	ulong newsize = offset + len;
 #ifdef CONFIG_SYS_DIRECT_FLASH_NFS
 	int i, rc = 0;
@@ -93,7 +124,9 @@ store_block(uchar *src, unsigned offset, unsigned len)
 	} else
 #endif /* CONFIG_SYS_DIRECT_FLASH_NFS */
 	{
-		(void)memcpy((void *)(load_addr + offset), src, len);
+		ptr = map_sysmem(load_addr + offset, len);
+		memcpy(ptr, src, len);
+		unmap_sysmem(ptr);
 	}
 
 	if (NetBootFileXferSize < (offset+len))
@@ -131,7 +164,7 @@ dirname(char *path)
 /**************************************************************************
 RPC_ADD_CREDENTIALS - Add RPC authentication/verifier entries
 **************************************************************************/
-static long *rpc_add_credentials(long *p)
+static uint32_t *rpc_add_credentials(uint32_t *p)
 {
 	int hl;
 	int hostnamelen;
@@ -172,9 +205,9 @@ static long *rpc_add_credentials(long *p)
 }
 
 /**************************************************************************
-RPC_LOOKUP - Lookup RPC Port numbers
+RPC_REQ - Send an RPC call, returns its id
 **************************************************************************/
-static void
+static unsigned long
 rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 {
 	struct rpc_t pkt;
@@ -188,7 +221,8 @@ rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 	pkt.u.call.type = htonl(MSG_CALL);
 	pkt.u.call.rpcvers = htonl(2);	/* use RPC version 2 */
 	pkt.u.call.prog = htonl(rpc_prog);
-	pkt.u.call.vers = htonl(2);	/* portmapper is version 2 */
+	/* portmapper is version 2, MOUNT goes with the NFS version */
+	pkt.u.call.vers = htonl(rpc_prog == PROG_PORTMAP ? 2 : nfs_version);
 	pkt.u.call.proc = htonl(rpc_proc);
 	p = (uint32_t *)&(pkt.u.call.data);
 
@@ -209,6 +243,48 @@ rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 
 	NetSendUDPPacket(NetServerEther, NfsServerIP, sport, NfsOurPort,
 		pktlen);
+
+	return id;
+}
+
+/* Add a file handle, which NFSv3 gives with its length */
+static uint32_t *
+nfs_add_fh(uint32_t *p, const uchar *fh, int fhlen)
+{
+	if (nfs_version == 3)
+		*p++ = htonl(fhlen);
+	if (fhlen & 3)
+		*(p + fhlen / 4) = 0;
+	memcpy(p, fh, fhlen);
+
+	return p + (fhlen + 3) / 4;
+}
+
+/* Take the file handle of a MOUNT or LOOKUP reply */
+static int
+nfs_get_fh(const uint32_t *p, uchar *fh, int *fhlen)
+{
+	int len = NFS_FHSIZE;
+
+	if (nfs_version == 3) {
+		len = ntohl(*p++);
+		if (len > NFS3_FHSIZE)
+			return -1;
+	}
+	memcpy(fh, p, len);
+	*fhlen = len;
+
+	return 0;
+}
+
+/* Skip the optional attributes NFSv3 puts ahead of READ and READLINK data */
+static uint32_t *
+nfs3_skip_attr(uint32_t *p)
+{
+	if (*p++)
+		p += NFS3_FATTR_SIZE / 4;
+
+	return p;
 }
 
 /**************************************************************************
@@ -243,7 +319,7 @@ nfs_mount_req(char *path)
 	pathlen = strlen(path);
 
 	p = &(data[0]);
-	p = (uint32_t *)rpc_add_credentials((long *)p);
+	p = rpc_add_credentials(p);
 
 	*p++ = htonl(pathlen);
 	if (pathlen & 3)
@@ -271,7 +347,7 @@ nfs_umountall_req(void)
 		return;
 
 	p = &(data[0]);
-	p = (uint32_t *)rpc_add_credentials((long *)p);
+	p = rpc_add_credentials(p);
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
@@ -293,10 +369,9 @@ nfs_readlink_req(void)
 	int len;
 
 	p = &(data[0]);
-	p = (uint32_t *)rpc_add_credentials((long *)p);
+	p = rpc_add_credentials(p);
 
-	memcpy(p, filefh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
+	p = nfs_add_fh(p, filefh, filefh_len);
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
@@ -317,10 +392,9 @@ nfs_lookup_req(char *fname)
 	fnamelen = strlen(fname);
 
 	p = &(data[0]);
-	p = (uint32_t *)rpc_add_credentials((long *)p);
+	p = rpc_add_credentials(p);
 
-	memcpy(p, dirfh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
+	p = nfs_add_fh(p, dirfh, dirfh_len);
 	*p++ = htonl(fnamelen);
 	if (fnamelen & 3)
 		*(p + fnamelen / 4) = 0;
@@ -329,48 +403,185 @@ nfs_lookup_req(char *fname)
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_LOOKUP, data, len);
+	rpc_req(PROG_NFS, nfs_version == 3 ? NFS3PROC_LOOKUP : NFS_LOOKUP,
+		data, len);
 }
 
 /**************************************************************************
 NFS_READ - Read File on NFS Server
 **************************************************************************/
-static void
-nfs_read_req(int offset, int readlen)
+static unsigned long
+nfs_read_req(u64 offset, int readlen)
 {
 	uint32_t data[1024];
 	uint32_t *p;
 	int len;
 
 	p = &(data[0]);
-	p = (uint32_t *)rpc_add_credentials((long *)p);
+	p = rpc_add_credentials(p);
 
-	memcpy(p, filefh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
-	*p++ = htonl(offset);
-	*p++ = htonl(readlen);
-	*p++ = 0;
+	p = nfs_add_fh(p, filefh, filefh_len);
+	if (nfs_version == 3) {
+		*p++ = htonl(offset >> 32);
+		*p++ = htonl(offset);
+		*p++ = htonl(readlen);
+	} else {
+		*p++ = htonl(offset);
+		*p++ = htonl(readlen);
+		*p++ = 0;
+	}
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_READ, data, len);
+	return rpc_req(PROG_NFS, NFS_READ, data, len);
+}
+
+/**************************************************************************
+Retransmit timing
+**************************************************************************/
+
+static void
+nfs_rtt_sample(ulong rtt)
+{
+	long err;
+
+	if (!nfs_srtt) {
+		nfs_srtt = rtt << 3;
+		nfs_rttvar = rtt << 1;
+	} else {
+		err = (long)rtt - (nfs_srtt >> 3);
+		nfs_srtt += err;
+		if (err < 0)
+			err = -err;
+		nfs_rttvar += err - (nfs_rttvar >> 2);
+	}
+
+	nfs_rto = (nfs_srtt >> 3) + nfs_rttvar;
+	nfs_rto = max(nfs_rto, NFS_RTO_MIN);
+	nfs_rto = min(nfs_rto, (ulong)NFS_TIMEOUT);
+}
+
+/* Timeout for a request already sent @tries times more */
+static ulong
+nfs_backoff(int tries)
+{
+	return min(nfs_rto << min(tries, 8), (ulong)NFS_TIMEOUT);
+}
+
+/**************************************************************************
+READ window
+**************************************************************************/
+
+static void
+nfs_read_send(struct nfs_read *r)
+{
+	r->id = nfs_read_req(r->offset, r->len);
+	r->sent = get_timer(0);
+}
+
+/* Put a READ in each free slot while there is file left to ask for */
+static void
+nfs_read_fill(void)
+{
+	struct nfs_read *r;
+
+	for (r = nfs_reads; r < nfs_reads + NFS_READ_WINDOW; r++) {
+		if (r->id && r->offset >= nfs_end)
+			r->id = 0;	/* past EOF, forget it */
+		if (r->id || nfs_next >= nfs_end)
+			continue;
+		r->offset = nfs_next;
+		r->len = nfs_read_size;
+		r->tries = 0;
+		nfs_next += r->len;
+		nfs_read_send(r);
+	}
+}
+
+static int
+nfs_read_done(void)
+{
+	struct nfs_read *r;
+
+	if (nfs_end == ~0UL)
+		return 0;
+	for (r = nfs_reads; r < nfs_reads + NFS_READ_WINDOW; r++) {
+		if (r->id && r->offset < nfs_end)
+			return 0;
+	}
+
+	return 1;
+}
+
+static void
+nfs_read_start(void)
+{
+	memset(nfs_reads, 0, sizeof(nfs_reads));
+	nfs_next = 0;
+	nfs_end = ~0UL;
+	nfs_received = 0;
+	nfs_read_size = NFS_READ_SIZE;
+	if (nfs_version == 2)
+		nfs_read_size = min(nfs_read_size, (unsigned)NFS2_MAXDATA);
+	nfs_start_time = get_timer(0);
+}
+
+static void
+nfs_read_timeout(void)
+{
+	struct nfs_read *r;
+
+	for (r = nfs_reads; r < nfs_reads + NFS_READ_WINDOW; r++) {
+		if (!r->id || get_timer(r->sent) < nfs_backoff(r->tries))
+			continue;
+		if (++r->tries > NFS_RETRY_COUNT) {
+			puts("\nRetry count exceeded; starting again\n");
+			NetStartAgain();
+			return;
+		}
+		puts("T ");
+		nfs_read_send(r);
+	}
+	NetSetTimeout(NFS_READ_TICK, nfs_read_timeout);
+}
+
+static void
+nfs_print_rate(void)
+{
+	ulong time = get_timer(nfs_start_time);
+
+	if (time > 0) {
+		puts("\n\t ");
+		print_size(NetBootFileXferSize / time * 1000, "/s");
+	}
 }
 
 /**************************************************************************
 RPC request dispatcher
 **************************************************************************/
 
+static void NfsTimeout(void);
+
 static void
 NfsSend(void)
 {
 	debug("%s\n", __func__);
 
+	if (NfsState == STATE_READ_REQ) {
+		nfs_read_fill();
+		NetSetTimeout(NFS_READ_TICK, nfs_read_timeout);
+		return;
+	}
+
+	nfs_sent = get_timer(0);
+	NetSetTimeout(nfs_backoff(NfsTimeoutCount), NfsTimeout);
+
 	switch (NfsState) {
 	case STATE_PRCLOOKUP_PROG_MOUNT_REQ:
-		rpc_lookup_req(PROG_MOUNT, 1);
+		rpc_lookup_req(PROG_MOUNT, nfs_version == 3 ? 3 : 1);
 		break;
 	case STATE_PRCLOOKUP_PROG_NFS_REQ:
-		rpc_lookup_req(PROG_NFS, 2);
+		rpc_lookup_req(PROG_NFS, nfs_version);
 		break;
 	case STATE_MOUNT_REQ:
 		nfs_mount_req(nfs_path);
@@ -381,9 +592,6 @@ NfsSend(void)
 	case STATE_LOOKUP_REQ:
 		nfs_lookup_req(nfs_filename);
 		break;
-	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
-		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
 		break;
@@ -394,12 +602,27 @@ NfsSend(void)
 Handlers for the reply from server
 **************************************************************************/
 
+/*
+ * Copy a reply out of the packet. With IP defragmentation that may be a
+ * READ reply of up to NFS_READ_SIZE bytes arriving late, in a state that
+ * expects a short reply; anything larger than an rpc_t is dropped.
+ */
+static int rpc_copy_reply(struct rpc_t *rpc_pkt, uchar *pkt, unsigned len)
+{
+	if (len > sizeof(rpc_pkt->u))
+		return -NFS_RPC_DROP;
+
+	memcpy((unsigned char *)rpc_pkt, pkt, len);
+	return 0;
+}
+
 static int
 rpc_lookup_reply(int prog, uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
 
-	memcpy((unsigned char *)&rpc_pkt, pkt, len);
+	if (rpc_copy_reply(&rpc_pkt, pkt, len))
+		return -NFS_RPC_DROP;
 
 	debug("%s\n", __func__);
 
@@ -432,7 +655,8 @@ nfs_mount_reply(uchar *pkt, unsigned len)
 
 	debug("%s\n", __func__);
 
-	memcpy((unsigned char *)&rpc_pkt, pkt, len);
+	if (rpc_copy_reply(&rpc_pkt, pkt, len))
+		return -NFS_RPC_DROP;
 
 	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
 		return -NFS_RPC_ERR;
@@ -445,8 +669,9 @@ nfs_mount_reply(uchar *pkt, unsigned len)
 	    rpc_pkt.u.reply.data[0])
 		return -1;
 
+	if (nfs_get_fh(rpc_pkt.u.reply.data + 1, dirfh, &dirfh_len))
+		return -1;
 	fs_mounted = 1;
-	memcpy(dirfh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
 
 	return 0;
 }
@@ -458,7 +683,8 @@ nfs_umountall_reply(uchar *pkt, unsigned len)
 
 	debug("%s\n", __func__);
 
-	memcpy((unsigned char *)&rpc_pkt, pkt, len);
+	if (rpc_copy_reply(&rpc_pkt, pkt, len))
+		return -NFS_RPC_DROP;
 
 	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
 		return -NFS_RPC_ERR;
@@ -483,7 +709,8 @@ nfs_lookup_reply(uchar *pkt, unsigned len)
 
 	debug("%s\n", __func__);
 
-	memcpy((unsigned char *)&rpc_pkt, pkt, len);
+	if (rpc_copy_reply(&rpc_pkt, pkt, len))
+		return -NFS_RPC_DROP;
 
 	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
 		return -NFS_RPC_ERR;
@@ -496,20 +723,21 @@ nfs_lookup_reply(uchar *pkt, unsigned len)
 	    rpc_pkt.u.reply.data[0])
 		return -1;
 
-	memcpy(filefh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
-
-	return 0;
+	return nfs_get_fh(rpc_pkt.u.reply.data + 1, filefh, &filefh_len);
 }
 
 static int
 nfs_readlink_reply(uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
+	uint32_t *p;
+	char *path;
 	int rlen;
 
 	debug("%s\n", __func__);
 
-	memcpy((unsigned char *)&rpc_pkt, pkt, len);
+	if (rpc_copy_reply(&rpc_pkt, pkt, len))
+		return -NFS_RPC_DROP;
 
 	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
 		return -NFS_RPC_ERR;
@@ -522,36 +750,49 @@ nfs_readlink_reply(uchar *pkt, unsigned len)
 	    rpc_pkt.u.reply.data[0])
 		return -1;
 
-	rlen = ntohl(rpc_pkt.u.reply.data[1]); /* new path length */
+	p = rpc_pkt.u.reply.data + 1;
+	if (nfs_version == 3)
+		p = nfs3_skip_attr(p);
+	rlen = ntohl(*p); /* new path length */
+	path = (char *)(p + 1);
 
-	if (*((char *)&(rpc_pkt.u.reply.data[2])) != '/') {
+	if (*path != '/') {
 		int pathlen;
 		strcat(nfs_path, "/");
 		pathlen = strlen(nfs_path);
-		memcpy(nfs_path + pathlen, (uchar *)&(rpc_pkt.u.reply.data[2]),
-			rlen);
+		memcpy(nfs_path + pathlen, path, rlen);
 		nfs_path[pathlen + rlen] = 0;
 	} else {
-		memcpy(nfs_path, (uchar *)&(rpc_pkt.u.reply.data[2]), rlen);
+		memcpy(nfs_path, path, rlen);
 		nfs_path[rlen] = 0;
 	}
 	return 0;
 }
 
+/*
+ * Replies may come in any order: each is stored where its READ asked for.
+ * Returns the length stored or a negative error.
+ */
 static int
 nfs_read_reply(uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
-	int rlen;
+	struct nfs_read *r;
+	uint32_t *p;
+	unsigned rlen, off;
+	int eof;
 
 	debug("%s\n", __func__);
 
-	memcpy((uchar *)&rpc_pkt, pkt, sizeof(rpc_pkt.u.reply));
+	memcpy((uchar *)&rpc_pkt, pkt,
+	       min(len, (unsigned)sizeof(rpc_pkt.u.reply)));
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
-		return -NFS_RPC_DROP;
+	for (r = nfs_reads; r < nfs_reads + NFS_READ_WINDOW; r++) {
+		if (r->id && r->id == ntohl(rpc_pkt.u.reply.id))
+			break;
+	}
+	if (r == nfs_reads + NFS_READ_WINDOW)
+		return -NFS_RPC_DROP;	/* answered already, or past EOF */
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -564,17 +805,52 @@ nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
+	if (nfs_version == 3) {
+		p = nfs3_skip_attr(rpc_pkt.u.reply.data + 1);
+		rlen = ntohl(p[0]);
+		eof = ntohl(p[1]) || !rlen;
+		p += 3;
+	} else {
+		/*
+		 * NFSv2 has no EOF flag, and a short read may just be the
+		 * server's limit. The file ends where its attributes say.
+		 */
+		rlen = ntohl(rpc_pkt.u.reply.data[18]);
+		eof = !rlen ||
+			r->offset + rlen >= ntohl(rpc_pkt.u.reply.data[6]);
+		p = rpc_pkt.u.reply.data + 19;
+	}
+	off = (uchar *)p - (uchar *)&rpc_pkt;
+	if (off > len || rlen > len - off || rlen > r->len)
+		return -NFS_RPC_DROP;
+
+	/* Karn: a reply to a request sent twice says nothing of the RTT */
+	if (!r->tries)
+		nfs_rtt_sample(get_timer(r->sent));
+	r->id = 0;
 
-	rlen = ntohl(rpc_pkt.u.reply.data[18]);
-	if (store_block((uchar *)pkt + sizeof(rpc_pkt.u.reply),
-			nfs_offset, rlen))
+	if (rlen && store_block(pkt + off, r->offset, rlen))
 		return -9999;
 
+	if ((nfs_received + rlen) / HASH_BYTES != nfs_received / HASH_BYTES) {
+		putc('#');
+		if (((nfs_received + rlen) / HASH_BYTES) % HASHES_PER_LINE == 0)
+			puts("\n\t ");
+	}
+	nfs_received += rlen;
+
+	if (eof) {
+		nfs_end = min(nfs_end, r->offset + rlen);
+	} else if (rlen < r->len) {
+		/* The server gives less than asked: take that as its limit */
+		if (rlen >= 1024)
+			nfs_read_size = min(nfs_read_size, rlen & ~1023);
+		r->offset += rlen;
+		r->len -= rlen;
+		r->tries = 0;
+		nfs_read_send(r);
+	}
+
 	return rlen;
 }
 
@@ -590,12 +866,19 @@ NfsTimeout(void)
 		NetStartAgain();
 	} else {
 		puts("T ");
-		NetSetTimeout(nfs_timeout + NFS_TIMEOUT * NfsTimeoutCount,
-			      NfsTimeout);
 		NfsSend();
 	}
 }
 
+/* The reply to the last request came: time it unless it was sent again */
+static void
+nfs_got_reply(void)
+{
+	if (!NfsTimeoutCount)
+		nfs_rtt_sample(get_timer(nfs_sent));
+	NfsTimeoutCount = 0;
+}
+
 static void
 NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 {
@@ -611,6 +894,7 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 	case STATE_PRCLOOKUP_PROG_MOUNT_REQ:
 		if (rpc_lookup_reply(PROG_MOUNT, pkt, len) == -NFS_RPC_DROP)
 			break;
+		nfs_got_reply();
 		NfsState = STATE_PRCLOOKUP_PROG_NFS_REQ;
 		NfsSend();
 		break;
@@ -618,7 +902,14 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 	case STATE_PRCLOOKUP_PROG_NFS_REQ:
 		if (rpc_lookup_reply(PROG_NFS, pkt, len) == -NFS_RPC_DROP)
 			break;
-		NfsState = STATE_MOUNT_REQ;
+		nfs_got_reply();
+		if (nfs_version == 3 && (!NfsSrvMountPort || !NfsSrvNfsPort)) {
+			/* No NFSv3 on this server: look up the v2 ports */
+			nfs_version = 2;
+			NfsState = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
+		} else {
+			NfsState = STATE_MOUNT_REQ;
+		}
 		NfsSend();
 		break;
 
@@ -626,7 +917,8 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 		reply = nfs_mount_reply(pkt, len);
 		if (reply == -NFS_RPC_DROP)
 			break;
-		else if (reply == -NFS_RPC_ERR) {
+		nfs_got_reply();
+		if (reply == -NFS_RPC_ERR) {
 			puts("*** ERROR: Cannot mount\n");
 			/* just to be sure... */
 			NfsState = STATE_UMOUNT_REQ;
@@ -641,7 +933,8 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 		reply = nfs_umountall_reply(pkt, len);
 		if (reply == -NFS_RPC_DROP)
 			break;
-		else if (reply == -NFS_RPC_ERR) {
+		nfs_got_reply();
+		if (reply == -NFS_RPC_ERR) {
 			puts("*** ERROR: Cannot umount\n");
 			net_set_state(NETLOOP_FAIL);
 		} else {
@@ -654,14 +947,14 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 		reply = nfs_lookup_reply(pkt, len);
 		if (reply == -NFS_RPC_DROP)
 			break;
-		else if (reply == -NFS_RPC_ERR) {
+		nfs_got_reply();
+		if (reply == -NFS_RPC_ERR) {
 			puts("*** ERROR: File lookup fail\n");
 			NfsState = STATE_UMOUNT_REQ;
 			NfsSend();
 		} else {
 			NfsState = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
+			nfs_read_start();
 			NfsSend();
 		}
 		break;
@@ -670,7 +963,8 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 		reply = nfs_readlink_reply(pkt, len);
 		if (reply == -NFS_RPC_DROP)
 			break;
-		else if (reply == -NFS_RPC_ERR) {
+		nfs_got_reply();
+		if (reply == -NFS_RPC_ERR) {
 			puts("*** ERROR: Symlink fail\n");
 			NfsState = STATE_UMOUNT_REQ;
 			NfsSend();
@@ -686,17 +980,21 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 
 	case STATE_READ_REQ:
 		rlen = nfs_read_reply(pkt, len);
-		NetSetTimeout(nfs_timeout, NfsTimeout);
-		if (rlen > 0) {
-			nfs_offset += rlen;
+		if (rlen == -NFS_RPC_DROP)
+			break;
+		if (rlen >= 0) {
+			nfs_read_fill();
+			if (!nfs_read_done())
+				break;
+			nfs_download_state = NETLOOP_SUCCESS;
+			nfs_print_rate();
+			NfsState = STATE_UMOUNT_REQ;
 			NfsSend();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			NfsState = STATE_READLINK_REQ;
 			NfsSend();
 		} else {
-			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
 			NfsState = STATE_UMOUNT_REQ;
 			NfsSend();
 		}
@@ -770,11 +1068,16 @@ NfsStart(void)
 	printf("\nLoad address: 0x%lx\n"
 		"Loading: *\b", load_addr);
 
-	NetSetTimeout(nfs_timeout, NfsTimeout);
 	net_set_udp_handler(NfsHandler);
 
 	NfsTimeoutCount = 0;
 	NfsState = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
+	nfs_version = 3;
+	NfsSrvMountPort = 0;
+	NfsSrvNfsPort = 0;
+	nfs_rto = NFS_TIMEOUT;
+	nfs_srtt = 0;
+	nfs_rttvar = 0;
 
 	/*NfsOurPort = 4096 + (get_ticks() % 3072);*/
 	/*FIX ME !!!*/
@@ -782,6 +1085,7 @@ NfsStart(void)
 
 	/* zero out server ether in case the server ip has changed */
 	memset(NetServerEther, 0, 6);
+	arp_cache_get(NfsServerIP, NetServerEther);
 
 	NfsSend();
 }
@@ -25,7 +25,12 @@
 #define NFS_READLINK    5
 #define NFS_READ        6
 
+#define NFS3PROC_LOOKUP 3	/* READLINK and READ keep their numbers */
+
 #define NFS_FHSIZE      32
+#define NFS3_FHSIZE     64
+#define NFS3_FATTR_SIZE 84
+#define NFS2_MAXDATA    8192	/* largest READ NFSv2 allows */
 
 #define NFSERR_PERM     1
 #define NFSERR_NOENT    2
@@ -35,15 +40,25 @@
 
 /* Block size used for NFS read accesses.  A RPC reply packet (including  all
  * headers) must fit within a single Ethernet frame to avoid fragmentation.
- * However, if CONFIG_IP_DEFRAG is set, the config file may want to use a
- * bigger value. In any case, most NFS servers are optimized for a power of 2.
+ * However, if CONFIG_IP_DEFRAG is set, a reply can be as large as the
+ * defragmenter takes. In any case, most NFS servers are optimized for a
+ * power of 2. NFSv2 reads are limited to NFS2_MAXDATA whatever this says.
  */
 #ifdef CONFIG_NFS_READ_SIZE
 #define NFS_READ_SIZE CONFIG_NFS_READ_SIZE
+#elif defined(CONFIG_IP_DEFRAG)
+#define NFS_READ_SIZE CONFIG_NET_MAXDEFRAG
 #else
 #define NFS_READ_SIZE 1024 /* biggest power of two that fits Ether frame */
 #endif
 
+/* Number of READ requests kept in flight */
+#ifdef CONFIG_NFS_READ_WINDOW
+#define NFS_READ_WINDOW CONFIG_NFS_READ_WINDOW
+#else
+#define NFS_READ_WINDOW 4
+#endif
+
 #define NFS_MAXLINKDEPTH 16
 
 struct rpc_t {
@@ -65,7 +80,7 @@ struct rpc_t {
 			uint32_t verifier;
 			uint32_t v2;
 			uint32_t astatus;
-			uint32_t data[19];
+			uint32_t data[26];	/* largest READ reply header */
 		} reply;
 	} u;
 };
@@ -0,0 +1,363 @@
+/*
+ * Minimal TCP client
+ *
+ * One connection at a time, opened by us, which receives a stream and
+ * sends little more than a request. The data goes straight to the caller,
+ * so the receive window never closes and only slides along with what has
+ * arrived. Segments are taken in order only: anything after a hole is
+ * dropped and answered at once with a duplicate ACK so the peer resends
+ * from the hole. In-order segments are acknowledged every second segment
+ * or at the next timer tick, whichever comes first.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <net.h>
+#include "tcp.h"
+
+#ifndef CONFIG_TCP_RX_WINDOW
+#define CONFIG_TCP_RX_WINDOW	(64 << 10)
+#endif
+
+/* Largest segment we take, so that no IP fragments are needed */
+#define TCP_MSS			1460
+
+#define TCP_TICK_MS		20	/* longest an ACK is delayed */
+#define TCP_RTO_MS		1000	/* first retransmit timeout */
+#define TCP_RTO_MAX_MS		8000
+#define TCP_RETRIES		6
+#define TCP_IDLE_MS		10000	/* give up on a silent peer */
+
+/* Sequence number a comes after b */
+#define tcp_after(a, b)		((s32)((a) - (b)) > 0)
+
+enum tcp_state {
+	TCP_STATE_CLOSED,
+	TCP_STATE_SYN_SENT,
+	TCP_STATE_ESTABLISHED,
+	TCP_STATE_CLOSE_WAIT,	/* peer sent FIN, our data still in flight */
+	TCP_STATE_LAST_ACK,	/* both sent FIN, ours not yet acknowledged */
+};
+
+static enum tcp_state tcp_state;
+static IPaddr_t tcp_remote_ip;
+static uchar tcp_remote_ether[6];
+static int tcp_lport;
+static int tcp_rport;
+static tcp_rx_handler *tcp_rx;
+static tcp_event_handler *tcp_event;
+
+static u32 tcp_snd_una;		/* oldest byte not acknowledged */
+static u32 tcp_snd_nxt;		/* next byte to send */
+static u32 tcp_rcv_nxt;		/* next byte expected */
+static int tcp_ws_shift;	/* window scale we ask for */
+static int tcp_wscale;		/* window scale in use */
+static int tcp_ack_pending;	/* segments received but not acknowledged */
+
+/* The segment not yet acknowledged: SYN, data or FIN */
+static uchar tcp_tx_buf[TCP_TX_MAX];
+static unsigned tcp_tx_len;
+static uchar tcp_tx_flags;
+static ulong tcp_tx_time;
+static ulong tcp_rto;
+static int tcp_retries;
+
+static ulong tcp_rx_time;
+
+static unsigned tcp_cksum(IPaddr_t src, IPaddr_t dst, uchar *seg, int len)
+{
+	ushort pseudo[6];
+	ulong sum;
+
+	/* NetCksum() works on whole words; there is room for the pad byte */
+	if (len & 1)
+		seg[len] = 0;
+	memcpy(&pseudo[0], &src, 4);
+	memcpy(&pseudo[2], &dst, 4);
+	pseudo[4] = htons(IPPROTO_TCP);
+	pseudo[5] = htons(len);
+	sum = NetCksum((uchar *)pseudo, 6) + NetCksum(seg, (len + 1) / 2);
+
+	return (sum & 0xffff) + (sum >> 16);
+}
+
+static void tcp_xmit(uchar flags, u32 seq, const uchar *data, unsigned len)
+{
+	uchar *pkt = (uchar *)NetTxPacket + NetEthHdrSize() + IP_HDR_SIZE;
+	struct tcp_hdr *tcp = (struct tcp_hdr *)pkt;
+	uchar *opt = pkt + TCP_HDR_SIZE;
+	ulong win = CONFIG_TCP_RX_WINDOW;
+	int hlen = TCP_HDR_SIZE;
+
+	if (flags & TCP_SYN) {
+		/* MSS, then window scale aligned by a NOP */
+		opt[0] = 2;
+		opt[1] = 4;
+		opt[2] = TCP_MSS >> 8;
+		opt[3] = TCP_MSS & 0xff;
+		opt[4] = 1;
+		opt[5] = 3;
+		opt[6] = 3;
+		opt[7] = tcp_ws_shift;
+		hlen += 8;
+	} else {
+		win >>= tcp_wscale;
+	}
+
+	tcp->tcp_src = htons(tcp_lport);
+	tcp->tcp_dst = htons(tcp_rport);
+	tcp->tcp_seq = htonl(seq);
+	tcp->tcp_ack = (flags & TCP_ACK) ? htonl(tcp_rcv_nxt) : 0;
+	tcp->tcp_hlen = hlen << 2;
+	tcp->tcp_flags = flags;
+	tcp->tcp_win = htons(min(win, 0xffffUL));
+	tcp->tcp_xsum = 0;
+	tcp->tcp_urg = 0;
+	memcpy(pkt + hlen, data, len);
+	tcp->tcp_xsum = ~tcp_cksum(NetOurIP, tcp_remote_ip, pkt, hlen + len);
+
+	if (flags & TCP_ACK)
+		tcp_ack_pending = 0;
+	net_send_ip_packet(tcp_remote_ether, tcp_remote_ip, IPPROTO_TCP,
+			   hlen + len);
+}
+
+static void tcp_ack_now(void)
+{
+	tcp_xmit(TCP_ACK, tcp_snd_nxt, NULL, 0);
+}
+
+/* (Re)send the segment waiting for its acknowledgement */
+static void tcp_output(void)
+{
+	uchar flags = tcp_tx_flags;
+
+	if (tcp_state != TCP_STATE_SYN_SENT)
+		flags |= TCP_ACK;
+	tcp_xmit(flags, tcp_snd_una, tcp_tx_buf, tcp_tx_len);
+	tcp_tx_time = get_timer(0);
+}
+
+static void tcp_queue(uchar flags, const void *data, unsigned len)
+{
+	memcpy(tcp_tx_buf, data, len);
+	tcp_tx_len = len;
+	tcp_tx_flags = flags;
+	tcp_snd_nxt = tcp_snd_una + len;
+	if (flags & (TCP_SYN | TCP_FIN))
+		tcp_snd_nxt++;
+	tcp_rto = TCP_RTO_MS;
+	tcp_retries = 0;
+	tcp_output();
+}
+
+static void tcp_close(enum tcp_event event)
+{
+	tcp_state = TCP_STATE_CLOSED;
+	tcp_event(event);
+}
+
+static void tcp_timer(void)
+{
+	if (tcp_state == TCP_STATE_CLOSED)
+		return;
+
+	if (tcp_ack_pending)
+		tcp_ack_now();
+
+	if (tcp_snd_una != tcp_snd_nxt) {
+		if (get_timer(tcp_tx_time) >= tcp_rto) {
+			if (++tcp_retries > TCP_RETRIES) {
+				/* After the peer's FIN the stream is complete */
+				tcp_close(tcp_state >= TCP_STATE_CLOSE_WAIT ?
+					  TCP_CLOSED : TCP_TIMEOUT);
+				return;
+			}
+			tcp_rto = min(tcp_rto * 2, (ulong)TCP_RTO_MAX_MS);
+			tcp_output();
+		}
+	} else if (get_timer(tcp_rx_time) >= TCP_IDLE_MS) {
+		tcp_close(TCP_TIMEOUT);
+		return;
+	}
+
+	NetSetTimeout(TCP_TICK_MS, tcp_timer);
+}
+
+void tcp_connect(IPaddr_t dest, int dport, tcp_rx_handler *rx,
+		 tcp_event_handler *event)
+{
+	tcp_remote_ip = dest;
+	tcp_rport = dport;
+	memset(tcp_remote_ether, '\0', sizeof(tcp_remote_ether));
+	tcp_rx = rx;
+	tcp_event = event;
+
+	/* A new port and sequence each time, so old segments do not match */
+	tcp_lport = 1024 + (get_timer(0) % 3072);
+	tcp_snd_una = get_timer(0) << 10;
+	tcp_rcv_nxt = 0;
+	tcp_ack_pending = 0;
+	for (tcp_ws_shift = 0; (CONFIG_TCP_RX_WINDOW >> tcp_ws_shift) > 0xffff;
+	     tcp_ws_shift++)
+		;
+	tcp_wscale = 0;
+
+	tcp_state = TCP_STATE_SYN_SENT;
+	tcp_rx_time = get_timer(0);
+	tcp_queue(TCP_SYN, NULL, 0);
+	NetSetTimeout(TCP_TICK_MS, tcp_timer);
+}
+
+int tcp_send(const void *data, unsigned len)
+{
+	if (tcp_state != TCP_STATE_ESTABLISHED ||
+	    tcp_snd_una != tcp_snd_nxt || len > TCP_TX_MAX)
+		return -1;
+
+	tcp_queue(TCP_PSH, data, len);
+
+	return 0;
+}
+
+void tcp_abort(void)
+{
+	if (tcp_state == TCP_STATE_CLOSED)
+		return;
+
+	tcp_xmit(TCP_RST | TCP_ACK, tcp_snd_nxt, NULL, 0);
+	tcp_state = TCP_STATE_CLOSED;
+}
+
+/* Pick out the options of the SYN-ACK that matter to us */
+static void tcp_syn_options(const uchar *opt, int len)
+{
+	while (len > 0 && opt[0]) {
+		if (opt[0] == 1) {
+			opt++;
+			len--;
+			continue;
+		}
+		if (len < 2 || opt[1] < 2 || opt[1] > len)
+			break;
+		/* Scaling applies only if both sides asked for it */
+		if (opt[0] == 3 && opt[1] == 3)
+			tcp_wscale = tcp_ws_shift;
+		len -= opt[1];
+		opt += opt[1];
+	}
+}
+
+void tcp_receive(struct ip_udp_hdr *ip, int len)
+{
+	uchar *pkt = (uchar *)ip + IP_HDR_SIZE;
+	struct tcp_hdr *tcp = (struct tcp_hdr *)pkt;
+	IPaddr_t src = NetReadIP(&ip->ip_src);
+	IPaddr_t dst = NetReadIP(&ip->ip_dst);
+	int hlen, dlen;
+	u32 seq, ack, skip;
+	uchar flags;
+
+	len -= IP_HDR_SIZE;
+	if (tcp_state == TCP_STATE_CLOSED || len < TCP_HDR_SIZE)
+		return;
+	if (src != tcp_remote_ip || ntohs(tcp->tcp_src) != tcp_rport ||
+	    ntohs(tcp->tcp_dst) != tcp_lport)
+		return;
+	hlen = (tcp->tcp_hlen >> 4) * 4;
+	if (hlen < TCP_HDR_SIZE || hlen > len)
+		return;
+	if (tcp_cksum(src, dst, pkt, len) != 0xffff) {
+		debug("tcp: bad checksum\n");
+		return;
+	}
+
+	seq = ntohl(tcp->tcp_seq);
+	ack = ntohl(tcp->tcp_ack);
+	flags = tcp->tcp_flags;
+	dlen = len - hlen;
+	tcp_rx_time = get_timer(0);
+
+	if (tcp_state == TCP_STATE_SYN_SENT) {
+		if (!(flags & TCP_ACK) || ack != tcp_snd_nxt)
+			return;
+		if (flags & TCP_RST) {
+			tcp_close(TCP_RESET);
+			return;
+		}
+		if (!(flags & TCP_SYN))
+			return;
+
+		tcp_syn_options(pkt + TCP_HDR_SIZE, hlen - TCP_HDR_SIZE);
+		tcp_rcv_nxt = seq + 1;
+		tcp_snd_una = ack;
+		tcp_state = TCP_STATE_ESTABLISHED;
+		tcp_event(TCP_CONNECTED);
+		/* The handshake ends with the request, if there is one */
+		if (tcp_state == TCP_STATE_ESTABLISHED &&
+		    tcp_snd_una == tcp_snd_nxt)
+			tcp_ack_now();
+		return;
+	}
+
+	if (flags & TCP_RST) {
+		/* Only a reset inside the window is believed */
+		if (seq - tcp_rcv_nxt < CONFIG_TCP_RX_WINDOW)
+			tcp_close(TCP_RESET);
+		return;
+	}
+
+	if ((flags & TCP_ACK) && tcp_after(ack, tcp_snd_una) &&
+	    !tcp_after(ack, tcp_snd_nxt))
+		tcp_snd_una = ack;
+
+	/* Once the peer has closed, send our FIN and wait for its ACK */
+	if (tcp_state == TCP_STATE_CLOSE_WAIT && tcp_snd_una == tcp_snd_nxt) {
+		tcp_state = TCP_STATE_LAST_ACK;
+		tcp_queue(TCP_FIN, NULL, 0);
+	}
+	if (tcp_state == TCP_STATE_LAST_ACK && tcp_snd_una == tcp_snd_nxt) {
+		tcp_close(TCP_CLOSED);
+		return;
+	}
+
+	/* A repeated SYN-ACK means our ACK of it was lost */
+	if (flags & TCP_SYN) {
+		tcp_ack_now();
+		return;
+	}
+	if (!dlen && !(flags & TCP_FIN))
+		return;
+
+	/* Trim what we already have; a hole or a plain resend gets an ACK */
+	skip = tcp_rcv_nxt - seq;
+	if (tcp_after(seq, tcp_rcv_nxt) || skip > dlen ||
+	    (skip == dlen && !(flags & TCP_FIN))) {
+		tcp_ack_now();
+		return;
+	}
+
+	if (dlen > skip) {
+		tcp_rcv_nxt += dlen - skip;
+		tcp_rx(pkt + hlen + skip, dlen - skip);
+		if (tcp_state == TCP_STATE_CLOSED)
+			return;
+	}
+
+	if (flags & TCP_FIN) {
+		tcp_rcv_nxt++;
+		/* Close our side too, unless our data is still in flight */
+		if (tcp_snd_una == tcp_snd_nxt) {
+			tcp_state = TCP_STATE_LAST_ACK;
+			tcp_queue(TCP_FIN, NULL, 0);
+		} else {
+			tcp_state = TCP_STATE_CLOSE_WAIT;
+			tcp_ack_now();
+		}
+		return;
+	}
+
+	if (++tcp_ack_pending >= 2)
+		tcp_ack_now();
+}
@@ -0,0 +1,83 @@
+/*
+ * Minimal TCP client
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __TCP_H__
+#define __TCP_H__
+
+#include <common.h>
+#include <net.h>
+
+struct tcp_hdr {
+	ushort		tcp_src;	/* source port			*/
+	ushort		tcp_dst;	/* destination port		*/
+	u32		tcp_seq;	/* sequence number		*/
+	u32		tcp_ack;	/* acknowledgement number	*/
+	uchar		tcp_hlen;	/* header length << 2		*/
+	uchar		tcp_flags;	/* flags			*/
+	ushort		tcp_win;	/* receive window		*/
+	ushort		tcp_xsum;	/* checksum			*/
+	ushort		tcp_urg;	/* urgent pointer		*/
+} __attribute__((packed));
+
+#define TCP_HDR_SIZE		(sizeof(struct tcp_hdr))
+
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PSH		0x08
+#define TCP_ACK		0x10
+
+enum tcp_event {
+	TCP_CONNECTED,		/* connection is open */
+	TCP_CLOSED,		/* both sides closed; no more data */
+	TCP_RESET,		/* peer reset or refused the connection */
+	TCP_TIMEOUT,		/* peer stopped answering */
+};
+
+/*
+ * Called with each piece of the received stream, strictly in order and
+ * without duplicates
+ */
+typedef void tcp_rx_handler(const uchar *data, unsigned len);
+typedef void tcp_event_handler(enum tcp_event event);
+
+/**
+ * Open the connection, sending the SYN. The handlers are called from
+ * NetReceive() and from the TCP timer once the netloop is running.
+ *
+ * @param dest		Server address
+ * @param dport		Server port
+ * @param rx		Receives the data
+ * @param event		Told about connection state changes
+ */
+void tcp_connect(IPaddr_t dest, int dport, tcp_rx_handler *rx,
+		 tcp_event_handler *event);
+
+/**
+ * Send data on the open connection. Only one segment may be in flight.
+ *
+ * @param data		Data to send
+ * @param len		Length, no more than TCP_TX_MAX
+ * @return 0 if sent, -1 if it cannot be sent now
+ */
+int tcp_send(const void *data, unsigned len);
+
+#define TCP_TX_MAX	512
+
+/*
+ * Drop the connection, sending a reset. No event is reported.
+ */
+void tcp_abort(void);
+
+/*
+ * Deal with a received TCP segment
+ *
+ * @param ip IP header of the segment
+ * @param len Length of the IP packet
+ */
+void tcp_receive(struct ip_udp_hdr *ip, int len);
+
+#endif /* __TCP_H__ */
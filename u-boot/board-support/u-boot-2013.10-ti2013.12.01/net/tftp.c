@@ -9,6 +9,7 @@
 #include <common.h>
 #include <command.h>
 #include <net.h>
+#include "arp.h"
 #include "tftp.h"
 #include "bootp.h"
 #ifdef CONFIG_SYS_DIRECT_FLASH_TFTP
@@ -119,17 +120,41 @@ static char tftp_filename[MAX_LEN];
 /* 512 is poor choice for ethernet, MTU is typically 1500.
  * Minus eth.hdrs thats 1468.  Can get 2x better throughput with
  * almost-MTU block sizes.  At least try... fall back to 512 if need be.
- * (but those using CONFIG_IP_DEFRAG may want to set a larger block in cfg file)
+ * With CONFIG_IP_DEFRAG we ask for blocks as large as we can reassemble,
+ * and fall back to 1468 if none of them make it through.
  */
-#ifdef CONFIG_TFTP_BLOCKSIZE
+#define TFTP_FRAME_BLOCKSIZE 1468
+#if defined(CONFIG_TFTP_BLOCKSIZE)
 #define TFTP_MTU_BLOCKSIZE CONFIG_TFTP_BLOCKSIZE
+#elif defined(CONFIG_IP_DEFRAG)
+#define TFTP_MTU_BLOCKSIZE \
+	(CONFIG_NET_MAXDEFRAG < 65464 ? CONFIG_NET_MAXDEFRAG : 65464)
 #else
-#define TFTP_MTU_BLOCKSIZE 1468
+#define TFTP_MTU_BLOCKSIZE TFTP_FRAME_BLOCKSIZE
 #endif
 
 static unsigned short TftpBlkSize = TFTP_BLOCK_SIZE;
 static unsigned short TftpBlkSizeOption = TFTP_MTU_BLOCKSIZE;
 
+/*
+ * RFC 7440: the server sends this many blocks before waiting for an ACK.
+ * A window of 1 is plain lock-step TFTP and is not asked for.
+ */
+#ifdef CONFIG_TFTP_WINDOWSIZE
+#define TFTP_WINDOWSIZE CONFIG_TFTP_WINDOWSIZE
+#else
+#define TFTP_WINDOWSIZE 1
+#endif
+
+static unsigned short TftpWindowSize = 1;
+static unsigned short TftpWindowSizeOption = TFTP_WINDOWSIZE;
+/* blocks received since we last sent an ACK */
+static unsigned short TftpWindowCount;
+/* last block we re-acknowledged after seeing a gap */
+static ulong	TftpLastNack;
+/* where the request goes, for starting it again with smaller blocks */
+static int	TftpServerPort;
+
 #ifdef CONFIG_MCAST_TFTP
 #include <malloc.h>
 #define MTFTP_BITMAPSIZE	0x1000
@@ -201,6 +226,8 @@ static void new_transfer(void)
 	TftpLastBlock = 0;
 	TftpBlockWrap = 0;
 	TftpBlockWrapOffset = 0;
+	TftpWindowCount = 0;
+	TftpLastNack = TFTP_SEQUENCE_SIZE;
 #ifdef CONFIG_CMD_TFTPPUT
 	TftpFinalBlock = 0;
 #endif
@@ -359,6 +386,10 @@ TftpSend(void)
 		/* try for more effic. blk size */
 		pkt += sprintf((char *)pkt, "blksize%c%d%c",
 				0, TftpBlkSizeOption, 0);
+		/* only downloads are windowed */
+		if (TftpState == STATE_SEND_RRQ && TftpWindowSizeOption > 1)
+			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
+					0, TftpWindowSizeOption, 0);
 #ifdef CONFIG_MCAST_TFTP
 		/* Check all preconditions before even trying the option */
 		if (!ProhibitMcast) {
@@ -448,6 +479,7 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 {
 	__be16 proto;
 	__be16 *s;
+	ulong block;
 	int i;
 
 	if (dest != TftpOurPort) {
@@ -528,6 +560,16 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 				debug("Blocksize ack: %s, %d\n",
 					(char *)pkt+i+8, TftpBlkSize);
 			}
+			if (strcmp((char *)pkt+i, "windowsize") == 0) {
+				TftpWindowSize = (unsigned short)
+					simple_strtoul((char *)pkt+i+11, NULL,
+						       10);
+				if (TftpWindowSize < 1 ||
+				    TftpWindowSize > TftpWindowSizeOption)
+					TftpWindowSize = 1;
+				debug("Windowsize ack: %s, %d\n",
+					(char *)pkt+i+11, TftpWindowSize);
+			}
 #ifdef CONFIG_TFTP_TSIZE
 			if (strcmp((char *)pkt+i, "tsize") == 0) {
 				TftpTsize = simple_strtoul((char *)pkt+i+6,
@@ -556,9 +598,7 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 		if (len < 2)
 			return;
 		len -= 2;
-		TftpBlock = ntohs(*(__be16 *)pkt);
-
-		update_block_number();
+		block = ntohs(*(__be16 *)pkt);
 
 		if (TftpState == STATE_SEND_RRQ)
 			debug("Server did not acknowledge timeout option!\n");
@@ -572,26 +612,49 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 
 #ifdef CONFIG_MCAST_TFTP
 			if (Multicast) { /* start!=1 common if mcast */
-				TftpLastBlock = TftpBlock - 1;
+				TftpLastBlock = block - 1;
 			} else
 #endif
-			if (TftpBlock != 1) {	/* Assertion */
+			if (block != 1) {	/* Assertion */
 				printf("\nTFTP error: "
 				       "First block is not block 1 (%ld)\n"
 				       "Starting again\n\n",
-					TftpBlock);
+					block);
 				NetStartAgain();
 				break;
 			}
 		}
 
-		if (TftpBlock == TftpLastBlock) {
+		if (block == TftpLastBlock) {
 			/*
 			 *	Same block again; ignore it.
 			 */
 			break;
 		}
 
+#ifdef CONFIG_MCAST_TFTP
+		if (!Multicast)
+#endif
+		if (block != ((TftpLastBlock + 1) & 0xffff)) {
+			/*
+			 * Blocks of a window went missing. Blocks from before
+			 * the last one we took are stale copies and ignored;
+			 * for a gap, acknowledge the last block in order once
+			 * so that the server resends the window from there.
+			 */
+			if (((block - TftpLastBlock) & 0xffff) < 0x8000 &&
+			    TftpLastNack != TftpLastBlock) {
+				debug("Got block %ld, expected %ld\n", block,
+				      (TftpLastBlock + 1) & 0xffff);
+				TftpLastNack = TftpLastBlock;
+				TftpWindowCount = 0;
+				TftpSend();
+			}
+			break;
+		}
+
+		TftpBlock = block;
+		update_block_number();
 		TftpLastBlock = TftpBlock;
 		TftpTimeoutCountMax = TIMEOUT_COUNT;
 		NetSetTimeout(TftpTimeoutMSecs, TftpTimeout);
@@ -626,8 +689,16 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 				TftpLastBlock = TftpBlock;
 			}
 		}
+		if (Multicast)
+			TftpSend();
+		else
 #endif
-		TftpSend();
+		if (++TftpWindowCount >= TftpWindowSize ||
+		    len < TftpBlkSize) {
+			/* The window, or the file, is complete */
+			TftpWindowCount = 0;
+			TftpSend();
+		}
 
 #ifdef CONFIG_MCAST_TFTP
 		if (Multicast) {
@@ -679,6 +750,24 @@ TftpTimeout(void)
 	} else {
 		puts("T ");
 		NetSetTimeout(TftpTimeoutMSecs, TftpTimeout);
+		if (TftpState == STATE_OACK && !TftpWriting &&
+		    TftpBlkSize > TFTP_FRAME_BLOCKSIZE) {
+			/*
+			 * The server agreed to blocks that need IP fragments
+			 * but none arrived. Something on the way drops them,
+			 * so ask again, from a new port, for blocks that fit
+			 * in a frame.
+			 */
+			printf("\nNo data with %d byte blocks, trying %d\n",
+			       TftpBlkSize, TFTP_FRAME_BLOCKSIZE);
+			TftpBlkSizeOption = TFTP_FRAME_BLOCKSIZE;
+			TftpBlkSize = TFTP_BLOCK_SIZE;
+			TftpWindowSize = 1;
+			TftpState = STATE_SEND_RRQ;
+			TftpRemotePort = TftpServerPort;
+			TftpOurPort = 1024 + (get_timer(0) % 3072);
+		}
+		TftpWindowCount = 0;
 		if (TftpState != STATE_RECV_WRQ)
 			TftpSend();
 	}
@@ -693,10 +782,16 @@ void TftpStart(enum proto_t protocol)
 	 * Allow the user to choose TFTP blocksize and timeout.
 	 * TFTP protocol has a minimal timeout of 1 second.
 	 */
+	TftpBlkSizeOption = TFTP_MTU_BLOCKSIZE;
 	ep = getenv("tftpblocksize");
 	if (ep != NULL)
 		TftpBlkSizeOption = simple_strtol(ep, NULL, 10);
 
+	TftpWindowSizeOption = TFTP_WINDOWSIZE;
+	ep = getenv("tftpwindowsize");
+	if (ep != NULL)
+		TftpWindowSizeOption = simple_strtol(ep, NULL, 10);
+
 	ep = getenv("tftptimeout");
 	if (ep != NULL)
 		TftpTimeoutMSecs = simple_strtol(ep, NULL, 10);
@@ -708,8 +803,8 @@ void TftpStart(enum proto_t protocol)
 		TftpTimeoutMSecs = 1000;
 	}
 
-	debug("TFTP blocksize = %i, timeout = %ld ms\n",
-		TftpBlkSizeOption, TftpTimeoutMSecs);
+	debug("TFTP blocksize = %i, windowsize = %i, timeout = %ld ms\n",
+		TftpBlkSizeOption, TftpWindowSizeOption, TftpTimeoutMSecs);
 
 	TftpRemoteIP = NetServerIP;
 	if (BootFile[0] == '\0') {
@@ -803,12 +898,15 @@ void TftpStart(enum proto_t protocol)
 	if (ep != NULL)
 		TftpOurPort = simple_strtol(ep, NULL, 10);
 #endif
+	TftpServerPort = TftpRemotePort;
 	TftpBlock = 0;
 
 	/* zero out server ether in case the server ip has changed */
 	memset(NetServerEther, 0, 6);
-	/* Revert TftpBlkSize to dflt */
+	arp_cache_get(TftpRemoteIP, NetServerEther);
+	/* Revert TftpBlkSize and TftpWindowSize to dflt */
 	TftpBlkSize = TFTP_BLOCK_SIZE;
+	TftpWindowSize = 1;
 #ifdef CONFIG_MCAST_TFTP
 	mcast_cleanup();
 #endif
@@ -837,8 +935,9 @@ TftpStartServer(void)
 	TftpTimeoutMSecs = TIMEOUT;
 	NetSetTimeout(TftpTimeoutMSecs, TftpTimeout);
 
-	/* Revert TftpBlkSize to dflt */
+	/* Revert TftpBlkSize and TftpWindowSize to dflt */
 	TftpBlkSize = TFTP_BLOCK_SIZE;
+	TftpWindowSize = 1;
 	TftpBlock = 0;
 	TftpOurPort = WELL_KNOWN_PORT;
 
@@ -0,0 +1,211 @@
+/*
+ * HTTP download over TCP
+ *
+ * An HTTP/1.0 GET whose response body is copied to load_addr as each
+ * segment arrives. With CONFIG_WGET_CRC32 the CRC32 of the body is worked
+ * out on the way, while the data is still in the cache, so checking it
+ * needs no second pass over memory.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <net.h>
+#include <asm/io.h>
+#include <u-boot/crc.h>
+#include "tcp.h"
+#include "wget.h"
+
+#define HTTP_PORT	80
+#define HDR_MAX		1024	/* longest response header we take */
+#define HASH_BYTES	(64 << 10)
+#define HASHES_PER_LINE	65
+
+static IPaddr_t wget_server_ip;
+static const char *wget_path;
+static char wget_hdr[HDR_MAX + 1];
+static unsigned wget_hdr_len;
+static int wget_in_body;
+static long wget_length;	/* Content-Length, or -1 if not given */
+static ulong wget_size;		/* body bytes received */
+#ifdef CONFIG_WGET_CRC32
+static u32 wget_crc;
+#endif
+
+static void wget_fail(const char *msg)
+{
+	if (msg)
+		printf("\n%s\n", msg);
+	tcp_abort();
+	net_set_state(NETLOOP_FAIL);
+}
+
+/* Check the status and find the length; returns -1 to give up */
+static int wget_parse_header(void)
+{
+	char *p, *eol;
+
+	eol = strstr(wget_hdr, "\r\n");
+	if (eol)
+		*eol = '\0';
+	p = strchr(wget_hdr, ' ');
+	if (strncmp(wget_hdr, "HTTP/1.", 7) || !p ||
+	    simple_strtoul(p + 1, NULL, 10) != 200) {
+		printf("\nServer answered '%s'\n", wget_hdr);
+		return -1;
+	}
+
+	wget_length = -1;
+	for (p = eol; p; p = strstr(p, "\r\n")) {
+		p += 2;
+		if (!strncasecmp(p, "Content-Length:", 15)) {
+			p += 15;
+			while (*p == ' ')
+				p++;
+			wget_length = simple_strtoul(p, NULL, 10);
+		}
+	}
+
+	return 0;
+}
+
+static void wget_store(const uchar *data, unsigned len)
+{
+	void *ptr;
+
+	ptr = map_sysmem(load_addr + wget_size, len);
+	memcpy(ptr, data, len);
+	unmap_sysmem(ptr);
+#ifdef CONFIG_WGET_CRC32
+	wget_crc = crc32(wget_crc, data, len);
+#endif
+
+	if ((wget_size + len) / HASH_BYTES != wget_size / HASH_BYTES) {
+		putc('#');
+		if (((wget_size + len) / HASH_BYTES) % HASHES_PER_LINE == 0)
+			puts("\n\t ");
+	}
+	wget_size += len;
+}
+
+static void wget_rx(const uchar *data, unsigned len)
+{
+	unsigned take, used;
+	char *end;
+
+	if (!wget_in_body) {
+		take = min(len, HDR_MAX - wget_hdr_len);
+		memcpy(wget_hdr + wget_hdr_len, data, take);
+		wget_hdr[wget_hdr_len + take] = '\0';
+		end = strstr(wget_hdr, "\r\n\r\n");
+		if (!end) {
+			wget_hdr_len += take;
+			if (wget_hdr_len == HDR_MAX)
+				wget_fail("HTTP header too long");
+			return;
+		}
+
+		used = end + 4 - wget_hdr - wget_hdr_len;
+		*end = '\0';
+		if (wget_parse_header()) {
+			wget_fail(NULL);
+			return;
+		}
+		wget_in_body = 1;
+		data += used;
+		len -= used;
+	}
+
+	if (len)
+		wget_store(data, len);
+}
+
+static void wget_event(enum tcp_event event)
+{
+	char req[TCP_TX_MAX];
+	int len;
+
+	switch (event) {
+	case TCP_CONNECTED:
+		len = snprintf(req, sizeof(req), "GET %s%s HTTP/1.0\r\n"
+			       "Host: %pI4\r\n"
+			       "User-Agent: U-Boot\r\n"
+			       "Connection: close\r\n\r\n",
+			       *wget_path == '/' ? "" : "/", wget_path,
+			       &wget_server_ip);
+		if (len >= sizeof(req) || tcp_send(req, len))
+			wget_fail("Request too long");
+		break;
+
+	case TCP_CLOSED:
+		if (!wget_in_body) {
+			puts("\nNo HTTP response\n");
+			net_set_state(NETLOOP_FAIL);
+			break;
+		}
+		if (wget_length >= 0 && wget_size != wget_length) {
+			printf("\nTruncated: got %lu of %ld bytes\n", wget_size,
+			       wget_length);
+			net_set_state(NETLOOP_FAIL);
+			break;
+		}
+
+		puts("\ndone\n");
+#ifdef CONFIG_WGET_CRC32
+		printf("CRC32 = %08x\n", wget_crc);
+		setenv_hex("filecrc", wget_crc);
+#endif
+		NetBootFileXferSize = wget_size;
+		net_set_state(NETLOOP_SUCCESS);
+		break;
+
+	case TCP_RESET:
+		puts("\nConnection reset\n");
+		net_set_state(NETLOOP_FAIL);
+		break;
+
+	case TCP_TIMEOUT:
+		puts("\nRetry count exceeded; giving up\n");
+		net_set_state(NETLOOP_FAIL);
+		break;
+	}
+}
+
+void wget_start(void)
+{
+	int port = HTTP_PORT;
+	char *p;
+
+	wget_server_ip = NetServerIP;
+	wget_path = BootFile;
+	p = strchr(BootFile, ':');
+	if (p) {
+		wget_server_ip = string_to_ip(BootFile);
+		wget_path = p + 1;
+	}
+	if (*wget_path == '\0') {
+		puts("*** ERROR: no file to get\n");
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+	p = getenv("httpdstp");
+	if (p)
+		port = simple_strtol(p, NULL, 10);
+
+	printf("Using %s device\n", eth_get_name());
+	printf("HTTP from server %pI4 port %d; our IP address is %pI4\n",
+	       &wget_server_ip, port, &NetOurIP);
+	printf("Filename '%s'.\n", wget_path);
+	printf("Load address: 0x%lx\n", load_addr);
+	puts("Loading: *\b");
+
+	wget_hdr_len = 0;
+	wget_in_body = 0;
+	wget_length = -1;
+	wget_size = 0;
+#ifdef CONFIG_WGET_CRC32
+	wget_crc = 0;
+#endif
+
+	tcp_connect(wget_server_ip, port, wget_rx, wget_event);
+}
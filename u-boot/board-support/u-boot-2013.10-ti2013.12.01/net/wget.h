@@ -0,0 +1,16 @@
+/*
+ * HTTP download over TCP
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __WGET_H__
+#define __WGET_H__
+
+/*
+ * Start the download of BootFile, as [host:]path, to load_addr
+ * (beginning of netloop)
+ */
+void wget_start(void);
+
+#endif /* __WGET_H__ */
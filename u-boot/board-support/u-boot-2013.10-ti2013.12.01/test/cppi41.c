@@ -0,0 +1,166 @@
+/*
+ * Tests for the CPPI 4.1 DMA driver against the sandbox queue manager
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <cppi41.h>
+#include <errno.h>
+#include <malloc.h>
+#include <asm/cppi41.h>
+#include <asm/io.h>
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+#define BUF_SIZE	512
+
+static u32 bus_addr(void *buf)
+{
+	return map_to_sysmem(buf);
+}
+
+static int test_transfers(void)
+{
+	struct cppi41_chan *tx, *rx;
+	struct cppi41 *cppi = NULL;
+	void *ctrl, *sched, *qmgr;
+	u8 *buf = NULL, *data = NULL;
+	u8 out[BUF_SIZE];
+	u32 actual;
+	int ret = 0;
+	int i;
+
+	printf(" testing cppi41 transfers ...\n");
+	sandbox_cppi41_reset(&ctrl, &sched, &qmgr);
+	buf = memalign(ARCH_DMA_MINALIGN, BUF_SIZE);
+	data = malloc(BUF_SIZE);
+	errcheck(buf && data);
+	for (i = 0; i < BUF_SIZE; i++)
+		data[i] = i * 7;
+
+	cppi = cppi41_init(ctrl, sched, qmgr);
+	errcheck(cppi != NULL);
+	errcheck(cppi41_chan_get(cppi, CPPI41_NUM_CHANS, 1) == NULL);
+	tx = cppi41_chan_get(cppi, 3, 1);
+	rx = cppi41_chan_get(cppi, 17, 0);
+	errcheck(tx && rx);
+
+	/* TX: nothing completes until the endpoint has taken the data */
+	memcpy(buf, data, 100);
+	errcheck(cppi41_chan_submit(tx, bus_addr(buf), 0) == -EINVAL);
+	errcheck(cppi41_chan_submit(tx, bus_addr(buf), 100) == 0);
+	errcheck(cppi41_chan_submit(tx, bus_addr(buf), 100) == -EBUSY);
+	errcheck(cppi41_chan_poll(tx, &actual) == 0);
+	errcheck(sandbox_cppi41_tx(3, out, BUF_SIZE) == 100);
+	errcheck(!memcmp(out, data, 100));
+	errcheck(sandbox_cppi41_tx(3, out, BUF_SIZE) == -1);
+	errcheck(cppi41_chan_poll(tx, &actual) == 1);
+	errcheck(actual == 100);
+	errcheck(cppi41_chan_poll(tx, &actual) == 0);
+
+	/* RX: a short transfer fills part of the buffer */
+	memset(buf, '\0', BUF_SIZE);
+	errcheck(cppi41_chan_submit(rx, bus_addr(buf), BUF_SIZE) == 0);
+	errcheck(cppi41_chan_poll(rx, &actual) == 0);
+	errcheck(sandbox_cppi41_rx(16, data, 10) == -1);
+	errcheck(sandbox_cppi41_rx(17, data, 200) == 200);
+	errcheck(sandbox_cppi41_rx(17, data, 200) == -1);
+	errcheck(cppi41_chan_poll(rx, &actual) == 1);
+	errcheck(actual == 200);
+	errcheck(!memcmp(buf, data, 200) && !buf[200]);
+
+	/* Descriptors go round the same queues many times */
+	for (i = 0; i < 200; i++) {
+		errcheck(cppi41_chan_submit(tx, bus_addr(buf), 1 + i) == 0);
+		errcheck(cppi41_chan_submit(rx, bus_addr(buf), BUF_SIZE) == 0);
+		errcheck(sandbox_cppi41_rx(17, data, BUF_SIZE) == BUF_SIZE);
+		errcheck(sandbox_cppi41_tx(3, out, BUF_SIZE) == 1 + i);
+		errcheck(cppi41_chan_poll(rx, &actual) == 1);
+		errcheck(cppi41_chan_poll(tx, &actual) == 1);
+		errcheck(actual == 1 + i);
+	}
+	errcheck(sandbox_cppi41_errors() == 0);
+
+out:
+	if (cppi)
+		cppi41_exit(cppi);
+	free(buf);
+	free(data);
+	printf(" cppi41 transfers: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int test_abort(void)
+{
+	struct cppi41_chan *tx, *rx;
+	struct cppi41 *cppi = NULL;
+	void *ctrl, *sched, *qmgr;
+	u8 *buf = NULL;
+	u32 actual;
+	int ret = 0;
+
+	printf(" testing cppi41 teardown ...\n");
+	sandbox_cppi41_reset(&ctrl, &sched, &qmgr);
+	buf = memalign(ARCH_DMA_MINALIGN, BUF_SIZE);
+	errcheck(buf != NULL);
+	cppi = cppi41_init(ctrl, sched, qmgr);
+	errcheck(cppi != NULL);
+	tx = cppi41_chan_get(cppi, 20, 1);
+	rx = cppi41_chan_get(cppi, 5, 0);
+
+	/* An idle channel needs nothing */
+	errcheck(cppi41_chan_abort(tx) == 0);
+
+	/* Queued TX work comes back through a teardown */
+	errcheck(cppi41_chan_submit(tx, bus_addr(buf), 64) == 0);
+	errcheck(cppi41_chan_abort(tx) == 0);
+	errcheck(sandbox_cppi41_tx(20, buf, BUF_SIZE) == -1);
+	errcheck(cppi41_chan_poll(tx, &actual) == 0);
+
+	/* The channel is enabled again by the next transfer */
+	errcheck(cppi41_chan_submit(tx, bus_addr(buf), 64) == 0);
+	errcheck(sandbox_cppi41_tx(20, buf, BUF_SIZE) == 64);
+	errcheck(cppi41_chan_poll(tx, &actual) == 1);
+
+	/* An RX descriptor still on the free queue is simply taken back */
+	errcheck(cppi41_chan_submit(rx, bus_addr(buf), BUF_SIZE) == 0);
+	errcheck(cppi41_chan_abort(rx) == 0);
+	errcheck(sandbox_cppi41_rx(5, buf, 64) == -1);
+	errcheck(cppi41_chan_submit(rx, bus_addr(buf), BUF_SIZE) == 0);
+	errcheck(sandbox_cppi41_rx(5, buf, 64) == 64);
+	errcheck(cppi41_chan_poll(rx, &actual) == 1);
+	errcheck(sandbox_cppi41_errors() == 0);
+
+out:
+	if (cppi)
+		cppi41_exit(cppi);
+	free(buf);
+	printf(" cppi41 teardown: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int do_test_cppi41(cmd_tbl_t *cmdtp, int flag, int argc,
+			  char * const argv[])
+{
+	int err = 0;
+
+	err += test_transfers();
+	err += test_abort();
+
+	printf("test_cppi41 %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	test_cppi41,	1,	1,	do_test_cppi41,
+	"Test the CPPI 4.1 DMA driver", ""
+);
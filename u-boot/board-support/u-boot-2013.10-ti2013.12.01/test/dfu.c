@@ -0,0 +1,157 @@
+/*
+ * Tests for the pipelined DFU write path, using a RAM entity
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dfu.h>
+#include <malloc.h>
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+#define PKT_SIZE	4096
+#define BUF_SIZE	0x80000		/* two parts of 256KiB */
+#define IMAGE_SIZE	(BUF_SIZE * 3 / 2 + 100)
+
+static struct dfu_entity *setup(void *target, unsigned size)
+{
+	char alt[64];
+
+	setenv_hex("dfu_bufsiz", BUF_SIZE);
+	dfu_free_entities();
+	sprintf(alt, "img ram %lx %x", (ulong)target, size);
+	if (dfu_config_entities(alt, "ram", 0))
+		return NULL;
+
+	return dfu_get_entity(0);
+}
+
+/* Send data in DFU-sized packets, starting at block seq */
+static int send(struct dfu_entity *dfu, u8 *data, int len, int *seq)
+{
+	int chunk, ret;
+
+	while (len > 0) {
+		chunk = min(len, PKT_SIZE);
+		ret = dfu_write(dfu, data, chunk, (*seq)++);
+		if (ret)
+			return ret;
+		data += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static int test_pipeline(void)
+{
+	struct dfu_entity *dfu;
+	u8 *data = NULL, *target = NULL;
+	int ret = 0;
+	int seq = 0;
+	int i;
+
+	printf(" testing dfu pipeline ...\n");
+	data = malloc(IMAGE_SIZE);
+	target = calloc(1, IMAGE_SIZE);
+	errcheck(data && target);
+	for (i = 0; i < IMAGE_SIZE; i++)
+		data[i] = i * 13 + (i >> 12);
+	dfu = setup(target, IMAGE_SIZE);
+	errcheck(dfu != NULL);
+
+	/* A full part is only written when asked, one slice at a time */
+	errcheck(dfu_flush_poll() == 0);
+	errcheck(send(dfu, data, BUF_SIZE / 2, &seq) == 0);
+	errcheck(!target[0]);
+	errcheck(dfu_flush_poll() == 1);
+	errcheck(!memcmp(target, data, CONFIG_SYS_DFU_WRITE_SLICE));
+	errcheck(!target[CONFIG_SYS_DFU_WRITE_SLICE]);
+	errcheck(dfu_flush_poll() == 1);
+	errcheck(!memcmp(target, data, BUF_SIZE / 2));
+	errcheck(dfu_flush_poll() == 0);
+
+	/* With no polling, a full pipeline is written in the foreground */
+	errcheck(send(dfu, data + BUF_SIZE / 2, BUF_SIZE / 2, &seq) == 0);
+	errcheck(!target[BUF_SIZE / 2]);
+	errcheck(send(dfu, data + BUF_SIZE, IMAGE_SIZE - BUF_SIZE,
+		      &seq) == 0);
+	errcheck(!memcmp(target, data, BUF_SIZE));
+	errcheck(!target[BUF_SIZE]);
+	errcheck(dfu_write(dfu, data, 0, seq) == 0);
+	errcheck(!memcmp(target, data, IMAGE_SIZE));
+	errcheck(dfu_flush_poll() == 0);
+
+out:
+	dfu_free_entities();
+	free(data);
+	free(target);
+	printf(" dfu pipeline: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int test_in_place(void)
+{
+	struct dfu_entity *dfu;
+	u8 *target = NULL, *buf;
+	int ret = 0;
+	int i;
+
+	printf(" testing dfu in-place and errors ...\n");
+	target = calloc(1, BUF_SIZE);
+	errcheck(target != NULL);
+	dfu = setup(target, BUF_SIZE);
+	errcheck(dfu != NULL);
+
+	/* Data received straight into the DFU buffer is not copied */
+	buf = dfu_get_buf();
+	errcheck(buf != NULL);
+	for (i = 0; i < BUF_SIZE; i++)
+		buf[i] = i * 3;
+	errcheck(dfu_write(dfu, buf, BUF_SIZE, 0) == 0);
+	for (i = 0; i < BUF_SIZE; i++)
+		errcheck(target[i] == (u8)(i * 3));
+	errcheck(dfu_write(dfu, buf, 0, 1) == 0);
+
+	/* A failed background write fails the next block */
+	dfu = setup(target, PKT_SIZE);
+	errcheck(dfu != NULL);
+	i = 0;
+	errcheck(send(dfu, target, BUF_SIZE / 2, &i) == 0);
+	while (dfu_flush_poll() > 0)
+		;
+	errcheck(dfu_write(dfu, target, PKT_SIZE, i++) != 0);
+	errcheck(dfu_write(dfu, target, 0, i) != 0);
+
+out:
+	dfu_free_entities();
+	free(target);
+	printf(" dfu in-place and errors: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int do_test_dfu(cmd_tbl_t *cmdtp, int flag, int argc,
+		       char * const argv[])
+{
+	int err = 0;
+
+	err += test_pipeline();
+	err += test_in_place();
+
+	printf("test_dfu %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	test_dfu,	1,	1,	do_test_dfu,
+	"Test the pipelined DFU write path", ""
+);
@@ -0,0 +1,186 @@
+/*
+ * Tests for batched device tree fixups
+ *
+ * The same fixups are applied to two copies of a tree, one directly and
+ * one through a batch, and the results compared.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <fdt_support.h>
+#include <malloc.h>
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+#define TEST_FDT_SIZE	4096
+
+static const char long_args[] = "console=ttyO0,115200n8 root=/dev/mmcblk0p2 rw";
+static const char short_args[] = "quiet";
+
+static int make_tree(void *fdt)
+{
+	static const u8 mac[6];
+	int node, err;
+
+	err = fdt_create_empty_tree(fdt, TEST_FDT_SIZE);
+	err |= fdt_setprop_cell(fdt, 0, "#address-cells", 1);
+	err |= fdt_setprop_cell(fdt, 0, "#size-cells", 1);
+	node = fdt_add_subnode(fdt, 0, "chosen");
+	err |= fdt_setprop_string(fdt, node, "bootargs", long_args);
+	node = fdt_add_subnode(fdt, 0, "memory");
+	err |= fdt_setprop_string(fdt, node, "device_type", "memory");
+	node = fdt_add_subnode(fdt, 0, "ocp");
+	node = fdt_add_subnode(fdt, node, "eth@1");
+	err |= fdt_setprop(fdt, node, "local-mac-address", mac, sizeof(mac));
+	err |= fdt_add_mem_rsv(fdt, 0x1000, 0x100);
+	err |= fdt_add_mem_rsv(fdt, 0x2000, 0x200);
+
+	return err;
+}
+
+static void apply_fixups(void *fdt)
+{
+	static const u8 mac[6] = { 0, 1, 2, 3, 4, 5 };
+	fdt32_t cells[2];
+
+	fdt_fixup_setprop(fdt, "/chosen", "bootargs", long_args,
+			  sizeof(long_args));
+	cells[0] = cpu_to_fdt32(0x88000000);
+	fdt_fixup_setprop(fdt, "/chosen", "linux,initrd-start", cells, 4);
+	cells[0] = cpu_to_fdt32(0x80000000);
+	cells[1] = cpu_to_fdt32(0x20000000);
+	fdt_fixup_setprop(fdt, "/memory", "reg", cells, 8);
+	fdt_fixup_setprop(fdt, "/reserved-memory", "ranges", NULL, 0);
+	fdt_fixup_setprop(fdt, "/reserved-memory/trace@9f000000", "reg",
+			  cells, 8);
+	do_fixup_by_path(fdt, "/ocp/eth@1", "local-mac-address", mac, 6, 1);
+	do_fixup_by_path(fdt, "/ocp/eth@1", "mac-address", mac, 6, 0);
+	/* A later value replaces the earlier one, and the blob shrinks here */
+	fdt_fixup_setprop(fdt, "/chosen", "bootargs", short_args,
+			  sizeof(short_args));
+	fdt_fixup_del_mem_rsv(fdt, 0x1000);
+	fdt_fixup_add_mem_rsv(fdt, 0x3000, 0x300);
+}
+
+static int same_prop(const void *a, const void *b, const char *path,
+		     const char *name)
+{
+	const void *va, *vb;
+	int la, lb;
+
+	va = fdt_getprop(a, fdt_path_offset(a, path), name, &la);
+	vb = fdt_getprop(b, fdt_path_offset(b, path), name, &lb);
+	if (!va || !vb || la != lb || memcmp(va, vb, la)) {
+		fprintf(stderr, "\t%s:%s differs\n", path, name);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int count_nodes(const void *fdt)
+{
+	int offset = 0, depth = 0, count = 0;
+
+	while (offset >= 0 && depth >= 0) {
+		count++;
+		offset = fdt_next_node(fdt, offset, &depth);
+	}
+
+	return count;
+}
+
+static int test_batch(void)
+{
+	char *direct = NULL, *batched = NULL;
+	struct fdt_batch *batch;
+	uint64_t addr_a, size_a, addr_b, size_b;
+	int ret = 0;
+	int i, used;
+
+	printf(" testing fdt batch ...\n");
+	direct = malloc(TEST_FDT_SIZE);
+	batched = malloc(TEST_FDT_SIZE);
+	errcheck(direct && batched);
+	errcheck(make_tree(direct) == 0);
+	memcpy(batched, direct, TEST_FDT_SIZE);
+
+	apply_fixups(direct);
+
+	batch = fdt_batch_begin(batched);
+	errcheck(batch != NULL);
+	errcheck(fdt_batch_get(batched) == batch);
+	errcheck(fdt_batch_begin(batched) == NULL);
+	apply_fixups(batched);
+	/* Nothing changes until the batch is committed */
+	errcheck(fdt_path_offset(batched, "/reserved-memory") < 0);
+	errcheck(fdt_fixup_node_exists(batched, "/reserved-memory"));
+	used = fdt_batch_size(batch);
+	errcheck(fdt_batch_commit(batch) == 0);
+	errcheck(fdt_batch_get(batched) == NULL);
+
+	errcheck(fdt_check_header(batched) == 0);
+	errcheck(used == fdt_off_dt_strings(batched) +
+		 fdt_size_dt_strings(batched));
+	errcheck(count_nodes(batched) == count_nodes(direct));
+	errcheck(fdt_size_dt_struct(batched) == fdt_size_dt_struct(direct));
+	errcheck(same_prop(direct, batched, "/chosen", "bootargs"));
+	errcheck(same_prop(direct, batched, "/chosen", "linux,initrd-start"));
+	errcheck(same_prop(direct, batched, "/memory", "device_type"));
+	errcheck(same_prop(direct, batched, "/memory", "reg"));
+	errcheck(same_prop(direct, batched, "/reserved-memory", "ranges"));
+	errcheck(same_prop(direct, batched, "/reserved-memory/trace@9f000000",
+			   "reg"));
+	errcheck(same_prop(direct, batched, "/ocp/eth@1",
+			   "local-mac-address"));
+	errcheck(fdt_getprop(batched, fdt_path_offset(batched, "/ocp/eth@1"),
+			     "mac-address", NULL) == NULL);
+	errcheck(same_prop(direct, batched, "/", "#size-cells"));
+
+	errcheck(fdt_num_mem_rsv(batched) == fdt_num_mem_rsv(direct));
+	for (i = 0; i < fdt_num_mem_rsv(direct); i++) {
+		fdt_get_mem_rsv(direct, i, &addr_a, &size_a);
+		fdt_get_mem_rsv(batched, i, &addr_b, &size_b);
+		errcheck(addr_a == addr_b && size_a == size_b);
+	}
+
+	/* A blob without room is left alone */
+	errcheck(make_tree(batched) == 0);
+	errcheck(fdt_pack(batched) == 0);
+	memcpy(direct, batched, fdt_totalsize(batched));
+	batch = fdt_batch_begin(batched);
+	errcheck(batch != NULL);
+	apply_fixups(batched);
+	errcheck(fdt_batch_commit(batch) == -FDT_ERR_NOSPACE);
+	errcheck(!memcmp(direct, batched, fdt_totalsize(direct)));
+
+out:
+	free(direct);
+	free(batched);
+	printf(" fdt batch: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int do_test_fdt_batch(cmd_tbl_t *cmdtp, int flag, int argc,
+			     char * const argv[])
+{
+	int err = 0;
+
+	err += test_batch();
+
+	printf("test_fdt_batch %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	test_fdt_batch,	1,	1,	do_test_fdt_batch,
+	"Test batched device tree fixups", ""
+);
@@ -0,0 +1,194 @@
+/*
+ * Tests for the device tree lookup index
+ *
+ * Two copies of a tree are kept, one indexed and one not, and every
+ * lookup must give the same result on both, also after changes.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <libfdt.h>
+#include <malloc.h>
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+#define TEST_FDT_SIZE	4096
+#define MAX_RESULTS	64
+
+static const char * const paths[] = {
+	"/", "/soc", "/soc/uart", "/soc/uart@2000", "/soc/uart@", "/chosen",
+	"/soc/i2c@3000/eeprom@50", "/soc/i2c/eeprom", "/soc/i2c@3000/eeprom",
+	"/nothere", "/soc/uart@1000/x", "/soc/mmc",
+};
+
+static const char * const compats[] = {
+	"ns16550a", "ti,omap3-uart", "ti,omap4-i2c", "at,24c256",
+	"ti,omap-hsmmc", "none",
+};
+
+static const struct {
+	const char *add;
+	const char *del;
+} changes[] = {
+	{ "mmc@4000", "/soc/uart@1000" },
+	{ "mmc@5000", "/soc/i2c@3000/eeprom@50" },
+};
+
+static int add_node(void *fdt, int parent, const char *name,
+		    const char *compat, int compat_len, uint32_t phandle)
+{
+	int node;
+
+	node = fdt_add_subnode(fdt, parent, name);
+	if (node < 0)
+		return node;
+	if (compat && fdt_setprop(fdt, node, "compatible", compat, compat_len))
+		return -1;
+	if (phandle && fdt_setprop_cell(fdt, node, "phandle", phandle))
+		return -1;
+
+	return node;
+}
+
+static int make_tree(void *fdt)
+{
+	static const char uart[] = "ti,omap3-uart\0ns16550a";
+	int soc, i2c, err;
+
+	err = fdt_create_empty_tree(fdt, TEST_FDT_SIZE);
+	/* Subnodes are added in front, so "uart" ends up after "uart@1000" */
+	soc = add_node(fdt, 0, "soc", NULL, 0, 0);
+	err |= add_node(fdt, soc, "uart", "ns16550a", 9, 4) < 0;
+	err |= add_node(fdt, soc, "uart@1000", uart, sizeof(uart), 1) < 0;
+	err |= add_node(fdt, soc, "uart@2000", uart, sizeof(uart), 2) < 0;
+	i2c = add_node(fdt, soc, "i2c@3000", "ti,omap4-i2c", 13, 3);
+	err |= add_node(fdt, i2c, "eeprom@50", "at,24c256", 10, 0) < 0;
+	err |= add_node(fdt, 0, "chosen", NULL, 0, 0) < 0;
+
+	return err || soc < 0 || i2c < 0;
+}
+
+/* Run every lookup, returning the number of results */
+static int lookup_all(const void *fdt, int *results)
+{
+	int i, n = 0, offset;
+
+	for (i = 0; i < ARRAY_SIZE(paths); i++)
+		results[n++] = fdt_path_offset(fdt, paths[i]);
+	for (i = 0; i < ARRAY_SIZE(compats); i++) {
+		offset = -1;
+		do {
+			offset = fdt_node_offset_by_compatible(fdt, offset,
+							       compats[i]);
+			results[n++] = offset;
+		} while (offset >= 0 && n < MAX_RESULTS - 8);
+	}
+	for (i = 0; i <= 6; i++)
+		results[n++] = fdt_node_offset_by_phandle(fdt, i);
+
+	return n;
+}
+
+static int same_lookups(const void *indexed, const void *plain)
+{
+	int a[MAX_RESULTS], b[MAX_RESULTS];
+	int na, nb, i;
+
+	na = lookup_all(indexed, a);
+	nb = lookup_all(plain, b);
+	if (na != nb) {
+		fprintf(stderr, "\t%d results, expected %d\n", na, nb);
+		return 0;
+	}
+	for (i = 0; i < na; i++) {
+		if (a[i] != b[i]) {
+			fprintf(stderr, "\tresult %d is %d, expected %d\n", i,
+				a[i], b[i]);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int test_index(void)
+{
+	char *indexed = NULL, *plain = NULL;
+	int ret = 0;
+	int i, node;
+
+	printf(" testing fdt index ...\n");
+	indexed = malloc(TEST_FDT_SIZE);
+	plain = malloc(TEST_FDT_SIZE);
+	errcheck(indexed && plain);
+	errcheck(make_tree(plain) == 0);
+	memcpy(indexed, plain, TEST_FDT_SIZE);
+
+	errcheck(fdt_index_enable(indexed) == 0);
+	errcheck(fdt_index_enable(indexed) == 0);
+	errcheck(same_lookups(indexed, plain));
+
+	/* Lookups scan the tree after a change, then rebuild the index */
+	for (i = 0; i < ARRAY_SIZE(changes); i++) {
+		node = fdt_path_offset(plain, "/soc");
+		errcheck(add_node(plain, node, changes[i].add, "ti,omap-hsmmc",
+				  14, 5 + i) >= 0);
+		node = fdt_path_offset(indexed, "/soc");
+		errcheck(add_node(indexed, node, changes[i].add,
+				  "ti,omap-hsmmc", 14, 5 + i) >= 0);
+		errcheck(same_lookups(indexed, plain));
+		errcheck(same_lookups(indexed, plain));
+		node = fdt_path_offset(plain, changes[i].del);
+		errcheck(fdt_del_node(plain, node) == 0);
+		node = fdt_path_offset(indexed, changes[i].del);
+		errcheck(fdt_del_node(indexed, node) == 0);
+		errcheck(same_lookups(indexed, plain));
+	}
+
+	/* Packing rewrites the tree, which also invalidates the index */
+	errcheck(fdt_pack(indexed) == 0);
+	errcheck(fdt_pack(plain) == 0);
+	errcheck(same_lookups(indexed, plain));
+	errcheck(same_lookups(indexed, plain));
+
+	/*
+	 * A tree copied over without libfdt, with the same block sizes, is
+	 * only noticed by fdt_index_enable() checking the index again
+	 */
+	node = fdt_path_offset(plain, "/soc/i2c@3000");
+	errcheck(fdt_setprop_inplace_cell(plain, node, "phandle", 6) == 0);
+	memcpy(indexed, plain, fdt_totalsize(plain));
+	errcheck(fdt_index_enable(indexed) == 0);
+	errcheck(same_lookups(indexed, plain));
+
+out:
+	fdt_index_disable(indexed);
+	free(indexed);
+	free(plain);
+	printf(" fdt index: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int do_test_fdt_index(cmd_tbl_t *cmdtp, int flag, int argc,
+			     char * const argv[])
+{
+	int err = 0;
+
+	err += test_index();
+
+	printf("test_fdt_index %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	test_fdt_index,	1,	1,	do_test_fdt_index,
+	"Test the device tree lookup index", ""
+);
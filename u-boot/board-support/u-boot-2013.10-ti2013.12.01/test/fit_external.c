@@ -0,0 +1,329 @@
+/*
+ * Tests for FITs with external data: reading the images of one
+ * configuration straight to their load addresses
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <malloc.h>
+#include <os.h>
+#include <asm/io.h>
+#include <u-boot/crc.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+#define FIT_ADDR	0x100000
+#define FIT_SIZE	4096
+#define DATA_ALIGN	0x200
+#define POISON		0xee
+#define TEST_FILE	"/tmp/u-boot-test-fit-external.itb"
+
+static struct {
+	const char *name;
+	ulong load;		/* 0 for none */
+	int size;
+	int offset;
+} imgs[] = {
+	{ "kernel@1", 0x800000, 0x3001 },
+	{ "fdt@1", 0, 0x123 },
+	{ "kernel@2", 0x900000, 0x1000 },
+};
+
+static u8 *storage;
+static int storage_size;
+static int reads;
+
+static u8 pattern(int image, int i)
+{
+	return image * 0x40 + i * 7;
+}
+
+static int add_image(void *fit, int parent, int i)
+{
+	int node, hash, err;
+	fdt32_t crc;
+	u8 *data;
+	int j;
+
+	data = malloc(imgs[i].size);
+	if (!data)
+		return -1;
+	for (j = 0; j < imgs[i].size; j++)
+		data[j] = pattern(i, j);
+	crc = cpu_to_fdt32(crc32(0, data, imgs[i].size));
+	free(data);
+
+	node = fdt_add_subnode(fit, parent, imgs[i].name);
+	err = fdt_setprop_string(fit, node, FIT_COMP_PROP, "none");
+	if (imgs[i].load)
+		err |= fdt_setprop_u32(fit, node, FIT_LOAD_PROP,
+				       imgs[i].load);
+	err |= fdt_setprop_u32(fit, node, FIT_DATA_OFFSET_PROP, 0);
+	err |= fdt_setprop_u32(fit, node, FIT_DATA_SIZE_PROP, imgs[i].size);
+	hash = fdt_add_subnode(fit, node, "hash@1");
+	err |= fdt_setprop_string(fit, hash, FIT_ALGO_PROP, "crc32");
+	err |= fdt_setprop(fit, hash, FIT_VALUE_PROP, &crc, sizeof(crc));
+
+	return err;
+}
+
+/* Lay a FIT out as mkimage -E -B 200 does */
+static int make_fit(void)
+{
+	int images_node, confs, conf, node;
+	void *fit;
+	ulong base, pos;
+	int i, j, err;
+
+	fit = malloc(FIT_SIZE);
+	if (!fit)
+		return -1;
+	err = fdt_create_empty_tree(fit, FIT_SIZE);
+	err |= fdt_setprop_string(fit, 0, FIT_DESC_PROP, "external data");
+	images_node = fdt_add_subnode(fit, 0, "images");
+	for (i = 0; i < ARRAY_SIZE(imgs); i++)
+		err |= add_image(fit, images_node, i);
+	confs = fdt_add_subnode(fit, 0, "configurations");
+	err |= fdt_setprop_string(fit, confs, FIT_DEFAULT_PROP, "conf@1");
+	conf = fdt_add_subnode(fit, confs, "conf@1");
+	err |= fdt_setprop_string(fit, conf, FIT_KERNEL_PROP, "kernel@1");
+	err |= fdt_setprop_string(fit, conf, FIT_FDT_PROP, "fdt@1");
+	conf = fdt_add_subnode(fit, confs, "conf@2");
+	err |= fdt_setprop_string(fit, conf, FIT_KERNEL_PROP, "kernel@2");
+	err |= fdt_pack(fit);
+	if (err) {
+		free(fit);
+		return -1;
+	}
+
+	base = fit_get_data_base(fit);
+	pos = base;
+	for (i = 0; i < ARRAY_SIZE(imgs); i++) {
+		pos = ALIGN(pos, DATA_ALIGN);
+		imgs[i].offset = pos - base;
+		pos += imgs[i].size;
+		node = fit_image_get_node(fit, imgs[i].name);
+		fdt_setprop_inplace_u32(fit, node, FIT_DATA_OFFSET_PROP,
+					imgs[i].offset);
+	}
+
+	storage_size = pos;
+	storage = calloc(1, storage_size);
+	if (!storage) {
+		free(fit);
+		return -1;
+	}
+	memcpy(storage, fit, fdt_totalsize(fit));
+	for (i = 0; i < ARRAY_SIZE(imgs); i++) {
+		for (j = 0; j < imgs[i].size; j++)
+			storage[base + imgs[i].offset + j] = pattern(i, j);
+	}
+	free(fit);
+
+	return 0;
+}
+
+static int mem_read(void *priv, ulong offset, ulong size, void *buf)
+{
+	reads++;
+	if (offset + size > storage_size)
+		return -1;
+	memcpy(buf, storage + offset, size);
+
+	return 0;
+}
+
+static void poison(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(imgs); i++) {
+		if (imgs[i].load)
+			memset(map_sysmem(imgs[i].load, imgs[i].size),
+			       POISON, imgs[i].size);
+	}
+	memset(map_sysmem(FIT_ADDR, storage_size), POISON, storage_size);
+}
+
+static int is_image(int i, const void *data)
+{
+	const u8 *p = data;
+	int j;
+
+	for (j = 0; j < imgs[i].size; j++) {
+		if (p[j] != pattern(i, j))
+			return 0;
+	}
+
+	return 1;
+}
+
+static int is_poison(const void *data, int size)
+{
+	const u8 *p = data;
+
+	while (size--) {
+		if (*p++ != POISON)
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Check what reading the default configuration leaves in memory */
+static int check_loaded(void *fit)
+{
+	const void *data;
+	size_t size;
+	int node;
+	int ret = 0;
+
+	/* The kernel went to its load address, and says so */
+	node = fit_image_get_node(fit, "kernel@1");
+	errcheck(fit_image_get_data(fit, node, &data, &size) == 0);
+	errcheck(data == map_sysmem(imgs[0].load, 0));
+	errcheck(size == imgs[0].size);
+	errcheck(is_image(0, data));
+	errcheck(fit_image_verify(fit, node) == 1);
+
+	/* The FDT has no load address, so went where it is in the file */
+	node = fit_image_get_node(fit, "fdt@1");
+	errcheck(fit_image_get_data(fit, node, &data, &size) == 0);
+	errcheck(data == fit + fit_get_data_base(fit) + imgs[1].offset);
+	errcheck(is_image(1, data));
+	errcheck(fit_image_verify(fit, node) == 1);
+
+	/* The other configuration's kernel was not read */
+	errcheck(is_poison(map_sysmem(imgs[2].load, 0), imgs[2].size));
+	errcheck(is_poison(fit + fit_get_data_base(fit) + imgs[2].offset,
+			   imgs[2].size));
+
+out:
+	return ret;
+}
+
+static int test_load(void)
+{
+	void *fit = map_sysmem(FIT_ADDR, 0);
+	int ret = 0;
+
+	printf(" testing reading one configuration ...\n");
+	poison();
+	memcpy(fit, storage, fdt_totalsize(storage));
+	reads = 0;
+	errcheck(fit_load_external(fit, NULL, mem_read, NULL) == 0);
+	errcheck(reads == 2);
+	errcheck(check_loaded(fit) == 0);
+
+	/* Loading a FIT that holds its own data reads nothing */
+	reads = 0;
+	errcheck(fdt_create_empty_tree(fit, FIT_SIZE) == 0);
+	errcheck(fit_load_external(fit, NULL, mem_read, NULL) == 0);
+	errcheck(reads == 0);
+
+out:
+	printf(" reading one configuration: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+/*
+ * Load a copy of the FIT with one property of one image changed; it must
+ * fail before reading that image, after the @before images ahead of it
+ */
+static int load_crafted(const char *image, const char *prop, u32 val,
+			int before)
+{
+	void *fit = map_sysmem(FIT_ADDR, 0);
+	int ret;
+
+	memcpy(fit, storage, fdt_totalsize(storage));
+	fdt_setprop_inplace_u32(fit, fit_image_get_node(fit, image), prop, val);
+	reads = 0;
+	ret = fit_load_external(fit, NULL, mem_read, NULL);
+
+	return ret && reads == before ? 0 : -1;
+}
+
+static int test_crafted(void)
+{
+	int ret = 0;
+
+	printf(" testing crafted offsets and sizes ...\n");
+	poison();
+	/* The kernel goes to its load address, the FDT where its offset says */
+	errcheck(load_crafted("kernel@1", FIT_DATA_SIZE_PROP, 0x7fffffff,
+			      0) == 0);
+	errcheck(load_crafted("kernel@1", FIT_LOAD_PROP,
+			      gd->start_addr_sp - 0x100, 0) == 0);
+	errcheck(load_crafted("kernel@1", FIT_LOAD_PROP, -0x1000, 0) == 0);
+	errcheck(is_poison(map_sysmem(imgs[0].load, 0), imgs[0].size));
+	errcheck(load_crafted("fdt@1", FIT_DATA_OFFSET_PROP, -0x1000, 1) == 0);
+	errcheck(load_crafted("fdt@1", FIT_DATA_OFFSET_PROP, 0x7ffff000,
+			      1) == 0);
+
+out:
+	printf(" crafted offsets and sizes: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int test_load_image(void)
+{
+	void *fit = map_sysmem(FIT_ADDR, 0);
+	char cmd[80];
+	int ret = 0;
+	int fd;
+
+	printf(" testing load.image ...\n");
+	fd = os_open(TEST_FILE, OS_O_WRONLY | OS_O_CREAT);
+	errcheck(fd >= 0);
+	errcheck(os_write(fd, storage, storage_size) == storage_size);
+	os_close(fd);
+
+	poison();
+	setenv("filesize", NULL);
+	snprintf(cmd, sizeof(cmd), "load.image host 0 %x %s", FIT_ADDR,
+		 TEST_FILE);
+	errcheck(run_command(cmd, 0) == 0);
+	errcheck(getenv_ulong("filesize", 16, 0) == fdt_totalsize(storage));
+	errcheck(check_loaded(fit) == 0);
+
+out:
+	printf(" load.image: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int do_test_fit_external(cmd_tbl_t *cmdtp, int flag, int argc,
+				char * const argv[])
+{
+	int err = 0;
+
+	if (make_fit()) {
+		printf("test_fit_external FAILED\n");
+		return 1;
+	}
+
+	err += test_load();
+	err += test_crafted();
+	err += test_load_image();
+	free(storage);
+
+	printf("test_fit_external %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	test_fit_external,	1,	1,	do_test_fit_external,
+	"Test reading FITs with external data", ""
+);
@@ -0,0 +1,87 @@
+/*
+ * Tests for the fixed-size object pools
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <malloc.h>
+#include <malloc_pool.h>
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+#define TEST_OBJS	1000
+
+static int test_pool(void)
+{
+	struct malloc_pool *pool;
+	void *obj[TEST_OBJS];
+	struct mallinfo before;
+	int ret = 0;
+	int i;
+
+	printf(" testing object pool ...\n");
+	before = mallinfo();
+	pool = malloc_pool_create("test", 21);
+	errcheck(pool != NULL);
+	errcheck(pool->obj_size == ALIGN(21, sizeof(void *)));
+
+	for (i = 0; i < TEST_OBJS; i++) {
+		obj[i] = malloc_pool_alloc(pool);
+		errcheck(obj[i] != NULL);
+		errcheck(((ulong)obj[i] & (sizeof(void *) - 1)) == 0);
+		memset(obj[i], i, 21);
+	}
+	errcheck(pool->in_use == TEST_OBJS && pool->peak == TEST_OBJS);
+	errcheck(pool->num_chunks ==
+		 (TEST_OBJS + pool->per_chunk - 1) / pool->per_chunk);
+
+	/* Objects must not overlap */
+	for (i = 0; i < TEST_OBJS; i++)
+		errcheck(((u8 *)obj[i])[20] == (u8)i);
+
+	/* A freed object is handed out again before the pool grows */
+	malloc_pool_free(pool, obj[500]);
+	errcheck(pool->in_use == TEST_OBJS - 1);
+	errcheck(malloc_pool_alloc(pool) == obj[500]);
+	errcheck(pool->allocs == TEST_OBJS + 1);
+
+	/* Reset hands every chunk back at once */
+	malloc_pool_reset(pool);
+	errcheck(pool->in_use == 0 && pool->num_chunks == 0);
+	errcheck(pool->peak == TEST_OBJS);
+	errcheck(malloc_pool_alloc(pool) != NULL);
+	errcheck(pool->num_chunks == 1);
+
+	malloc_pool_destroy(pool);
+	pool = NULL;
+	errcheck(mallinfo().uordblks == before.uordblks);
+
+out:
+	malloc_pool_destroy(pool);
+	printf(" object pool: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int do_test_malloc_pool(cmd_tbl_t *cmdtp, int flag, int argc,
+			       char * const argv[])
+{
+	int err = 0;
+
+	err += test_pool();
+
+	printf("test_malloc_pool %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	test_malloc_pool,	1,	1,	do_test_malloc_pool,
+	"Test fixed-size object pools", ""
+);
@@ -0,0 +1,81 @@
+/*
+ * Pieces shared by the fake servers that the network tests put behind the
+ * sandbox Ethernet hook
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <net.h>
+#include <asm/unaligned.h>
+#include "net_fake_server.h"
+
+const uchar server_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+const uchar server_ip[4] = { 192, 168, 1, 1 };
+
+u16 fake_srv_ip_sum(const uchar *ip)
+{
+	u32 sum = 0;
+	int i;
+
+	for (i = 0; i < IP_HDR_SIZE; i += 2)
+		sum += ip[i] << 8 | ip[i + 1];
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum;
+}
+
+uchar *fake_srv_ip_hdr(uchar *frame, const uchar *mac, const uchar *ip,
+		       int proto, int len, u16 id, u16 frag)
+{
+	uchar *hdr = frame + ETHER_HDR_SIZE;
+
+	memset(frame, '\0', ETHER_HDR_SIZE + IP_HDR_SIZE);
+	memcpy(frame, mac, 6);
+	memcpy(frame + 6, server_mac, 6);
+	put_unaligned_be16(PROT_IP, frame + 12);
+
+	hdr[0] = 0x45;
+	put_unaligned_be16(IP_HDR_SIZE + len, hdr + 2);
+	put_unaligned_be16(id, hdr + 4);
+	put_unaligned_be16(frag, hdr + 6);
+	hdr[8] = 64;
+	hdr[9] = proto;
+	memcpy(hdr + 12, server_ip, 4);
+	memcpy(hdr + 16, ip, 4);
+	put_unaligned_be16(fake_srv_ip_sum(hdr), hdr + 10);
+
+	return hdr + IP_HDR_SIZE;
+}
+
+int fake_srv_arp(const uchar *frame, int len)
+{
+	const uchar *arp = frame + ETHER_HDR_SIZE;
+	uchar reply[ETHER_HDR_SIZE + ARP_HDR_SIZE];
+	uchar *rarp = reply + ETHER_HDR_SIZE;
+
+	if (len < ETHER_HDR_SIZE + ARP_HDR_SIZE ||
+	    get_unaligned_be16(frame + 12) != PROT_ARP ||
+	    get_unaligned_be16(arp + 6) != ARPOP_REQUEST ||
+	    memcmp(arp + 24, server_ip, 4))
+		return 0;
+
+	memcpy(reply, arp + 8, 6);
+	memcpy(reply + 6, server_mac, 6);
+	put_unaligned_be16(PROT_ARP, reply + 12);
+	memcpy(rarp, arp, 6);
+	put_unaligned_be16(ARPOP_REPLY, rarp + 6);
+	memcpy(rarp + 8, server_mac, 6);
+	memcpy(rarp + 14, server_ip, 4);
+	memcpy(rarp + 18, arp + 8, 10);
+	sandbox_eth_inject(reply, sizeof(reply));
+
+	return 1;
+}
+
+void fake_srv_start(sandbox_eth_tx_hook *rx)
+{
+	sandbox_eth_flush();
+	sandbox_eth_set_tx_hook(rx);
+}
@@ -0,0 +1,34 @@
+/*
+ * Pieces shared by the fake servers that the network tests put behind the
+ * sandbox Ethernet hook
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _TEST_NET_FAKE_SERVER_H
+#define _TEST_NET_FAKE_SERVER_H
+
+#include <asm/eth.h>
+
+/* 192.168.1.1, which the tests use as serverip */
+extern const uchar server_mac[6];
+extern const uchar server_ip[4];
+
+/* Checksum of the IP header at @ip, ready to be stored */
+u16 fake_srv_ip_sum(const uchar *ip);
+
+/*
+ * Fill in the Ethernet and IP headers of a frame from the server to the
+ * client at @mac and @ip, with @len bytes of IP payload. @frag is the
+ * flags and fragment offset field. Returns where the payload goes.
+ */
+uchar *fake_srv_ip_hdr(uchar *frame, const uchar *mac, const uchar *ip,
+		       int proto, int len, u16 id, u16 frag);
+
+/* Answer an ARP request for server_ip; returns 1 if @frame was one */
+int fake_srv_arp(const uchar *frame, int len);
+
+/* Drop what the client has not received yet and send it to @rx from now */
+void fake_srv_start(sandbox_eth_tx_hook *rx);
+
+#endif /* _TEST_NET_FAKE_SERVER_H */
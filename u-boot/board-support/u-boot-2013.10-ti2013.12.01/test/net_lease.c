@@ -0,0 +1,175 @@
+/*
+ * Tests for taking over the BOOTP lease SPL leaves, and for the ARP cache
+ * that lets later transfers to the server skip the ARP request
+ *
+ * The fake server answers ARP and refuses every TFTP read, which is all
+ * it takes to see which frames a transfer starts with.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <asm/io.h>
+#include <asm/unaligned.h>
+#include "../net/arp.h"
+#include "net_fake_server.h"
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+static struct {
+	int frames;
+	int arps;
+	int reads;
+	int bad;		/* reads sent to the wrong MAC address */
+} srv;
+
+/* Answer a read request with "File not found" */
+static void srv_tftp(const uchar *frame)
+{
+	static const char msg[] = "\0\5\0\1File not found";
+	const uchar *ip = frame + ETHER_HDR_SIZE;
+	const uchar *udp = ip + IP_HDR_SIZE;
+	uchar reply[ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + sizeof(msg)];
+	uchar *rudp;
+
+	srv.reads++;
+	if (memcmp(frame, server_mac, 6))
+		srv.bad++;
+
+	rudp = fake_srv_ip_hdr(reply, frame + 6, ip + 12, IPPROTO_UDP,
+			       8 + sizeof(msg), 0, 0);
+	put_unaligned_be16(1069, rudp);
+	memcpy(rudp + 2, udp, 2);
+	put_unaligned_be16(8 + sizeof(msg), rudp + 4);
+	put_unaligned_be16(0, rudp + 6);
+	memcpy(rudp + 8, msg, sizeof(msg));
+	sandbox_eth_inject(reply, sizeof(reply));
+}
+
+static void srv_rx(const uchar *frame, int len)
+{
+	const uchar *ip = frame + ETHER_HDR_SIZE;
+
+	srv.frames++;
+	if (fake_srv_arp(frame, len))
+		srv.arps++;
+	else if (len >= ETHER_HDR_SIZE + IP_UDP_HDR_SIZE &&
+		 get_unaligned_be16(frame + 12) == PROT_IP &&
+		 ip[9] == IPPROTO_UDP && !memcmp(ip + 16, server_ip, 4) &&
+		 get_unaligned_be16(ip + IP_HDR_SIZE + 2) == 69)
+		srv_tftp(frame);
+}
+
+static void srv_reset(void)
+{
+	memset(&srv, '\0', sizeof(srv));
+	fake_srv_start(srv_rx);
+}
+
+static int env_is(const char *name, const char *value)
+{
+	const char *s = getenv(name);
+
+	return s && !strcmp(s, value);
+}
+
+static int test_lease(void)
+{
+	struct net_lease *lease;
+	int ret = 0;
+
+	printf(" testing bootp with a lease from SPL ...\n");
+
+	/* What SPL knows once it has loaded U-Boot */
+	eth_getenv_enetaddr("ethaddr", NetOurEther);
+	NetOurIP = string_to_ip("192.168.1.10");
+	NetOurSubnetMask = string_to_ip("255.255.255.0");
+	NetOurGatewayIP = string_to_ip("192.168.1.254");
+	NetServerIP = string_to_ip("192.168.1.1");
+	arp_cache_set(NetServerIP, server_mac);
+	net_save_lease();
+	arp_cache_set(0, NULL);
+
+	srv_reset();
+	setenv("ipaddr", NULL);
+	setenv("serverip", NULL);
+	setenv("netmask", NULL);
+	setenv("gatewayip", NULL);
+	setenv("autoload", "no");
+	errcheck(run_command("bootp", 0) == 0);
+	errcheck(srv.frames == 0);
+	errcheck(env_is("ipaddr", "192.168.1.10"));
+	errcheck(env_is("serverip", "192.168.1.1"));
+	errcheck(env_is("netmask", "255.255.255.0"));
+	errcheck(env_is("gatewayip", "192.168.1.254"));
+
+	/* It is used once */
+	lease = map_sysmem(CONFIG_SPL_NET_LEASE_ADDR, sizeof(*lease));
+	errcheck(lease->magic != NET_LEASE_MAGIC);
+
+	/* The server's MAC address came with it */
+	errcheck(run_command("tftp 100000 file", 0) != 0);
+	errcheck(srv.reads == 1);
+	errcheck(srv.arps == 0);
+	errcheck(srv.bad == 0);
+
+out:
+	setenv("autoload", NULL);
+	printf(" bootp with a lease from SPL: %s\n",
+	       ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int test_arp_cache(void)
+{
+	int ret = 0;
+
+	printf(" testing the ARP cache ...\n");
+	srv_reset();
+	arp_cache_set(0, NULL);
+	setenv("ipaddr", "192.168.1.10");
+	setenv("serverip", "192.168.1.1");
+	setenv("netmask", "255.255.255.0");
+
+	/* Only the first transfer asks */
+	errcheck(run_command("tftp 100000 file", 0) != 0);
+	errcheck(srv.arps == 1);
+	errcheck(run_command("tftp 100000 file", 0) != 0);
+	errcheck(srv.arps == 1);
+	errcheck(srv.reads == 2);
+	errcheck(srv.bad == 0);
+
+out:
+	printf(" ARP cache: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int do_test_net_lease(cmd_tbl_t *cmdtp, int flag, int argc,
+			     char * const argv[])
+{
+	int err = 0;
+
+	setenv("netretry", "no");
+	err += test_lease();
+	err += test_arp_cache();
+	setenv("netretry", NULL);
+	sandbox_eth_set_tx_hook(NULL);
+
+	printf("test_net_lease %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	test_net_lease,	1,	1,	do_test_net_lease,
+	"Test taking over the lease from SPL and the ARP cache", ""
+);
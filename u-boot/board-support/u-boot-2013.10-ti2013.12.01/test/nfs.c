@@ -0,0 +1,409 @@
+/*
+ * Tests for the nfs command against a fake NFS server
+ *
+ * The server sits behind the sandbox Ethernet hook and answers portmap,
+ * MOUNT and NFS calls over UDP, in version 3 or only version 2. READ
+ * replies larger than a frame are sent as IP fragments, and each is held
+ * back until the next one has gone, so they arrive out of order.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <malloc.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <asm/io.h>
+#include <asm/unaligned.h>
+#include "net_fake_server.h"
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+#define FILE_SIZE	200000
+#define LOAD_ADDR	0x100000
+#define MOUNT_PORT	635
+#define NFS_PORT	2049
+#define FRAG_DATA	1480	/* IP payload per fragment */
+#define MAX_REPLY	(IP_UDP_HDR_SIZE + 256 + 16384)
+
+static const char root_fh[] = "ROOTFH3!";
+static const char file_fh[] = "FILEHAND10";
+
+static struct {
+	uchar client_mac[6];
+	uchar client_ip[4];
+	int client_port;
+	int v2_only;
+	int version;		/* NFS version the client mounted with */
+	int drop_read;		/* READ reply lost, by count */
+	int reads;
+	int max_count;		/* largest READ asked for */
+	int max_read;		/* most the server sends per READ, if set */
+	int reordered;
+	int bad;
+	u16 ip_id;
+	uchar held[MAX_REPLY];	/* READ reply waiting for the next */
+	int held_len;
+} srv;
+
+static uchar *file;
+
+/* Send a UDP datagram, held in @dgram from its UDP header on */
+static void srv_send_dgram(const uchar *dgram, int len)
+{
+	uchar frame[PKTSIZE_ALIGN];
+	uchar *data;
+	int off, flen, frag;
+
+	srv.ip_id++;
+	for (off = 0; off < len; off += flen) {
+		flen = min(len - off, FRAG_DATA);
+		frag = (off + flen < len ? IP_FLAGS_MFRAG : 0) | off / 8;
+		data = fake_srv_ip_hdr(frame, srv.client_mac, srv.client_ip,
+				       IPPROTO_UDP, flen, srv.ip_id, frag);
+		memcpy(data, dgram + off, flen);
+
+		sandbox_eth_inject(frame, ETHER_HDR_SIZE + IP_HDR_SIZE + flen);
+	}
+}
+
+/* Start a reply in @dgram; returns where the results go */
+static uchar *srv_reply(uchar *dgram, int sport, u32 xid)
+{
+	uchar *rpc = dgram + 8;
+
+	put_unaligned_be16(sport, dgram);
+	put_unaligned_be16(srv.client_port, dgram + 2);
+	put_unaligned_be16(0, dgram + 6);
+	put_unaligned_be32(xid, rpc);
+	put_unaligned_be32(1, rpc + 4);		/* MSG_REPLY */
+	memset(rpc + 8, '\0', 16);		/* accepted, AUTH_NONE, ok */
+
+	return rpc + 24;
+}
+
+static void srv_finish(uchar *dgram, uchar *end)
+{
+	put_unaligned_be16(end - dgram, dgram + 4);
+	srv_send_dgram(dgram, end - dgram);
+}
+
+static uchar *put_fh(uchar *p, const char *fh)
+{
+	int len = strlen(fh);
+
+	if (srv.version == 3) {
+		put_unaligned_be32(len, p);
+		p += 4;
+	} else {
+		len = 32;
+	}
+	memset(p, '\0', (len + 3) & ~3);
+	memcpy(p, fh, min(len, (int)strlen(fh)));
+
+	return p + ((len + 3) & ~3);
+}
+
+/* Check the file handle at *pp is @fh and step over it */
+static int get_fh(const uchar **pp, const char *fh)
+{
+	const uchar *p = *pp;
+	int len = 32;
+
+	if (srv.version == 3) {
+		len = get_unaligned_be32(p);
+		p += 4;
+	}
+	*pp = p + ((len + 3) & ~3);
+
+	return strncmp((const char *)p, fh, len);
+}
+
+static void srv_portmap(u32 xid, const uchar *args)
+{
+	uchar dgram[64];
+	uchar *p = srv_reply(dgram, 111, xid);
+	u32 prog = get_unaligned_be32(args);
+	u32 vers = get_unaligned_be32(args + 4);
+	int port = 0;
+
+	if (prog == 100005 && (vers == 3 ? !srv.v2_only : vers == 1))
+		port = MOUNT_PORT;
+	if (prog == 100003 && (vers == 3 ? !srv.v2_only : vers == 2))
+		port = NFS_PORT;
+	put_unaligned_be32(port, p);
+	srv_finish(dgram, p + 4);
+}
+
+static void srv_mount(u32 xid, u32 vers, u32 proc)
+{
+	uchar dgram[128];
+	uchar *p = srv_reply(dgram, MOUNT_PORT, xid);
+
+	if (proc == 1) {
+		srv.version = vers == 3 ? 3 : 2;
+		put_unaligned_be32(0, p);
+		p = put_fh(p + 4, root_fh);
+		if (srv.version == 3) {
+			put_unaligned_be32(1, p);	/* one flavor */
+			put_unaligned_be32(1, p + 4);	/* AUTH_UNIX */
+			p += 8;
+		}
+	}
+	srv_finish(dgram, p);
+}
+
+static void srv_lookup(u32 xid, const uchar *args)
+{
+	uchar dgram[256];
+	uchar *p = srv_reply(dgram, NFS_PORT, xid);
+	int len;
+
+	if (get_fh(&args, root_fh))
+		srv.bad++;
+	len = get_unaligned_be32(args);
+	if (len != 4 || memcmp(args + 4, "file", 4)) {
+		put_unaligned_be32(2, p);	/* NOENT */
+		srv_finish(dgram, p + 4);
+		return;
+	}
+
+	put_unaligned_be32(0, p);
+	p = put_fh(p + 4, file_fh);
+	if (srv.version == 3) {
+		memset(p, '\0', 8);		/* no attributes */
+		p += 8;
+	} else {
+		memset(p, '\0', 68);
+		p += 68;
+	}
+	srv_finish(dgram, p);
+}
+
+static void srv_read(u32 xid, const uchar *args)
+{
+	uchar dgram[MAX_REPLY];
+	uchar *p = srv_reply(dgram, NFS_PORT, xid);
+	u32 offset, count;
+
+	if (get_fh(&args, file_fh))
+		srv.bad++;
+	if (srv.version == 3) {
+		if (get_unaligned_be32(args))
+			srv.bad++;
+		args += 4;
+	}
+	offset = get_unaligned_be32(args);
+	count = get_unaligned_be32(args + 4);
+	srv.max_count = max(srv.max_count, (int)count);
+	if (count > 16384)
+		srv.bad++;
+	if (offset > FILE_SIZE)
+		offset = FILE_SIZE;
+	count = min(count, (u32)FILE_SIZE - offset);
+	if (srv.max_read)
+		count = min(count, (u32)srv.max_read);
+
+	put_unaligned_be32(0, p);
+	p += 4;
+	if (srv.version == 3) {
+		put_unaligned_be32(1, p);	/* attributes follow */
+		memset(p + 4, '\0', 84);
+		put_unaligned_be32(count, p + 88);
+		put_unaligned_be32(offset + count == FILE_SIZE, p + 92);
+		p += 96;
+	} else {
+		memset(p, '\0', 68);
+		put_unaligned_be32(FILE_SIZE, p + 20);	/* size */
+		p += 68;
+	}
+	put_unaligned_be32(count, p);
+	memcpy(p + 4, file + offset, count);
+	p += 4 + ((count + 3) & ~3);
+	put_unaligned_be16(p - dgram, dgram + 4);
+
+	if (srv.reads++ == srv.drop_read)
+		return;
+	if (!srv.held_len) {
+		srv.held_len = p - dgram;
+		memcpy(srv.held, dgram, srv.held_len);
+		return;
+	}
+	srv_send_dgram(dgram, p - dgram);
+	srv_send_dgram(srv.held, srv.held_len);
+	srv.held_len = 0;
+	srv.reordered++;
+}
+
+static void srv_nfs(u32 xid, u32 vers, u32 proc, const uchar *args)
+{
+	uchar dgram[64];
+
+	if (vers != srv.version)
+		srv.bad++;
+	if (proc == 6) {
+		srv_read(xid, args);
+	} else if (proc == (vers == 3 ? 3 : 4)) {
+		srv_lookup(xid, args);
+	} else {
+		srv.bad++;
+		srv_finish(dgram, srv_reply(dgram, NFS_PORT, xid));
+	}
+}
+
+static void srv_rx(const uchar *frame, int len)
+{
+	const uchar *ip = frame + ETHER_HDR_SIZE;
+	const uchar *udp = ip + IP_HDR_SIZE;
+	const uchar *rpc = udp + 8;
+	const uchar *args;
+	u32 xid, vers, proc;
+
+	if (fake_srv_arp(frame, len))
+		return;
+	if (get_unaligned_be16(frame + 12) != PROT_IP ||
+	    ip[9] != IPPROTO_UDP || memcmp(ip + 16, server_ip, 4))
+		return;
+
+	memcpy(srv.client_mac, frame + 6, 6);
+	memcpy(srv.client_ip, ip + 12, 4);
+	srv.client_port = get_unaligned_be16(udp);
+	xid = get_unaligned_be32(rpc);
+	vers = get_unaligned_be32(rpc + 16);
+	proc = get_unaligned_be32(rpc + 20);
+
+	/* Step over the credential and the verifier */
+	args = rpc + 24;
+	args += 8 + ((get_unaligned_be32(args + 4) + 3) & ~3);
+	args += 8 + ((get_unaligned_be32(args + 4) + 3) & ~3);
+
+	switch (get_unaligned_be16(udp + 2)) {
+	case 111:
+		srv_portmap(xid, args);
+		break;
+	case MOUNT_PORT:
+		srv_mount(xid, vers, proc);
+		break;
+	case NFS_PORT:
+		srv_nfs(xid, vers, proc, args);
+		break;
+	default:
+		srv.bad++;
+	}
+}
+
+static void srv_reset(void)
+{
+	memset(&srv, '\0', sizeof(srv));
+	srv.drop_read = -1;
+	fake_srv_start(srv_rx);
+}
+
+static int check_file(void)
+{
+	return getenv_ulong("filesize", 16, 0) == FILE_SIZE &&
+		!memcmp(map_sysmem(LOAD_ADDR, FILE_SIZE), file, FILE_SIZE);
+}
+
+static int test_v3(void)
+{
+	int ret = 0;
+	ulong start;
+
+	printf(" testing nfs v3 with a lost reply ...\n");
+	srv_reset();
+	srv.drop_read = 5;
+	memset(map_sysmem(LOAD_ADDR, FILE_SIZE), '\0', FILE_SIZE);
+	start = get_timer(0);
+	errcheck(run_command("nfs 100000 192.168.1.1:/export/file", 0) == 0);
+	errcheck(check_file());
+	errcheck(srv.version == 3);
+	errcheck(srv.max_count == 16384);
+	errcheck(srv.reordered > 0);
+	errcheck(srv.bad == 0);
+
+	/* The lost reply is asked for again well before CONFIG_NFS_TIMEOUT */
+	errcheck(get_timer(start) < 1000);
+
+out:
+	printf(" nfs v3 with a lost reply: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int test_v2(void)
+{
+	int ret = 0;
+
+	printf(" testing nfs v2 fallback ...\n");
+	srv_reset();
+	srv.v2_only = 1;
+	/* Short reads: v2 has no EOF flag, so these must not end the file */
+	srv.max_read = 6000;
+	memset(map_sysmem(LOAD_ADDR, FILE_SIZE), '\0', FILE_SIZE);
+	errcheck(run_command("nfs 100000 192.168.1.1:/export/file", 0) == 0);
+	errcheck(check_file());
+	errcheck(srv.version == 2);
+	errcheck(srv.max_count == 8192);
+	errcheck(srv.bad == 0);
+
+out:
+	printf(" nfs v2 fallback: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int test_missing(void)
+{
+	int ret = 0;
+
+	printf(" testing nfs with a missing file ...\n");
+	srv_reset();
+	errcheck(run_command("nfs 100000 192.168.1.1:/export/none", 0) != 0);
+	errcheck(srv.reads == 0);
+	errcheck(srv.bad == 0);
+
+out:
+	printf(" nfs with a missing file: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int do_test_nfs(cmd_tbl_t *cmdtp, int flag, int argc,
+		       char * const argv[])
+{
+	int err = 0;
+	int i;
+
+	file = malloc(FILE_SIZE);
+	if (!file)
+		return 1;
+	for (i = 0; i < FILE_SIZE; i++)
+		file[i] = i * 13 + (i >> 9);
+
+	setenv("ipaddr", "192.168.1.2");
+	setenv("netmask", "255.255.255.0");
+	setenv("serverip", "192.168.1.1");
+
+	err += test_v3();
+	err += test_v2();
+	err += test_missing();
+
+	srv_reset();
+	sandbox_eth_set_tx_hook(NULL);
+	free(file);
+
+	printf("test_nfs %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	test_nfs,	1,	1,	do_test_nfs,
+	"Test the nfs command", ""
+);
@@ -0,0 +1,187 @@
+/*
+ * Tests for RNDIS initialisation and packet framing, replaying transfers
+ * the way a Linux host sends them
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <errno.h>
+#include <net.h>
+#include <linux/list.h>
+#include <linux/netdevice.h>
+#include <asm/unaligned.h>
+#include "../drivers/usb/gadget/rndis.h"
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+#define MTU		1500
+#define HOST_MAX	0x4000		/* what rndis_host asks for */
+
+/* REMOTE_NDIS_INITIALIZE_MSG, RequestID 1, RNDIS 1.0 */
+static const u8 init_msg[] = {
+	0x02, 0x00, 0x00, 0x00,	0x18, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x00, 0x00,	0x01, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00,	0x00, 0x40, 0x00, 0x00,
+};
+
+static struct eth_device rndis_eth;
+static struct net_device_stats rndis_stats;
+static int acks;
+
+static int ack(struct eth_device *dev)
+{
+	acks++;
+	return 0;
+}
+
+static void fill(u8 *frame, int len, int seed)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		frame[i] = seed + i;
+}
+
+static int check(const u8 *frame, int len, int seed)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (frame[i] != (u8)(seed + i))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int test_init(int config)
+{
+	rndis_init_cmplt_type *resp;
+	u8 msg[sizeof(init_msg)];
+	u32 len;
+	int ret = 0;
+
+	printf(" testing rndis init ...\n");
+	memcpy(msg, init_msg, sizeof(msg));
+	acks = 0;
+	errcheck(rndis_msg_parser(config, msg) == 0);
+	errcheck(acks == 1);
+	errcheck(rndis_get_state(config) == RNDIS_INITIALIZED);
+	errcheck(rndis_get_max_transfer(config) == HOST_MAX);
+
+	resp = (rndis_init_cmplt_type *)rndis_get_next_response(config, &len);
+	errcheck(resp != NULL);
+	errcheck(len == sizeof(*resp));
+	errcheck(le32_to_cpu(resp->MessageType) ==
+		 REMOTE_NDIS_INITIALIZE_CMPLT);
+	errcheck(le32_to_cpu(resp->RequestID) == 1);
+	errcheck(le32_to_cpu(resp->Status) == RNDIS_STATUS_SUCCESS);
+	errcheck(le32_to_cpu(resp->MaxPacketsPerTransfer) == RNDIS_MAX_PKTS);
+	errcheck(le32_to_cpu(resp->MaxTransferSize) ==
+		 RNDIS_MAX_TRANSFER(MTU));
+	errcheck(le32_to_cpu(resp->PacketAlignmentFactor) == 2);
+	rndis_free_response(config, (u8 *)resp);
+	errcheck(rndis_get_next_response(config, &len) == NULL);
+
+out:
+	printf(" rndis init: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int test_framing(void)
+{
+	static u8 xfer[RNDIS_MAX_TRANSFER(MTU)];
+	u8 frame[ETHER_HDR_SIZE + MTU];
+	const int sizes[] = { 60, ETHER_HDR_SIZE + MTU, 343 };
+	int len, offset, max, i, n;
+	u8 *data;
+	int ret = 0;
+
+	printf(" testing rndis framing ...\n");
+
+	/* Gather frames as ether.c does, then take them apart again */
+	len = 0;
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		fill(frame, sizes[i], i);
+		len = rndis_tx_pkt(xfer, len, sizeof(xfer), frame, sizes[i]);
+		errcheck(len > 0);
+		errcheck(len % 4 == 0);
+	}
+	errcheck(len <= 3 * RNDIS_PKT_SPACE(MTU));
+
+	offset = 0;
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		errcheck(rndis_rx_pkt(xfer, len, &offset, &data) == sizes[i]);
+		errcheck(((ulong)data & 3) == 0);
+		errcheck(check(data, sizes[i], i) == 0);
+	}
+	errcheck(offset == len);
+	errcheck(rndis_rx_pkt(xfer, len, &offset, &data) == 0);
+
+	/* A host may pad the transfer with zeroes */
+	memset(xfer + len, '\0', 64);
+	errcheck(rndis_rx_pkt(xfer, len + 64, &offset, &data) == 0);
+
+	/* Frames stop at the limit; the one that does not fit is refused */
+	max = 2 * RNDIS_PKT_SPACE(MTU);
+	len = 0;
+	for (n = 0; n < RNDIS_MAX_PKTS; n++) {
+		i = rndis_tx_pkt(xfer, len, max, frame, ETHER_HDR_SIZE + MTU);
+		if (i < 0)
+			break;
+		len = i;
+	}
+	errcheck(n == min(2, RNDIS_MAX_PKTS));
+	if (n < RNDIS_MAX_PKTS)
+		errcheck(i == -ENOSPC);
+
+	/* Corrupt transfers are rejected, not read past their end */
+	len = rndis_tx_pkt(xfer, 0, sizeof(xfer), frame, 60);
+	offset = 0;
+	errcheck(rndis_rx_pkt(xfer, len - 4, &offset, &data) == -EOVERFLOW);
+	put_unaligned_le32(REMOTE_NDIS_QUERY_MSG, xfer);
+	errcheck(rndis_rx_pkt(xfer, len, &offset, &data) == -EINVAL);
+	put_unaligned_le32(REMOTE_NDIS_PACKET_MSG, xfer);
+	put_unaligned_le32(len, xfer + 12);
+	errcheck(rndis_rx_pkt(xfer, len, &offset, &data) == -EOVERFLOW);
+
+out:
+	printf(" rndis framing: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int do_test_rndis(cmd_tbl_t *cmdtp, int flag, int argc,
+			 char * const argv[])
+{
+	int config;
+	int err = 0;
+
+	rndis_init();
+	config = rndis_register(ack);
+	if (config < 0 ||
+	    rndis_set_param_dev(config, &rndis_eth, MTU, &rndis_stats, NULL)) {
+		printf("test_rndis FAILED\n");
+		return 1;
+	}
+
+	err += test_init(config);
+	err += test_framing();
+
+	rndis_deregister(config);
+	printf("test_rndis %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	test_rndis,	1,	1,	do_test_rndis,
+	"Test RNDIS initialisation and packet framing", ""
+);
@@ -0,0 +1,169 @@
+/*
+ * Host test of the SPL page table builder and cache teardown order
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <errno.h>
+#include <malloc.h>
+#include <spl_cache.h>
+
+/* ARM section attributes, as in enum dcache_option */
+#define TEST_DCACHE_OFF		0x12
+#define TEST_DCACHE_WRITEBACK	0x1e
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+static int test_table(void)
+{
+	struct spl_mmu_region region[] = {
+		/* 256MiB of DDR at 0x80000000, like an AM335x */
+		{ 0x80000000, 256 << 20, TEST_DCACHE_WRITEBACK },
+		/* Unaligned: must round out to sections 0x402 and 0x403 */
+		{ 0x402ff000, 0x2000, TEST_DCACHE_WRITEBACK },
+		/* A later region wins over an earlier one */
+		{ 0x8ff00000, 1 << 20, TEST_DCACHE_OFF },
+	};
+	struct spl_mmu_region bad = { 0xfff00000, 2 << 20, 0 };
+	u32 *table;
+	int ret;
+
+	printf(" testing page table ...\n");
+	table = malloc(SPL_MMU_TABLE_SIZE);
+	errcheck(table != NULL);
+
+	ret = spl_mmu_build_table(table, TEST_DCACHE_OFF, region,
+				  ARRAY_SIZE(region));
+	errcheck(ret == 256 + 2 + 1);
+	ret = 0;
+
+	/* Identity mapping, AP = read/write */
+	errcheck(table[0] == (0x00000000 | (3 << 10) | TEST_DCACHE_OFF));
+	errcheck(table[0x7ff] == (0x7ff00000 | (3 << 10) | TEST_DCACHE_OFF));
+	errcheck(table[0x800] ==
+		 (0x80000000 | (3 << 10) | TEST_DCACHE_WRITEBACK));
+	errcheck(table[0x8fe] ==
+		 (0x8fe00000 | (3 << 10) | TEST_DCACHE_WRITEBACK));
+	errcheck(table[0x8ff] == (0x8ff00000 | (3 << 10) | TEST_DCACHE_OFF));
+	errcheck(table[0x900] == (0x90000000 | (3 << 10) | TEST_DCACHE_OFF));
+	errcheck(table[0x401] == (0x40100000 | (3 << 10) | TEST_DCACHE_OFF));
+	errcheck(table[0x402] ==
+		 (0x40200000 | (3 << 10) | TEST_DCACHE_WRITEBACK));
+	errcheck(table[0x403] ==
+		 (0x40300000 | (3 << 10) | TEST_DCACHE_WRITEBACK));
+	errcheck(table[0x404] == (0x40400000 | (3 << 10) | TEST_DCACHE_OFF));
+	errcheck(table[0xfff] == (0xfff00000 | (3 << 10) | TEST_DCACHE_OFF));
+
+	/* Running off the end of the 4GiB space is refused */
+	errcheck(spl_mmu_build_table(table, TEST_DCACHE_OFF, &bad, 1) ==
+		 -EINVAL);
+
+out:
+	printf(" page table: %s\n", ret == 0 ? "ok" : "FAILED");
+	free(table);
+
+	return ret;
+}
+
+enum {
+	STEP_FLUSH_DCACHE = 1,
+	STEP_DISABLE_DCACHE,
+	STEP_INVAL_DCACHE,
+	STEP_DISABLE_ICACHE,
+	STEP_INVAL_ICACHE,
+	STEP_INVAL_TLB,
+
+	STEP_COUNT = STEP_INVAL_TLB,
+};
+
+static int steps[STEP_COUNT + 1];
+static int num_steps;
+
+static void record_step(int step)
+{
+	if (num_steps < ARRAY_SIZE(steps))
+		steps[num_steps] = step;
+	num_steps++;
+}
+
+static void fake_flush_dcache(void)
+{
+	record_step(STEP_FLUSH_DCACHE);
+}
+
+static void fake_disable_dcache(void)
+{
+	record_step(STEP_DISABLE_DCACHE);
+}
+
+static void fake_inval_dcache(void)
+{
+	record_step(STEP_INVAL_DCACHE);
+}
+
+static void fake_disable_icache(void)
+{
+	record_step(STEP_DISABLE_ICACHE);
+}
+
+static void fake_inval_icache(void)
+{
+	record_step(STEP_INVAL_ICACHE);
+}
+
+static void fake_inval_tlb(void)
+{
+	record_step(STEP_INVAL_TLB);
+}
+
+static int test_teardown(void)
+{
+	static const struct spl_cache_ops ops = {
+		.flush_dcache	= fake_flush_dcache,
+		.disable_dcache	= fake_disable_dcache,
+		.inval_dcache	= fake_inval_dcache,
+		.disable_icache	= fake_disable_icache,
+		.inval_icache	= fake_inval_icache,
+		.inval_tlb	= fake_inval_tlb,
+	};
+	int ret = 0;
+	int i;
+
+	printf(" testing cache teardown ...\n");
+	num_steps = 0;
+	spl_cache_teardown(&ops);
+
+	/* Each step exactly once, dirty data written back first */
+	errcheck(num_steps == STEP_COUNT);
+	for (i = 0; i < STEP_COUNT; i++)
+		errcheck(steps[i] == i + 1);
+
+out:
+	printf(" cache teardown: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int do_test_spl_cache(cmd_tbl_t *cmdtp, int flag, int argc,
+			     char * const argv[])
+{
+	int err = 0;
+
+	err += test_table();
+	err += test_teardown();
+
+	printf("test_spl_cache %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	test_spl_cache,	1,	1,	do_test_spl_cache,
+	"Test SPL page table builder and cache teardown order", ""
+);
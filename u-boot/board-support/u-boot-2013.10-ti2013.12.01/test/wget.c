@@ -0,0 +1,391 @@
+/*
+ * Tests for the TCP client and wget against a fake HTTP server
+ *
+ * The server sits behind the sandbox Ethernet hook. It answers ARP,
+ * respects the advertised window with its scale, and goes back to the
+ * first lost segment after three duplicate ACKs.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <malloc.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <asm/io.h>
+#include <asm/unaligned.h>
+#include <u-boot/crc.h>
+#include "net_fake_server.h"
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+#define BODY_SIZE	200000
+#define LOAD_ADDR	0x100000
+#define MSS		1460
+#define SERVER_ISS	7000
+
+#define FIN		0x01
+#define SYN		0x02
+#define RST		0x04
+#define PSH		0x08
+#define ACK		0x10
+
+static struct {
+	uchar client_mac[6];
+	uchar client_ip[4];
+	int client_port;
+	int client_ws;		/* window scale the client asked for */
+	u32 client_win;
+	u32 snd_una;
+	u32 snd_nxt;
+	u32 rcv_nxt;
+	uchar *resp;
+	int resp_len;
+	int dup_acks;
+	int drop_seg;		/* data segment lost the first time */
+	int refuse;
+	int segs;		/* data segments sent */
+	int acks;		/* ACKs received without data */
+	int retransmits;
+	int bad;
+	int got_fin;
+	int fins;		/* FINs received */
+	int lose_fin;		/* FINs to ignore */
+} srv;
+
+static uchar *body;
+
+static u32 sum_bytes(u32 sum, const uchar *p, int len)
+{
+	int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += p[i] << 8 | p[i + 1];
+	if (len & 1)
+		sum += p[len - 1] << 8;
+
+	return sum;
+}
+
+static u16 fold(u32 sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return sum;
+}
+
+static u16 tcp_sum(const uchar *ip, int tcp_len)
+{
+	uchar pseudo[12];
+
+	memcpy(pseudo, ip + 12, 8);
+	pseudo[8] = 0;
+	pseudo[9] = IPPROTO_TCP;
+	put_unaligned_be16(tcp_len, pseudo + 10);
+
+	return fold(sum_bytes(sum_bytes(0, pseudo, 12), ip + 20, tcp_len));
+}
+
+static void srv_send(uchar flags, u32 seq, const uchar *data, int len)
+{
+	uchar frame[PKTSIZE_ALIGN];
+	uchar *ip = frame + ETHER_HDR_SIZE;
+	uchar *tcp;
+	int hlen = (flags & SYN) ? 28 : 20;
+
+	tcp = fake_srv_ip_hdr(frame, srv.client_mac, srv.client_ip,
+			      IPPROTO_TCP, hlen + len, 0, 0x4000);
+	memset(tcp, '\0', hlen);
+	put_unaligned_be16(80, tcp);
+	put_unaligned_be16(srv.client_port, tcp + 2);
+	put_unaligned_be32(seq, tcp + 4);
+	put_unaligned_be32(srv.rcv_nxt, tcp + 8);
+	tcp[12] = hlen << 2;
+	tcp[13] = flags;
+	put_unaligned_be16(0xffff, tcp + 14);
+	if (flags & SYN) {
+		/* MSS, NOP, window scale 0 */
+		tcp[20] = 2;
+		tcp[21] = 4;
+		put_unaligned_be16(MSS, tcp + 22);
+		tcp[24] = 1;
+		tcp[25] = 3;
+		tcp[26] = 3;
+		tcp[27] = 0;
+	}
+	memcpy(tcp + hlen, data, len);
+	put_unaligned_be16(~tcp_sum(ip, hlen + len), tcp + 16);
+
+	sandbox_eth_inject(frame, ETHER_HDR_SIZE + IP_HDR_SIZE + hlen + len);
+}
+
+/* Send as much as the client's window allows */
+static void srv_push(void)
+{
+	u32 off;
+	int len;
+
+	while (srv.resp && srv.snd_nxt - srv.snd_una < srv.client_win) {
+		off = srv.snd_nxt - SERVER_ISS - 1;
+		if (off >= srv.resp_len) {
+			if (off == srv.resp_len) {
+				srv_send(FIN | ACK, srv.snd_nxt, NULL, 0);
+				srv.snd_nxt++;
+			}
+			break;
+		}
+		len = min(srv.resp_len - (int)off, MSS);
+		len = min(len, (int)(srv.client_win -
+				     (srv.snd_nxt - srv.snd_una)));
+		if (srv.segs++ != srv.drop_seg)
+			srv_send(ACK | PSH, srv.snd_nxt, srv.resp + off, len);
+		srv.snd_nxt += len;
+	}
+}
+
+static void srv_request(const char *req, int len)
+{
+	static const char not_found[] = "HTTP/1.0 404 Not Found\r\n\r\n";
+	char hdr[128];
+	int hlen;
+
+	if (len > 9 && !strncmp(req, "GET /file ", 10))
+		hlen = sprintf(hdr, "HTTP/1.0 200 OK\r\n"
+			       "Content-Length: %d\r\n\r\n", BODY_SIZE);
+	else if (len > 10 && !strncmp(req, "GET /nolen ", 11))
+		hlen = sprintf(hdr, "HTTP/1.1 200 OK\r\nServer: test\r\n\r\n");
+	else
+		hlen = sprintf(hdr, "%s", not_found);
+
+	srv.resp_len = hlen;
+	if (strstr(hdr, " 200 "))
+		srv.resp_len += BODY_SIZE;
+	srv.resp = malloc(srv.resp_len);
+	memcpy(srv.resp, hdr, hlen);
+	if (srv.resp_len > hlen)
+		memcpy(srv.resp + hlen, body, BODY_SIZE);
+}
+
+static void srv_syn(const uchar *ip, const uchar *tcp, int hlen)
+{
+	const uchar *opt = tcp + 20;
+	int i;
+
+	memcpy(srv.client_mac, ip - ETHER_HDR_SIZE + 6, 6);
+	memcpy(srv.client_ip, ip + 12, 4);
+	srv.client_port = get_unaligned_be16(tcp);
+	srv.client_ws = -1;
+	for (i = 0; i < hlen - 20 && opt[i]; i += opt[i] == 1 ? 1 : opt[i + 1]) {
+		if (opt[i] == 3)
+			srv.client_ws = opt[i + 2];
+	}
+
+	srv.rcv_nxt = get_unaligned_be32(tcp + 4) + 1;
+	if (srv.refuse) {
+		srv_send(RST | ACK, 0, NULL, 0);
+		return;
+	}
+	srv.snd_una = SERVER_ISS;
+	srv.snd_nxt = SERVER_ISS + 1;
+	srv_send(SYN | ACK, SERVER_ISS, NULL, 0);
+}
+
+static void srv_rx(const uchar *frame, int len)
+{
+	const uchar *ip = frame + ETHER_HDR_SIZE;
+	const uchar *tcp = ip + IP_HDR_SIZE;
+	int tcp_len, hlen, dlen, flags;
+	u32 seq, ack;
+
+	if (fake_srv_arp(frame, len))
+		return;
+	if (get_unaligned_be16(frame + 12) != PROT_IP ||
+	    ip[9] != IPPROTO_TCP || memcmp(ip + 16, server_ip, 4))
+		return;
+
+	tcp_len = get_unaligned_be16(ip + 2) - IP_HDR_SIZE;
+	if (fold(sum_bytes(0, ip, IP_HDR_SIZE)) != 0xffff ||
+	    tcp_sum(ip, tcp_len) != 0xffff) {
+		srv.bad++;
+		return;
+	}
+	flags = tcp[13];
+	hlen = (tcp[12] >> 4) * 4;
+	dlen = tcp_len - hlen;
+	seq = get_unaligned_be32(tcp + 4);
+	ack = get_unaligned_be32(tcp + 8);
+
+	if (flags & SYN) {
+		srv_syn(ip, tcp, hlen);
+		return;
+	}
+	if (flags & RST)
+		return;
+
+	srv.client_win = get_unaligned_be16(tcp + 14) << max(srv.client_ws, 0);
+	if (flags & ACK) {
+		if ((s32)(ack - srv.snd_una) > 0) {
+			srv.snd_una = ack;
+			srv.dup_acks = 0;
+		} else if (!dlen && !(flags & FIN) &&
+			   srv.snd_una != srv.snd_nxt && ++srv.dup_acks == 3) {
+			srv.snd_nxt = srv.snd_una;
+			srv.retransmits++;
+		}
+		if (!dlen)
+			srv.acks++;
+	}
+	if (dlen && seq == srv.rcv_nxt) {
+		srv.rcv_nxt += dlen;
+		if (!srv.resp)
+			srv_request((const char *)tcp + hlen, dlen);
+	}
+	if (flags & FIN) {
+		srv.fins++;
+		if (srv.lose_fin) {
+			srv.lose_fin--;
+			return;
+		}
+		srv.got_fin = 1;
+		srv.rcv_nxt = seq + dlen + 1;
+		srv_send(ACK, srv.snd_nxt, NULL, 0);
+		return;
+	}
+	srv_push();
+}
+
+static void srv_reset(void)
+{
+	free(srv.resp);
+	memset(&srv, '\0', sizeof(srv));
+	srv.drop_seg = -1;
+	fake_srv_start(srv_rx);
+}
+
+static int test_get(void)
+{
+	int ret = 0;
+
+	printf(" testing wget with a lost segment ...\n");
+	srv_reset();
+	srv.drop_seg = 10;
+	memset(map_sysmem(LOAD_ADDR, BODY_SIZE), '\0', BODY_SIZE);
+	errcheck(run_command("wget 100000 /file", 0) == 0);
+	errcheck(getenv_ulong("filesize", 16, 0) == BODY_SIZE);
+	errcheck(!memcmp(map_sysmem(LOAD_ADDR, BODY_SIZE), body, BODY_SIZE));
+	errcheck(getenv_ulong("filecrc", 16, 0) == crc32(0, body, BODY_SIZE));
+
+	/* 64KiB does not fit the window field without scaling */
+	errcheck(srv.client_ws == 1);
+	errcheck(srv.retransmits == 1);
+	errcheck(srv.got_fin);
+	errcheck(srv.bad == 0);
+
+out:
+	printf(" wget with a lost segment: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int test_delayed_ack(void)
+{
+	int ret = 0;
+
+	printf(" testing wget without Content-Length ...\n");
+	srv_reset();
+	errcheck(run_command("wget 100000 192.168.1.1:nolen", 0) == 0);
+	errcheck(getenv_ulong("filesize", 16, 0) == BODY_SIZE);
+	errcheck(!memcmp(map_sysmem(LOAD_ADDR, BODY_SIZE), body, BODY_SIZE));
+
+	/* One ACK for every two segments, plus the handshake and the end */
+	errcheck(srv.acks <= srv.segs / 2 + 3);
+	errcheck(srv.retransmits == 0);
+	errcheck(srv.bad == 0);
+
+out:
+	printf(" wget without Content-Length: %s\n",
+	       ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int test_lost_fin(void)
+{
+	int ret = 0;
+
+	printf(" testing wget with a lost FIN ...\n");
+	srv_reset();
+	srv.lose_fin = 1;
+	errcheck(run_command("wget 100000 /file", 0) == 0);
+	errcheck(getenv_ulong("filesize", 16, 0) == BODY_SIZE);
+
+	/* The connection stays open until the resent FIN is acknowledged */
+	errcheck(srv.fins == 2);
+	errcheck(srv.got_fin);
+	errcheck(srv.bad == 0);
+
+out:
+	printf(" wget with a lost FIN: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int test_errors(void)
+{
+	int ret = 0;
+
+	printf(" testing wget errors ...\n");
+	srv_reset();
+	errcheck(run_command("wget 100000 /missing", 0) != 0);
+	errcheck(srv.bad == 0);
+
+	srv_reset();
+	srv.refuse = 1;
+	errcheck(run_command("wget 100000 /file", 0) != 0);
+
+out:
+	printf(" wget errors: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int do_test_wget(cmd_tbl_t *cmdtp, int flag, int argc,
+			char * const argv[])
+{
+	int err = 0;
+	int i;
+
+	body = malloc(BODY_SIZE);
+	if (!body)
+		return 1;
+	for (i = 0; i < BODY_SIZE; i++)
+		body[i] = i * 7 + (i >> 8);
+
+	setenv("ipaddr", "192.168.1.2");
+	setenv("netmask", "255.255.255.0");
+	setenv("serverip", "192.168.1.1");
+
+	err += test_get();
+	err += test_delayed_ack();
+	err += test_lost_fin();
+	err += test_errors();
+
+	srv_reset();
+	sandbox_eth_set_tx_hook(NULL);
+	free(body);
+
+	printf("test_wget %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	test_wget,	1,	1,	do_test_wget,
+	"Test the TCP client and wget", ""
+);
@@ -0,0 +1,579 @@
+/*
+ * Block map flasher
+ *
+ * Writes an image to one or more SD cards or other block devices, only
+ * the blocks its bmap lists. Each card gets a writer thread, doing large
+ * aligned O_DIRECT writes, and a verifier thread reading back what has
+ * been written while the next chunk goes out, and checking the hash of
+ * each range against the bmap.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <sha1.h>
+#include <sha256.h>
+#include "parse_size.h"
+
+#define DIRECT_ALIGN		4096
+#define DEFAULT_CHUNK		(4 * 1024 * 1024)
+#define MAX_CARDS		16
+#define MAX_SUM_LEN		SHA256_SUM_LEN
+
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#define ALIGN_UP(n, a)		(DIV_ROUND_UP(n, a) * (a))
+
+enum hash_type {
+	HASH_SHA1,
+	HASH_SHA256,
+};
+
+union hash_ctx {
+	sha1_context sha1;
+	sha256_context sha256;
+};
+
+struct range {
+	uint64_t first, last;		/* blocks */
+	uint8_t sum[MAX_SUM_LEN];
+	int has_sum;
+};
+
+/* Ranges are written and checked in chunks of at most chunk_size */
+struct chunk {
+	uint64_t offset;
+	uint32_t len;
+	int range;
+	int range_end;			/* last chunk of its range */
+};
+
+struct card {
+	const char *path;
+	int fd;
+	int direct;
+	pthread_t writer, verifier;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int written;			/* chunks written so far */
+	int failed;
+	uint8_t (*image_sums)[MAX_SUM_LEN];	/* of each range, as read */
+};
+
+static enum hash_type hash_type;
+static int sum_len;
+static uint64_t image_size;
+static uint32_t block_size;
+static struct range *ranges;
+static int nranges;
+static struct chunk *chunks;
+static int nchunks;
+static uint32_t chunk_size = DEFAULT_CHUNK;
+static int verify = 1;
+
+static const char *image_name;
+static int image_fd;
+static struct card cards[MAX_CARDS];
+static int ncards;
+
+static void usage(const char *prg)
+{
+	fprintf(stderr,
+		"Usage: %s [-c <chunk size>] [-n] <bmap> <image> "
+		"<device> ...\n"
+		"Write the blocks of an image that its bmap lists to one or "
+		"more devices\n"
+		"at once, and check them by reading them back\n"
+		"\n"
+		"  -c <size>    size of each write (default %u)\n"
+		"  -n           do not read back and check what was written\n",
+		prg, DEFAULT_CHUNK);
+}
+
+static void hash_start(union hash_ctx *ctx)
+{
+	if (hash_type == HASH_SHA1)
+		sha1_starts(&ctx->sha1);
+	else
+		sha256_starts(&ctx->sha256);
+}
+
+static void hash_update(union hash_ctx *ctx, const uint8_t *buf,
+			uint32_t len)
+{
+	if (hash_type == HASH_SHA1)
+		sha1_update(&ctx->sha1, buf, len);
+	else
+		sha256_update(&ctx->sha256, buf, len);
+}
+
+static void hash_finish(union hash_ctx *ctx, uint8_t *sum)
+{
+	if (hash_type == HASH_SHA1)
+		sha1_finish(&ctx->sha1, sum);
+	else
+		sha256_finish(&ctx->sha256, sum);
+}
+
+static int parse_hex(const char *s, uint8_t *sum)
+{
+	unsigned int byte;
+	int i;
+
+	for (i = 0; i < sum_len; i++) {
+		if (sscanf(s + 2 * i, "%2x", &byte) != 1)
+			return -1;
+		sum[i] = byte;
+	}
+
+	return 0;
+}
+
+/* Find <tag> and return what follows it */
+static char *find_tag(char *text, const char *tag)
+{
+	char *p = strstr(text, tag);
+
+	return p ? p + strlen(tag) : NULL;
+}
+
+/*
+ * The bmap of a file must hash to the value it holds, computed with that
+ * value replaced by zeros.
+ */
+static int check_bmap_sum(char *text, size_t size, const char *tag)
+{
+	uint8_t want[MAX_SUM_LEN], got[MAX_SUM_LEN];
+	union hash_ctx ctx;
+	char *p;
+
+	p = find_tag(text, tag);
+	if (!p)
+		return 0;
+	p += strspn(p, " \t\n");
+	if (parse_hex(p, want))
+		return -1;
+	memset(p, '0', 2 * sum_len);
+	hash_start(&ctx);
+	hash_update(&ctx, (uint8_t *)text, size);
+	hash_finish(&ctx, got);
+
+	return memcmp(want, got, sum_len) ? -1 : 0;
+}
+
+/*
+ * Read a bmap as bmap-tools writes it, versions 1.3 to 2.0: SHA1 and the
+ * sha1 attribute up to 1.3, then the hash named in ChecksumType and the
+ * chksum attribute. This is not an XML parser, it just looks for the
+ * elements we need.
+ */
+static int read_bmap(const char *path)
+{
+	const char *attr = "chksum=\"";
+	const char *file_sum = "<BmapFileChecksum>";
+	char *text, *p, *end;
+	struct stat st;
+	int ret = -1;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f || fstat(fileno(f), &st)) {
+		fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	text = malloc(st.st_size + 1);
+	if (!text || fread(text, st.st_size, 1, f) != 1) {
+		fprintf(stderr, "Can't read %s\n", path);
+		goto out;
+	}
+	text[st.st_size] = '\0';
+
+	p = find_tag(text, "<ChecksumType>");
+	if (!p) {
+		hash_type = HASH_SHA1;
+		attr = "sha1=\"";
+		file_sum = "<BmapFileSHA1>";
+	} else if (!strncmp(p + strspn(p, " "), "sha256", 6)) {
+		hash_type = HASH_SHA256;
+	} else if (!strncmp(p + strspn(p, " "), "sha1", 4)) {
+		hash_type = HASH_SHA1;
+	} else {
+		fprintf(stderr, "%s: unknown checksum type\n", path);
+		goto out;
+	}
+	sum_len = hash_type == HASH_SHA1 ? SHA1_SUM_LEN : SHA256_SUM_LEN;
+
+	p = find_tag(text, "<ImageSize>");
+	if (p)
+		image_size = strtoull(p, NULL, 10);
+	p = find_tag(text, "<BlockSize>");
+	if (p)
+		block_size = strtoul(p, NULL, 10);
+	if (!image_size || !block_size || block_size % 512) {
+		fprintf(stderr, "%s: bad image or block size\n", path);
+		goto out;
+	}
+
+	/* Ranges are single blocks "n" or "first-last" */
+	for (p = text; (p = strstr(p, "<Range")); p = end) {
+		struct range *r;
+
+		end = strchr(p, '>');
+		if (!end)
+			break;
+		r = realloc(ranges, (nranges + 1) * sizeof(*ranges));
+		if (!r) {
+			fprintf(stderr, "Out of memory\n");
+			goto out;
+		}
+		ranges = r;
+		r += nranges++;
+		memset(r, 0, sizeof(*r));
+
+		*end = '\0';
+		p = strstr(p, attr);
+		if (p && parse_hex(p + strlen(attr), r->sum) == 0)
+			r->has_sum = 1;
+		*end++ = '>';
+
+		r->first = strtoull(end, &p, 10);
+		r->last = *p == '-' ? strtoull(p + 1, NULL, 10) : r->first;
+		if (r->last < r->first ||
+		    r->first * block_size >= image_size) {
+			fprintf(stderr, "%s: bad range %llu-%llu\n", path,
+				(unsigned long long)r->first,
+				(unsigned long long)r->last);
+			goto out;
+		}
+	}
+
+	if (check_bmap_sum(text, st.st_size, file_sum)) {
+		fprintf(stderr, "%s is corrupt: bad checksum\n", path);
+		goto out;
+	}
+	ret = 0;
+
+out:
+	free(text);
+	fclose(f);
+
+	return ret;
+}
+
+static int make_chunks(void)
+{
+	uint64_t offset, end;
+	int i;
+
+	for (i = 0; i < nranges; i++) {
+		offset = ranges[i].first * block_size;
+		end = (ranges[i].last + 1) * block_size;
+		if (end > image_size)
+			end = image_size;
+		while (offset < end) {
+			struct chunk *c;
+
+			c = realloc(chunks, (nchunks + 1) * sizeof(*chunks));
+			if (!c)
+				return -1;
+			chunks = c;
+			c += nchunks++;
+			c->offset = offset;
+			c->len = end - offset < chunk_size ?
+				end - offset : chunk_size;
+			c->range = i;
+			offset += c->len;
+			c->range_end = offset == end;
+		}
+	}
+
+	return 0;
+}
+
+static void card_fail(struct card *card)
+{
+	pthread_mutex_lock(&card->lock);
+	card->failed = 1;
+	pthread_cond_broadcast(&card->cond);
+	pthread_mutex_unlock(&card->lock);
+}
+
+static void range_error(struct card *card, int range, const char *what)
+{
+	fprintf(stderr, "%s: blocks %llu-%llu %s\n", card->path,
+		(unsigned long long)ranges[range].first,
+		(unsigned long long)ranges[range].last, what);
+}
+
+/*
+ * Write each chunk, hashing the image as it is read. O_DIRECT needs whole
+ * sectors, so a short last chunk is padded with zeros.
+ */
+static void *card_writer(void *arg)
+{
+	struct card *card = arg;
+	union hash_ctx ctx;
+	uint32_t len;
+	uint8_t *buf;
+	int i;
+
+	if (posix_memalign((void **)&buf, DIRECT_ALIGN, chunk_size)) {
+		fprintf(stderr, "Out of memory\n");
+		card_fail(card);
+		return NULL;
+	}
+
+	for (i = 0; i < nchunks && !card->failed; i++) {
+		struct chunk *c = &chunks[i];
+		struct range *r = &ranges[c->range];
+
+		if (c->offset == r->first * block_size)
+			hash_start(&ctx);
+		if (pread(image_fd, buf, c->len, c->offset) != c->len) {
+			fprintf(stderr, "Can't read %s: %s\n", image_name,
+				strerror(errno));
+			card_fail(card);
+			break;
+		}
+		hash_update(&ctx, buf, c->len);
+		if (c->range_end) {
+			hash_finish(&ctx, card->image_sums[c->range]);
+			if (r->has_sum &&
+			    memcmp(r->sum, card->image_sums[c->range],
+				   sum_len)) {
+				fprintf(stderr, "%s does not match its bmap\n",
+					image_name);
+				range_error(card, c->range, "differ");
+				card_fail(card);
+				break;
+			}
+		}
+
+		len = ALIGN_UP(c->len, 512);
+		memset(buf + c->len, 0, len - c->len);
+		if (pwrite(card->fd, buf, len, c->offset) != len) {
+			fprintf(stderr, "%s: write error at %llu: %s\n",
+				card->path, (unsigned long long)c->offset,
+				strerror(errno));
+			card_fail(card);
+			break;
+		}
+
+		pthread_mutex_lock(&card->lock);
+		card->written = i + 1;
+		pthread_cond_broadcast(&card->cond);
+		pthread_mutex_unlock(&card->lock);
+	}
+
+	if (!card->failed && fsync(card->fd)) {
+		fprintf(stderr, "%s: %s\n", card->path, strerror(errno));
+		card_fail(card);
+	}
+	free(buf);
+
+	return NULL;
+}
+
+/* Read back each chunk once written, and check the hash of each range */
+static void *card_verifier(void *arg)
+{
+	struct card *card = arg;
+	uint8_t sum[MAX_SUM_LEN];
+	const uint8_t *want;
+	union hash_ctx ctx;
+	uint32_t len;
+	uint8_t *buf;
+	int i;
+
+	if (posix_memalign((void **)&buf, DIRECT_ALIGN, chunk_size)) {
+		fprintf(stderr, "Out of memory\n");
+		card_fail(card);
+		return NULL;
+	}
+
+	for (i = 0; i < nchunks; i++) {
+		struct chunk *c = &chunks[i];
+		struct range *r = &ranges[c->range];
+
+		pthread_mutex_lock(&card->lock);
+		while (card->written <= i && !card->failed)
+			pthread_cond_wait(&card->cond, &card->lock);
+		pthread_mutex_unlock(&card->lock);
+		if (card->failed)
+			break;
+
+		if (c->offset == r->first * block_size)
+			hash_start(&ctx);
+		len = ALIGN_UP(c->len, 512);
+		if (pread(card->fd, buf, len, c->offset) != len) {
+			fprintf(stderr, "%s: read error at %llu: %s\n",
+				card->path, (unsigned long long)c->offset,
+				strerror(errno));
+			card_fail(card);
+			break;
+		}
+		hash_update(&ctx, buf, c->len);
+		if (!c->range_end)
+			continue;
+
+		/* Without a hash in the bmap, the image's is all we have */
+		hash_finish(&ctx, sum);
+		want = r->has_sum ? r->sum : card->image_sums[c->range];
+		if (memcmp(sum, want, sum_len)) {
+			range_error(card, c->range, "read back wrong");
+			card_fail(card);
+			break;
+		}
+	}
+	free(buf);
+
+	return NULL;
+}
+
+static int open_card(struct card *card, const char *path)
+{
+	off_t size;
+
+	card->path = path;
+	card->direct = 1;
+	card->fd = open(path, O_RDWR | O_DIRECT);
+	if (card->fd < 0 && errno == EINVAL) {
+		card->direct = 0;
+		card->fd = open(path, O_RDWR);
+	}
+	if (card->fd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (!card->direct && verify)
+		fprintf(stderr, "%s: no O_DIRECT, reading back may only "
+			"check the cache\n", path);
+
+	size = lseek(card->fd, 0, SEEK_END);
+	if (size < 0 || size < image_size) {
+		fprintf(stderr, "%s is smaller than the image\n", path);
+		close(card->fd);
+		return -1;
+	}
+
+	card->image_sums = calloc(nranges, sizeof(*card->image_sums));
+	if (!card->image_sums) {
+		fprintf(stderr, "Out of memory\n");
+		close(card->fd);
+		return -1;
+	}
+	pthread_mutex_init(&card->lock, NULL);
+	pthread_cond_init(&card->cond, NULL);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *prg = basename(argv[0]);
+	struct timespec start, end;
+	uint64_t bytes = 0;
+	struct stat st;
+	int ret = EXIT_SUCCESS;
+	int option;
+	int i;
+
+	while ((option = getopt(argc, argv, "c:nh")) != -1) {
+		switch (option) {
+		case 'c':
+			chunk_size = parse_size(optarg, NULL);
+			break;
+		case 'n':
+			verify = 0;
+			break;
+		case 'h':
+			usage(prg);
+			return EXIT_SUCCESS;
+		default:
+			usage(prg);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind < 3 || argc - optind - 2 > MAX_CARDS) {
+		usage(prg);
+		return EXIT_FAILURE;
+	}
+	if (!chunk_size || chunk_size % DIRECT_ALIGN) {
+		fprintf(stderr, "Chunk size must be a multiple of %u\n",
+			DIRECT_ALIGN);
+		return EXIT_FAILURE;
+	}
+
+	if (read_bmap(argv[optind]))
+		return EXIT_FAILURE;
+
+	image_name = argv[optind + 1];
+	image_fd = open(image_name, O_RDONLY);
+	if (image_fd < 0 || fstat(image_fd, &st)) {
+		fprintf(stderr, "Can't open %s: %s\n", image_name,
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if (st.st_size != image_size) {
+		fprintf(stderr, "%s is not the size its bmap gives\n",
+			image_name);
+		return EXIT_FAILURE;
+	}
+	if (make_chunks()) {
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < nchunks; i++)
+		bytes += chunks[i].len;
+
+	for (i = optind + 2; i < argc; i++) {
+		if (open_card(&cards[ncards], argv[i]))
+			return EXIT_FAILURE;
+		ncards++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < ncards; i++) {
+		if (pthread_create(&cards[i].writer, NULL, card_writer,
+				   &cards[i]) ||
+		    (verify && pthread_create(&cards[i].verifier, NULL,
+					      card_verifier, &cards[i]))) {
+			fprintf(stderr, "Can't start threads\n");
+			return EXIT_FAILURE;
+		}
+	}
+	for (i = 0; i < ncards; i++) {
+		pthread_join(cards[i].writer, NULL);
+		if (verify)
+			pthread_join(cards[i].verifier, NULL);
+		if (close(cards[i].fd))
+			cards[i].failed = 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (i = 0; i < ncards; i++) {
+		printf("%s: %s\n", cards[i].path, cards[i].failed ? "FAILED" :
+		       verify ? "written and verified" : "written");
+		if (cards[i].failed)
+			ret = EXIT_FAILURE;
+	}
+	printf("%llu of %llu MiB in %.1f s\n",
+	       (unsigned long long)bytes >> 20,
+	       (unsigned long long)image_size >> 20,
+	       end.tv_sec - start.tv_sec +
+	       (end.tv_nsec - start.tv_nsec) / 1e9);
+
+	return ret;
+}
@@ -1,8 +1,10 @@
 #include "compiler.h"
+#include <rle_logo.h>
 
 enum {
 	MODE_GEN_INFO,
-	MODE_GEN_DATA
+	MODE_GEN_DATA,
+	MODE_GEN_RLE
 };
 
 typedef struct bitmap_s {		/* bitmap description */
@@ -16,7 +18,8 @@ typedef struct bitmap_s {		/* bitmap description */
 
 void usage(const char *prog)
 {
-	fprintf(stderr, "Usage: %s [--gen-info|--gen-data] file\n", prog);
+	fprintf(stderr, "Usage: %s [--gen-info|--gen-data|--gen-rle] file\n",
+		prog);
 }
 
 /*
@@ -70,6 +73,146 @@ void gen_info(bitmap_t *b, uint16_t n_colors)
 		DEFAULT_CMAP_SIZE);
 }
 
+static uint32_t get_le(const uint8_t *p, int n)
+{
+	uint32_t val = 0;
+
+	while (n--)
+		val = val << 8 | p[n];
+	return val;
+}
+
+static uint8_t *put_le16(uint8_t *p, uint16_t val)
+{
+	*p++ = val & 0xff;
+	*p++ = val >> 8;
+	return p;
+}
+
+/* Encode n pixels as described in include/rle_logo.h, return the length */
+static size_t rle_encode(const uint16_t *pix, size_t n, uint8_t *out)
+{
+	uint8_t *o = out;
+	size_t i = 0, run, j;
+
+	while (i < n) {
+		for (run = 1; i + run < n && run < RLE_LOGO_MAX_RUN; run++)
+			if (pix[i + run] != pix[i])
+				break;
+		if (run > 1) {
+			*o++ = RLE_LOGO_REPEAT | (run - 1);
+			o = put_le16(o, pix[i]);
+			i += run;
+			continue;
+		}
+
+		/* literal pixels, up to where the next repeat starts */
+		for (run = 1; i + run < n && run < RLE_LOGO_MAX_RUN; run++)
+			if (i + run + 1 < n && pix[i + run] == pix[i + run + 1])
+				break;
+		*o++ = run - 1;
+		for (j = 0; j < run; j++)
+			o = put_le16(o, pix[i + j]);
+		i += run;
+	}
+
+	return o - out;
+}
+
+/*
+ * Write an 8 bit palettized or a 24 bit bitmap to stdout as an RLE logo in
+ * RGB565, the format "lcd logo" writes to the panel without conversion
+ */
+void gen_rle(FILE *fp)
+{
+	uint8_t *bmp, *line, *rle;
+	uint16_t *pix, *p;
+	uint16_t palette[256];
+	struct rle_logo_header hdr;
+	long size;
+	uint32_t offset, width, height, bits, colors, stride, i, x, y;
+	int32_t rows;
+	size_t rle_size;
+
+	if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 54 ||
+	    fseek(fp, 0, SEEK_SET))
+		error("Couldn't get bitmap size", fp);
+	bmp = malloc(size);
+	if (!bmp)
+		error("Error allocating memory for file", fp);
+	if (fread(bmp, size, 1, fp) != 1)
+		error("Couldn't read bitmap", fp);
+
+	offset = get_le(bmp + 10, 4);
+	width = get_le(bmp + 18, 4);
+	rows = (int32_t)get_le(bmp + 22, 4);
+	height = rows < 0 ? -rows : rows;	/* < 0: top row first */
+	bits = get_le(bmp + 28, 2);
+	colors = get_le(bmp + 46, 4);
+
+	if (get_le(bmp + 30, 4) != 0 || (bits != 8 && bits != 24))
+		error("Only uncompressed 8 and 24 bit bitmaps are supported",
+		      fp);
+	if (!width || width > 0xffff || !height || height > 0xffff)
+		error("Bad bitmap size", fp);
+	stride = (width * bits / 8 + 3) & ~3;
+	if (offset > size || (long)stride * height > size - offset)
+		error("Bitmap data is truncated", fp);
+
+	if (bits == 8) {
+		if (!colors || colors > 256)
+			colors = 256;
+		if (14 + get_le(bmp + 14, 4) + colors * 4 > offset)
+			error("Bitmap palette is truncated", fp);
+		for (i = 0; i < colors; i++) {
+			uint8_t *c = bmp + 14 + get_le(bmp + 14, 4) + i * 4;
+
+			palette[i] = ((c[2] << 8) & 0xf800) |
+				     ((c[1] << 3) & 0x07e0) |
+				     (c[0] >> 3);
+		}
+		for (; i < 256; i++)
+			palette[i] = 0;
+	}
+
+	pix = malloc(width * height * sizeof(*pix));
+	/* worst case: all literals, a control byte per RLE_LOGO_MAX_RUN */
+	rle = malloc(width * height * 2 +
+		     width * height / RLE_LOGO_MAX_RUN + 1);
+	if (!pix || !rle)
+		error("Error allocating memory for file", fp);
+
+	p = pix;
+	for (y = 0; y < height; y++) {
+		line = bmp + offset + stride * (rows < 0 ? y : height - 1 - y);
+		for (x = 0; x < width; x++) {
+			if (bits == 8) {
+				*p++ = palette[line[x]];
+			} else {
+				uint8_t *c = line + x * 3;
+
+				*p++ = ((c[2] << 8) & 0xf800) |
+				       ((c[1] << 3) & 0x07e0) |
+				       (c[0] >> 3);
+			}
+		}
+	}
+
+	rle_size = rle_encode(pix, width * height, rle);
+
+	memcpy(hdr.magic, RLE_LOGO_MAGIC, RLE_LOGO_MAGIC_LEN);
+	hdr.width = cpu_to_le16(width);
+	hdr.height = cpu_to_le16(height);
+	hdr.data_size = cpu_to_le32(rle_size);
+	if (fwrite(&hdr, sizeof(hdr), 1, stdout) != 1 ||
+	    fwrite(rle, rle_size, 1, stdout) != 1 || fflush(stdout))
+		error("Couldn't write RLE logo", fp);
+
+	free(rle);
+	free(pix);
+	free(bmp);
+}
+
 int main (int argc, char *argv[])
 {
 	int	mode, i, x;
@@ -87,6 +230,8 @@ int main (int argc, char *argv[])
 		mode = MODE_GEN_INFO;
 	else if (!strcmp(argv[1], "--gen-data"))
 		mode = MODE_GEN_DATA;
+	else if (!strcmp(argv[1], "--gen-rle"))
+		mode = MODE_GEN_RLE;
 	else {
 		usage(argv[0]);
 		exit(EXIT_FAILURE);
@@ -101,6 +246,11 @@ int main (int argc, char *argv[])
 	if (fgetc (fp) != 'B' || fgetc (fp) != 'M')
 		error ("Input file is not a bitmap", fp);
 
+	if (mode == MODE_GEN_RLE) {
+		gen_rle(fp);
+		goto out;
+	}
+
 	/*
 	 * read width and height of the image, and the number of colors used;
 	 * ignore the rest
@@ -0,0 +1,578 @@
+/*
+ * Root filesystem delta applier
+ *
+ * Reads a delta made by tools/mkdelta on stdin and applies it to the tree
+ * at <root>. New files are built in <root>/.delta~ first, from the
+ * stream and from the installed files, and only once the whole stream
+ * has been read and every hash matched are they renamed into place. A
+ * delta that does not fit the installed system leaves it as it was.
+ *
+ * Applying the same delta again is harmless: files that already have
+ * their new contents are not touched, so an update that was cut short in
+ * the commit phase can simply be run again.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <sha256.h>
+#include "delta.h"
+
+#define BUF_SIZE	(64 * 1024)
+
+struct record {
+	int type;
+	char *path;
+	char *link;
+	uint32_t mode, uid, gid;
+	uint32_t major, minor;
+	uint64_t mtime;
+	int staged;		/* the new file is in DELTA_STAGING */
+};
+
+static struct record *records;
+static int nrecords;
+
+static sha256_context in_ctx;
+static int dry_run;
+static uint8_t buf[BUF_SIZE];
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: applydelta [-n] <root>\n"
+		"Apply the delta on stdin to the root filesystem at <root>\n"
+		"\n"
+		"  -n    only check that the delta fits <root>\n");
+}
+
+static int get(void *p, size_t len)
+{
+	if (fread(p, len, 1, stdin) != 1) {
+		fprintf(stderr, "The delta is truncated\n");
+		return -1;
+	}
+	sha256_update(&in_ctx, p, len);
+
+	return 0;
+}
+
+static int get_u8(uint8_t *val)
+{
+	return get(val, 1);
+}
+
+static int get_u16(uint16_t *val)
+{
+	uint8_t b[2];
+
+	if (get(b, 2))
+		return -1;
+	*val = b[0] | b[1] << 8;
+
+	return 0;
+}
+
+static int get_u32(uint32_t *val)
+{
+	uint16_t lo, hi;
+
+	if (get_u16(&lo) || get_u16(&hi))
+		return -1;
+	*val = lo | (uint32_t)hi << 16;
+
+	return 0;
+}
+
+static int get_u64(uint64_t *val)
+{
+	uint32_t lo, hi;
+
+	if (get_u32(&lo) || get_u32(&hi))
+		return -1;
+	*val = lo | (uint64_t)hi << 32;
+
+	return 0;
+}
+
+/* A path below the root: not empty, not absolute, no ".." */
+static int get_path(char **path)
+{
+	uint16_t len;
+	char *p;
+
+	if (get_u16(&len))
+		return -1;
+	*path = p = malloc(len + 1);
+	if (!p) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	if (get(p, len))
+		return -1;
+	p[len] = '\0';
+
+	if (!len || strlen(p) != len || p[0] == '/')
+		goto bad;
+	for (; p; p = strchr(p, '/')) {
+		if (*p == '/')
+			p++;
+		if (!strncmp(p, "..", 2) && (!p[2] || p[2] == '/'))
+			goto bad;
+		if (!strncmp(p, DELTA_STAGING, strlen(DELTA_STAGING)))
+			goto bad;
+	}
+
+	return 0;
+
+bad:
+	fprintf(stderr, "Bad path in the delta: %s\n", *path);
+	return -1;
+}
+
+static int get_owner(struct record *r, int with_mode)
+{
+	if (with_mode && get_u32(&r->mode))
+		return -1;
+
+	return get_u32(&r->uid) || get_u32(&r->gid);
+}
+
+static void staged_name(char *name, int n)
+{
+	sprintf(name, DELTA_STAGING "/%d", n);
+}
+
+static int hash_file(const char *path, uint8_t *sum, uint64_t *size)
+{
+	sha256_context ctx;
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	sha256_starts(&ctx);
+	*size = 0;
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		sha256_update(&ctx, buf, len);
+		*size += len;
+	}
+	close(fd);
+	if (len < 0)
+		return -1;
+	sha256_finish(&ctx, sum);
+
+	return 0;
+}
+
+static int write_all(int fd, const uint8_t *p, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int deleted(const char *path)
+{
+	int i;
+
+	for (i = 0; i < nrecords; i++)
+		if (records[i].type == DELTA_DELETE &&
+		    !strcmp(records[i].path, path))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Build a new file in the staging directory. Its ops are always read, so
+ * that the stream stays in step, even when the installed file already has
+ * the new contents and nothing is written.
+ */
+static int stage_file(struct record *r)
+{
+	uint8_t new_sum[DELTA_SUM_LEN], base_sum[DELTA_SUM_LEN];
+	uint8_t sum[DELTA_SUM_LEN];
+	char name[sizeof(DELTA_STAGING) + 16];
+	uint64_t size, done = 0, offset = 0, cur_size = 0;
+	sha256_context ctx;
+	uint32_t len, chunk;
+	uint8_t has_base, op;
+	int base = -1, fd = -1, have;
+	struct stat st;
+	ssize_t ret;
+
+	if (get_owner(r, 1) || get_u64(&r->mtime) || get_u64(&size) ||
+	    get(new_sum, sizeof(new_sum)) || get_u8(&has_base))
+		return -1;
+	if (has_base && get(base_sum, sizeof(base_sum)))
+		return -1;
+
+	have = !deleted(r->path) && !lstat(r->path, &st) &&
+		S_ISREG(st.st_mode) && !hash_file(r->path, sum, &cur_size);
+
+	/* Already there, from an earlier run */
+	r->staged = !have || cur_size != size ||
+		memcmp(sum, new_sum, sizeof(sum));
+
+	if (r->staged && has_base) {
+		if (!have || memcmp(sum, base_sum, sizeof(sum)) ||
+		    (base = open(r->path, O_RDONLY)) < 0) {
+			fprintf(stderr, "%s is not the version the delta was "
+				"made for\n", r->path);
+			goto err;
+		}
+	}
+	if (r->staged && !dry_run) {
+		staged_name(name, r - records);
+		fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0) {
+			fprintf(stderr, "Can't create %s: %s\n", name,
+				strerror(errno));
+			goto err;
+		}
+	}
+
+	sha256_starts(&ctx);
+	for (;;) {
+		if (get_u8(&op))
+			goto err;
+		if (op == DELTA_OP_END)
+			break;
+		if (op == DELTA_OP_COPY) {
+			if (get_u64(&offset) || get_u32(&len))
+				goto err;
+			if (!r->staged)
+				continue;
+			if (base < 0) {
+				fprintf(stderr, "%s: copy without a base\n",
+					r->path);
+				goto err;
+			}
+		} else if (op == DELTA_OP_DATA) {
+			if (get_u32(&len))
+				goto err;
+		} else {
+			fprintf(stderr, "%s: bad op %u\n", r->path, op);
+			goto err;
+		}
+
+		for (; len; len -= chunk, offset += chunk) {
+			chunk = len < sizeof(buf) ? len : sizeof(buf);
+			if (op == DELTA_OP_DATA) {
+				if (get(buf, chunk))
+					goto err;
+				if (!r->staged)
+					continue;
+			} else {
+				ret = pread(base, buf, chunk, offset);
+				if (ret != chunk) {
+					fprintf(stderr, "%s: copy beyond "
+						"its end\n", r->path);
+					goto err;
+				}
+			}
+			sha256_update(&ctx, buf, chunk);
+			done += chunk;
+			if (fd >= 0 && write_all(fd, buf, chunk)) {
+				fprintf(stderr, "Can't write %s: %s\n", name,
+					strerror(errno));
+				goto err;
+			}
+		}
+	}
+	sha256_finish(&ctx, sum);
+
+	if (r->staged && (done != size || memcmp(sum, new_sum, sizeof(sum)))) {
+		fprintf(stderr, "%s does not come out as it should\n",
+			r->path);
+		goto err;
+	}
+	if (fd >= 0 && (fchown(fd, r->uid, r->gid) ||
+			fchmod(fd, r->mode) || close(fd))) {
+		fprintf(stderr, "Can't finish %s: %s\n", name,
+			strerror(errno));
+		fd = -1;
+		goto err;
+	}
+	if (base >= 0)
+		close(base);
+
+	return 0;
+
+err:
+	if (fd >= 0)
+		close(fd);
+	if (base >= 0)
+		close(base);
+	return -1;
+}
+
+static int read_delta(void)
+{
+	uint8_t magic[DELTA_MAGIC_LEN], sum[DELTA_SUM_LEN];
+	uint8_t expected[DELTA_SUM_LEN];
+	uint32_t version;
+	struct record *r;
+	uint8_t type;
+	int ret;
+
+	sha256_starts(&in_ctx);
+	if (get(magic, sizeof(magic)) || get_u32(&version))
+		return -1;
+	if (memcmp(magic, DELTA_MAGIC, DELTA_MAGIC_LEN) ||
+	    version != DELTA_VERSION) {
+		fprintf(stderr, "This is not a version %d delta\n",
+			DELTA_VERSION);
+		return -1;
+	}
+
+	for (;;) {
+		if (get_u8(&type))
+			return -1;
+		if (type == DELTA_END)
+			break;
+
+		r = realloc(records, (nrecords + 1) * sizeof(*r));
+		if (!r) {
+			fprintf(stderr, "Out of memory\n");
+			return -1;
+		}
+		records = r;
+		r += nrecords++;
+		memset(r, 0, sizeof(*r));
+		r->type = type;
+		if (get_path(&r->path))
+			return -1;
+
+		switch (type) {
+		case DELTA_DELETE:
+			ret = 0;
+			break;
+		case DELTA_DIR:
+		case DELTA_META:
+			ret = get_owner(r, 1);
+			break;
+		case DELTA_FILE:
+			ret = stage_file(r);
+			break;
+		case DELTA_SYMLINK:
+			ret = get_owner(r, 0) || get_path(&r->link);
+			break;
+		case DELTA_NODE:
+			ret = get_owner(r, 1) || get_u32(&r->major) ||
+				get_u32(&r->minor);
+			break;
+		case DELTA_HARDLINK:
+			ret = get_path(&r->link);
+			break;
+		default:
+			fprintf(stderr, "Bad record %u in the delta\n", type);
+			return -1;
+		}
+		if (ret)
+			return -1;
+	}
+
+	sha256_finish(&in_ctx, sum);
+	if (fread(expected, sizeof(expected), 1, stdin) != 1 ||
+	    memcmp(sum, expected, sizeof(sum))) {
+		fprintf(stderr, "The delta is corrupt\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int remove_tree(const char *path)
+{
+	struct dirent *de;
+	struct stat st;
+	char *child;
+	DIR *dir;
+	int ret = 0;
+
+	if (lstat(path, &st))
+		return errno == ENOENT ? 0 : -1;
+	if (!S_ISDIR(st.st_mode))
+		return unlink(path);
+
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+	while (!ret && (de = readdir(dir))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		child = malloc(strlen(path) + strlen(de->d_name) + 2);
+		if (!child) {
+			ret = -1;
+			break;
+		}
+		sprintf(child, "%s/%s", path, de->d_name);
+		ret = remove_tree(child);
+		free(child);
+	}
+	closedir(dir);
+
+	return ret ? ret : rmdir(path);
+}
+
+static int set_owner(const char *path, const struct record *r)
+{
+	return lchown(path, r->uid, r->gid) || chmod(path, r->mode);
+}
+
+/* Put what was made under a temporary name in place of r->path */
+static int replace(const char *tmp, const struct record *r)
+{
+	if (rename(tmp, r->path))
+		return -1;
+	/* rename() leaves both if they were hard links to the same file */
+	unlink(tmp);
+
+	return 0;
+}
+
+static int commit(struct record *r)
+{
+	char name[sizeof(DELTA_STAGING) + 16];
+	struct timeval times[2];
+	struct stat st;
+
+	staged_name(name, r - records);
+	if (r->type != DELTA_FILE)
+		unlink(name);
+
+	switch (r->type) {
+	case DELTA_DELETE:
+		return remove_tree(r->path);
+	case DELTA_DIR:
+		if (mkdir(r->path, r->mode) &&
+		    (errno != EEXIST || stat(r->path, &st) ||
+		     !S_ISDIR(st.st_mode)))
+			return -1;
+		return set_owner(r->path, r);
+	case DELTA_FILE:
+		if (!r->staged &&
+		    (chown(r->path, r->uid, r->gid) || chmod(r->path, r->mode)))
+			return -1;
+		times[0].tv_sec = times[1].tv_sec = r->mtime;
+		times[0].tv_usec = times[1].tv_usec = 0;
+		if (r->staged && (utimes(name, times) || rename(name, r->path)))
+			return -1;
+		return r->staged ? 0 : utimes(r->path, times);
+	case DELTA_SYMLINK:
+		return symlink(r->link, name) ||
+			lchown(name, r->uid, r->gid) || replace(name, r);
+	case DELTA_NODE:
+		return mknod(name, r->mode, makedev(r->major, r->minor)) ||
+			set_owner(name, r) || replace(name, r);
+	case DELTA_META:
+		if (lstat(r->path, &st))
+			return -1;
+		if (S_ISLNK(st.st_mode))
+			return lchown(r->path, r->uid, r->gid);
+		return set_owner(r->path, r);
+	case DELTA_HARDLINK:
+		return link(r->link, name) || replace(name, r);
+	}
+
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	int option, i, files = 0, staged = 0;
+
+	while ((option = getopt(argc, argv, "nh")) != -1) {
+		switch (option) {
+		case 'n':
+			dry_run = 1;
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind != 1) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	if (chdir(argv[optind])) {
+		fprintf(stderr, "Can't enter %s: %s\n", argv[optind],
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	umask(0);
+	if (!dry_run && (remove_tree(DELTA_STAGING) ||
+			 mkdir(DELTA_STAGING, 0700))) {
+		fprintf(stderr, "Can't create %s: %s\n", DELTA_STAGING,
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (read_delta())
+		goto err;
+
+	for (i = 0; i < nrecords; i++) {
+		if (records[i].type != DELTA_FILE)
+			continue;
+		files++;
+		staged += records[i].staged;
+	}
+	printf("Delta checked: %d records, %d of %d files to replace\n",
+	       nrecords, staged, files);
+	if (dry_run)
+		return EXIT_SUCCESS;
+
+	/* From here on the old system is changed */
+	sync();
+	for (i = 0; i < nrecords; i++) {
+		if (commit(&records[i])) {
+			fprintf(stderr, "Can't update %s: %s\n",
+				records[i].path, strerror(errno));
+			fprintf(stderr, "Run the update again to finish it\n");
+			return EXIT_FAILURE;
+		}
+	}
+	remove_tree(DELTA_STAGING);
+	sync();
+	printf("Delta applied\n");
+
+	return EXIT_SUCCESS;
+
+err:
+	if (!dry_run)
+		remove_tree(DELTA_STAGING);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,62 @@
+/*
+ * Root filesystem delta format, written by tools/mkdelta and applied on
+ * the target by applydelta
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _DELTA_H
+#define _DELTA_H
+
+/*
+ * A delta is a stream: the header, records, then DELTA_END and the
+ * SHA256 of everything before that hash. Numbers are little endian, a
+ * path is a u16 length and the bytes, relative to the root and without
+ * a trailing '\0'.
+ *
+ * Records come in the order they are to be committed: deletions, deepest
+ * first; new directories, parents first; files, symlinks and device
+ * nodes; metadata changes; hard links last, so that their targets are in
+ * place.
+ *
+ *	DELTA_DELETE	path
+ *	DELTA_DIR	path, u32 mode, u32 uid, u32 gid
+ *	DELTA_FILE	path, u32 mode, u32 uid, u32 gid, u64 mtime,
+ *			u64 size, u8 new_sum[32], u8 has_base,
+ *			[u8 base_sum[32]], ops..., DELTA_OP_END
+ *	DELTA_SYMLINK	path, u32 uid, u32 gid, target path
+ *	DELTA_NODE	path, u32 mode, u32 uid, u32 gid, u32 major, u32 minor
+ *	DELTA_META	path, u32 mode, u32 uid, u32 gid
+ *	DELTA_HARDLINK	path, target path
+ *
+ * The ops of a file build its new contents: DELTA_OP_COPY, u64 offset and
+ * u32 length take bytes from the installed file, which must then hash to
+ * base_sum; DELTA_OP_DATA, u32 length and the bytes, takes them from the
+ * stream.
+ */
+#define DELTA_MAGIC		"TXTDELTA"
+#define DELTA_MAGIC_LEN		8
+#define DELTA_VERSION		1
+#define DELTA_SUM_LEN		32	/* SHA256 */
+
+enum delta_record {
+	DELTA_END,
+	DELTA_DELETE,
+	DELTA_DIR,
+	DELTA_FILE,
+	DELTA_SYMLINK,
+	DELTA_NODE,
+	DELTA_META,
+	DELTA_HARDLINK,
+};
+
+enum delta_op {
+	DELTA_OP_END,
+	DELTA_OP_COPY,
+	DELTA_OP_DATA,
+};
+
+/* Where applydelta puts new files until the stream has been checked */
+#define DELTA_STAGING		".delta~"
+
+#endif /* _DELTA_H */
@@ -45,6 +45,7 @@ struct envdev_s {
 	ulong env_size;			/* environment size */
 	ulong erase_size;		/* device erase size */
 	ulong env_sectors;		/* number of environment sectors */
+	ulong write_size;		/* NAND page size, 0 on other devices */
 	uint8_t mtd_type;		/* type of the MTD device */
 };
 
@@ -63,6 +64,7 @@ static int dev_current;
 #define ENVSIZE(i)    envdevices[(i)].env_size
 #define DEVESIZE(i)   envdevices[(i)].erase_size
 #define ENVSECTORS(i) envdevices[(i)].env_sectors
+#define DEVWSIZE(i)   envdevices[(i)].write_size
 #define DEVTYPE(i)    envdevices[(i)].mtd_type
 
 #define CUR_ENVSIZE ENVSIZE(dev_current)
@@ -92,6 +94,8 @@ struct environment {
 	unsigned char		*flags;
 	char			*data;
 	enum flag_scheme	flag_scheme;
+	int			end;	/* offset of the empty entry */
+	int			dirty;	/* changed since read or written */
 };
 
 static struct environment environment = {
@@ -99,6 +103,23 @@ static struct environment environment = {
 };
 
 static int HaveRedundEnv = 0;
+static int env_opened;
+
+/*
+ * Index of the variables, so that a script setting many of them does not
+ * scan the whole environment for each one
+ */
+#define ENV_HASH_SIZE	256
+
+struct env_entry {
+	int offset;		/* of "name=value" in the data, -1 if deleted */
+	int next;		/* next entry in the same bucket, or -1 */
+};
+
+static struct env_entry *env_entries;
+static int env_nentries;
+static int env_max_entries;
+static int env_buckets[ENV_HASH_SIZE];
 
 static unsigned char active_flag = 1;
 /* obsolete_flag must be 0 to efficiently set it on NOR flash without erasing */
@@ -109,6 +130,7 @@ static unsigned char obsolete_flag = 0;
 
 static int flash_io (int mode);
 static char *envmatch (char * s1, char * s2);
+static int env_index_find(char *name);
 static int parse_config (void);
 
 #if defined(CONFIG_FILE)
@@ -139,30 +161,117 @@ static char *fw_string_blank(char *s, int noblank)
 	return s;
 }
 
-/*
- * Search the environment for a variable.
- * Return the value, if found, or NULL, if not found.
- */
-char *fw_getenv (char *name)
+static unsigned int env_hash(const char *name)
+{
+	unsigned int hash = 0;
+
+	while (*name && *name != '=')
+		hash = hash * 31 + (unsigned char)*name++;
+
+	return hash & (ENV_HASH_SIZE - 1);
+}
+
+static int env_index_add(int offset)
+{
+	unsigned int bucket = env_hash(environment.data + offset);
+
+	if (env_nentries == env_max_entries) {
+		int max = env_max_entries ? 2 * env_max_entries : 64;
+		struct env_entry *entries;
+
+		entries = realloc(env_entries, max * sizeof(*entries));
+		if (!entries) {
+			fprintf(stderr, "Cannot malloc %zu bytes: %s\n",
+				max * sizeof(*entries), strerror(errno));
+			return -1;
+		}
+		env_entries = entries;
+		env_max_entries = max;
+	}
+
+	env_entries[env_nentries].offset = offset;
+	env_entries[env_nentries].next = env_buckets[bucket];
+	env_buckets[bucket] = env_nentries++;
+
+	return 0;
+}
+
+/* Index the environment, which must end with an empty entry */
+static int env_index_build(void)
 {
 	char *env, *nxt;
+	int i;
 
-	for (env = environment.data; *env; env = nxt + 1) {
-		char *val;
+	env_nentries = 0;
+	for (i = 0; i < ENV_HASH_SIZE; i++)
+		env_buckets[i] = -1;
 
+	for (env = environment.data; *env; env = nxt + 1) {
 		for (nxt = env; *nxt; ++nxt) {
-			if (nxt >= &environment.data[ENV_SIZE]) {
-				fprintf (stderr, "## Error: "
+			if (nxt >= &environment.data[ENV_SIZE - 1]) {
+				fprintf(stderr, "## Error: "
 					"environment not terminated\n");
-				return NULL;
+				return -1;
 			}
 		}
-		val = envmatch (name, env);
-		if (!val)
-			continue;
-		return val;
+		if (env_index_add(env - environment.data))
+			return -1;
 	}
-	return NULL;
+	environment.end = env - environment.data;
+
+	return 0;
+}
+
+static int env_index_find(char *name)
+{
+	int idx;
+
+	for (idx = env_buckets[env_hash(name)]; idx >= 0;
+	     idx = env_entries[idx].next) {
+		if (envmatch(name, environment.data + env_entries[idx].offset))
+			return idx;
+	}
+
+	return -1;
+}
+
+/* Remove a variable from the environment and from the index */
+static void env_index_delete(int idx)
+{
+	int offset = env_entries[idx].offset;
+	char *env = environment.data + offset;
+	int len = strlen(env) + 1;
+	int *link;
+	int i;
+
+	for (link = &env_buckets[env_hash(env)]; *link != idx;
+	     link = &env_entries[*link].next)
+		;
+	*link = env_entries[idx].next;
+	env_entries[idx].offset = -1;
+
+	for (i = 0; i < env_nentries; i++) {
+		if (env_entries[i].offset > offset)
+			env_entries[i].offset -= len;
+	}
+
+	memmove(env, env + len, environment.end - offset - len);
+	environment.end -= len;
+	memset(environment.data + environment.end, '\0', len);
+}
+
+/*
+ * Search the environment for a variable.
+ * Return the value, if found, or NULL, if not found.
+ */
+char *fw_getenv (char *name)
+{
+	int idx = env_index_find(name);
+
+	if (idx < 0)
+		return NULL;
+
+	return envmatch(name, environment.data + env_entries[idx].offset);
 }
 
 /*
@@ -234,28 +343,15 @@ int fw_printenv (int argc, char *argv[])
 
 	for (i = 1; i < argc; ++i) {	/* print single env variables   */
 		char *name = argv[i];
-		char *val = NULL;
-
-		for (env = environment.data; *env; env = nxt + 1) {
+		char *val = fw_getenv(name);
 
-			for (nxt = env; *nxt; ++nxt) {
-				if (nxt >= &environment.data[ENV_SIZE]) {
-					fprintf (stderr, "## Error: "
-						"environment not terminated\n");
-					return -1;
-				}
-			}
-			val = envmatch (name, env);
-			if (val) {
-				if (!n_flag) {
-					fputs (name, stdout);
-					putc ('=', stdout);
-				}
-				puts (val);
-				break;
+		if (val) {
+			if (!n_flag) {
+				fputs (name, stdout);
+				putc ('=', stdout);
 			}
-		}
-		if (!val) {
+			puts (val);
+		} else {
 			fprintf (stderr, "## Error: \"%s\" not defined\n", name);
 			rc = -1;
 		}
@@ -266,6 +362,19 @@ int fw_printenv (int argc, char *argv[])
 
 int fw_env_close(void)
 {
+	/* Nothing to write if nothing has changed */
+	if (!environment.dirty)
+		return 0;
+
+	/*
+	 * Leave the unused end erased on NAND, so that flash_write_buf()
+	 * does not have to program those pages
+	 */
+	if (DEVTYPE(dev_current) == MTD_NANDFLASH &&
+	    environment.end + 2 < ENV_SIZE)
+		memset(environment.data + environment.end + 2, 0xff,
+		       ENV_SIZE - environment.end - 2);
+
 	/*
 	 * Update CRC
 	 */
@@ -278,6 +387,11 @@ int fw_env_close(void)
 			return -1;
 	}
 
+	/* The copy just written is the current one now */
+	if (HaveRedundEnv)
+		dev_current = !dev_current;
+	environment.dirty = 0;
+
 	return 0;
 }
 
@@ -289,26 +403,18 @@ int fw_env_close(void)
  */
 int fw_env_write(char *name, char *value)
 {
-	int len;
-	char *env, *nxt;
+	int len, idx;
+	char *env;
 	char *oldval = NULL;
 	int deleting, creating, overwriting;
 
 	/*
 	 * search if variable with this name already exists
 	 */
-	for (nxt = env = environment.data; *env; env = nxt + 1) {
-		for (nxt = env; *nxt; ++nxt) {
-			if (nxt >= &environment.data[ENV_SIZE]) {
-				fprintf(stderr, "## Error: "
-					"environment not terminated\n");
-				errno = EINVAL;
-				return -1;
-			}
-		}
-		if ((oldval = envmatch (name, env)) != NULL)
-			break;
-	}
+	idx = env_index_find(name);
+	if (idx >= 0)
+		oldval = envmatch(name, environment.data +
+				  env_entries[idx].offset);
 
 	deleting = (oldval && !(value && strlen(value)));
 	creating = (!oldval && (value && strlen(value)));
@@ -352,19 +458,13 @@ int fw_env_write(char *name, char *value)
 		/* Nothing to do */
 		return 0;
 
-	if (deleting || overwriting) {
-		if (*++nxt == '\0') {
-			*env = '\0';
-		} else {
-			for (;;) {
-				*env = *nxt++;
-				if ((*env == '\0') && (*nxt == '\0'))
-					break;
-				++env;
-			}
-		}
-		*++env = '\0';
-	}
+	/* Leave the variable where it is if its value is the same */
+	if (overwriting && strcmp(oldval, value) == 0)
+		return 0;
+
+	environment.dirty = 1;
+	if (deleting || overwriting)
+		env_index_delete(idx);
 
 	/* Delete only ? */
 	if (!value || !strlen(value))
@@ -373,9 +473,7 @@ int fw_env_write(char *name, char *value)
 	/*
 	 * Append new definition at the end
 	 */
-	for (env = environment.data; *env || *(env + 1); ++env);
-	if (env > environment.data)
-		++env;
+	env = environment.data + environment.end;
 	/*
 	 * Overflow when:
 	 * "name" + "=" + "val" +"\0\0"  > CUR_ENVSIZE - (env-environment)
@@ -400,6 +498,12 @@ int fw_env_write(char *name, char *value)
 	/* end is marked with double '\0' */
 	*++env = '\0';
 
+	if (env_index_add(environment.end)) {
+		environment.data[environment.end] = '\0';
+		return -1;
+	}
+	environment.end = env - environment.data;
+
 	return 0;
 }
 
@@ -473,6 +577,9 @@ int fw_setenv(int argc, char *argv[])
  *
  * Comments are allowed if the first character in the line is #
  *
+ * All lines are applied to the environment in memory, which is then
+ * written back once, and only if a variable has changed.
+ *
  * Returns -1 and sets errno error codes:
  * 0	  - OK
  * -1     - Error
@@ -480,11 +587,11 @@ int fw_setenv(int argc, char *argv[])
 int fw_parse_script(char *fname)
 {
 	FILE *fp;
-	char dump[1024];	/* Maximum line length in the file */
+	char *dump = NULL;
+	size_t size = 0;
 	char *name;
 	char *val;
-	int lineno = 0;
-	int len;
+	ssize_t len;
 	int ret = 0;
 
 	if (fw_env_open()) {
@@ -503,22 +610,8 @@ int fw_parse_script(char *fname)
 		}
 	}
 
-	while (fgets(dump, sizeof(dump), fp)) {
-		lineno++;
-		len = strlen(dump);
-
-		/*
-		 * Read a whole line from the file. If the line is too long
-		 * or is not terminated, reports an error and exit.
-		 */
-		if (dump[len - 1] != '\n') {
-			fprintf(stderr,
-			"Line %d not corrected terminated or too long\n",
-				lineno);
-			ret = -1;
-			break;
-		}
-
+	/* Lines may be as long as the values in the environment */
+	while ((len = getline(&dump, &size, fp)) != -1) {
 		/* Drop ending line feed / carriage return */
 		while (len > 0 && (dump[len - 1] == '\n' ||
 				dump[len - 1] == '\r')) {
@@ -576,6 +669,7 @@ int fw_parse_script(char *fname)
 	/* Close file if not stdin */
 	if (strcmp(fname, "-") != 0)
 		fclose(fp);
+	free(dump);
 
 	ret |= fw_env_close();
 
@@ -700,6 +794,26 @@ static int flash_read_buf (int dev, int fd, void *buf, size_t count,
 	return processed;
 }
 
+/*
+ * Number of bytes at the start of an erased NAND block that have to be
+ * written: pages of 0xff at its end read back the same if left alone.
+ */
+static size_t flash_write_len (int dev, const uint8_t *data, size_t len)
+{
+	size_t page = DEVWSIZE (dev);
+	size_t i;
+
+	while (page && len >= page) {
+		for (i = len - page; i < len; i++) {
+			if (data[i] != 0xff)
+				return len;
+		}
+		len -= page;
+	}
+
+	return len;
+}
+
 /*
  * Write count bytes at offset, but stay within ENVSECTORS (dev) sectors of
  * DEVOFFSET (dev). Similar to the read case above, on NOR and dataflash we
@@ -725,6 +839,7 @@ static int flash_write_buf (int dev, int fd, void *buf, size_t count,
 	off_t top_of_range;	/* end of the last block we may use */
 	loff_t blockstart;	/* running start of the current block -
 				   MEMGETBADBLOCK needs 64 bits */
+	size_t write_len;	/* bytes of the current block to program */
 	int rc;
 
 	/*
@@ -850,11 +965,17 @@ static int flash_write_buf (int dev, int fd, void *buf, size_t count,
 			return -1;
 		}
 
+		write_len = erasesize;
+		if (mtd_type == MTD_NANDFLASH)
+			write_len = flash_write_len (dev, data + processed,
+						     erasesize);
+
 #ifdef DEBUG
-		fprintf(stderr, "Write 0x%x bytes at 0x%llx\n", erasesize,
+		fprintf(stderr, "Write 0x%x bytes at 0x%llx\n", write_len,
 			blockstart);
 #endif
-		if (write (fd, data + processed, erasesize) != erasesize) {
+		if (write_len &&
+		    write (fd, data + processed, write_len) != write_len) {
 			fprintf (stderr, "Write error on %s: %s\n",
 				 DEVNAME (dev), strerror (errno));
 			return -1;
@@ -978,6 +1099,8 @@ static int flash_read (int fd)
 	}
 
 	DEVTYPE(dev_current) = mtdinfo.type;
+	if (mtdinfo.type == MTD_NANDFLASH)
+		DEVWSIZE(dev_current) = mtdinfo.writesize;
 
 	rc = flash_read_buf(dev_current, fd, environment.image, CUR_ENVSIZE,
 			     DEVOFFSET (dev_current), mtdinfo.type);
@@ -1064,6 +1187,8 @@ static char *envmatch (char * s1, char * s2)
 
 /*
  * Prevent confusion if running from erased flash memory
+ *
+ * The environment is read once; later calls return what is in memory.
  */
 int fw_env_open(void)
 {
@@ -1078,6 +1203,9 @@ int fw_env_open(void)
 	struct env_image_single *single;
 	struct env_image_redundant *redundant;
 
+	if (env_opened)
+		return 0;
+
 	if (parse_config ())		/* should fill envdevices */
 		return -1;
 
@@ -1115,6 +1243,7 @@ int fw_env_open(void)
 			fprintf (stderr,
 				"Warning: Bad CRC, using default environment\n");
 			memcpy(environment.data, default_environment, sizeof default_environment);
+			environment.dirty = 1;
 		}
 	} else {
 		flag0 = *environment.flags;
@@ -1171,6 +1300,7 @@ int fw_env_open(void)
 				"Warning: Bad CRC, using default environment\n");
 			memcpy (environment.data, default_environment,
 				sizeof default_environment);
+			environment.dirty = 1;
 			dev_current = 0;
 		} else {
 			switch (environment.flag_scheme) {
@@ -1227,6 +1357,11 @@ int fw_env_open(void)
 		fprintf(stderr, "Selected env in %s\n", DEVNAME(dev_current));
 #endif
 	}
+
+	if (env_index_build())
+		return -1;
+	env_opened = 1;
+
 	return 0;
 }
 
@@ -56,6 +56,10 @@ extern int   fw_printenv(int argc, char *argv[]);
 extern char *fw_getenv  (char *name);
 extern int fw_setenv  (int argc, char *argv[]);
 extern int fw_parse_script(char *fname);
+/*
+ * fw_env_open() reads the environment once, fw_env_write() changes it in
+ * memory and fw_env_close() writes it back, if anything has changed
+ */
 extern int fw_env_open(void);
 extern int fw_env_write(char *name, char *value);
 extern int fw_env_close(void);
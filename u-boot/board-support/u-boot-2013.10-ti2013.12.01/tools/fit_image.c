@@ -72,15 +72,394 @@ int mmap_fdt(struct mkimage_params *params, const char *fname, void **blobp,
 		return -1;
 	}
 
+	/* Signing looks up the same nodes many times */
+	fdt_index_enable(ptr);
+
 	*blobp = ptr;
 	return fd;
 }
 
+/*
+ * Room left in the blob for the hash and signature values, and the
+ * timestamp, which are added to it. The FIT is packed again before it is
+ * written, so unused space costs nothing.
+ */
+#define FIT_EXTRA_SPACE		0x1000
+#define FIT_NODE_SPACE		0x400
+
+/**
+ * fit_import_data() - put external image data back into the FIT
+ *
+ * This lets an image made with -E be signed again. It is written out
+ * with external data as before, though only aligned as -B says.
+ *
+ * @params:	mkimage parameters
+ * @old:	image as read from the file
+ * @len:	size of the file
+ * @fit:	place to put the FIT with the data in it
+ * @space:	size of @fit
+ * @return 0 if ok, -1 on error (which has been reported)
+ */
+static int fit_import_data(struct mkimage_params *params, const char *old,
+			   size_t len, void *fit, int space)
+{
+	int images_noffset, noffset;
+	int offset, size;
+	ulong base;
+	int ret;
+
+	ret = fdt_open_into(old, fit, space);
+	if (ret) {
+		fprintf(stderr, "%s: Can't open FIT blob: %s\n",
+			params->cmdname, fdt_strerror(ret));
+		return -1;
+	}
+
+	base = fit_get_data_base(old);
+	images_noffset = fdt_path_offset(fit, FIT_IMAGES_PATH);
+	for (noffset = fdt_first_subnode(fit, images_noffset);
+	     noffset >= 0;
+	     noffset = fdt_next_subnode(fit, noffset)) {
+		if (fit_image_get_data_offset(fit, noffset, &offset))
+			continue;
+		if (fit_image_get_data_size(fit, noffset, &size) ||
+		    offset < 0 || size < 0 || base + offset + size > len) {
+			fprintf(stderr, "%s: Data of '%s' is not in the file\n",
+				params->cmdname,
+				fit_get_name(fit, noffset, NULL));
+			return -1;
+		}
+
+		ret = fdt_setprop(fit, noffset, FIT_DATA_PROP,
+				  old + base + offset, size);
+		if (!ret)
+			ret = fdt_delprop(fit, noffset, FIT_DATA_OFFSET_PROP);
+		if (!ret)
+			ret = fdt_delprop(fit, noffset, FIT_DATA_SIZE_PROP);
+		if (ret) {
+			fprintf(stderr, "%s: Can't import data of '%s': %s\n",
+				params->cmdname,
+				fit_get_name(fit, noffset, NULL),
+				fdt_strerror(ret));
+			return -1;
+		}
+	}
+	params->external_data = 1;
+
+	return 0;
+}
+
+/**
+ * fit_read_blob() - read the FIT into memory, with room to add to it
+ *
+ * This reads the output of dtc through a pipe, or the existing image
+ * file, so that the FIT is only written out once it is complete.
+ *
+ * @params:	mkimage parameters
+ * @blobp:	returns the blob, which the caller must free()
+ * @padp:	returns the free space at the end of the FIT as read
+ * @return 0 if ok, -1 on error (which has been reported)
+ */
+static int fit_read_blob(struct mkimage_params *params, void **blobp,
+			 int *padp)
+{
+	char cmd[MKIMAGE_MAX_DTC_CMDLINE_LEN];
+	const char *fname;
+	size_t len, space, n;
+	char *buf, *new;
+	int nodes, offset, depth;
+	ulong end, size;
+	FILE *f;
+	int ret;
+
+	/* We either compile the source file, or use the existing FIT image */
+	if (params->datafile) {
+		/* dtc -I dts -O dtb -p 500 datafile */
+		snprintf(cmd, sizeof(cmd), "%s %s %s",
+			 MKIMAGE_DTC, params->dtc, params->datafile);
+		debug("Trying to execute \"%s\"\n", cmd);
+		fname = cmd;
+		f = popen(cmd, "r");
+	} else {
+		fname = params->imagefile;
+		f = fopen(fname, "rb");
+	}
+	if (!f) {
+		fprintf(stderr, "%s: Can't read %s: %s\n",
+			params->cmdname, fname, strerror(errno));
+		return -1;
+	}
+
+	buf = NULL;
+	len = 0;
+	space = 0;
+	do {
+		if (len == space) {
+			space = space ? space * 2 : 0x10000;
+			new = realloc(buf, space);
+			if (!new) {
+				fprintf(stderr, "%s: Out of memory\n",
+					params->cmdname);
+				break;
+			}
+			buf = new;
+		}
+		n = fread(buf + len, 1, space - len, f);
+		len += n;
+	} while (n);
+	ret = len < space ? ferror(f) : -1;
+	if (params->datafile) {
+		if (pclose(f))
+			ret = -1;
+	} else {
+		fclose(f);
+	}
+	if (ret || len < sizeof(struct fdt_header) || fdt_check_header(buf) ||
+	    fdt_totalsize(buf) > len) {
+		fprintf(stderr, "%s: Invalid FIT blob\n", params->cmdname);
+		goto err;
+	}
+
+	nodes = 0;
+	depth = 0;
+	for (offset = 0; offset >= 0 && depth >= 0;
+	     offset = fdt_next_node(buf, offset, &depth))
+		nodes++;
+
+	/* dtc -p leaves free space after the strings */
+	size = fdt_totalsize(buf);
+	end = fdt_off_dt_strings(buf) + fdt_size_dt_strings(buf);
+	if (end < fdt_off_dt_struct(buf) + fdt_size_dt_struct(buf))
+		end = fdt_off_dt_struct(buf) + fdt_size_dt_struct(buf);
+	*padp = size > end ? size - end : 0;
+
+	space = len + FIT_EXTRA_SPACE + nodes * FIT_NODE_SPACE;
+	if (fit_has_external(buf)) {
+		new = malloc(space);
+		if (!new) {
+			fprintf(stderr, "%s: Out of memory\n",
+				params->cmdname);
+			goto err;
+		}
+		ret = fit_import_data(params, buf, len, new, space);
+		free(buf);
+		buf = new;
+		if (ret)
+			goto err;
+	} else {
+		new = realloc(buf, space);
+		if (!new) {
+			fprintf(stderr, "%s: Out of memory\n",
+				params->cmdname);
+			goto err;
+		}
+		buf = new;
+		ret = fdt_open_into(buf, buf, space);
+		if (ret) {
+			fprintf(stderr, "%s: Can't open FIT blob: %s\n",
+				params->cmdname, fdt_strerror(ret));
+			goto err;
+		}
+	}
+
+	*blobp = buf;
+	return 0;
+
+err:
+	free(buf);
+	return -1;
+}
+
+/**
+ * fit_pack_blob() - pack the FIT, leaving free space at the end
+ *
+ * The padding asked of dtc, or left in an existing image, is kept so
+ * that it is still there for signing the FIT later.
+ *
+ * @blob:	FIT to pack
+ * @pad:	free space to leave
+ * @return new size of the FIT
+ */
+static int fit_pack_blob(void *blob, int pad)
+{
+	int size;
+
+	fdt_pack(blob);
+	size = fdt_totalsize(blob);
+	memset(blob + size, '\0', pad);
+	fdt_set_totalsize(blob, size + pad);
+
+	return size + pad;
+}
+
+/**
+ * fit_extract_data() - move image data out of the FIT structure
+ *
+ * The data property of each image is replaced by data-offset and
+ * data-size, and the data is put after the FIT, each image aligned to
+ * params->data_align bytes from the start of the file. Then the FIT
+ * can be read on its own, and each image read straight to where it
+ * will be used.
+ *
+ * @params:	mkimage parameters
+ * @fit:	FIT to change, which has room for the new properties
+ * @pad:	free space to leave at the end of the FIT structure
+ * @outp:	returns the whole image, which the caller must free()
+ * @sizep:	returns the size of the whole image
+ * @return 0 if ok, -1 on error (which has been reported)
+ */
+static int fit_extract_data(struct mkimage_params *params, void *fit,
+			    int pad, char **outp, int *sizep)
+{
+	ulong align = params->data_align ? params->data_align : 4;
+	int images_noffset, noffset;
+	ulong base, pos, total;
+	int *sizes, *offsets;
+	const void *data;
+	char *ext, *out;
+	int count, i, len;
+	int ret;
+
+	images_noffset = fdt_path_offset(fit, FIT_IMAGES_PATH);
+	if (images_noffset < 0) {
+		fprintf(stderr, "%s: Can't find images parent node\n",
+			params->cmdname);
+		return -1;
+	}
+
+	count = 0;
+	total = 0;
+	for (noffset = fdt_first_subnode(fit, images_noffset);
+	     noffset >= 0;
+	     noffset = fdt_next_subnode(fit, noffset)) {
+		if (fdt_getprop(fit, noffset, FIT_DATA_PROP, &len)) {
+			count++;
+			total += len;
+		}
+	}
+	sizes = calloc(count ? count : 1, 2 * sizeof(int));
+	ext = malloc(total ? total : 1);
+	out = NULL;
+	if (!sizes || !ext) {
+		fprintf(stderr, "%s: Out of memory\n", params->cmdname);
+		goto err;
+	}
+	offsets = sizes + count;
+
+	/* Take the data out, with offsets to be filled in below */
+	pos = 0;
+	i = 0;
+	for (noffset = fdt_first_subnode(fit, images_noffset);
+	     noffset >= 0;
+	     noffset = fdt_next_subnode(fit, noffset)) {
+		data = fdt_getprop(fit, noffset, FIT_DATA_PROP, &len);
+		if (!data)
+			continue;
+		memcpy(ext + pos, data, len);
+		pos += len;
+		sizes[i++] = len;
+
+		ret = fdt_delprop(fit, noffset, FIT_DATA_PROP);
+		if (!ret)
+			ret = fdt_setprop_u32(fit, noffset,
+					      FIT_DATA_OFFSET_PROP, 0);
+		if (!ret)
+			ret = fdt_setprop_u32(fit, noffset,
+					      FIT_DATA_SIZE_PROP, len);
+		if (ret) {
+			fprintf(stderr, "%s: Can't move out data of '%s': %s\n",
+				params->cmdname,
+				fit_get_name(fit, noffset, NULL),
+				fdt_strerror(ret));
+			goto err;
+		}
+	}
+
+	/* Only now is it known where the data will go */
+	fit_pack_blob(fit, pad);
+	base = fit_get_data_base(fit);
+	pos = base;
+	for (i = 0; i < count; i++) {
+		pos = (pos + align - 1) & ~(align - 1);
+		offsets[i] = pos - base;
+		pos += sizes[i];
+	}
+	total = pos;
+
+	i = 0;
+	for (noffset = fdt_first_subnode(fit, images_noffset);
+	     noffset >= 0;
+	     noffset = fdt_next_subnode(fit, noffset)) {
+		if (fdt_getprop(fit, noffset, FIT_DATA_OFFSET_PROP, NULL))
+			fdt_setprop_inplace_u32(fit, noffset,
+						FIT_DATA_OFFSET_PROP,
+						offsets[i++]);
+	}
+
+	out = calloc(1, total);
+	if (!out) {
+		fprintf(stderr, "%s: Out of memory\n", params->cmdname);
+		goto err;
+	}
+	memcpy(out, fit, fdt_totalsize(fit));
+	for (i = 0, pos = 0; i < count; pos += sizes[i++])
+		memcpy(out + base + offsets[i], ext + pos, sizes[i]);
+
+	free(ext);
+	free(sizes);
+	*outp = out;
+	*sizep = total;
+	return 0;
+
+err:
+	free(ext);
+	free(sizes);
+	return -1;
+}
+
+/**
+ * fit_write_file() - write out a finished image
+ *
+ * @params:	mkimage parameters
+ * @fname:	file to write
+ * @buf:	image to write
+ * @size:	size of the image
+ * @return 0 if ok, -1 on error (which has been reported)
+ */
+static int fit_write_file(struct mkimage_params *params, const char *fname,
+			  const void *buf, int size)
+{
+	int fd;
+
+	fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "%s: Can't open %s: %s\n",
+			params->cmdname, fname, strerror(errno));
+		return -1;
+	}
+	if (write(fd, buf, size) != size) {
+		fprintf(stderr, "%s: Write error on %s: %s\n",
+			params->cmdname, fname, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (close(fd)) {
+		fprintf(stderr, "%s: Write error on %s: %s\n",
+			params->cmdname, fname, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
 /**
  * fit_handle_file - main FIT file processing function
  *
  * fit_handle_file() runs dtc to convert .its to .itb, includes
  * binary data, updates timestamp property and calculates hashes.
+ * The FIT is built in memory and written out once, through a temporary
+ * file which then replaces the image file. With -E the image data goes
+ * after the FIT structure instead of in it.
  *
  * datafile  - .its file
  * imagefile - .itb file
@@ -91,17 +470,17 @@ int mmap_fdt(struct mkimage_params *params, const char *fname, void **blobp,
 static int fit_handle_file (struct mkimage_params *params)
 {
 	char tmpfile[MKIMAGE_MAX_TMPFILE_LEN];
-	char cmd[MKIMAGE_MAX_DTC_CMDLINE_LEN];
-	int tfd, destfd = 0;
+	int destfd = 0;
 	void *dest_blob = NULL;
 	struct stat sbuf;
 	void *ptr;
 	off_t destfd_size = 0;
+	char *out;
+	int size, pad;
 
 	/* Flattened Image Tree (FIT) format  handling */
 	debug ("FIT format handling\n");
 
-	/* call dtc to include binary properties into the tmp file */
 	if (strlen (params->imagefile) +
 		strlen (MKIMAGE_TMPFILE_SUFFIX) + 1 > sizeof (tmpfile)) {
 		fprintf (stderr, "%s: Image file name (%s) too long, "
@@ -111,21 +490,8 @@ static int fit_handle_file (struct mkimage_params *params)
 	}
 	sprintf (tmpfile, "%s%s", params->imagefile, MKIMAGE_TMPFILE_SUFFIX);
 
-	/* We either compile the source file, or use the existing FIT image */
-	if (params->datafile) {
-		/* dtc -I dts -O dtb -p 500 datafile > tmpfile */
-		snprintf(cmd, sizeof(cmd), "%s %s %s > %s",
-			 MKIMAGE_DTC, params->dtc, params->datafile, tmpfile);
-		debug("Trying to execute \"%s\"\n", cmd);
-	} else {
-		snprintf(cmd, sizeof(cmd), "cp %s %s",
-			 params->imagefile, tmpfile);
-	}
-	if (system (cmd) == -1) {
-		fprintf (stderr, "%s: system(%s) failed: %s\n",
-				params->cmdname, cmd, strerror(errno));
-		goto err_system;
-	}
+	if (fit_read_blob(params, &ptr, &pad))
+		return -1;
 
 	if (params->keydest) {
 		destfd = mmap_fdt(params, params->keydest, &dest_blob, &sbuf);
@@ -134,9 +500,8 @@ static int fit_handle_file (struct mkimage_params *params)
 		destfd_size = sbuf.st_size;
 	}
 
-	tfd = mmap_fdt(params, tmpfile, &ptr, &sbuf);
-	if (tfd < 0)
-		goto err_mmap;
+	/* Signing looks up the same nodes many times */
+	fdt_index_enable(ptr);
 
 	/* set hashes for images in the blob */
 	if (fit_add_verification_data(params->keydir,
@@ -148,20 +513,34 @@ static int fit_handle_file (struct mkimage_params *params)
 	}
 
 	/* for first image creation, add a timestamp at offset 0 i.e., root  */
-	if (params->datafile && fit_set_timestamp(ptr, 0, sbuf.st_mtime)) {
+	if (params->datafile && fit_set_timestamp(ptr, 0, time(NULL))) {
 		fprintf (stderr, "%s: Can't add image timestamp\n",
 				params->cmdname);
 		goto err_add_timestamp;
 	}
 	debug ("Added timestamp successfully\n");
 
-	munmap ((void *)ptr, sbuf.st_size);
-	close (tfd);
+	fdt_index_disable(ptr);
 	if (dest_blob) {
+		fdt_index_disable(dest_blob);
 		munmap(dest_blob, destfd_size);
 		close(destfd);
 	}
 
+	if (params->external_data) {
+		if (fit_extract_data(params, ptr, pad, &out, &size))
+			goto err_write;
+		free(ptr);
+		ptr = out;
+	} else {
+		size = fit_pack_blob(ptr, pad);
+	}
+	if (fit_write_file(params, tmpfile, ptr, size)) {
+		unlink(tmpfile);
+		goto err_write;
+	}
+	free(ptr);
+
 	if (rename (tmpfile, params->imagefile) == -1) {
 		fprintf (stderr, "%s: Can't rename %s to %s: %s\n",
 				params->cmdname, tmpfile, params->imagefile,
@@ -174,13 +553,15 @@ static int fit_handle_file (struct mkimage_params *params)
 
 err_add_timestamp:
 err_add_hashes:
-	munmap(ptr, sbuf.st_size);
-err_mmap:
-	if (dest_blob)
+	fdt_index_disable(ptr);
+	if (dest_blob) {
+		fdt_index_disable(dest_blob);
 		munmap(dest_blob, destfd_size);
+		close(destfd);
+	}
 err_keydest:
-err_system:
-	unlink(tmpfile);
+err_write:
+	free(ptr);
 	return -1;
 }
 
@@ -11,8 +11,137 @@
 
 #include "mkimage.h"
 #include <image.h>
+#include <pthread.h>
 #include <version.h>
 
+#define MAX_HASH_THREADS	16
+
+/*
+ * The hashes of all images are worked out by several threads before any
+ * is written, as each image is hashed on its own and large images take
+ * most of the time. Writing them changes the FIT, so that is left to
+ * fit_image_process_hash(), which visits hash nodes in the same order
+ * and takes the values in turn.
+ */
+struct hash_job {
+	const void *data;
+	size_t size;
+	const char *algo;
+	uint8_t value[FIT_MAX_HASH_LEN];
+	int value_len;
+	int ret;
+};
+
+static struct hash_job *hash_jobs;
+static int hash_job_count;
+static int hash_job_next;
+static pthread_mutex_t hash_job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *fit_hash_worker(void *arg)
+{
+	struct hash_job *job;
+
+	for (;;) {
+		pthread_mutex_lock(&hash_job_lock);
+		job = NULL;
+		if (hash_job_next < hash_job_count)
+			job = &hash_jobs[hash_job_next++];
+		pthread_mutex_unlock(&hash_job_lock);
+		if (!job)
+			return NULL;
+
+		job->ret = calculate_hash(job->data, job->size, job->algo,
+					  job->value, &job->value_len);
+	}
+}
+
+/**
+ * fit_hash_images() - work out the hash of every image, in parallel
+ *
+ * Visits hash nodes as fit_add_verification_data() does, stopping at
+ * the first image that would make that fail. Threads are only used when
+ * there is more than one hash to do.
+ *
+ * @fit:	pointer to the FIT format image header
+ * @images_noffset: offset of the images parent node
+ * @return 0 if ok, -ENOMEM if out of memory
+ */
+static int fit_hash_images(void *fit, int images_noffset)
+{
+	pthread_t threads[MAX_HASH_THREADS];
+	struct hash_job *job;
+	const void *data;
+	size_t size;
+	int image_noffset, noffset;
+	int count, i, n;
+	char *algo;
+
+	count = 0;
+	for (image_noffset = fdt_first_subnode(fit, images_noffset);
+	     image_noffset >= 0;
+	     image_noffset = fdt_next_subnode(fit, image_noffset)) {
+		for (noffset = fdt_first_subnode(fit, image_noffset);
+		     noffset >= 0;
+		     noffset = fdt_next_subnode(fit, noffset))
+			count++;
+	}
+	hash_jobs = calloc(count ? count : 1, sizeof(*hash_jobs));
+	if (!hash_jobs)
+		return -ENOMEM;
+
+	count = 0;
+	for (image_noffset = fdt_first_subnode(fit, images_noffset);
+	     image_noffset >= 0;
+	     image_noffset = fdt_next_subnode(fit, image_noffset)) {
+		if (fit_image_get_data(fit, image_noffset, &data, &size))
+			break;
+		for (noffset = fdt_first_subnode(fit, image_noffset);
+		     noffset >= 0;
+		     noffset = fdt_next_subnode(fit, noffset)) {
+			if (strncmp(fit_get_name(fit, noffset, NULL),
+				    FIT_HASH_NODENAME,
+				    strlen(FIT_HASH_NODENAME)))
+				continue;
+			if (fit_image_hash_get_algo(fit, noffset, &algo))
+				goto done;
+			job = &hash_jobs[count++];
+			job->data = data;
+			job->size = size;
+			job->algo = algo;
+		}
+	}
+done:
+	hash_job_count = count;
+	hash_job_next = 0;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n > count)
+		n = count;
+	if (n > MAX_HASH_THREADS)
+		n = MAX_HASH_THREADS;
+	for (i = 1; i < n; i++) {
+		if (pthread_create(&threads[i], NULL, fit_hash_worker, NULL))
+			break;
+	}
+	n = i;
+	fit_hash_worker(NULL);
+	for (i = 1; i < n; i++)
+		pthread_join(threads[i], NULL);
+
+	/* Now hand the results out in order */
+	hash_job_next = 0;
+
+	return 0;
+}
+
+static void fit_hash_images_done(void)
+{
+	free(hash_jobs);
+	hash_jobs = NULL;
+	hash_job_count = 0;
+	hash_job_next = 0;
+}
+
 /**
  * fit_set_hash_value - set hash value in requested has node
  * @fit: pointer to the FIT format image header
@@ -61,8 +190,10 @@ static int fit_image_process_hash(void *fit, const char *image_name,
 {
 	uint8_t value[FIT_MAX_HASH_LEN];
 	const char *node_name;
+	struct hash_job *job;
 	int value_len;
 	char *algo;
+	int ret;
 
 	node_name = fit_get_name(fit, noffset, NULL);
 
@@ -72,7 +203,16 @@ static int fit_image_process_hash(void *fit, const char *image_name,
 		return -1;
 	}
 
-	if (calculate_hash(data, size, algo, value, &value_len)) {
+	/* Take the value fit_hash_images() worked out, if there is one */
+	if (hash_job_next < hash_job_count) {
+		job = &hash_jobs[hash_job_next++];
+		ret = job->ret;
+		value_len = job->value_len;
+		memcpy(value, job->value, sizeof(value));
+	} else {
+		ret = calculate_hash(data, size, algo, value, &value_len);
+	}
+	if (ret) {
 		printf("Unsupported hash algorithm (%s) for '%s' hash node in '%s' image node\n",
 		       algo, node_name, image_name);
 		return -1;
@@ -486,7 +626,9 @@ static int fit_config_get_data(void *fit, int conf_noffset, int noffset,
 		struct image_region **regionp, int *region_countp,
 		char **region_propp, int *region_proplen)
 {
-	char * const exc_prop[] = {"data"};
+	/* External data is checked by hash, wherever it has been put */
+	char * const exc_prop[] = {FIT_DATA_PROP, FIT_DATA_OFFSET_PROP,
+				   FIT_DATA_SIZE_PROP};
 	struct strlist node_inc;
 	struct image_region *region;
 	struct fdt_region fdt_regions[100];
@@ -656,6 +798,12 @@ int fit_add_verification_data(const char *keydir, void *keydest, void *fit,
 		return images_noffset;
 	}
 
+	ret = fit_hash_images(fit, images_noffset);
+	if (ret) {
+		printf("Out of memory hashing images\n");
+		return ret;
+	}
+
 	/* Process its subnodes, print out component images details */
 	for (noffset = fdt_first_subnode(fit, images_noffset);
 	     noffset >= 0;
@@ -667,8 +815,11 @@ int fit_add_verification_data(const char *keydir, void *keydest, void *fit,
 		ret = fit_image_add_verification_data(keydir, keydest,
 				fit, noffset, comment, require_keys);
 		if (ret)
-			return ret;
+			break;
 	}
+	fit_hash_images_done();
+	if (ret)
+		return ret;
 
 	/* If there are no keys, we can't sign configurations */
 	if (!IMAGE_ENABLE_SIGN || !keydir)
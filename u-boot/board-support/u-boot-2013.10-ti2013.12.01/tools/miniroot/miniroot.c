@@ -0,0 +1,504 @@
+/*
+ * RAM system builder for the TXT update scripts
+ *
+ * Copies the parts of the running root filesystem that a manifest names
+ * into <dest>, all in one process: files with sendfile(), symlinks and
+ * device nodes recreated, owners, modes and times kept as cp -p does.
+ *
+ * The manifest has one directive per line, '#' starts a comment:
+ *
+ *	tree <path> [!<path>]...	<path> and everything below it,
+ *					except the paths given with '!'
+ *	flat <path>			the files and symlinks directly in
+ *					<path>
+ *	links <dir> <target>		the symlinks in <dir> that resolve
+ *					to <target>
+ *	copy <pattern>...		what matches the glob patterns; none
+ *					need to match
+ *	dir <path> <mode> [<user>[:<group>]]
+ *					an empty directory
+ *	symlink <path> <target>		a new symlink
+ *
+ * As in the scripts this replaces, a copied symlink points to where the
+ * original resolves, as an absolute path, unless that is on another
+ * filesystem.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#define MAX_ARGS	32
+#define BUF_SIZE	(64 * 1024)
+
+static const char *dest;
+static int verbose, errors;
+static char last_parent[PATH_MAX];
+
+static struct {
+	int files, links, dirs, nodes;
+	unsigned long long bytes;
+} stats;
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: miniroot [-v] <manifest> <dest>\n"
+		"Copy what <manifest> lists from / to <dest>; "
+		"<manifest> may be - for stdin\n"
+		"\n"
+		"  -v    list each path copied\n");
+}
+
+static void fail(const char *what, const char *path)
+{
+	fprintf(stderr, "miniroot: %s %s: %s\n", what, path,
+		strerror(errno));
+	errors++;
+}
+
+/*
+ * For the source side: files, in /var in particular, may go away between
+ * readdir() and copying them. That is only worth a warning.
+ */
+static void fail_src(const char *what, const char *path)
+{
+	if (errno != ENOENT) {
+		fail(what, path);
+		return;
+	}
+	fprintf(stderr, "miniroot: skipping %s: %s\n", path, strerror(errno));
+}
+
+static int dest_path(char *buf, const char *path)
+{
+	if (snprintf(buf, PATH_MAX, "%s%s", dest, path) >= PATH_MAX) {
+		errno = ENAMETOOLONG;
+		fail("can't copy", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void set_attr(const char *dst, const struct stat *st)
+{
+	struct timeval times[2];
+
+	if (lchown(dst, st->st_uid, st->st_gid))
+		fail("can't chown", dst);
+	if (S_ISLNK(st->st_mode))
+		return;
+	if (chmod(dst, st->st_mode & 07777))
+		fail("can't chmod", dst);
+	times[0].tv_sec = st->st_atime;
+	times[1].tv_sec = st->st_mtime;
+	times[0].tv_usec = times[1].tv_usec = 0;
+	if (utimes(dst, times))
+		fail("can't set the times of", dst);
+}
+
+/* Create the directories above path in dest, like the source ones */
+static int make_parents(const char *path)
+{
+	char parent[PATH_MAX], dst[PATH_MAX];
+	struct stat st;
+	char *p, c;
+
+	strcpy(parent, path);
+	p = strrchr(parent, '/');
+	if (!p || p == parent)
+		return 0;
+	*p = '\0';
+	if (!strcmp(parent, last_parent))
+		return 0;
+
+	for (p = parent + 1; ; p++) {
+		if (*p && *p != '/')
+			continue;
+		c = *p;
+		*p = '\0';
+		if (dest_path(dst, parent))
+			return -1;
+		if (lstat(dst, &st)) {
+			if (stat(parent, &st) || mkdir(dst, 0700)) {
+				fail("can't create", dst);
+				return -1;
+			}
+			set_attr(dst, &st);
+			stats.dirs++;
+		}
+		if (!c)
+			break;
+		*p = c;
+	}
+	strcpy(last_parent, parent);
+
+	return 0;
+}
+
+static int copy_data(int in, int out, off_t size)
+{
+	static char buf[BUF_SIZE];
+	ssize_t len;
+
+	/* sendfile() to a regular file needs Linux 2.6.33 */
+	while (size > 0) {
+		len = sendfile(out, in, NULL, size);
+		if (!len)
+			return 0;	/* it shrank */
+		if (len < 0)
+			break;
+		size -= len;
+	}
+	if (!size)
+		return 0;
+	if (size < 0 || (errno != EINVAL && errno != ENOSYS))
+		return -1;
+
+	while ((len = read(in, buf, sizeof(buf))) > 0)
+		if (write(out, buf, len) != len)
+			return -1;
+
+	return len;
+}
+
+static void copy_file(const char *path, const char *dst,
+		      const struct stat *st)
+{
+	int in, out;
+
+	in = open(path, O_RDONLY);
+	if (in < 0) {
+		fail_src("can't open", path);
+		return;
+	}
+	unlink(dst);
+	out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (out < 0) {
+		fail("can't create", dst);
+		close(in);
+		return;
+	}
+	if (copy_data(in, out, st->st_size))
+		fail("can't copy", path);
+	close(in);
+	if (close(out))
+		fail("can't write", dst);
+	set_attr(dst, st);
+	stats.files++;
+	stats.bytes += st->st_size;
+}
+
+static void copy_link(const char *path, const char *dst,
+		      const struct stat *st)
+{
+	char target[PATH_MAX];
+	struct stat tst;
+	ssize_t len;
+
+	/*
+	 * Keep links that dangle or lead to another filesystem, such as
+	 * /dev/fd to /proc/self/fd, as they are
+	 */
+	if (!realpath(path, target) || stat(target, &tst) ||
+	    tst.st_dev != st->st_dev) {
+		len = readlink(path, target, sizeof(target) - 1);
+		if (len < 0) {
+			fail_src("can't read", path);
+			return;
+		}
+		target[len] = '\0';
+	}
+	unlink(dst);
+	if (symlink(target, dst)) {
+		fail("can't create", dst);
+		return;
+	}
+	set_attr(dst, st);
+	stats.links++;
+}
+
+static void copy_entry(const char *path, const struct stat *st)
+{
+	char dst[PATH_MAX];
+
+	if (make_parents(path) || dest_path(dst, path))
+		return;
+	if (verbose)
+		printf("%s\n", path);
+
+	switch (st->st_mode & S_IFMT) {
+	case S_IFREG:
+		copy_file(path, dst, st);
+		break;
+	case S_IFLNK:
+		copy_link(path, dst, st);
+		break;
+	case S_IFDIR:
+		if (mkdir(dst, 0700) && errno != EEXIST) {
+			fail("can't create", dst);
+			break;
+		}
+		set_attr(dst, st);
+		stats.dirs++;
+		break;
+	default:
+		unlink(dst);
+		if (mknod(dst, st->st_mode & S_IFMT, st->st_rdev)) {
+			fail("can't create", dst);
+			break;
+		}
+		set_attr(dst, st);
+		stats.nodes++;
+		break;
+	}
+}
+
+static int excluded(const char *path, char **excludes, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (!strcmp(path, excludes[i]))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Walk the directory path: recursive for tree, files and symlinks only
+ * for flat, and with link_target only the symlinks resolving to it.
+ */
+static void walk(const char *path, int recursive, const char *link_target,
+		 char **excludes, int n)
+{
+	char child[PATH_MAX], target[PATH_MAX];
+	struct dirent *de;
+	struct stat st;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "miniroot: skipping %s: %s\n", path,
+			strerror(errno));
+		return;
+	}
+	while ((de = readdir(dir))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		if (snprintf(child, sizeof(child), "%s/%s",
+			     strcmp(path, "/") ? path : "", de->d_name) >=
+		    sizeof(child)) {
+			errno = ENAMETOOLONG;
+			fail("can't read", child);
+			continue;
+		}
+		if (lstat(child, &st)) {
+			fail_src("can't read", child);
+			continue;
+		}
+		if (excluded(child, excludes, n))
+			continue;
+		if (link_target) {
+			if (S_ISLNK(st.st_mode) && realpath(child, target) &&
+			    !strcmp(target, link_target))
+				copy_entry(child, &st);
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			if (!recursive)
+				continue;
+			copy_entry(child, &st);
+			walk(child, 1, NULL, excludes, n);
+			continue;
+		}
+		if (recursive || S_ISREG(st.st_mode) || S_ISLNK(st.st_mode))
+			copy_entry(child, &st);
+	}
+	closedir(dir);
+}
+
+/*
+ * A user or group id by name, from /etc/passwd or /etc/group directly:
+ * this runs statically linked, without NSS
+ */
+static int lookup_id(const char *file, const char *name, unsigned *id)
+{
+	char line[512], *p;
+	size_t len = strlen(name);
+	FILE *f;
+	int ret = -1;
+
+	*id = strtoul(name, &p, 10);
+	if (*name && !*p)
+		return 0;
+
+	f = fopen(file, "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, name, len) || line[len] != ':')
+			continue;
+		p = strchr(line + len + 1, ':');
+		if (p) {
+			*id = strtoul(p + 1, NULL, 10);
+			ret = 0;
+		}
+		break;
+	}
+	fclose(f);
+
+	return ret;
+}
+
+static void make_dir(char **args, int n)
+{
+	struct stat st;
+	unsigned uid = 0, gid = 0;
+	char *group;
+
+	memset(&st, 0, sizeof(st));
+	st.st_mode = S_IFDIR | strtoul(args[1], NULL, 8);
+	st.st_atime = st.st_mtime = time(NULL);
+	if (n > 2) {
+		group = strchr(args[2], ':');
+		if (group)
+			*group++ = '\0';
+		if (lookup_id("/etc/passwd", args[2], &uid) ||
+		    (group && lookup_id("/etc/group", group, &gid))) {
+			fprintf(stderr, "miniroot: unknown owner of %s\n",
+				args[0]);
+			errors++;
+			return;
+		}
+	}
+	st.st_uid = uid;
+	st.st_gid = gid;
+	copy_entry(args[0], &st);
+}
+
+static void make_symlink(const char *path, const char *target)
+{
+	char dst[PATH_MAX];
+
+	if (make_parents(path) || dest_path(dst, path))
+		return;
+	unlink(dst);
+	if (symlink(target, dst))
+		fail("can't create", dst);
+	else
+		stats.links++;
+}
+
+static void run(char **args, int n, int line)
+{
+	char *excludes[MAX_ARGS];
+	struct stat st;
+	glob_t g;
+	int i, j, nex = 0;
+
+	if (!strcmp(args[0], "tree") && n >= 2) {
+		for (i = 2; i < n; i++)
+			if (args[i][0] == '!')
+				excludes[nex++] = args[i] + 1;
+		if (lstat(args[1], &st)) {
+			fprintf(stderr, "miniroot: skipping %s: %s\n",
+				args[1], strerror(errno));
+			return;
+		}
+		copy_entry(args[1], &st);
+		if (S_ISDIR(st.st_mode))
+			walk(args[1], 1, NULL, excludes, nex);
+	} else if (!strcmp(args[0], "flat") && n == 2) {
+		walk(args[1], 0, NULL, NULL, 0);
+	} else if (!strcmp(args[0], "links") && n == 3) {
+		walk(args[1], 0, args[2], NULL, 0);
+	} else if (!strcmp(args[0], "copy") && n >= 2) {
+		for (i = 1; i < n; i++) {
+			if (glob(args[i], GLOB_NOSORT, NULL, &g))
+				continue;
+			for (j = 0; j < g.gl_pathc; j++)
+				if (!lstat(g.gl_pathv[j], &st))
+					copy_entry(g.gl_pathv[j], &st);
+			globfree(&g);
+		}
+	} else if (!strcmp(args[0], "dir") && (n == 3 || n == 4)) {
+		make_dir(args + 1, n - 1);
+	} else if (!strcmp(args[0], "symlink") && n == 3) {
+		make_symlink(args[1], args[2]);
+	} else {
+		fprintf(stderr, "miniroot: bad directive in line %d\n", line);
+		errors++;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	char buf[1024], *args[MAX_ARGS], *p;
+	int option, n, line = 0;
+	FILE *manifest;
+
+	while ((option = getopt(argc, argv, "vh")) != -1) {
+		switch (option) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (argc - optind != 2) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	manifest = strcmp(argv[optind], "-") ? fopen(argv[optind], "r") :
+		stdin;
+	if (!manifest) {
+		fprintf(stderr, "miniroot: can't open %s: %s\n", argv[optind],
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+	dest = argv[optind + 1];
+
+	while (fgets(buf, sizeof(buf), manifest)) {
+		line++;
+		p = strchr(buf, '#');
+		if (p)
+			*p = '\0';
+		n = 0;
+		for (p = strtok(buf, " \t\n"); p && n < MAX_ARGS;
+		     p = strtok(NULL, " \t\n"))
+			args[n++] = p;
+		if (n)
+			run(args, n, line);
+	}
+
+	printf("miniroot: %d files (%llu KiB), %d links, %d directories, "
+	       "%d nodes\n", stats.files, stats.bytes / 1024, stats.links,
+	       stats.dirs, stats.nodes);
+	if (errors) {
+		fprintf(stderr, "miniroot: %d errors\n", errors);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,792 @@
+/*
+ * Root filesystem delta generator
+ *
+ * Compares two root filesystem tarballs, as buildroot makes them, and
+ * writes the delta that applydelta turns the old tree into the new one
+ * with (see tools/delta/delta.h). A changed file is sent as the ranges it
+ * shares with its old version, found with a rolling checksum as rsync
+ * does, and the bytes that are new.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <sha256.h>
+#include "delta/delta.h"
+
+#define TAR_BLOCK		512
+#define DEFAULT_MATCH_BLOCK	1024
+#define MAX_CANDIDATES		16
+#define MAX_EXCLUDES		16
+
+#define ALIGN_UP(n, a)		(((n) + (a) - 1) / (a) * (a))
+
+struct entry {
+	char *path;
+	char type;		/* tar typeflag */
+	int index;		/* in the tarball; the last of a path wins */
+	uint32_t mode, uid, gid;
+	uint64_t mtime, size;
+	const uint8_t *data;
+	char *link;
+	uint32_t major, minor;
+	int changed;		/* a DELTA_FILE was written for it */
+};
+
+struct tree {
+	const char *name;
+	uint8_t *map;
+	size_t size;
+	struct entry *entries;
+	int count;
+};
+
+struct op {
+	int type;
+	uint64_t offset;	/* in the old file, or the new one for data */
+	uint64_t len;
+};
+
+static uint32_t match_block = DEFAULT_MATCH_BLOCK;
+static const char *excludes[MAX_EXCLUDES];
+static int nexcludes;
+
+static FILE *out;
+static sha256_context out_ctx;
+
+static struct op *ops;
+static int nops, max_ops;
+
+static struct {
+	int deleted, dirs, files, patched, links, nodes, meta;
+	uint64_t copied, data;
+} stats;
+
+static void usage(const char *prg)
+{
+	fprintf(stderr,
+		"Usage: %s [-b <block size>] [-x <path>]... [-o <outfile>] "
+		"<old tar> <new tar>\n"
+		"Write the delta that turns the root filesystem in <old tar> "
+		"into the one\n"
+		"in <new tar>\n"
+		"\n"
+		"  -b <size>    smallest run of old bytes to reuse "
+		"(default %u)\n"
+		"  -x <path>    do not expect <path>, or what is below it, to "
+		"be on the\n"
+		"               target as in <old tar>: send changed files "
+		"whole and\n"
+		"               do not delete anything there\n"
+		"  -o <file>    write the delta there instead of stdout\n",
+		prg, DEFAULT_MATCH_BLOCK);
+}
+
+static uint64_t tar_num(const uint8_t *p, int len)
+{
+	uint64_t val = 0;
+	int i = 0;
+
+	/* GNU base-256 for values that do not fit in octal */
+	if (*p & 0x80) {
+		val = *p & 0x3f;
+		for (i = 1; i < len; i++)
+			val = val << 8 | p[i];
+		return val;
+	}
+
+	while (i < len && p[i] == ' ')
+		i++;
+	for (; i < len && p[i] >= '0' && p[i] <= '7'; i++)
+		val = val * 8 + p[i] - '0';
+
+	return val;
+}
+
+static int tar_checksum_ok(const uint8_t *hdr)
+{
+	uint32_t sum = 0;
+	int i;
+
+	for (i = 0; i < TAR_BLOCK; i++)
+		sum += i >= 148 && i < 156 ? ' ' : hdr[i];
+
+	return sum == tar_num(hdr + 148, 8);
+}
+
+/* Drop leading "./" and "/" and trailing "/" */
+static char *tar_path(const char *name)
+{
+	char *path;
+	int len;
+
+	for (;;) {
+		if (name[0] == '/')
+			name++;
+		else if (name[0] == '.' && name[1] == '/')
+			name += 2;
+		else
+			break;
+	}
+	path = strdup(name);
+	if (!path)
+		return NULL;
+	len = strlen(path);
+	while (len && path[len - 1] == '/')
+		path[--len] = '\0';
+	if (!strcmp(path, "."))
+		path[0] = '\0';
+
+	return path;
+}
+
+/* The path and linkpath of a pax extended header */
+static void pax_parse(const uint8_t *data, uint64_t size, char **path,
+		      char **link)
+{
+	const char *p = (const char *)data, *end = p + size;
+	char *rec_end, *key, *eq;
+	unsigned long len;
+
+	while (p < end) {
+		len = strtoul(p, &rec_end, 10);
+		if (!len || p + len > end || *rec_end != ' ')
+			break;
+		key = rec_end + 1;
+		eq = memchr(key, '=', p + len - key);
+		if (eq && p[len - 1] == '\n') {
+			char **val = NULL;
+
+			if (eq - key == 4 && !strncmp(key, "path", 4))
+				val = path;
+			else if (eq - key == 8 && !strncmp(key, "linkpath", 8))
+				val = link;
+			if (val) {
+				free(*val);
+				*val = strndup(eq + 1, p + len - 1 - eq - 1);
+			}
+		}
+		p += len;
+	}
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+	const struct entry *ea = a, *eb = b;
+	int ret = strcmp(ea->path, eb->path);
+
+	return ret ? ret : ea->index - eb->index;
+}
+
+static int load_tree(struct tree *t, const char *name)
+{
+	char *long_name = NULL, *long_link = NULL;
+	const uint8_t *hdr;
+	struct stat st;
+	uint64_t off = 0;
+	int fd, i, n;
+
+	t->name = name;
+	fd = open(name, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Can't open %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+	t->size = st.st_size;
+	t->map = mmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (t->map == MAP_FAILED) {
+		fprintf(stderr, "Can't map %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	while (off + TAR_BLOCK <= t->size) {
+		struct entry *e;
+		char buf[256 + 1];
+		uint64_t size;
+		char type;
+
+		hdr = t->map + off;
+		if (!hdr[0])
+			break;			/* end of archive */
+		if (!tar_checksum_ok(hdr)) {
+			fprintf(stderr, "%s: bad tar header at %llu\n", name,
+				(unsigned long long)off);
+			return -1;
+		}
+		size = tar_num(hdr + 124, 12);
+		type = hdr[156] ? hdr[156] : '0';
+		if (off + TAR_BLOCK + size > t->size) {
+			fprintf(stderr, "%s is truncated\n", name);
+			return -1;
+		}
+		off += TAR_BLOCK;
+
+		switch (type) {
+		case 'L':
+			free(long_name);
+			long_name = strndup((char *)t->map + off, size);
+			break;
+		case 'K':
+			free(long_link);
+			long_link = strndup((char *)t->map + off, size);
+			break;
+		case 'x':
+			pax_parse(t->map + off, size, &long_name, &long_link);
+			break;
+		case 'g':
+			break;
+		default:
+			e = realloc(t->entries, (t->count + 1) * sizeof(*e));
+			if (!e) {
+				fprintf(stderr, "Out of memory\n");
+				return -1;
+			}
+			t->entries = e;
+			e += t->count;
+			memset(e, 0, sizeof(*e));
+			e->index = t->count++;
+
+			if (long_name) {
+				e->path = tar_path(long_name);
+			} else {
+				n = 0;
+				if (hdr[345] && !memcmp(hdr + 257, "ustar", 5))
+					n = sprintf(buf, "%.155s/",
+						    (char *)hdr + 345);
+				sprintf(buf + n, "%.100s", (char *)hdr);
+				e->path = tar_path(buf);
+			}
+			if (long_link) {
+				e->link = tar_path(long_link);
+			} else {
+				sprintf(buf, "%.100s", (char *)hdr + 157);
+				e->link = type == '1' ? tar_path(buf) :
+					strdup(buf);
+			}
+			free(long_name);
+			free(long_link);
+			long_name = long_link = NULL;
+
+			e->type = type == '7' ? '0' : type;
+			e->mode = tar_num(hdr + 100, 8) & 07777;
+			e->uid = tar_num(hdr + 108, 8);
+			e->gid = tar_num(hdr + 116, 8);
+			e->mtime = tar_num(hdr + 136, 12);
+			e->major = tar_num(hdr + 329, 8);
+			e->minor = tar_num(hdr + 337, 8);
+			if (e->type == '0') {
+				e->size = size;
+				e->data = t->map + off;
+			}
+			if (!e->path || !e->link) {
+				fprintf(stderr, "Out of memory\n");
+				return -1;
+			}
+			break;
+		}
+		off += ALIGN_UP(size, TAR_BLOCK);
+	}
+
+	/* Sort by path, keeping only the last entry of each */
+	qsort(t->entries, t->count, sizeof(*t->entries), entry_cmp);
+	for (i = 0, n = 0; i < t->count; i++) {
+		if (!t->entries[i].path[0])
+			continue;		/* the root itself */
+		if (i + 1 < t->count &&
+		    !strcmp(t->entries[i].path, t->entries[i + 1].path))
+			continue;
+		t->entries[n++] = t->entries[i];
+	}
+	t->count = n;
+
+	return 0;
+}
+
+static struct entry *find_entry(struct tree *t, const char *path)
+{
+	int lo = 0, hi = t->count - 1, mid, cmp;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		cmp = strcmp(path, t->entries[mid].path);
+		if (!cmp)
+			return &t->entries[mid];
+		if (cmp < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+static int is_excluded(const char *path)
+{
+	int i, len;
+
+	for (i = 0; i < nexcludes; i++) {
+		len = strlen(excludes[i]);
+		if (!strncmp(path, excludes[i], len) &&
+		    (!path[len] || path[len] == '/'))
+			return 1;
+	}
+
+	return 0;
+}
+
+static void put(const void *buf, size_t len)
+{
+	sha256_update(&out_ctx, buf, len);
+	fwrite(buf, len, 1, out);
+}
+
+static void put_u8(uint8_t val)
+{
+	put(&val, 1);
+}
+
+static void put_u16(uint16_t val)
+{
+	uint8_t buf[2] = { val, val >> 8 };
+
+	put(buf, 2);
+}
+
+static void put_u32(uint32_t val)
+{
+	put_u16(val);
+	put_u16(val >> 16);
+}
+
+static void put_u64(uint64_t val)
+{
+	put_u32(val);
+	put_u32(val >> 32);
+}
+
+static void put_path(const char *path)
+{
+	put_u16(strlen(path));
+	put(path, strlen(path));
+}
+
+static void put_owner(const struct entry *e, int with_mode)
+{
+	if (with_mode)
+		put_u32(e->mode);
+	put_u32(e->uid);
+	put_u32(e->gid);
+}
+
+static int add_op(int type, uint64_t offset, uint64_t len)
+{
+	struct op *op;
+
+	if (!len)
+		return 0;
+	/* Merge copies of consecutive old bytes */
+	if (type == DELTA_OP_COPY && nops &&
+	    ops[nops - 1].type == DELTA_OP_COPY &&
+	    ops[nops - 1].offset + ops[nops - 1].len == offset) {
+		ops[nops - 1].len += len;
+		return 0;
+	}
+	if (nops == max_ops) {
+		max_ops = max_ops ? 2 * max_ops : 256;
+		op = realloc(ops, max_ops * sizeof(*ops));
+		if (!op)
+			return -1;
+		ops = op;
+	}
+	ops[nops].type = type;
+	ops[nops].offset = offset;
+	ops[nops].len = len;
+	nops++;
+
+	return 0;
+}
+
+static uint32_t weak_sum(const uint8_t *p, uint32_t len)
+{
+	uint32_t a = 0, b = 0, i;
+
+	for (i = 0; i < len; i++) {
+		a += p[i];
+		b += (len - i) * p[i];
+	}
+
+	return (a & 0xffff) | b << 16;
+}
+
+/*
+ * Find what new shares with old, as rsync does: hash each match_block of
+ * the old file, then roll the same checksum over every offset of the new
+ * one. A block that matches is grown both ways as far as the bytes agree.
+ * Leaves the ops in ops[]; returns the number of new bytes they hold.
+ */
+static int64_t diff_file(const struct entry *old, const struct entry *new)
+{
+	const uint8_t *o = old->data, *n = new->data;
+	uint64_t osize = old->size, nsize = new->size;
+	uint64_t blocks = osize / match_block;
+	uint32_t buckets, *head, *next, s, a, b;
+	uint64_t pos = 0, lit = 0, data = 0, k, mo, mn, bo, bn;
+	int found, tries;
+
+	nops = 0;
+	if (!blocks || nsize < match_block)
+		return add_op(DELTA_OP_DATA, 0, nsize) ? -1 : nsize;
+
+	for (buckets = 1; buckets < 2 * blocks; buckets <<= 1)
+		;
+	head = malloc(buckets * sizeof(*head));
+	next = malloc(blocks * sizeof(*next));
+	if (!head || !next) {
+		free(head);
+		free(next);
+		return -1;
+	}
+	memset(head, 0xff, buckets * sizeof(*head));
+	for (k = blocks; k-- > 0; ) {
+		s = weak_sum(o + k * match_block, match_block);
+		next[k] = head[s & (buckets - 1)];
+		head[s & (buckets - 1)] = k;
+	}
+
+	s = weak_sum(n, match_block);
+	while (pos + match_block <= nsize) {
+		found = 0;
+		tries = 0;
+		for (k = head[s & (buckets - 1)];
+		     k != 0xffffffff && tries < MAX_CANDIDATES;
+		     k = next[k], tries++) {
+			if (!memcmp(o + k * match_block, n + pos,
+				    match_block)) {
+				found = 1;
+				break;
+			}
+		}
+
+		if (found) {
+			mo = k * match_block + match_block;
+			mn = pos + match_block;
+			while (mn < nsize && mo < osize && o[mo] == n[mn]) {
+				mo++;
+				mn++;
+			}
+			bo = k * match_block;
+			bn = pos;
+			while (bn > lit && bo > 0 && o[bo - 1] == n[bn - 1]) {
+				bo--;
+				bn--;
+			}
+			if (add_op(DELTA_OP_DATA, lit, bn - lit) ||
+			    add_op(DELTA_OP_COPY, bo, mn - bn))
+				goto oom;
+			data += bn - lit;
+			pos = lit = mn;
+			if (pos + match_block <= nsize)
+				s = weak_sum(n + pos, match_block);
+			continue;
+		}
+
+		if (pos + match_block < nsize) {
+			a = (s & 0xffff) - n[pos] + n[pos + match_block];
+			b = (s >> 16) - match_block * n[pos] + a;
+			s = (a & 0xffff) | b << 16;
+		}
+		pos++;
+	}
+	if (add_op(DELTA_OP_DATA, lit, nsize - lit))
+		goto oom;
+	data += nsize - lit;
+
+	free(head);
+	free(next);
+	return data;
+
+oom:
+	free(head);
+	free(next);
+	return -1;
+}
+
+static void file_sum(const struct entry *e, uint8_t *sum)
+{
+	sha256_csum_wd(e->data, e->size, sum, CHUNKSZ_SHA256);
+}
+
+static int same_data(const struct entry *a, const struct entry *b)
+{
+	return a->size == b->size && !memcmp(a->data, b->data, a->size);
+}
+
+/*
+ * Send a file as a patch of its old version when that saves at least a
+ * tenth of it, and the target is expected to have the old version.
+ */
+static int put_file(struct entry *old, struct entry *new)
+{
+	uint8_t sum[DELTA_SUM_LEN];
+	int64_t data = -1;
+	int i;
+
+	if (old && !is_excluded(new->path) && old->size) {
+		data = diff_file(old, new);
+		if (data < 0) {
+			fprintf(stderr, "Out of memory\n");
+			return -1;
+		}
+		if (data > new->size - new->size / 10)
+			data = -1;
+	}
+	if (data < 0) {
+		nops = 0;
+		if (add_op(DELTA_OP_DATA, 0, new->size)) {
+			fprintf(stderr, "Out of memory\n");
+			return -1;
+		}
+	}
+
+	put_u8(DELTA_FILE);
+	put_path(new->path);
+	put_owner(new, 1);
+	put_u64(new->mtime);
+	put_u64(new->size);
+	file_sum(new, sum);
+	put(sum, sizeof(sum));
+	put_u8(data >= 0);
+	if (data >= 0) {
+		file_sum(old, sum);
+		put(sum, sizeof(sum));
+		stats.patched++;
+	}
+
+	for (i = 0; i < nops; i++) {
+		put_u8(ops[i].type);
+		if (ops[i].type == DELTA_OP_COPY) {
+			put_u64(ops[i].offset);
+			put_u32(ops[i].len);
+			stats.copied += ops[i].len;
+		} else {
+			put_u32(ops[i].len);
+			put(new->data + ops[i].offset, ops[i].len);
+			stats.data += ops[i].len;
+		}
+	}
+	put_u8(DELTA_OP_END);
+	new->changed = 1;
+	stats.files++;
+
+	return 0;
+}
+
+static int is_dir(const struct entry *e)
+{
+	return e && e->type == '5';
+}
+
+static int is_file(const struct entry *e)
+{
+	return e && (e->type == '0' || e->type == '1');
+}
+
+static int write_delta(struct tree *old_tree, struct tree *new_tree)
+{
+	uint8_t sum[DELTA_SUM_LEN];
+	struct entry *old, *new;
+	int i;
+
+	sha256_starts(&out_ctx);
+	put(DELTA_MAGIC, DELTA_MAGIC_LEN);
+	put_u32(DELTA_VERSION);
+
+	/* Deletions, children first */
+	for (i = old_tree->count - 1; i >= 0; i--) {
+		old = &old_tree->entries[i];
+		new = find_entry(new_tree, old->path);
+		if (is_excluded(old->path) ||
+		    (new && is_dir(old) == is_dir(new)))
+			continue;
+		put_u8(DELTA_DELETE);
+		put_path(old->path);
+		stats.deleted++;
+	}
+
+	/* New directories, parents first */
+	for (i = 0; i < new_tree->count; i++) {
+		new = &new_tree->entries[i];
+		old = find_entry(old_tree, new->path);
+		if (!is_dir(new) || is_dir(old))
+			continue;
+		put_u8(DELTA_DIR);
+		put_path(new->path);
+		put_owner(new, 1);
+		stats.dirs++;
+	}
+
+	for (i = 0; i < new_tree->count; i++) {
+		new = &new_tree->entries[i];
+		old = find_entry(old_tree, new->path);
+		if (old && old->type != new->type &&
+		    !(is_file(old) && new->type == '0'))
+			old = NULL;
+
+		switch (new->type) {
+		case '0':
+			if (old && old->type == '0' && same_data(old, new))
+				break;
+			if (put_file(old && old->type == '0' ? old : NULL,
+				     new))
+				return -1;
+			continue;
+		case '2':
+			if (old && !strcmp(old->link, new->link))
+				break;
+			put_u8(DELTA_SYMLINK);
+			put_path(new->path);
+			put_owner(new, 0);
+			put_path(new->link);
+			stats.links++;
+			continue;
+		case '3':
+		case '4':
+		case '6':
+			if (old && old->major == new->major &&
+			    old->minor == new->minor)
+				break;
+			put_u8(DELTA_NODE);
+			put_path(new->path);
+			put_u32(new->mode | (new->type == '3' ? S_IFCHR :
+					     new->type == '4' ? S_IFBLK :
+					     S_IFIFO));
+			put_owner(new, 0);
+			put_u32(new->major);
+			put_u32(new->minor);
+			stats.nodes++;
+			continue;
+		default:
+			continue;
+		}
+	}
+
+	/* Metadata of what is otherwise unchanged; mtimes are left alone */
+	for (i = 0; i < new_tree->count; i++) {
+		new = &new_tree->entries[i];
+		old = find_entry(old_tree, new->path);
+		if (!old || new->changed || new->type == '1' ||
+		    old->type != new->type || is_excluded(new->path) ||
+		    (old->mode == new->mode && old->uid == new->uid &&
+		     old->gid == new->gid))
+			continue;
+		if (new->type == '2' && strcmp(old->link, new->link))
+			continue;
+		put_u8(DELTA_META);
+		put_path(new->path);
+		put_owner(new, 1);
+		stats.meta++;
+	}
+
+	/* Hard links, which must be made again when their target changed */
+	for (i = 0; i < new_tree->count; i++) {
+		struct entry *target;
+
+		new = &new_tree->entries[i];
+		if (new->type != '1')
+			continue;
+		old = find_entry(old_tree, new->path);
+		target = find_entry(new_tree, new->link);
+		if (old && old->type == '1' && !strcmp(old->link, new->link) &&
+		    !(target && target->changed))
+			continue;
+		put_u8(DELTA_HARDLINK);
+		put_path(new->path);
+		put_path(new->link);
+		stats.links++;
+	}
+
+	put_u8(DELTA_END);
+	sha256_finish(&out_ctx, sum);
+	fwrite(sum, sizeof(sum), 1, out);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *prg = basename(argv[0]);
+	const char *out_name = NULL;
+	struct tree old_tree, new_tree;
+	int option;
+
+	while ((option = getopt(argc, argv, "b:x:o:h")) != -1) {
+		switch (option) {
+		case 'b':
+			match_block = strtoul(optarg, NULL, 0);
+			break;
+		case 'x':
+			if (nexcludes == MAX_EXCLUDES) {
+				fprintf(stderr, "Too many -x\n");
+				return EXIT_FAILURE;
+			}
+			excludes[nexcludes++] = tar_path(optarg);
+			break;
+		case 'o':
+			out_name = optarg;
+			break;
+		case 'h':
+			usage(prg);
+			return EXIT_SUCCESS;
+		default:
+			usage(prg);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind != 2 || match_block < 64) {
+		usage(prg);
+		return EXIT_FAILURE;
+	}
+
+	memset(&old_tree, 0, sizeof(old_tree));
+	memset(&new_tree, 0, sizeof(new_tree));
+	if (load_tree(&old_tree, argv[optind]) ||
+	    load_tree(&new_tree, argv[optind + 1]))
+		return EXIT_FAILURE;
+
+	out = out_name ? fopen(out_name, "wb") : stdout;
+	if (!out) {
+		fprintf(stderr, "Can't create %s: %s\n", out_name,
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if (write_delta(&old_tree, &new_tree) || fflush(out) || ferror(out) ||
+	    (out_name && fclose(out))) {
+		fprintf(stderr, "Can't write the delta\n");
+		if (out_name)
+			unlink(out_name);
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stderr, "%d deleted, %d directories, %d files (%d patched), "
+		"%d links, %d nodes, %d changed metadata\n"
+		"%llu bytes reused, %llu bytes sent\n",
+		stats.deleted, stats.dirs, stats.files, stats.patched,
+		stats.links, stats.nodes, stats.meta,
+		(unsigned long long)stats.copied,
+		(unsigned long long)stats.data);
+
+	return EXIT_SUCCESS;
+}
@@ -184,11 +184,27 @@ main (int argc, char **argv)
 					genimg_get_comp_id (*++argv)) < 0)
 					usage ();
 				goto NXTARG;
+			case 'B':
+				if (--argc <= 0)
+					usage();
+				params.data_align = strtoul(*++argv, &ptr, 16);
+				if (*ptr || params.data_align < 4 ||
+				    (params.data_align &
+				     (params.data_align - 1))) {
+					fprintf(stderr,
+						"%s: invalid alignment %s\n",
+						params.cmdname, *argv);
+					exit(EXIT_FAILURE);
+				}
+				goto NXTARG;
 			case 'D':
 				if (--argc <= 0)
 					usage ();
 				params.dtc = *++argv;
 				goto NXTARG;
+			case 'E':
+				params.external_data = 1;
+				break;
 
 			case 'O':
 				if ((--argc <= 0) ||
@@ -650,10 +666,12 @@ usage ()
 			 "          -d ==> use image data from 'datafile'\n"
 			 "          -x ==> set XIP (execute in place)\n",
 		params.cmdname);
-	fprintf(stderr, "       %s [-D dtc_options] [-f fit-image.its|-F] fit-image\n",
+	fprintf(stderr, "       %s [-D dtc_options] [-f fit-image.its|-F] [-E [-B align]] fit-image\n",
 		params.cmdname);
 	fprintf(stderr, "          -D => set options for device tree compiler\n"
-			"          -f => input filename for FIT source\n");
+			"          -f => input filename for FIT source\n"
+			"          -E => put image data after the FIT structure\n"
+			"          -B => align external data to 'align' bytes (hex)\n");
 #ifdef CONFIG_FIT_SIGNATURE
 	fprintf(stderr, "Signing / verified boot options: [-k keydir] [-K dtb] [ -c <comment>] [-r]\n"
 			"          -k => set directory containing private keys\n"
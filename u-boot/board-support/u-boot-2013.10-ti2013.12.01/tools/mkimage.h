@@ -78,6 +78,8 @@ struct mkimage_params {
 	const char *keydest;	/* Destination .dtb for public key */
 	const char *comment;	/* Comment to add to signature node */
 	int require_keys;	/* 1 to mark signing keys as 'required' */
+	int external_data;	/* 1 to put FIT image data after the FIT */
+	unsigned int data_align; /* Alignment of external data in the file */
 };
 
 /*
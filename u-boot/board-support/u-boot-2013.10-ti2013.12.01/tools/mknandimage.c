@@ -0,0 +1,435 @@
+/*
+ * NAND image generator for the OMAP GPMC
+ *
+ * Builds a raw image of a NAND chip from the files that go into its
+ * partitions: each page is followed by its spare area, holding the BCH8
+ * ECC the GPMC computes with OMAP_ECC_BCH8_CODE_HW. A gang programmer
+ * can then write the image as it is, without computing ECC itself.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <linux/bch.h>
+#include "parse_size.h"
+
+#ifndef __ASSEMBLY__
+#define	__ASSEMBLY__			/* Dirty trick to get only #defines	*/
+#endif
+#define	__ASM_STUB_PROCESSOR_H__	/* don't include asm/processor.		*/
+#include <config.h>
+#undef	__ASSEMBLY__
+
+#ifndef CONFIG_SYS_NAND_PAGE_SIZE
+#define CONFIG_SYS_NAND_PAGE_SIZE	2048
+#endif
+#ifndef CONFIG_SYS_NAND_OOBSIZE
+#define CONFIG_SYS_NAND_OOBSIZE		64
+#endif
+#ifndef CONFIG_SYS_NAND_BLOCK_SIZE
+#define CONFIG_SYS_NAND_BLOCK_SIZE	(128 * 1024)
+#endif
+#ifndef MTDPARTS_DEFAULT
+#define MTDPARTS_DEFAULT		NULL
+#endif
+
+/* GPMC BCH8 constants, as in drivers/mtd/nand/omap_gpmc.c */
+#define BADBLOCK_MARKER_LENGTH	2
+#define SECTOR_BYTES		512
+#define BCH8_ECC_BYTES		13	/* computed by the BCH engine */
+#define BCH8_OOB_BYTES		14	/* 14th byte is 0 to match ROM layout */
+
+#define MAX_PARTS		32
+#define MAX_INPUTS		32
+
+struct nand_part {
+	char name[32];
+	uint64_t offset;
+	uint64_t size;		/* 0 up to the end of the chip */
+};
+
+struct nand_input {
+	const char *file;
+	int fd;
+	uint64_t offset;
+	uint64_t size;
+};
+
+static uint32_t page_size = CONFIG_SYS_NAND_PAGE_SIZE;
+static uint32_t oob_size = CONFIG_SYS_NAND_OOBSIZE;
+static uint32_t block_size = CONFIG_SYS_NAND_BLOCK_SIZE;
+static uint64_t chip_size;
+
+static struct nand_part parts[MAX_PARTS];
+static int nparts;
+static struct nand_input inputs[MAX_INPUTS];
+static int ninputs;
+
+static void usage(const char *prg)
+{
+	fprintf(stderr,
+		"Usage: %s [-p <page size>] [-o <oob size>] [-e <erase size>]\n"
+		"       [-s <chip size>] [-m <mtdparts>] <outfile> "
+		"<part>[,<part>...]=<file> ...\n"
+		"Build a raw NAND image, each page followed by its OOB with\n"
+		"the ECC of the OMAP GPMC in BCH8 mode\n"
+		"\n"
+		"  <part>       partition name from mtdparts, or an offset\n"
+		"  <file>       file to write there, padded with 0xff;\n"
+		"               list several partitions to write copies of it\n"
+		"  -p <size>    NAND page size (default %u)\n"
+		"  -o <size>    NAND OOB size (default %u)\n"
+		"  -e <size>    NAND erase size (default %u)\n"
+		"  -s <size>    chip size; the image stops after the last\n"
+		"               file if not given\n"
+		"  -m <parts>   partitions, as in the mtdparts variable\n"
+		"               (default \"%s\")\n"
+		"\n"
+		"Pages left at 0xff are left erased, OOB included, so that\n"
+		"UBI and the environment can be written later.\n",
+		prg, CONFIG_SYS_NAND_PAGE_SIZE, CONFIG_SYS_NAND_OOBSIZE,
+		CONFIG_SYS_NAND_BLOCK_SIZE,
+		MTDPARTS_DEFAULT ? MTDPARTS_DEFAULT : "");
+}
+
+/* Take the partitions of the first device in an mtdparts string */
+static int parse_mtdparts(const char *s)
+{
+	uint64_t offset = 0;
+	const char *p;
+	char *end;
+	int len;
+
+	p = strchr(s, ':');
+	if (!p)
+		return -1;
+	p++;
+
+	nparts = 0;
+	while (*p && *p != ';') {
+		struct nand_part *part = &parts[nparts];
+
+		if (nparts == MAX_PARTS)
+			return -1;
+		if (*p == '-') {
+			part->size = 0;
+			end = (char *)p + 1;
+		} else {
+			part->size = parse_size(p, &end);
+		}
+		if (*end == '@')
+			offset = parse_size(end + 1, &end);
+		if (*end != '(')
+			return -1;
+		p = end + 1;
+		end = strchr(p, ')');
+		len = end ? end - p : 0;
+		if (!len || len >= sizeof(part->name))
+			return -1;
+		memcpy(part->name, p, len);
+		part->name[len] = '\0';
+		part->offset = offset;
+		offset += part->size;
+		nparts++;
+
+		p = end + 1;
+		if (!strncmp(p, "ro", 2))
+			p += 2;
+		if (*p == ',')
+			p++;
+	}
+
+	return 0;
+}
+
+static struct nand_part *find_part(const char *name, int len)
+{
+	int i;
+
+	for (i = 0; i < nparts; i++) {
+		if (strlen(parts[i].name) == len &&
+		    !strncmp(parts[i].name, name, len))
+			return &parts[i];
+	}
+
+	return NULL;
+}
+
+/* Add <part>[,<part>...]=<file>: one input for each copy of the file */
+static int add_input(const char *arg)
+{
+	const char *file, *name, *next;
+	struct stat st;
+	int fd;
+
+	file = strchr(arg, '=');
+	if (!file) {
+		fprintf(stderr, "Missing '=<file>' in %s\n", arg);
+		return -1;
+	}
+	file++;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Can't open %s: %s\n", file, strerror(errno));
+		return -1;
+	}
+
+	for (name = arg; name < file; name = next + 1) {
+		struct nand_input *in = &inputs[ninputs];
+		struct nand_part *part;
+		uint64_t space;
+		int len;
+
+		next = strpbrk(name, ",=");
+		len = next - name;
+		if (ninputs == MAX_INPUTS) {
+			fprintf(stderr, "Too many files\n");
+			return -1;
+		}
+
+		if (isdigit(*name)) {
+			in->offset = parse_size(name, NULL);
+			space = 0;
+		} else {
+			part = find_part(name, len);
+			if (!part) {
+				fprintf(stderr, "No partition %.*s\n", len,
+					name);
+				return -1;
+			}
+			in->offset = part->offset;
+			space = part->size;
+		}
+
+		if (in->offset % block_size) {
+			fprintf(stderr, "%.*s does not start on a block\n",
+				len, name);
+			return -1;
+		}
+		if (space && st.st_size > space) {
+			fprintf(stderr, "%s does not fit in %.*s (%llu bytes)\n",
+				file, len, name, (unsigned long long)space);
+			return -1;
+		}
+		in->file = file;
+		in->fd = fd;
+		in->size = st.st_size;
+		ninputs++;
+	}
+
+	return 0;
+}
+
+static int check_inputs(void)
+{
+	uint64_t end = 0;
+	int i, j;
+
+	for (i = 0; i < ninputs; i++) {
+		struct nand_input *in = &inputs[i];
+
+		if (chip_size && in->offset + in->size > chip_size) {
+			fprintf(stderr, "%s goes past the end of the chip\n",
+				in->file);
+			return -1;
+		}
+		for (j = 0; j < i; j++) {
+			if (in->offset < inputs[j].offset + inputs[j].size &&
+			    inputs[j].offset < in->offset + in->size) {
+				fprintf(stderr, "%s overlaps %s\n", in->file,
+					inputs[j].file);
+				return -1;
+			}
+		}
+		if (in->offset + in->size > end)
+			end = in->offset + in->size;
+	}
+
+	/* Without a chip size, stop after the last block written */
+	if (!chip_size)
+		chip_size = (end + block_size - 1) / block_size * block_size;
+
+	return 0;
+}
+
+/* Read what the files hold for a page; return 0 if there is nothing */
+static int read_page(uint64_t offset, uint8_t *buf)
+{
+	int found = 0;
+	int i;
+
+	memset(buf, 0xff, page_size);
+	for (i = 0; i < ninputs; i++) {
+		struct nand_input *in = &inputs[i];
+		uint64_t len;
+
+		if (offset < in->offset || offset >= in->offset + in->size)
+			continue;
+		len = in->offset + in->size - offset;
+		if (len > page_size)
+			len = page_size;
+		if (pread(in->fd, buf, len, offset - in->offset) != len) {
+			fprintf(stderr, "Can't read %s: %s\n", in->file,
+				strerror(errno));
+			return -1;
+		}
+		found = 1;
+	}
+
+	return found;
+}
+
+static int is_erased(const uint8_t *buf, int len)
+{
+	while (len--) {
+		if (*buf++ != 0xff)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Fill in the OOB as omap_gpmc.c does with OMAP_ECC_BCH8_CODE_HW: the
+ * bad block marker, then 14 bytes for each 512-byte sector. The GPMC
+ * gives the complement of the BCH remainder lib/bch.c computes (compare
+ * encode_bch() of an erased sector with bch8_polynomial in omap_gpmc.c),
+ * and the 14th byte is left zero.
+ */
+static void page_ecc(struct bch_control *bch, const uint8_t *data,
+		     uint8_t *oob)
+{
+	uint8_t *ecc = oob + BADBLOCK_MARKER_LENGTH;
+	int sector, i;
+
+	for (sector = 0; sector < page_size / SECTOR_BYTES; sector++) {
+		memset(ecc, 0, BCH8_OOB_BYTES);
+		encode_bch(bch, data + sector * SECTOR_BYTES, SECTOR_BYTES,
+			   ecc);
+		for (i = 0; i < BCH8_ECC_BYTES; i++)
+			ecc[i] = ~ecc[i];
+		ecc += BCH8_OOB_BYTES;
+	}
+}
+
+static int write_image(FILE *out)
+{
+	struct bch_control *bch;
+	uint64_t offset;
+	uint8_t *buf;
+	int ret = -1;
+	int found;
+
+	bch = init_bch(13, 8, 0x201b);
+	buf = malloc(page_size + oob_size);
+	if (!bch || !buf) {
+		fprintf(stderr, "Can't set up BCH8\n");
+		goto out;
+	}
+
+	for (offset = 0; offset < chip_size; offset += page_size) {
+		found = read_page(offset, buf);
+		if (found < 0)
+			goto out;
+		memset(buf + page_size, 0xff, oob_size);
+		if (found && !is_erased(buf, page_size))
+			page_ecc(bch, buf, buf + page_size);
+		if (fwrite(buf, page_size + oob_size, 1, out) != 1) {
+			fprintf(stderr, "Write error: %s\n", strerror(errno));
+			goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	free(buf);
+	if (bch)
+		free_bch(bch);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	const char *mtdparts = MTDPARTS_DEFAULT;
+	const char *prg = basename(argv[0]);
+	FILE *out;
+	int option;
+	int i;
+
+	while ((option = getopt(argc, argv, "p:o:e:s:m:h")) != -1) {
+		switch (option) {
+		case 'p':
+			page_size = parse_size(optarg, NULL);
+			break;
+		case 'o':
+			oob_size = parse_size(optarg, NULL);
+			break;
+		case 'e':
+			block_size = parse_size(optarg, NULL);
+			break;
+		case 's':
+			chip_size = parse_size(optarg, NULL);
+			break;
+		case 'm':
+			mtdparts = optarg;
+			break;
+		case 'h':
+			usage(prg);
+			return EXIT_SUCCESS;
+		default:
+			usage(prg);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind < 2) {
+		usage(prg);
+		return EXIT_FAILURE;
+	}
+
+	if (!page_size || page_size % SECTOR_BYTES ||
+	    !block_size || block_size % page_size ||
+	    BADBLOCK_MARKER_LENGTH + page_size / SECTOR_BYTES *
+	    BCH8_OOB_BYTES > oob_size) {
+		fprintf(stderr, "Bad NAND geometry\n");
+		return EXIT_FAILURE;
+	}
+
+	if (mtdparts && parse_mtdparts(mtdparts)) {
+		fprintf(stderr, "Can't parse mtdparts %s\n", mtdparts);
+		return EXIT_FAILURE;
+	}
+
+	for (i = optind + 1; i < argc; i++) {
+		if (add_input(argv[i]))
+			return EXIT_FAILURE;
+	}
+	if (check_inputs())
+		return EXIT_FAILURE;
+
+	out = fopen(argv[optind], "wb");
+	if (!out) {
+		fprintf(stderr, "Can't create %s: %s\n", argv[optind],
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if (write_image(out) || fclose(out)) {
+		unlink(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,1015 @@
+/*
+ * SD card image generator
+ *
+ * Builds an SD card image without root, loop devices or mkfs: an MBR, a
+ * bootable FAT32 partition holding the given files, MLO first, and a
+ * partition holding an ext2/3/4 filesystem image. Only the blocks that
+ * mean something are written, the rest is left as holes in the output,
+ * and a bmap of the written blocks lets the card be flashed without
+ * writing the holes.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <sha256.h>
+#include "parse_size.h"
+
+#define SECTOR_SIZE		512
+#define PART_ALIGN		(1024 * 1024)
+#define BMAP_BLOCK_SIZE		4096
+#define COPY_CHUNK		(1024 * 1024)
+#define MAX_FILES		32
+
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+
+/* MBR partition types */
+#define PART_TYPE_FAT32_LBA	0x0c
+#define PART_TYPE_LINUX		0x83
+
+/* FAT32 layout, as mkfs.vfat -F 32 does it */
+#define FAT_RESERVED_SECTORS	32
+#define FAT_NUM_FATS		2
+#define FAT_FSINFO_SECTOR	1
+#define FAT_BACKUP_SECTOR	6
+#define FAT_ROOT_CLUSTER	2
+#define FAT_MIN_CLUSTERS	65525
+#define FAT_MEDIA		0xf8
+#define FAT_EOC			0x0fffffff
+#define DIR_ENTRY_SIZE		32
+#define LFN_CHARS		13
+
+#define ATTR_VOLUME_ID		0x08
+#define ATTR_ARCHIVE		0x20
+#define ATTR_LFN		0x0f
+
+/* The parts of an ext2 superblock and group descriptor we need */
+#define EXT2_SB_OFFSET		1024
+#define EXT2_MAGIC		0xef53
+#define EXT4_FEATURE_INCOMPAT_64BIT	0x0080
+#define EXT4_BG_BLOCK_UNINIT	0x0002
+
+struct boot_file {
+	char name[256];		/* long name in the FAT */
+	const char *path;
+	uint64_t size;
+	time_t mtime;
+	uint8_t short_name[11];
+	int lfn_entries;	/* long name entries before the short one */
+	uint32_t cluster;	/* first cluster, 0 if empty */
+};
+
+struct fat_layout {
+	uint64_t offset;	/* of the partition in the image */
+	uint32_t sectors;
+	uint32_t cluster_sectors;
+	uint32_t fat_sectors;
+	uint32_t clusters;
+	uint32_t root_clusters;
+	uint32_t next_cluster;	/* first free cluster */
+};
+
+static struct boot_file files[MAX_FILES];
+static int nfiles;
+static struct fat_layout fat;
+static char fat_label[11] = "BOOT       ";
+
+static const char *out_name;
+static int out_fd;
+static uint64_t image_size;
+static uint8_t *mapped;		/* one bit for each bmap block */
+static uint8_t *copy_buf;
+
+static void usage(const char *prg)
+{
+	fprintf(stderr,
+		"Usage: %s [-b <boot size>] [-s <image size>] [-n <label>]\n"
+		"       [-r <rootfs image>] [-m <bmap file>] <outfile> "
+		"[<name>=]<file> ...\n"
+		"Build an SD card image with a bootable FAT32 partition "
+		"holding the\n"
+		"files, and a Linux partition holding the rootfs image\n"
+		"\n"
+		"  <name>       name of the file in the FAT (default: its "
+		"basename);\n"
+		"               MLO is always put first\n"
+		"  -b <size>    size of the FAT32 partition (default 64M)\n"
+		"  -s <size>    image size; the Linux partition takes what "
+		"is left.\n"
+		"               Default: just enough for the rootfs image\n"
+		"  -n <label>   FAT volume label (default BOOT)\n"
+		"  -r <file>    ext2/3/4 image for the Linux partition\n"
+		"  -m <file>    write a bmap of the blocks that must be "
+		"written\n"
+		"\n"
+		"Blocks left out of the bmap are holes in the image, and "
+		"what the card\n"
+		"holds there does not matter.\n",
+		prg);
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return get_le16(p) | (uint32_t)get_le16(p + 2) << 16;
+}
+
+static void put_le16(uint8_t *p, uint16_t val)
+{
+	p[0] = val;
+	p[1] = val >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t val)
+{
+	put_le16(p, val);
+	put_le16(p + 2, val >> 16);
+}
+
+/* Note that the card must be written from offset to offset + len */
+static void map_range(uint64_t offset, uint64_t len)
+{
+	uint64_t block;
+
+	if (!len)
+		return;
+	for (block = offset / BMAP_BLOCK_SIZE;
+	     block <= (offset + len - 1) / BMAP_BLOCK_SIZE; block++)
+		mapped[block / 8] |= 1 << (block % 8);
+}
+
+static int is_mapped(uint64_t block)
+{
+	return mapped[block / 8] & (1 << (block % 8));
+}
+
+static int write_out(uint64_t offset, const void *buf, size_t len)
+{
+	if (pwrite(out_fd, buf, len, offset) != len) {
+		fprintf(stderr, "Can't write %s: %s\n", out_name,
+			strerror(errno));
+		return -1;
+	}
+	map_range(offset, len);
+
+	return 0;
+}
+
+/* Copy len bytes of a file into the image; past its end, it reads 0 */
+static int copy_range(int fd, const char *path, uint64_t from, uint64_t to,
+		      uint64_t len)
+{
+	ssize_t got;
+	size_t n;
+
+	while (len) {
+		n = len < COPY_CHUNK ? len : COPY_CHUNK;
+		got = pread(fd, copy_buf, n, from);
+		if (got < 0) {
+			fprintf(stderr, "Can't read %s: %s\n", path,
+				strerror(errno));
+			return -1;
+		}
+		memset(copy_buf + got, 0, n - got);
+		if (write_out(to, copy_buf, n))
+			return -1;
+		from += n;
+		to += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void put_chs(uint8_t *p, uint32_t lba)
+{
+	uint32_t c = lba / (255 * 63);
+	uint32_t h = lba / 63 % 255;
+	uint32_t s = lba % 63 + 1;
+
+	if (c > 1023) {
+		c = 1023;
+		h = 254;
+		s = 63;
+	}
+	p[0] = h;
+	p[1] = s | (c >> 2 & 0xc0);
+	p[2] = c;
+}
+
+static void put_part(uint8_t *entry, int boot, uint8_t type, uint64_t offset,
+		     uint64_t size)
+{
+	uint32_t start = offset / SECTOR_SIZE;
+	uint32_t sectors = size / SECTOR_SIZE;
+
+	entry[0] = boot ? 0x80 : 0;
+	put_chs(entry + 1, start);
+	entry[4] = type;
+	put_chs(entry + 5, start + sectors - 1);
+	put_le32(entry + 8, start);
+	put_le32(entry + 12, sectors);
+}
+
+/*
+ * The MBR, as fdisk writes it. Everything up to the first partition is
+ * mapped, so that the zeros there overwrite any MLO the ROM would
+ * otherwise find in raw mode at 128K, 256K or 384K.
+ */
+static int write_mbr(uint64_t boot_offset, uint64_t boot_size,
+		     uint64_t root_offset, uint64_t root_size)
+{
+	uint8_t mbr[SECTOR_SIZE];
+
+	memset(mbr, 0, sizeof(mbr));
+	put_le32(mbr + 440, time(NULL));
+	put_part(mbr + 446, 1, PART_TYPE_FAT32_LBA, boot_offset, boot_size);
+	if (root_size)
+		put_part(mbr + 462, 0, PART_TYPE_LINUX, root_offset,
+			 root_size);
+	mbr[510] = 0x55;
+	mbr[511] = 0xaa;
+
+	if (write_out(0, mbr, sizeof(mbr)))
+		return -1;
+	map_range(0, boot_offset);
+
+	return 0;
+}
+
+/* Add [<name>=]<file> to the FAT */
+static int add_file(const char *arg)
+{
+	struct boot_file *f = &files[nfiles];
+	const char *path, *p;
+	struct stat st;
+	int len;
+
+	if (nfiles == MAX_FILES) {
+		fprintf(stderr, "Too many files\n");
+		return -1;
+	}
+
+	path = strchr(arg, '=');
+	if (path) {
+		len = path - arg;
+		path++;
+	} else {
+		path = arg;
+		p = strrchr(arg, '/');
+		arg = p ? p + 1 : arg;
+		len = strlen(arg);
+	}
+	if (!len || len >= sizeof(f->name)) {
+		fprintf(stderr, "Bad file name in %s\n", arg);
+		return -1;
+	}
+	memcpy(f->name, arg, len);
+	f->name[len] = '\0';
+
+	for (p = f->name; *p; p++) {
+		if (*p < 0x20 || *p > 0x7e || strchr("\"*/:<>?\\|", *p)) {
+			fprintf(stderr, "Can't put %s in a FAT\n", f->name);
+			return -1;
+		}
+	}
+
+	errno = 0;
+	if (stat(path, &st) || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "Can't use %s: %s\n", path,
+			errno ? strerror(errno) : "not a file");
+		return -1;
+	}
+	f->path = path;
+	f->size = st.st_size;
+	f->mtime = st.st_mtime;
+	nfiles++;
+
+	return 0;
+}
+
+/* The ROM reads MLO from the FAT; keep it at the start of the data area */
+static void mlo_first(void)
+{
+	struct boot_file mlo;
+	int i;
+
+	for (i = 1; i < nfiles; i++) {
+		if (!strcasecmp(files[i].name, "MLO")) {
+			mlo = files[i];
+			memmove(&files[1], &files[0], i * sizeof(files[0]));
+			files[0] = mlo;
+			return;
+		}
+	}
+}
+
+static int short_name_char(int c)
+{
+	return isupper(c) || isdigit(c) ||
+		(c && c < 0x7f && strchr("!#$%&'()-@^_`{}~", c));
+}
+
+static int short_name_used(const uint8_t *name, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!memcmp(files[i].short_name, name, 11))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Use the name itself if it is a valid upper case 8.3 name. Otherwise
+ * give it a long name, and a short one made as Windows does: up to six
+ * characters of the name, ~n and up to three of the extension.
+ */
+static int make_short_name(int index)
+{
+	struct boot_file *f = &files[index];
+	const char *ext = strrchr(f->name, '.');
+	int base_len = ext ? ext - f->name : strlen(f->name);
+	int ext_len = ext ? strlen(ext + 1) : 0;
+	uint8_t *sn = f->short_name;
+	int valid = base_len && base_len <= 8 && ext_len <= 3;
+	int i, n, len;
+
+	for (i = 0; i < index; i++) {
+		if (!strcasecmp(files[i].name, f->name)) {
+			fprintf(stderr, "%s is in the FAT twice\n", f->name);
+			return -1;
+		}
+	}
+
+	memset(sn, ' ', 11);
+	for (i = 0; i < base_len; i++)
+		valid &= short_name_char(f->name[i]);
+	for (i = 0; i < ext_len; i++)
+		valid &= short_name_char(ext[1 + i]);
+	if (valid) {
+		memcpy(sn, f->name, base_len);
+		memcpy(sn + 8, ext + 1, ext_len);
+		f->lfn_entries = 0;
+		return 0;
+	}
+
+	for (i = 0, len = 0; i < ext_len && len < 3; i++) {
+		if (short_name_char(toupper(ext[1 + i])))
+			sn[8 + len++] = toupper(ext[1 + i]);
+	}
+	for (i = 0, len = 0; i < base_len && len < 6; i++) {
+		if (short_name_char(toupper(f->name[i])))
+			sn[len++] = toupper(f->name[i]);
+	}
+	if (!len)
+		sn[len++] = '_';
+	sn[len] = '~';
+	for (n = 1; n <= 9; n++) {
+		sn[len + 1] = '0' + n;
+		if (!short_name_used(sn, index))
+			break;
+	}
+	if (n > 9) {
+		fprintf(stderr, "Can't make a short name for %s\n", f->name);
+		return -1;
+	}
+	f->lfn_entries = DIV_ROUND_UP(strlen(f->name), LFN_CHARS);
+
+	return 0;
+}
+
+static uint8_t lfn_checksum(const uint8_t *short_name)
+{
+	uint8_t sum = 0;
+	int i;
+
+	for (i = 0; i < 11; i++)
+		sum = ((sum & 1) << 7) + (sum >> 1) + short_name[i];
+
+	return sum;
+}
+
+static void fat_time(time_t t, uint8_t *p)
+{
+	struct tm *tm = localtime(&t);
+
+	if (!tm || tm->tm_year < 80) {
+		put_le16(p, 0);
+		put_le16(p + 2, 1 << 5 | 1);
+		return;
+	}
+	put_le16(p, tm->tm_hour << 11 | tm->tm_min << 5 | tm->tm_sec / 2);
+	put_le16(p + 2, (tm->tm_year - 80) << 9 | (tm->tm_mon + 1) << 5 |
+		 tm->tm_mday);
+}
+
+static void put_dir_entry(uint8_t *p, const uint8_t *name, uint8_t attr,
+			  uint32_t cluster, uint32_t size, time_t t)
+{
+	memcpy(p, name, 11);
+	p[11] = attr;
+	fat_time(t, p + 14);			/* created */
+	memcpy(p + 18, p + 16, 2);		/* accessed */
+	put_le16(p + 20, cluster >> 16);
+	fat_time(t, p + 22);			/* written */
+	put_le16(p + 26, cluster);
+	put_le32(p + 28, size);
+}
+
+/* Long name entries come last part first, before the short entry */
+static void put_lfn_entries(uint8_t *p, const struct boot_file *f)
+{
+	static const uint8_t pos[LFN_CHARS] = {
+		1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30
+	};
+	uint8_t sum = lfn_checksum(f->short_name);
+	int len = strlen(f->name);
+	int i, j, c;
+
+	for (i = f->lfn_entries; i > 0; i--, p += DIR_ENTRY_SIZE) {
+		p[0] = i | (i == f->lfn_entries ? 0x40 : 0);
+		p[11] = ATTR_LFN;
+		p[13] = sum;
+		for (j = 0; j < LFN_CHARS; j++) {
+			c = (i - 1) * LFN_CHARS + j;
+			if (c < len)
+				c = f->name[c];
+			else
+				c = c == len ? 0 : 0xffff;
+			put_le16(p + pos[j], c);
+		}
+	}
+}
+
+static uint64_t cluster_offset(uint32_t cluster)
+{
+	return fat.offset + (uint64_t)(FAT_RESERVED_SECTORS +
+		FAT_NUM_FATS * fat.fat_sectors +
+		(cluster - FAT_ROOT_CLUSTER) * fat.cluster_sectors) *
+		SECTOR_SIZE;
+}
+
+/* Size the FAT as Microsoft's FAT specification does */
+static int fat_setup(uint64_t offset, uint64_t size)
+{
+	uint32_t sectors = size / SECTOR_SIZE;
+	uint32_t cluster_size, entries, i;
+	uint32_t div;
+
+	if (sectors <= 532480)
+		fat.cluster_sectors = 1;
+	else if (sectors <= 16777216)
+		fat.cluster_sectors = 8;
+	else if (sectors <= 33554432)
+		fat.cluster_sectors = 16;
+	else if (sectors <= 67108864)
+		fat.cluster_sectors = 32;
+	else
+		fat.cluster_sectors = 64;
+
+	div = (256 * fat.cluster_sectors + FAT_NUM_FATS) / 2;
+	fat.offset = offset;
+	fat.sectors = sectors;
+	fat.fat_sectors = DIV_ROUND_UP(sectors - FAT_RESERVED_SECTORS, div);
+	fat.clusters = (sectors - FAT_RESERVED_SECTORS -
+			FAT_NUM_FATS * fat.fat_sectors) / fat.cluster_sectors;
+	if (sectors <= FAT_RESERVED_SECTORS ||
+	    fat.clusters < FAT_MIN_CLUSTERS) {
+		fprintf(stderr, "Boot partition too small for FAT32\n");
+		return -1;
+	}
+
+	/* The volume label, then each file */
+	mlo_first();
+	entries = 1;
+	for (i = 0; i < nfiles; i++) {
+		if (make_short_name(i))
+			return -1;
+		entries += files[i].lfn_entries + 1;
+	}
+
+	/* Lay the root directory, then the files, out contiguously */
+	cluster_size = fat.cluster_sectors * SECTOR_SIZE;
+	fat.root_clusters = DIV_ROUND_UP(entries * DIR_ENTRY_SIZE,
+					 cluster_size);
+	fat.next_cluster = FAT_ROOT_CLUSTER + fat.root_clusters;
+	for (i = 0; i < nfiles; i++) {
+		if (!files[i].size)
+			continue;
+		files[i].cluster = fat.next_cluster;
+		fat.next_cluster += DIV_ROUND_UP(files[i].size, cluster_size);
+		if (fat.next_cluster - FAT_ROOT_CLUSTER > fat.clusters ||
+		    files[i].size > 0xffffffff) {
+			fprintf(stderr, "%s does not fit in the FAT\n",
+				files[i].name);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void put_boot_sector(uint8_t *p, uint32_t serial)
+{
+	p[0] = 0xeb;
+	p[1] = 0x58;
+	p[2] = 0x90;
+	memcpy(p + 3, "MSWIN4.1", 8);
+	put_le16(p + 11, SECTOR_SIZE);
+	p[13] = fat.cluster_sectors;
+	put_le16(p + 14, FAT_RESERVED_SECTORS);
+	p[16] = FAT_NUM_FATS;
+	p[21] = FAT_MEDIA;
+	put_le16(p + 24, 63);			/* sectors per track */
+	put_le16(p + 26, 255);			/* heads */
+	put_le32(p + 28, fat.offset / SECTOR_SIZE);
+	put_le32(p + 32, fat.sectors);
+	put_le32(p + 36, fat.fat_sectors);
+	put_le32(p + 44, FAT_ROOT_CLUSTER);
+	put_le16(p + 48, FAT_FSINFO_SECTOR);
+	put_le16(p + 50, FAT_BACKUP_SECTOR);
+	p[64] = 0x80;				/* drive number */
+	p[66] = 0x29;				/* extended boot signature */
+	put_le32(p + 67, serial);
+	memcpy(p + 71, fat_label, 11);
+	memcpy(p + 82, "FAT32   ", 8);
+	p[510] = 0x55;
+	p[511] = 0xaa;
+}
+
+static void put_fsinfo(uint8_t *p)
+{
+	put_le32(p, 0x41615252);
+	put_le32(p + 484, 0x61417272);
+	put_le32(p + 488, fat.clusters - (fat.next_cluster - FAT_ROOT_CLUSTER));
+	put_le32(p + 492, fat.next_cluster);
+	put_le32(p + 508, 0xaa550000);
+}
+
+static void chain(uint8_t *table, uint32_t first, uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		put_le32(table + (first + i) * 4,
+			 i == count - 1 ? FAT_EOC : first + i + 1);
+}
+
+/*
+ * Write the reserved sectors, both FATs, the root directory and the
+ * files. The free end of each FAT and of the root directory must read
+ * as zero, so is mapped even where it is a hole.
+ */
+static int write_fat(void)
+{
+	uint32_t cluster_size = fat.cluster_sectors * SECTOR_SIZE;
+	uint64_t fat_size = (uint64_t)fat.fat_sectors * SECTOR_SIZE;
+	uint32_t serial = time(NULL);
+	uint8_t *reserved, *table, *root, *p;
+	int ret = -1;
+	int i, fd;
+
+	reserved = calloc(FAT_RESERVED_SECTORS, SECTOR_SIZE);
+	table = calloc(fat.next_cluster, 4);
+	root = calloc(fat.root_clusters, cluster_size);
+	if (!reserved || !table || !root) {
+		fprintf(stderr, "Out of memory\n");
+		goto out;
+	}
+
+	put_boot_sector(reserved, serial);
+	put_fsinfo(reserved + FAT_FSINFO_SECTOR * SECTOR_SIZE);
+	memcpy(reserved + FAT_BACKUP_SECTOR * SECTOR_SIZE, reserved,
+	       2 * SECTOR_SIZE);
+	if (write_out(fat.offset, reserved, FAT_RESERVED_SECTORS * SECTOR_SIZE))
+		goto out;
+
+	put_le32(table, 0x0fffff00 | FAT_MEDIA);
+	put_le32(table + 4, FAT_EOC);
+	chain(table, FAT_ROOT_CLUSTER, fat.root_clusters);
+	for (i = 0; i < nfiles; i++) {
+		if (files[i].cluster)
+			chain(table, files[i].cluster,
+			      DIV_ROUND_UP(files[i].size, cluster_size));
+	}
+	for (i = 0; i < FAT_NUM_FATS; i++) {
+		uint64_t offset = fat.offset +
+			FAT_RESERVED_SECTORS * SECTOR_SIZE + i * fat_size;
+
+		if (write_out(offset, table, fat.next_cluster * 4))
+			goto out;
+		map_range(offset, fat_size);
+	}
+
+	p = root;
+	put_dir_entry(p, (uint8_t *)fat_label, ATTR_VOLUME_ID, 0, 0,
+		      serial);
+	p += DIR_ENTRY_SIZE;
+	for (i = 0; i < nfiles; i++) {
+		struct boot_file *f = &files[i];
+
+		put_lfn_entries(p, f);
+		p += f->lfn_entries * DIR_ENTRY_SIZE;
+		put_dir_entry(p, f->short_name, ATTR_ARCHIVE, f->cluster,
+			      f->size, f->mtime);
+		p += DIR_ENTRY_SIZE;
+	}
+	if (write_out(cluster_offset(FAT_ROOT_CLUSTER), root,
+		      fat.root_clusters * cluster_size))
+		goto out;
+
+	for (i = 0; i < nfiles; i++) {
+		struct boot_file *f = &files[i];
+
+		fd = open(f->path, O_RDONLY);
+		if (fd < 0) {
+			fprintf(stderr, "Can't open %s: %s\n", f->path,
+				strerror(errno));
+			goto out;
+		}
+		if (f->size &&
+		    copy_range(fd, f->path, 0, cluster_offset(f->cluster),
+			       f->size)) {
+			close(fd);
+			goto out;
+		}
+		close(fd);
+	}
+	ret = 0;
+
+out:
+	free(root);
+	free(table);
+	free(reserved);
+
+	return ret;
+}
+
+static uint64_t ext_blocks(const uint8_t *sb)
+{
+	uint64_t blocks = get_le32(sb + 4);
+
+	if (get_le32(sb + 96) & EXT4_FEATURE_INCOMPAT_64BIT)
+		blocks |= (uint64_t)get_le32(sb + 0x150) << 32;
+
+	return blocks;
+}
+
+/* Read the superblock of an ext2/3/4 image; return its size in bytes */
+static int64_t ext_size(const char *path, uint8_t *sb)
+{
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (pread(fd, sb, 1024, EXT2_SB_OFFSET) != 1024 ||
+	    get_le16(sb + 56) != EXT2_MAGIC || get_le32(sb + 24) > 6) {
+		fprintf(stderr, "%s is not an ext2/3/4 image\n", path);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	return ext_blocks(sb) << (10 + get_le32(sb + 24));
+}
+
+/*
+ * Copy the blocks of an ext2/3/4 image that its block bitmaps mark as
+ * used, which include the superblocks, descriptors, bitmaps and inode
+ * tables. Free blocks are left as holes. Groups whose bitmap was never
+ * initialised are copied whole.
+ */
+static int copy_ext(const char *path, const uint8_t *sb, uint64_t offset)
+{
+	uint32_t block_size = 1024 << get_le32(sb + 24);
+	uint32_t first = get_le32(sb + 20);
+	uint32_t per_group = get_le32(sb + 32);
+	uint64_t blocks = ext_blocks(sb);
+	int is64 = get_le32(sb + 96) & EXT4_FEATURE_INCOMPAT_64BIT;
+	uint32_t desc_size = is64 ? get_le16(sb + 254) : 32;
+	uint8_t *gdt = NULL, *bitmap = NULL, *desc;
+	uint64_t groups, g, start, count, b, run;
+	int ret = -1;
+	int fd;
+
+	if (!per_group || desc_size < 32) {
+		fprintf(stderr, "%s has a bad superblock\n", path);
+		return -1;
+	}
+	groups = DIV_ROUND_UP(blocks - first, per_group);
+
+	fd = open(path, O_RDONLY);
+	gdt = malloc(groups * desc_size);
+	bitmap = malloc(block_size);
+	if (fd < 0 || !gdt || !bitmap) {
+		fprintf(stderr, "Can't read %s\n", path);
+		goto out;
+	}
+	if (pread(fd, gdt, groups * desc_size,
+		  (uint64_t)(first + 1) * block_size) != groups * desc_size) {
+		fprintf(stderr, "Can't read the group descriptors of %s\n",
+			path);
+		goto out;
+	}
+
+	/* With 1k blocks, no group holds block 0 */
+	if (copy_range(fd, path, 0, offset, block_size))
+		goto out;
+
+	for (g = 0; g < groups; g++) {
+		desc = gdt + g * desc_size;
+		start = first + g * per_group;
+		count = blocks - start < per_group ? blocks - start : per_group;
+
+		if (get_le16(desc + 18) & EXT4_BG_BLOCK_UNINIT) {
+			if (copy_range(fd, path, start * block_size,
+				       offset + start * block_size,
+				       count * block_size))
+				goto out;
+			continue;
+		}
+
+		b = get_le32(desc);
+		if (is64 && desc_size >= 64)
+			b |= (uint64_t)get_le32(desc + 0x20) << 32;
+		if (pread(fd, bitmap, block_size, b * block_size) !=
+		    block_size) {
+			fprintf(stderr, "Can't read the bitmap of group %llu\n",
+				(unsigned long long)g);
+			goto out;
+		}
+
+		for (b = 0; b < count; b = run) {
+			if (!(bitmap[b / 8] & (1 << (b % 8)))) {
+				run = b + 1;
+				continue;
+			}
+			for (run = b + 1; run < count; run++) {
+				if (!(bitmap[run / 8] & (1 << (run % 8))))
+					break;
+			}
+			if (copy_range(fd, path, (start + b) * block_size,
+				       offset + (start + b) * block_size,
+				       (run - b) * block_size))
+				goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	if (fd >= 0)
+		close(fd);
+	free(bitmap);
+	free(gdt);
+
+	return ret;
+}
+
+static void hex(char *s, const uint8_t *digest)
+{
+	int i;
+
+	for (i = 0; i < SHA256_SUM_LEN; i++)
+		sprintf(s + 2 * i, "%02x", digest[i]);
+}
+
+static int hash_range(uint64_t offset, uint64_t len, char *s)
+{
+	uint8_t digest[SHA256_SUM_LEN];
+	sha256_context ctx;
+	ssize_t got;
+
+	sha256_starts(&ctx);
+	while (len) {
+		got = pread(out_fd, copy_buf, len < COPY_CHUNK ?
+			    len : COPY_CHUNK, offset);
+		if (got <= 0) {
+			fprintf(stderr, "Can't read %s: %s\n", out_name,
+				got ? strerror(errno) : "short file");
+			return -1;
+		}
+		sha256_update(&ctx, copy_buf, got);
+		offset += got;
+		len -= got;
+	}
+	sha256_finish(&ctx, digest);
+	hex(s, digest);
+
+	return 0;
+}
+
+/*
+ * Write a bmap, in the format of bmap-tools 2.0: the mapped block ranges,
+ * with the SHA256 of each, and the SHA256 of the bmap itself, computed
+ * with its own value set to zeros.
+ */
+static int write_bmap(const char *path)
+{
+	uint64_t blocks = DIV_ROUND_UP(image_size, BMAP_BLOCK_SIZE);
+	uint64_t count = 0, b, run, len;
+	uint8_t digest[SHA256_SUM_LEN];
+	char sum[2 * SHA256_SUM_LEN + 1];
+	long sum_pos, size;
+	char *text = NULL;
+	int ret = -1;
+	FILE *f;
+
+	for (b = 0; b < blocks; b++)
+		count += !!is_mapped(b);
+
+	f = fopen(path, "w+");
+	if (!f) {
+		fprintf(stderr, "Can't create %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	fprintf(f, "<?xml version=\"1.0\" ?>\n"
+		"<bmap version=\"2.0\">\n"
+		"    <ImageSize> %llu </ImageSize>\n"
+		"    <BlockSize> %u </BlockSize>\n"
+		"    <BlocksCount> %llu </BlocksCount>\n"
+		"    <MappedBlocksCount> %llu </MappedBlocksCount>\n"
+		"    <ChecksumType> sha256 </ChecksumType>\n"
+		"    <BmapFileChecksum> ",
+		(unsigned long long)image_size, BMAP_BLOCK_SIZE,
+		(unsigned long long)blocks, (unsigned long long)count);
+	sum_pos = ftell(f);
+	memset(sum, '0', sizeof(sum) - 1);
+	sum[sizeof(sum) - 1] = '\0';
+	fprintf(f, "%s </BmapFileChecksum>\n    <BlockMap>\n", sum);
+
+	for (b = 0; b < blocks; b = run) {
+		if (!is_mapped(b)) {
+			run = b + 1;
+			continue;
+		}
+		for (run = b + 1; run < blocks && is_mapped(run); run++)
+			;
+		len = (run - b) * BMAP_BLOCK_SIZE;
+		if (b * BMAP_BLOCK_SIZE + len > image_size)
+			len = image_size - b * BMAP_BLOCK_SIZE;
+		if (hash_range(b * BMAP_BLOCK_SIZE, len, sum))
+			goto out;
+		if (run - b == 1)
+			fprintf(f, "        <Range chksum=\"%s\"> %llu "
+				"</Range>\n", sum, (unsigned long long)b);
+		else
+			fprintf(f, "        <Range chksum=\"%s\"> %llu-%llu "
+				"</Range>\n", sum, (unsigned long long)b,
+				(unsigned long long)run - 1);
+	}
+	fprintf(f, "    </BlockMap>\n</bmap>\n");
+
+	size = ftell(f);
+	text = malloc(size);
+	if (!text || fseek(f, 0, SEEK_SET) || fread(text, size, 1, f) != 1)
+		goto out;
+	sha256_csum_wd((uint8_t *)text, size, digest, CHUNKSZ_SHA256);
+	hex(sum, digest);
+	if (fseek(f, sum_pos, SEEK_SET) ||
+	    fwrite(sum, 2 * SHA256_SUM_LEN, 1, f) != 1)
+		goto out;
+	ret = 0;
+
+out:
+	free(text);
+	if (fclose(f) || ret) {
+		fprintf(stderr, "Can't write %s\n", path);
+		unlink(path);
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *prg = basename(argv[0]);
+	const char *rootfs = NULL, *bmap = NULL;
+	uint64_t boot_size = 64 << 20;
+	uint64_t root_offset, root_size = 0;
+	uint8_t sb[1024];
+	int64_t fs_size;
+	int option;
+	int i;
+
+	while ((option = getopt(argc, argv, "b:s:n:r:m:h")) != -1) {
+		switch (option) {
+		case 'b':
+			boot_size = parse_size(optarg, NULL);
+			break;
+		case 's':
+			image_size = parse_size(optarg, NULL);
+			break;
+		case 'n':
+			if (strlen(optarg) > sizeof(fat_label)) {
+				fprintf(stderr, "Label %s is too long\n",
+					optarg);
+				return EXIT_FAILURE;
+			}
+			memset(fat_label, ' ', sizeof(fat_label));
+			for (i = 0; optarg[i]; i++)
+				fat_label[i] = toupper(optarg[i]);
+			break;
+		case 'r':
+			rootfs = optarg;
+			break;
+		case 'm':
+			bmap = optarg;
+			break;
+		case 'h':
+			usage(prg);
+			return EXIT_SUCCESS;
+		default:
+			usage(prg);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind < 1) {
+		usage(prg);
+		return EXIT_FAILURE;
+	}
+	out_name = argv[optind];
+
+	for (i = optind + 1; i < argc; i++) {
+		if (add_file(argv[i]))
+			return EXIT_FAILURE;
+	}
+
+	/* Partitions start on 1M, as fdisk puts them */
+	boot_size = boot_size / SECTOR_SIZE * SECTOR_SIZE;
+	root_offset = DIV_ROUND_UP(PART_ALIGN + boot_size, PART_ALIGN) *
+		PART_ALIGN;
+	if (rootfs) {
+		fs_size = ext_size(rootfs, sb);
+		if (fs_size < 0)
+			return EXIT_FAILURE;
+		if (!image_size)
+			image_size = root_offset +
+				DIV_ROUND_UP(fs_size, PART_ALIGN) * PART_ALIGN;
+		if (image_size < root_offset + fs_size) {
+			fprintf(stderr, "%s does not fit in the image\n",
+				rootfs);
+			return EXIT_FAILURE;
+		}
+		root_size = (image_size - root_offset) / SECTOR_SIZE *
+			SECTOR_SIZE;
+	} else if (!image_size) {
+		image_size = PART_ALIGN + boot_size;
+	}
+	if (image_size < PART_ALIGN + boot_size ||
+	    image_size / SECTOR_SIZE > 0xffffffff) {
+		fprintf(stderr, "Bad image size\n");
+		return EXIT_FAILURE;
+	}
+
+	if (fat_setup(PART_ALIGN, boot_size))
+		return EXIT_FAILURE;
+
+	mapped = calloc(DIV_ROUND_UP(image_size, 8 * BMAP_BLOCK_SIZE), 1);
+	copy_buf = malloc(COPY_CHUNK);
+	if (!mapped || !copy_buf) {
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	out_fd = open(out_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (out_fd < 0) {
+		fprintf(stderr, "Can't create %s: %s\n", out_name,
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if (ftruncate(out_fd, image_size) ||
+	    write_mbr(PART_ALIGN, boot_size, root_offset, root_size) ||
+	    write_fat() ||
+	    (rootfs && copy_ext(rootfs, sb, root_offset)) ||
+	    (bmap && write_bmap(bmap)) ||
+	    close(out_fd)) {
+		unlink(out_name);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
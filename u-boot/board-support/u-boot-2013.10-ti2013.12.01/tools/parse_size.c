@@ -0,0 +1,33 @@
+/*
+ * Size arguments of the image and flashing tools
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <stdlib.h>
+#include "parse_size.h"
+
+uint64_t parse_size(const char *s, char **endp)
+{
+	uint64_t size;
+	char *end;
+
+	size = strtoull(s, &end, 0);
+	switch (*end) {
+	case 'g':
+	case 'G':
+		size <<= 10;
+	case 'm':
+	case 'M':
+		size <<= 10;
+	case 'k':
+	case 'K':
+		size <<= 10;
+		end++;
+		break;
+	}
+	if (endp)
+		*endp = end;
+
+	return size;
+}
@@ -0,0 +1,18 @@
+/*
+ * Size arguments of the image and flashing tools
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _PARSE_SIZE_H
+#define _PARSE_SIZE_H
+
+#include <stdint.h>
+
+/*
+ * Parse a number with an optional k/m/g suffix, as in mtdparts. If @endp
+ * is not NULL it is set to the first character after the suffix.
+ */
+uint64_t parse_size(const char *s, char **endp);
+
+#endif /* _PARSE_SIZE_H */
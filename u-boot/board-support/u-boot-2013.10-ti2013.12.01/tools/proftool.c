@@ -85,6 +85,7 @@ static void usage(void)
 		"\n"
 		"Commands\n"
 		"   dump-ftrace\t\tDump out textual data in ftrace format\n"
+		"   dump-folded\t\tDump out folded stacks for flame graphs\n"
 		"\n"
 		"Options:\n"
 		"   -m <map>\tSpecify Systen.map file\n"
@@ -249,6 +250,10 @@ static int read_profile(FILE *fin, int *not_found)
 			if (read_calls(fin, hdr.rec_count))
 				return 1;
 			break;
+
+		case TRACE_CHUNK_END:
+			/* Data handed over to the OS: the rest is junk */
+			return 0;
 		}
 	}
 	return 0;
@@ -531,6 +536,155 @@ static int make_ftrace(void)
 	return 0;
 }
 
+/* Folded stacks seen so far, with their weights */
+struct folded_stack {
+	struct folded_stack *next;
+	unsigned long weight;
+	char name[];
+};
+
+#define FOLDED_HASH_SIZE	4096
+#define MAX_STACK_DEPTH		256
+
+static struct folded_stack *folded_hash[FOLDED_HASH_SIZE];
+static int folded_count;
+
+static void add_folded(const char *name, unsigned long weight)
+{
+	struct folded_stack *stack;
+	unsigned int hash = 0;
+	const char *p;
+
+	if (!weight)
+		return;
+	for (p = name; *p; p++)
+		hash = hash * 31 + *p;
+	hash %= FOLDED_HASH_SIZE;
+	for (stack = folded_hash[hash]; stack; stack = stack->next) {
+		if (!strcmp(stack->name, name)) {
+			stack->weight += weight;
+			return;
+		}
+	}
+
+	stack = malloc(sizeof(*stack) + strlen(name) + 1);
+	assert(stack);
+	strcpy(stack->name, name);
+	stack->weight = weight;
+	stack->next = folded_hash[hash];
+	folded_hash[hash] = stack;
+	folded_count++;
+}
+
+static int h_cmp_folded(const void *v1, const void *v2)
+{
+	const struct folded_stack *const *s1 = v1, *const *s2 = v2;
+
+	return strcmp((*s1)->name, (*s2)->name);
+}
+
+/* Build the folded name of the call stack, leaving out excluded functions */
+static void fold_stack(char *buf, int size, struct func_info **stack,
+		       int depth, struct func_info *leaf)
+{
+	int len = 0;
+	int i;
+
+	*buf = '\0';
+	for (i = 0; i <= depth && len < size; i++) {
+		struct func_info *func = i < depth ? stack[i] : leaf;
+
+		if (!func || !(func->flags & FUNCF_TRACE))
+			continue;
+		len += snprintf(buf + len, size - len, "%s%s", len ? ";" : "",
+				func->name);
+	}
+}
+
+/*
+ * Brendan Gregg's folded stack format, one line per distinct stack:
+ *
+ * board_init_r;run_main_loop;do_bootm;bootm_load_os 1234
+ *
+ * If the profile has PC samples, each counts 1 against the function it
+ * hit, under the call stack known from function entry/exit at that time
+ * (if any). Otherwise the weight is the time in microseconds spent in
+ * each function itself, worked out from the entry/exit timestamps.
+ */
+static int make_folded(void)
+{
+	struct func_info *stack[MAX_STACK_DEPTH];
+	struct folded_stack **list, *item;
+	struct trace_call *call;
+	char name[MAX_LINE_LEN * 4];
+	ulong last_time = 0;
+	int use_samples = 0;
+	int depth = 0;
+	int i, upto, top;
+
+	for (i = 0, call = call_list; i < call_count; i++, call++) {
+		if (TRACE_CALL_TYPE(call) == FUNCF_SAMPLE) {
+			use_samples = 1;
+			break;
+		}
+	}
+	notice("folded: weighting by %s\n",
+	       use_samples ? "PC samples" : "self time (us)");
+
+	for (i = 0, call = call_list; i < call_count; i++, call++) {
+		ulong time = call->flags & FUNCF_TIMESTAMP_MASK;
+		struct func_info *func;
+
+		/*
+		 * Charge time since the last record to the current stack,
+		 * or to its outermost MAX_STACK_DEPTH entries if it is deeper
+		 */
+		if (!use_samples && depth) {
+			top = MIN(depth, MAX_STACK_DEPTH) - 1;
+			fold_stack(name, sizeof(name), stack, top, stack[top]);
+			add_folded(name, (time - last_time) &
+				   FUNCF_TIMESTAMP_MASK);
+		}
+		last_time = time;
+
+		switch (TRACE_CALL_TYPE(call)) {
+		case FUNCF_ENTRY:
+			func = find_func_by_offset(call->func);
+			if (depth < MAX_STACK_DEPTH)
+				stack[depth] = func;
+			depth++;
+			break;
+		case FUNCF_EXIT:
+			/* A ring buffer may start part-way down the stack */
+			if (depth)
+				depth--;
+			break;
+		case FUNCF_SAMPLE:
+			func = find_caller_by_offset(call->func);
+			fold_stack(name, sizeof(name), stack,
+				   MIN(depth, MAX_STACK_DEPTH), func);
+			add_folded(name, 1);
+			break;
+		}
+	}
+
+	list = malloc(folded_count * sizeof(*list));
+	assert(list || !folded_count);
+	for (i = upto = 0; i < FOLDED_HASH_SIZE; i++) {
+		for (item = folded_hash[i]; item; item = item->next)
+			list[upto++] = item;
+	}
+	qsort(list, folded_count, sizeof(*list), h_cmp_folded);
+	for (i = 0; i < folded_count; i++) {
+		if (*list[i]->name)
+			printf("%s %lu\n", list[i]->name, list[i]->weight);
+	}
+	free(list);
+	info("folded: %d stacks\n", folded_count);
+
+	return 0;
+}
+
 static int prof_tool(int argc, char * const argv[],
 		     const char *prof_fname, const char *map_fname,
 		     const char *trace_config_fname)
@@ -551,6 +705,8 @@ static int prof_tool(int argc, char * const argv[],
 
 		if (0 == strcmp(cmd, "dump-ftrace"))
 			err = make_ftrace();
+		else if (0 == strcmp(cmd, "dump-folded"))
+			err = make_folded();
 		else
 			warn("Unknown command '%s'\n", cmd);
 	}
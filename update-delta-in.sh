@@ -0,0 +1,242 @@
+#!/bin/sh
+
+# ============================================================================
+# Update TXT System with a delta against the installed system
+# ============================================================================
+# (C) 2018 Michael Sögtrop - all rights reserved
+# ============================================================================
+
+# Usage
+# Copy update.sh and update-xxxx.sig to /tmp
+# Execute method 1
+#   su
+#   <enter root password>
+#   cd /tmp
+#   /tmp/update.sh  (attention, always give full path)
+#
+# Execute method 2
+#   sudo /usr/sbin/exec_signed.sh update.sh update_xxxx-sig
+#
+# Unlike update.sh, which replaces the whole root file system from a RAM
+# system, this script only carries what changed since the firmware it was
+# made for (see Make-TXT-UpdateScripts.sh) and applies it in place. It checks
+# the whole delta against the installed files before changing anything.
+
+set -e
+set -x
+
+# ========== Get absolute script name and path ==========
+
+# Absolute symlink free path of this script
+SCRIPTPATH="$(readlink -f "$0")"
+
+# Absolute symlink free folder of this script
+SCRIPTFLDR="$(dirname "$SCRIPTPATH")"
+
+# ATTENTION: this script expects that it is stored somewhere below /tmp
+
+# ========== Check if this is the first or I/O redirected start of the script ==========
+
+if [ $# = 0 ]
+then
+
+  # ========== Refuse A/B slots ==========
+
+  # This script writes the running root file system and the single slot
+  # kernel and DT partitions, which an A/B TXT does not boot from
+  SLOT=$(fw_printenv -n boot_slot 2>/dev/null || true)
+  if [ -n "$SLOT" ]
+  then
+    echo "This TXT boots from A/B slot $SLOT, which update-delta.sh would overwrite." 1>&2
+    echo "Install the new system into the other slot with /usr/sbin/ab_install." 1>&2
+    exit 1
+  fi
+
+  # ========== extract ShowProgress and applydelta ==========
+
+  # Note: the version of ShowProgress compiled for the old system also works for the new system - no need to distinguish
+
+  payloadtoolsbeg_match=$(grep -n -m 1 '^PAYLOADTOOLSBEG:$' "$SCRIPTPATH" | cut -d ':' -f 1)
+  payloadtoolsend_match=$(grep -n -m 1 '^PAYLOADTOOLSEND:$' "$SCRIPTPATH" | cut -d ':' -f 1)
+  payloadtools_start=$((payloadtoolsbeg_match + 1))
+  payloadtools_length=$((payloadtoolsend_match - payloadtoolsbeg_match - 1))
+  tail -n +$payloadtools_start "$SCRIPTPATH" | head -n $payloadtools_length | openssl enc -base64 -d | gzip -d - >> "$SCRIPTFLDR"/ShowProgressOld || { echo "tar failed" 1>&2; sleep 300; exit 1; }
+  chmod u+x "$SCRIPTFLDR"/ShowProgressOld
+
+  payloadapplybeg_match=$(grep -n -m 1 '^PAYLOADAPPLYBEG:$' "$SCRIPTPATH" | cut -d ':' -f 1)
+  payloadapplyend_match=$(grep -n -m 1 '^PAYLOADAPPLYEND:$' "$SCRIPTPATH" | cut -d ':' -f 1)
+  payloadapply_start=$((payloadapplybeg_match + 1))
+  payloadapply_length=$((payloadapplyend_match - payloadapplybeg_match - 1))
+  tail -n +$payloadapply_start "$SCRIPTPATH" | head -n $payloadapply_length | openssl enc -base64 -d | gzip -d - > "$SCRIPTFLDR"/applydelta || { echo "tar failed" 1>&2; sleep 300; exit 1; }
+  chmod u+x "$SCRIPTFLDR"/applydelta
+
+  # ========== In case this is executed by exec_signed move everything to new folder ==========
+
+  # exec_signed deletes the executable as soon as the scrip terminates, but we still need the file
+
+  if [ "$(basename "$SCRIPTPATH")" = "executable" ]
+  then
+    # Set umask to exclusive root access
+    umask 077
+    # Create a new folder with unique name in /tmp
+    # Cause of umask setting, it will have access rights 700
+    EXECFLDR=$( mktemp -d -p /tmp )
+    # move files
+    mv "$SCRIPTFLDR"/executable "$EXECFLDR"/executable
+    mv "$SCRIPTFLDR"/signature "$EXECFLDR"/signature
+    mv "$SCRIPTFLDR"/ShowProgressOld "$EXECFLDR"/ShowProgressOld
+    mv "$SCRIPTFLDR"/applydelta "$EXECFLDR"/applydelta
+    # create dummy files (exec_signed wants to delete them)
+    touch "$SCRIPTFLDR"/executable
+    touch "$SCRIPTFLDR"/signature
+    SCRIPTFLDR="$EXECFLDR"
+    SCRIPTPATH="$EXECFLDR"/executable
+  fi
+
+  # ========== Restart this script with I/O redirected to ShowProgress ==========
+
+  # screen -m -d -S <name> starts a detached deamon session with name <name>
+  
+  screen -m -d -S update /bin/sh -c '/bin/sh '"$SCRIPTPATH"' restart 2>&1 | '"$SCRIPTFLDR"/ShowProgressOld
+
+  # ========== Terminate shell which sharted this script ==========
+  
+  exit 0
+
+fi
+
+# ========== I/O redirected branch of the script ==========
+
+set -x
+
+# Set number of steps in ShowProgress
+# Note: all lines starting with !! are control lines for ShowProgress
+echo "!!C8"
+
+# ========== Wait for shell disconnect before killing ssh ==========
+
+# Set current step info in ShowProgress
+echo "!!S1"
+echo "!!TWait for disconnect"
+
+sleep 2
+
+# ========== Stop ROBOPro app ==========
+echo "!!S2"
+echo "!!TStop ROBOPro App"
+
+killall -9 run.sh || true
+
+# ========== Stop services ==========
+
+# Set current step info in ShowProgress
+echo "!!S3"
+echo "!!TStop services"
+
+/etc/init.d/bt_ap stop || true
+/etc/init.d/wlan_ap stop || true
+/etc/init.d/S99_dhcpd stop || true
+/etc/init.d/S98usb_g_ether stop || true
+/etc/init.d/S98_bt_nap stop || true
+/etc/init.d/S80dhcp-server stop || true
+/etc/init.d/S80dhcp-relay stop || true
+/etc/init.d/S60openvpn stop || true
+/etc/init.d/S50sshd stop || true
+/etc/init.d/S40network stop || true
+/etc/init.d/S30dbus stop || true
+/etc/init.d/S26gdk-pixbuf stop || true
+/etc/init.d/S25pango stop || true
+/etc/init.d/S21rngd stop || true
+/etc/init.d/S20urandom stop || true
+/etc/init.d/S10udev stop || true
+/etc/init.d/S03uim-sysfs.sh stop || true
+/etc/init.d/M99_vncserver stop || true
+/etc/init.d/M01logging stop || true
+
+# ========== Check delta ==========
+
+echo "!!S4"
+echo "!!TCheck update"
+
+payloaddelta_match=$(grep -n -m 1 '^PAYLOADDELTA:$' "$SCRIPTPATH" | cut -d ':' -f 1)
+payloaddelta_start=$((payloaddelta_match + 1))
+
+# Only reads the installed files, so a delta made for another firmware
+# version stops here with the system untouched
+tail -n +$payloaddelta_start "$SCRIPTPATH" | xzcat | "$SCRIPTFLDR"/applydelta -n / || { echo "Update does not fit the installed firmware" 1>&2 ; sleep 300; exit 1; }
+
+# ========== Install delta ==========
+
+echo "!!S5"
+echo "!!TInstall update"
+
+# applydelta builds all changed files first and only then moves them into
+# place. If this is interrupted, running the update again finishes it.
+tail -n +$payloaddelta_start "$SCRIPTPATH" | xzcat | "$SCRIPTFLDR"/applydelta / || { echo "applydelta failed" 1>&2 ; sleep 300; exit 1; }
+
+# sync here in case the power controller does something strange during the FW update
+sync
+
+# ========== Flash boot, kernel, ... ==========
+
+echo "!!S6"
+echo "!!TFlash boot loader"
+
+# The delta only carries the images that changed
+
+if [ -f /lib/boot/uImage ]
+then
+  flash_erase /dev/mtd8 0 0
+  nandwrite -p /dev/mtd8 /lib/boot/uImage
+  rm /lib/boot/uImage
+fi
+
+if [ -f /lib/boot/am335x-kno_txt.dtb ]
+then
+  flash_erase /dev/mtd4 0 0
+  nandwrite -p /dev/mtd4 /lib/boot/am335x-kno_txt.dtb
+  rm /lib/boot/am335x-kno_txt.dtb
+fi
+
+if [ -f /lib/boot/MLO ]
+then
+  flash_erase /dev/mtd0 0 0
+  nandwrite -p /dev/mtd0 /lib/boot/MLO
+  rm /lib/boot/MLO
+fi
+
+if [ -f /lib/boot/u-boot.img ]
+then
+  flash_erase /dev/mtd5 0 0
+  nandwrite -p /dev/mtd5 /lib/boot/u-boot.img
+  rm /lib/boot/u-boot.img
+fi
+
+rm -f /lib/boot/UpdateBootloader.sh
+
+# ========== Update IO firmware ==========
+
+echo "!!S7"
+echo "!!TUpdate IO firmware"
+
+if [ -f /sbin/FwUpdTxt ]
+then
+  /sbin/FwUpdTxt || { echo "Firmware update failed" 1>&2 ; sleep 300; exit 2; }
+  rm /sbin/FwUpdTxt
+
+  # The firmware update is really nasty - it terminate before it is finished
+  # Poweroff after 10s delays fails
+  sleep 15
+fi
+
+# ========== Shutdown ==========
+
+echo "!!S8"
+echo "!!TShutdown"
+
+sync
+sync
+sleep 1
+echo 1 > /sys/class/leds/off-uc/brightness
+
+# ========== End of script ==========
@@ -35,7 +35,19 @@ SCRIPTFLDR="$(dirname "$SCRIPTPATH")"
 if [ $# = 0 ]
 then
 
-  # ========== extract ShowProgress ==========
+  # ========== Refuse A/B slots ==========
+
+  # This script writes the running root file system and the single slot
+  # kernel and DT partitions, which an A/B TXT does not boot from
+  SLOT=$(fw_printenv -n boot_slot 2>/dev/null || true)
+  if [ -n "$SLOT" ]
+  then
+    echo "This TXT boots from A/B slot $SLOT, which update.sh would overwrite." 1>&2
+    echo "Install the new system into the other slot with /usr/sbin/ab_install." 1>&2
+    exit 1
+  fi
+
+  # ========== extract ShowProgress and miniroot ==========
 
   # Note: the version of ShowProgress compiled for the old system also works for the new system - no need to distinguish
 
@@ -46,6 +58,13 @@ then
   tail -n +$payloadtools_start "$SCRIPTPATH" | head -n $payloadtools_length | openssl enc -base64 -d | gzip -d - >> "$SCRIPTFLDR"/ShowProgressOld || { echo "tar failed" 1>&2; sleep 300; exit 1; }
   chmod u+x "$SCRIPTFLDR"/ShowProgressOld
 
+  payloadminirootbeg_match=$(grep -n -m 1 '^PAYLOADMINIROOTBEG:$' "$SCRIPTPATH" | cut -d ':' -f 1)
+  payloadminirootend_match=$(grep -n -m 1 '^PAYLOADMINIROOTEND:$' "$SCRIPTPATH" | cut -d ':' -f 1)
+  payloadminiroot_start=$((payloadminirootbeg_match + 1))
+  payloadminiroot_length=$((payloadminirootend_match - payloadminirootbeg_match - 1))
+  tail -n +$payloadminiroot_start "$SCRIPTPATH" | head -n $payloadminiroot_length | openssl enc -base64 -d | gzip -d - > "$SCRIPTFLDR"/miniroot || { echo "tar failed" 1>&2; sleep 300; exit 1; }
+  chmod u+x "$SCRIPTFLDR"/miniroot
+
   # ========== In case this is executed by exec_signed move everything to new folder ==========
 
   # exec_signed deletes the executable as soon as the scrip terminates, but we still need the file
@@ -61,6 +80,7 @@ then
     mv "$SCRIPTFLDR"/executable "$EXECFLDR"/executable
     mv "$SCRIPTFLDR"/signature "$EXECFLDR"/signature
     mv "$SCRIPTFLDR"/ShowProgressOld "$EXECFLDR"/ShowProgressOld
+    mv "$SCRIPTFLDR"/miniroot "$EXECFLDR"/miniroot
     # create dummy files (exec_signed wants to delete them)
     touch "$SCRIPTFLDR"/executable
     touch "$SCRIPTFLDR"/signature
@@ -178,67 +198,50 @@ mkdir /tmp/tmproot/oldroot
 mkdir /tmp/tmproot/proc
 mkdir /tmp/tmproot/sys
 
-# cp -a of /dev doesn't copy file contents but special files
-cp -a /dev /tmp/tmproot/dev
-
-# cp -dp or cp -a doesn't work because these redirect the symlinks to the destination folder, but we need them relative to root
-find /bin -type f -exec sh -c 'echo FILE {}; mkdir -p /tmp/tmproot/$(dirname {}) ; cp -p {} /tmp/tmproot{}' \;
-find /bin -type l -exec sh -c 'echo LINK {}; mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{}' \;
+# Copy what the update needs in one process, see tools/miniroot in u-boot.
+# Symlinks are recreated pointing to where they resolve, because the
+# originals may lead to something that is not copied.
+"$SCRIPTFLDR"/miniroot - /tmp/tmproot <<'EOF'
+# /dev including its special files
+tree /dev
 
-find /sbin -type f -exec sh -c 'echo FILE {}; mkdir -p /tmp/tmproot/$(dirname {}) ; cp -p {} /tmp/tmproot{}' \;
-find /sbin -type l -exec sh -c 'echo LINK {}; mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{}' \;
+tree /bin
+tree /sbin
 
 # In /etc we exclude a few large folders
-ETCEX="-path /etc/joe -prune -o -path /etc/udev -prune -o -path /etc/keymaps -prune -o -path /etc/rc_keymaps -prune -o -path /etc/udev -prune -o"
-find /etc $ETCEX -type f -exec sh -c 'echo FILE {}; mkdir -p /tmp/tmproot/$(dirname {}) ; cp -p {} /tmp/tmproot{}' \;
-find /etc $ETCEX -type l -exec sh -c 'echo LINK {}; mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{}' \;
+tree /etc !/etc/joe !/etc/udev !/etc/keymaps !/etc/rc_keymaps
 
 # In /lib only direct children are important
-find /lib -type f -maxdepth 1 -exec sh -c 'echo FILE {}; mkdir -p /tmp/tmproot/$(dirname {}) ; cp -p {} /tmp/tmproot{}' \;
-find /lib -type l -maxdepth 1 -exec sh -c 'echo LINK {}; mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{}' \;
+flat /lib
 
 # In /usr/bin and /usr/sbin we copy only links to /bin/busybox
-find /usr/bin -type l -exec sh -c 'echo LINK {}; if [ "$(readlink -f {})"=="/bin/busybox" ] ; then mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{} ; fi' \;
-find /usr/sbin -type l -exec sh -c 'echo LINK {}; if [ "$(readlink -f {})"=="/bin/busybox" ] ; then mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{} ; fi' \;
+links /usr/bin /bin/busybox
+links /usr/sbin /bin/busybox
 
 # In /var we exclude a few large folders
-VAREX="-path /var/psg -prune -o -path /var/www -prune -o"
-find /var $VAREX -type f -exec sh -c 'echo FILE {}; mkdir -p /tmp/tmproot/$(dirname {}) ; cp -p {} /tmp/tmproot{}' \;
-find /var $VAREX -type l -exec sh -c 'echo LINK {}; mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{}' \;
+tree /var !/var/psg !/var/www
 # This special folder is required by sshd with exactly these rights
-mkdir -m 755 /tmp/tmproot/var/empty 
+dir /var/empty 755
 
 # /usr/sbin additional required files
-cp -p /usr/sbin/ubi* /tmp/tmproot/usr/sbin
-cp -p /usr/sbin/flash_erase /tmp/tmproot/usr/sbin
-cp -p /usr/sbin/nandwrite /tmp/tmproot/usr/sbin
+copy /usr/sbin/ubi* /usr/sbin/flash_erase /usr/sbin/nandwrite
 
 # /usr/lib additional required files
-mkdir -p /tmp/tmproot/usr/lib
-ln -s /usr/lib /tmp/tmproot/usr/lib/arm-linux-gnueabihf
+symlink /usr/lib/arm-linux-gnueabihf /usr/lib
 # libz is required to untar zipped new system
-cp -p /usr/lib/libz.so.1.2.8 /tmp/tmproot/usr/lib/          || cp -p /usr/lib/libz.so.1.2.11 /tmp/tmproot/usr/lib/
-ln -s /usr/lib/libz.so.1.2.8 /tmp/tmproot/usr/lib/libz.so.1 || ln -s /usr/lib/libz.so.1.2.11 /tmp/tmproot/usr/lib/libz.so.1
-ln -s /usr/lib/libz.so.1.2.8 /tmp/tmproot/usr/lib/libz.so   || ln -s /usr/lib/libz.so.1.2.11 /tmp/tmproot/usr/lib/libz.so
+copy /usr/lib/libz.so*
 # libstdc++ is required for firmware update
 # in new system libstdc++.so.6 in in /lib and copied by default
-cp -p /usr/lib/libstdc++.so.6.0.20 /tmp/tmproot/usr/lib/               || ls /lib/libstdc++.so.6
-ln -s /usr/lib/libstdc++.so.6.0.20 /tmp/tmproot/usr/lib/libstdc++.so.6 || ls /lib/libstdc++.so.6
+copy /usr/lib/libstdc++.so.6*
 
 # /usr/share additional required files
-mkdir -p /tmp/tmproot/usr/share/txt-utils
-cp -p /usr/share/txt-utils/power-off /tmp/tmproot/usr/share/txt-utils/
+copy /usr/share/txt-utils/power-off
 
 # some empty directories
-mkdir /tmp/tmproot/tmp
-chmod 1777 /tmp/tmproot/tmp
-
-mkdir -p /tmp/tmproot/opt/knobloch
-chown ROBOPro:ROBOPro /tmp/tmproot/opt/knobloch
-chmod 775 /tmp/tmproot/opt/knobloch
-
-mkdir /tmp/tmproot/root
-chmod 700 /tmp/tmproot/root
+dir /tmp 1777
+dir /opt/knobloch 775 ROBOPro:ROBOPro
+dir /root 700
+EOF
 
 # config for sudo debugging
 # echo "Debug sudo /var/log/sudo_debug all@debug" > /tmp/tmproot/etc/sudo.conf
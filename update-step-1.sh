@@ -10,6 +10,21 @@
 set -e
 set -x
 
+# ========== extract miniroot ==========
+
+# Make-TXT-UpdateScripts.sh appends miniroot to this script as a payload,
+# as for update.sh, so that it does not depend on the installed firmware
+
+SCRIPTPATH="$(readlink -f "$0")"
+SCRIPTFLDR="$(dirname "$SCRIPTPATH")"
+
+payloadminirootbeg_match=$(grep -n -m 1 '^PAYLOADMINIROOTBEG:$' "$SCRIPTPATH" | cut -d ':' -f 1)
+payloadminirootend_match=$(grep -n -m 1 '^PAYLOADMINIROOTEND:$' "$SCRIPTPATH" | cut -d ':' -f 1)
+payloadminiroot_start=$((payloadminirootbeg_match + 1))
+payloadminiroot_length=$((payloadminirootend_match - payloadminirootbeg_match - 1))
+tail -n +$payloadminiroot_start "$SCRIPTPATH" | head -n $payloadminiroot_length | openssl enc -base64 -d | gzip -d - > "$SCRIPTFLDR"/miniroot
+chmod u+x "$SCRIPTFLDR"/miniroot
+
 # ========== kill all non required processes ==========
 
 # First stop some init.d processes
@@ -87,79 +102,55 @@ mkdir /tmp/tmproot/oldroot
 mkdir /tmp/tmproot/proc
 mkdir /tmp/tmproot/sys
 
-# cp -a of /dev doesn't copy file contents but special files
-cp -a /dev /tmp/tmproot/dev
+# Copy what is needed in one process with miniroot from tools/miniroot in
+# u-boot, extracted above. Symlinks are recreated pointing to where they
+# resolve, because the originals may lead to something that is not copied.
+"$SCRIPTFLDR"/miniroot - /tmp/tmproot <<'EOF'
+# /dev including its special files
+tree /dev
 
-# cp -dp or cp -a because these redirect tje symlinks to the destination folder, but we need them relative to root
-find /bin -type f -exec sh -c 'echo FILE {}; mkdir -p /tmp/tmproot/$(dirname {}) ; cp -p {} /tmp/tmproot{}' \;
-find /bin -type l -exec sh -c 'echo LINK {}; mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{}' \;
-
-find /sbin -type f -exec sh -c 'echo FILE {}; mkdir -p /tmp/tmproot/$(dirname {}) ; cp -p {} /tmp/tmproot{}' \;
-find /sbin -type l -exec sh -c 'echo LINK {}; mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{}' \;
+tree /bin
+tree /sbin
 
 # In /etc we exclude a few large folders
-ETCEX="-path /etc/joe -prune -o -path /etc/udev -prune -o -path /etc/keymaps -prune -o -path /etc/rc_keymaps -prune -o -path /etc/udev -prune -o"
-find /etc $ETCEX -type f -exec sh -c 'echo FILE {}; mkdir -p /tmp/tmproot/$(dirname {}) ; cp -p {} /tmp/tmproot{}' \;
-find /etc $ETCEX -type l -exec sh -c 'echo LINK {}; mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{}' \;
+tree /etc !/etc/joe !/etc/udev !/etc/keymaps !/etc/rc_keymaps
 
 # In /lib only direct children are important
-find /lib -type f -maxdepth 1 -exec sh -c 'echo FILE {}; mkdir -p /tmp/tmproot/$(dirname {}) ; cp -p {} /tmp/tmproot{}' \;
-find /lib -type l -maxdepth 1 -exec sh -c 'echo LINK {}; mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{}' \;
+flat /lib
 
 # In /usr/bin and /usr/sbin we copy only links to /bin/busybox
-find /usr/bin -type l -exec sh -c 'echo LINK {}; if [ "$(readlink -f {})"=="/bin/busybox" ] ; then mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{} ; fi' \;
-
-find /usr/sbin -type l -exec sh -c 'echo LINK {}; if [ "$(readlink -f {})"=="/bin/busybox" ] ; then mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{} ; fi' \;
+links /usr/bin /bin/busybox
+links /usr/sbin /bin/busybox
 
 # In /var we exclude a few large folders
-VAREX="-path /var/psg -prune -o -path /var/www -prune -o"
-find /var $VAREX -type f -exec sh -c 'echo FILE {}; mkdir -p /tmp/tmproot/$(dirname {}) ; cp -p {} /tmp/tmproot{}' \;
-find /var $VAREX -type l -exec sh -c 'echo LINK {}; mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{}' \;
+tree /var !/var/psg !/var/www
 # This special folder is required by sshd with exactly these rights
-mkdir -m 755 /tmp/tmproot/var/empty 
+dir /var/empty 755
 
 # /usr/libexec contains just a few files, sudo, and sftp server
-find /usr/libexec -type f -exec sh -c 'echo FILE {}; mkdir -p /tmp/tmproot/$(dirname {}) ; cp -p {} /tmp/tmproot{}' \;
-find /usr/libexec -type l -exec sh -c 'echo LINK {}; mkdir -p /tmp/tmproot/$(dirname {}) ; ln -s $(readlink -f {}) /tmp/tmproot{}' \;
+tree /usr/libexec
 
 # /usr/sbin additional required files
-cp -p /usr/sbin/sshd /tmp/tmproot/usr/sbin
-cp -p /usr/sbin/dhcpd /tmp/tmproot/usr/sbin
-cp -p /usr/sbin/ubi* /tmp/tmproot/usr/sbin
-cp -p /usr/sbin/flash_erase /tmp/tmproot/usr/sbin
-cp -p /usr/sbin/nandwrite /tmp/tmproot/usr/sbin
+copy /usr/sbin/sshd /usr/sbin/dhcpd
+copy /usr/sbin/ubi* /usr/sbin/flash_erase /usr/sbin/nandwrite
 
 # /usr/bin additional required files
-cp -p /usr/bin/ssh-keygen /tmp/tmproot/usr/bin
-cp -p /usr/bin/scp /tmp/tmproot/usr/bin
-cp -p /usr/bin/sudo /tmp/tmproot/usr/bin
-cp -p /usr/bin/openssl /tmp/tmproot/usr/bin
+copy /usr/bin/ssh-keygen /usr/bin/scp /usr/bin/sudo /usr/bin/openssl
 
 # /usr/lib additional required files
-mkdir -p /tmp/tmproot/usr/lib
-ln -s /usr/lib /tmp/tmproot/usr/lib/arm-linux-gnueabihf
-cp -p /usr/lib/libcrypto.so.1.0.0 /tmp/tmproot/usr/lib/
-ln -s /usr/lib/libcrypto.so.1.0.0 /tmp/tmproot/usr/lib/libcrypto.so
-cp -p /usr/lib/libz.so.1.2.8 /tmp/tmproot/usr/lib/
-ln -s /usr/lib/libz.so.1.2.8 /tmp/tmproot/usr/lib/libz.so.1
-ln -s /usr/lib/libz.so.1.2.8 /tmp/tmproot/usr/lib/libz.so
-cp -p /usr/lib/libstdc++.so.6.0.20 /tmp/tmproot/usr/lib/
-ln -s /usr/lib/libstdc++.so.6.0.20 /tmp/tmproot/usr/lib/libstdc++.so.6
+symlink /usr/lib/arm-linux-gnueabihf /usr/lib
+copy /usr/lib/libcrypto.so*
+copy /usr/lib/libz.so*
+copy /usr/lib/libstdc++.so.6*
 
 # /usr/share additional required files
-mkdir -p /tmp/tmproot/usr/share/txt-utils
-cp -p /usr/share/txt-utils/power-off /tmp/tmproot/usr/share/txt-utils/
+copy /usr/share/txt-utils/power-off
 
 # some empty directories
-mkdir /tmp/tmproot/tmp
-chmod 1777 /tmp/tmproot/tmp
-
-mkdir -p /tmp/tmproot/opt/knobloch
-chown ROBOPro:ROBOPro /tmp/tmproot/opt/knobloch
-chmod 775 /tmp/tmproot/opt/knobloch
-
-mkdir /tmp/tmproot/root
-chmod 700 /tmp/tmproot/root
+dir /tmp 1777
+dir /opt/knobloch 775 ROBOPro:ROBOPro
+dir /root 700
+EOF
 
 # config for sudo debugging
 # echo "Debug sudo /var/log/sudo_debug all@debug" > /tmp/tmproot/etc/sudo.conf